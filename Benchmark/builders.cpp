@@ -0,0 +1,349 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "builders.h"
+#include "flat_bvh.h"
+
+#include "radeon_rays.h"
+#include "calc.h"
+#include "device.h"
+#include "RadeonRays/src/accelerator/bvh.h"
+#include "RadeonRays/src/accelerator/split_bvh.h"
+#include "RadeonRays/src/accelerator/hlbvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+namespace Benchmark
+{
+    // GPU intersector defaults
+    static float const kTraversalCost = 10.f;
+    static int const kNumBins = 64;
+
+    typedef std::chrono::high_resolution_clock Clock;
+
+    static double GetMilliseconds(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // Runs func repeat times and records best and mean duration
+    static void Time(int repeat, std::function<void()> const& func, double& best_ms, double& mean_ms)
+    {
+        best_ms = 0.0;
+        mean_ms = 0.0;
+
+        for (int i = 0; i < repeat; ++i)
+        {
+            auto start = Clock::now();
+            func();
+            double ms = GetMilliseconds(start);
+            best_ms = i == 0 ? ms : std::min(best_ms, ms);
+            mean_ms += ms / repeat;
+        }
+    }
+
+    // Exposes the node tree of Bvh based builders
+    template <typename Base> class FlattenedBvh : public Base
+    {
+    public:
+        template <typename... Args> FlattenedBvh(Args... args) : Base(args...) {}
+
+        void Flatten(FlatBvh& bvh) const
+        {
+            bvh.nodes.clear();
+            bvh.indices.assign(this->m_packed_indices.begin(), this->m_packed_indices.end());
+
+            if (this->m_root)
+            {
+                Flatten(this->m_root, bvh);
+            }
+        }
+
+        std::size_t GetSizeInBytes() const
+        {
+            return this->m_nodecnt.load() * sizeof(typename Base::Node) + this->m_packed_indices.size() * sizeof(int);
+        }
+
+    private:
+        int Flatten(typename Base::Node const* node, FlatBvh& bvh) const
+        {
+            int idx = static_cast<int>(bvh.nodes.size());
+            bvh.nodes.push_back(FlatBvh::Node());
+            bvh.nodes[idx].bounds = node->bounds;
+
+            if (node->type == Base::kLeaf)
+            {
+                bvh.nodes[idx].first = node->startidx;
+                bvh.nodes[idx].count = node->numprims;
+            }
+            else
+            {
+                int left = Flatten(node->lc, bvh);
+                int right = Flatten(node->rc, bvh);
+                bvh.nodes[idx].left = left;
+                bvh.nodes[idx].right = right;
+                bvh.nodes[idx].count = 0;
+            }
+
+            return idx;
+        }
+    };
+
+    template <typename Base, typename... Args>
+    static void RunBvhBuilder(Scene const& scene, Result& result, FlatBvh& flat, int repeat, Args... args)
+    {
+        std::vector<bbox> bounds;
+        scene.GetFaceBounds(bounds);
+
+        std::unique_ptr<FlattenedBvh<Base>> bvh;
+        Time(repeat, [&]()
+        {
+            bvh.reset(new FlattenedBvh<Base>(args...));
+            bvh->Build(&bounds[0], static_cast<int>(bounds.size()));
+        }, result.build_ms, result.build_ms_mean);
+
+        bvh->Flatten(flat);
+        result.memory_bytes = static_cast<long long>(bvh->GetSizeInBytes());
+    }
+
+    // Hlbvh running its build kernels on the host Calc device
+    static void RunHlbvhBuilder(Scene const& scene, Result& result, FlatBvh& flat, int repeat)
+    {
+        using RadeonRays::Hlbvh;
+
+        std::vector<bbox> bounds;
+        scene.GetFaceBounds(bounds);
+        int num_prims = static_cast<int>(bounds.size());
+
+        std::unique_ptr<Calc::Calc, void(*)(Calc::Calc*)> calc(CreateCalc(Calc::Platform::kHost, 0), DeleteCalc);
+        auto device = calc->CreateDevice(0);
+
+        {
+            Hlbvh hlbvh(device, "");
+
+            // First build allocates device buffers, keep it out of the timings
+            hlbvh.Build(&bounds[0], num_prims);
+
+            Time(repeat, [&]()
+            {
+                hlbvh.Build(&bounds[0], num_prims);
+            }, result.build_ms, result.build_ms_mean);
+
+            // First N-1 nodes are internal, last N are leafs referencing primitives directly
+            int num_nodes = 2 * num_prims - 1;
+            std::vector<Hlbvh::Node> nodes(num_nodes);
+            std::vector<bbox> node_bounds(num_nodes);
+            auto const& gpudata = hlbvh.GetGpuData();
+            device->ReadTypedBuffer(gpudata.nodes, 0, 0, num_nodes, &nodes[0], nullptr);
+            device->ReadTypedBuffer(gpudata.sorted_bounds, 0, 0, num_nodes, &node_bounds[0], nullptr);
+
+            flat.nodes.resize(num_nodes);
+            flat.indices.resize(num_prims);
+
+            for (int i = 0; i < num_nodes; ++i)
+            {
+                auto& node = flat.nodes[i];
+                node.bounds = node_bounds[i];
+
+                if (i >= num_prims - 1)
+                {
+                    node.first = i - (num_prims - 1);
+                    node.count = 1;
+                    flat.indices[node.first] = nodes[i].left;
+                }
+                else
+                {
+                    node.left = nodes[i].left;
+                    node.right = nodes[i].right;
+                    node.count = 0;
+                }
+            }
+
+            result.memory_bytes = static_cast<long long>(num_nodes * (sizeof(Hlbvh::Node) + sizeof(bbox)) + num_prims * sizeof(int));
+        }
+
+        calc->DeleteDevice(device);
+    }
+
+    std::vector<std::string> GetBuilderNames()
+    {
+        return { "bvh_median", "bvh_sah", "split_bvh", "hlbvh" };
+    }
+
+    Result RunBuilder(std::string const& name, Scene const& scene, RaySets const& rays, int repeat)
+    {
+        Result result;
+        result.builder = name;
+        FlatBvh flat;
+
+        if (name == "bvh_median")
+        {
+            RunBvhBuilder<RadeonRays::Bvh>(scene, result, flat, repeat, kTraversalCost, kNumBins, false);
+        }
+        else if (name == "bvh_sah")
+        {
+            RunBvhBuilder<RadeonRays::Bvh>(scene, result, flat, repeat, kTraversalCost, kNumBins, true);
+        }
+        else if (name == "split_bvh")
+        {
+            // Intersector defaults for max split depth, min overlap and extra node budget
+            RunBvhBuilder<RadeonRays::SplitBvh>(scene, result, flat, repeat, kTraversalCost, kNumBins, 10, 0.05f, 0.5f);
+        }
+        else if (name == "hlbvh")
+        {
+            RunHlbvhBuilder(scene, result, flat, repeat);
+        }
+        else
+        {
+            throw std::runtime_error("Unknown builder " + name);
+        }
+
+        RadeonRays::BvhStatistics stats;
+        GetTreeStatistics(flat, stats);
+        result.sah_cost = stats.sah_cost;
+        result.num_nodes = stats.num_nodes;
+        result.num_leaves = stats.num_leaves;
+        result.max_depth = stats.max_depth;
+
+        for (auto const& set : rays)
+        {
+            Result::Trace trace = { set.first, 0.0, 0 };
+            double best_ms = 0.0;
+            double mean_ms = 0.0;
+
+            Time(repeat, [&]()
+            {
+                trace.hits = TraceRays(flat, scene, set.second);
+            }, best_ms, mean_ms);
+
+            trace.rays_per_sec = set.second.size() / (best_ms * 1e-3);
+            result.traces.push_back(trace);
+        }
+
+        return result;
+    }
+
+    static RadeonRays::IntersectionApi* CreateNativeApi(int width)
+    {
+        using namespace RadeonRays;
+
+        IntersectionApi::SetPlatform(DeviceInfo::kNative);
+
+        for (std::uint32_t i = 0; i < IntersectionApi::GetDeviceCount(); ++i)
+        {
+            DeviceInfo info;
+            IntersectionApi::GetDeviceInfo(i, info);
+
+            if (info.platform == DeviceInfo::kNative)
+            {
+                auto api = IntersectionApi::Create(i);
+                api->SetOption("bvh.builder", "sah");
+                api->SetOption("bvh.width", static_cast<float>(width));
+                return api;
+            }
+        }
+
+        throw std::runtime_error("Native CPU device is not available");
+    }
+
+    Result RunNativeDevice(int width, Scene const& scene, RaySets const& rays, int repeat)
+    {
+        using namespace RadeonRays;
+
+        Result result;
+        result.builder = "native_bvh2_width" + std::to_string(width);
+
+        std::unique_ptr<IntersectionApi, void(*)(IntersectionApi*)> api(nullptr, IntersectionApi::Delete);
+
+        // Each repeat commits a fresh scene, the device only rebuilds changed worlds.
+        // Only the commit is timed, it copies the mesh and builds the BVH.
+        result.build_ms_mean = 0.0;
+        for (int i = 0; i < repeat; ++i)
+        {
+            api.reset(CreateNativeApi(width));
+            auto shape = api->CreateMesh(&scene.vertices[0].x, static_cast<int>(scene.vertices.size()), sizeof(float3),
+                &scene.indices[0], 0, nullptr, scene.GetNumFaces());
+            api->AttachShape(shape);
+
+            auto start = Clock::now();
+            api->Commit();
+            double ms = GetMilliseconds(start);
+
+            result.build_ms = i == 0 ? ms : std::min(result.build_ms, ms);
+            result.build_ms_mean += ms / repeat;
+        }
+
+        // Tree metrics describe the binary tree before it is collapsed,
+        // memory is everything the traversal reads
+        BvhStatistics stats;
+        api->GetBvhStatistics(stats);
+        result.memory_bytes = static_cast<long long>(stats.layout_bytes);
+        result.sah_cost = stats.sah_cost;
+        result.num_nodes = stats.num_nodes;
+        result.num_leaves = stats.num_leaves;
+        result.max_depth = stats.max_depth;
+
+        for (auto const& set : rays)
+        {
+            Result::Trace trace = { set.first, 0.0, 0 };
+            int num_rays = static_cast<int>(set.second.size());
+
+            auto ray_buffer = api->CreateBuffer(num_rays * sizeof(ray), const_cast<ray*>(&set.second[0]));
+            auto hit_buffer = api->CreateBuffer(num_rays * sizeof(Intersection), nullptr);
+
+            double best_ms = 0.0;
+            double mean_ms = 0.0;
+
+            Time(repeat, [&]()
+            {
+                Event* e = nullptr;
+                api->QueryIntersection(ray_buffer, num_rays, hit_buffer, nullptr, &e);
+                e->Wait();
+                api->DeleteEvent(e);
+            }, best_ms, mean_ms);
+
+            Intersection* hits = nullptr;
+            Event* e = nullptr;
+            api->MapBuffer(hit_buffer, kMapRead, 0, num_rays * sizeof(Intersection), reinterpret_cast<void**>(&hits), &e);
+            e->Wait();
+            api->DeleteEvent(e);
+
+            trace.hits = static_cast<int>(std::count_if(hits, hits + num_rays,
+                [](Intersection const& hit) { return hit.shapeid != kNullId; }));
+
+            api->UnmapBuffer(hit_buffer, hits, &e);
+            e->Wait();
+            api->DeleteEvent(e);
+
+            api->DeleteBuffer(ray_buffer);
+            api->DeleteBuffer(hit_buffer);
+
+            trace.rays_per_sec = num_rays / (best_ms * 1e-3);
+            result.traces.push_back(trace);
+        }
+
+        return result;
+    }
+}
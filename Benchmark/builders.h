@@ -0,0 +1,65 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "scene.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Benchmark
+{
+    // Named ray set, e.g. "coherent"
+    typedef std::vector<std::pair<std::string, std::vector<ray>>> RaySets;
+
+    // One builder on one scene, negative values are unknown and reported as null
+    struct Result
+    {
+        struct Trace
+        {
+            std::string rays;
+            double rays_per_sec;
+            int hits;
+        };
+
+        std::string builder;
+        // Best and mean build time over the repeats
+        double build_ms = -1.0;
+        double build_ms_mean = -1.0;
+        // Size of the tree in the builder's own layout
+        long long memory_bytes = -1;
+        double sah_cost = -1.0;
+        int num_nodes = -1;
+        int num_leaves = -1;
+        int max_depth = -1;
+        std::vector<Trace> traces;
+    };
+
+    // Builders evaluated through FlatBvh: "bvh_median", "bvh_sah", "split_bvh", "hlbvh"
+    std::vector<std::string> GetBuilderNames();
+    Result RunBuilder(std::string const& name, Scene const& scene, RaySets const& rays, int repeat);
+
+    // Native CPU device through IntersectionApi, builds Bvh2 collapsed to the given width
+    // on commit and traces with its own kernels
+    Result RunNativeDevice(int width, Scene const& scene, RaySets const& rays, int repeat);
+}
@@ -0,0 +1,167 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "flat_bvh.h"
+#include "RadeonRays/src/accelerator/bvh_statistics.h"
+#include "RadeonRays/src/async/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+namespace Benchmark
+{
+    // Number of rays traced by a single task
+    static int const kRaysPerTask = 1024;
+
+    void GetTreeStatistics(FlatBvh const& bvh, RadeonRays::BvhStatistics& stats)
+    {
+        using RadeonRays::TreeletOptimizer;
+
+        // Same layout, Collect only follows children so parents are left unset
+        std::vector<TreeletOptimizer::Node> nodes(bvh.nodes.size());
+
+        for (std::size_t i = 0; i < bvh.nodes.size(); ++i)
+        {
+            auto const& node = bvh.nodes[i];
+            auto& flat = nodes[i];
+
+            flat.bounds = node.bounds;
+            flat.parent = -1;
+            flat.left = node.count > 0 ? -1 : node.left;
+            flat.right = node.count > 0 ? -1 : node.right;
+            flat.numprims = node.count;
+        }
+
+        RadeonRays::BvhStatisticsCollector::Collect(nodes, 0, stats);
+    }
+
+    static inline bool IntersectBox(bbox const& box, float3 const& o, float3 const& inv_d, float max_t)
+    {
+        float3 t0 = (box.pmin - o) * inv_d;
+        float3 t1 = (box.pmax - o) * inv_d;
+        float3 tmin = vmin(t0, t1);
+        float3 tmax = vmax(t0, t1);
+        float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.f));
+        float exit = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, max_t));
+        return enter <= exit;
+    }
+
+    // Moller-Trumbore, returns distance or max_t
+    static inline float IntersectTriangle(float3 const& o, float3 const& d, float3 const& v0, float3 const& v1, float3 const& v2, float max_t)
+    {
+        float3 e1 = v1 - v0;
+        float3 e2 = v2 - v0;
+        float3 p = cross(d, e2);
+        float det = dot(e1, p);
+
+        if (std::abs(det) < 1e-12f)
+        {
+            return max_t;
+        }
+
+        float inv_det = 1.f / det;
+        float3 s = o - v0;
+        float u = dot(s, p) * inv_det;
+        if (u < 0.f || u > 1.f)
+        {
+            return max_t;
+        }
+
+        float3 q = cross(s, e1);
+        float v = dot(d, q) * inv_det;
+        if (v < 0.f || u + v > 1.f)
+        {
+            return max_t;
+        }
+
+        float t = dot(e2, q) * inv_det;
+        return t > 0.f && t < max_t ? t : max_t;
+    }
+
+    int TraceRays(FlatBvh const& bvh, Scene const& scene, std::vector<ray> const& rays)
+    {
+        std::atomic<int> num_hits(0);
+
+        if (bvh.nodes.empty())
+        {
+            return 0;
+        }
+
+        RadeonRays::parallel_for(0, static_cast<int>(rays.size()), kRaysPerTask, [&](int begin, int end)
+        {
+            std::vector<int> stack;
+            int hits = 0;
+
+            for (int i = begin; i < end; ++i)
+            {
+                float3 o = rays[i].o;
+                float3 d = rays[i].d;
+                float3 inv_d(1.f / d.x, 1.f / d.y, 1.f / d.z);
+                float max_t = rays[i].GetMaxT();
+                bool hit = false;
+
+                stack.assign(1, 0);
+
+                while (!stack.empty())
+                {
+                    auto const& node = bvh.nodes[stack.back()];
+                    stack.pop_back();
+
+                    if (!IntersectBox(node.bounds, o, inv_d, max_t))
+                    {
+                        continue;
+                    }
+
+                    if (node.count > 0)
+                    {
+                        for (int p = node.first; p < node.first + node.count; ++p)
+                        {
+                            int face = bvh.indices[p];
+                            float t = IntersectTriangle(o, d,
+                                scene.vertices[scene.indices[3 * face]],
+                                scene.vertices[scene.indices[3 * face + 1]],
+                                scene.vertices[scene.indices[3 * face + 2]], max_t);
+
+                            if (t < max_t)
+                            {
+                                max_t = t;
+                                hit = true;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        stack.push_back(node.right);
+                        stack.push_back(node.left);
+                    }
+                }
+
+                hits += hit ? 1 : 0;
+            }
+
+            num_hits.fetch_add(hits);
+        });
+
+        return num_hits.load();
+    }
+}
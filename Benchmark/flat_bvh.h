@@ -0,0 +1,60 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "scene.h"
+#include "radeon_rays.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace Benchmark
+{
+    // Builder independent binary tree used to evaluate quality and trace rays
+    // with the same traversal for every builder
+    struct FlatBvh
+    {
+        struct Node
+        {
+            bbox bounds;
+            // Children for internal nodes
+            int left;
+            int right;
+            // Range in indices for leaves, count is 0 for internal nodes
+            int first;
+            int count;
+        };
+
+        // Root is the first node
+        std::vector<Node> nodes;
+        // Face indices referenced by leaves
+        std::vector<int> indices;
+    };
+
+    // Tree metrics through BvhStatisticsCollector, the same ones the
+    // native device reports, memory and timings are left unset
+    void GetTreeStatistics(FlatBvh const& bvh, RadeonRays::BvhStatistics& stats);
+
+    // Closest hit for every ray on all threads,
+    // returns the number of rays hitting anything
+    int TraceRays(FlatBvh const& bvh, Scene const& scene, std::vector<ray> const& rays);
+}
@@ -0,0 +1,153 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Benchmark
+{
+    // Minimal streaming JSON writer, keys and values are written in call order
+    class JsonWriter
+    {
+    public:
+        explicit JsonWriter(std::ostream& os) : m_os(os), m_after_key(false) {}
+
+        void BeginObject() { Open('{'); }
+        void EndObject() { Close('}'); }
+        void BeginArray() { Open('['); }
+        void EndArray() { Close(']'); }
+
+        void Key(std::string const& key)
+        {
+            Separate();
+            WriteString(key);
+            m_os << ": ";
+            m_after_key = true;
+        }
+
+        void Value(std::string const& value) { Separate(); WriteString(value); }
+        void Value(char const* value) { Value(std::string(value)); }
+        void Value(int value) { Separate(); m_os << value; }
+        void Value(long long value) { Separate(); m_os << value; }
+        void Value(bool value) { Separate(); m_os << (value ? "true" : "false"); }
+        void Null() { Separate(); m_os << "null"; }
+
+        void Value(double value)
+        {
+            if (!std::isfinite(value))
+            {
+                Null();
+                return;
+            }
+
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.6g", value);
+            Separate();
+            m_os << buffer;
+        }
+
+        // Negative values mark unknown results
+        template <typename T> void ValueOrNull(T value)
+        {
+            if (value < 0)
+                Null();
+            else
+                Value(value);
+        }
+
+    private:
+        void Open(char c)
+        {
+            Separate();
+            m_os << c;
+            m_counts.push_back(0);
+        }
+
+        void Close(char c)
+        {
+            bool empty = m_counts.back() == 0;
+            m_counts.pop_back();
+            if (!empty)
+                Newline();
+            m_os << c;
+            if (m_counts.empty())
+                m_os << "\n";
+        }
+
+        // Comma and indentation before a value, nothing after a key
+        void Separate()
+        {
+            if (m_after_key)
+            {
+                m_after_key = false;
+                return;
+            }
+
+            if (!m_counts.empty())
+            {
+                if (m_counts.back()++ > 0)
+                    m_os << ",";
+                Newline();
+            }
+        }
+
+        void Newline()
+        {
+            m_os << "\n" << std::string(2 * m_counts.size(), ' ');
+        }
+
+        void WriteString(std::string const& s)
+        {
+            m_os << '"';
+            for (char c : s)
+            {
+                switch (c)
+                {
+                case '"': m_os << "\\\""; break;
+                case '\\': m_os << "\\\\"; break;
+                case '\n': m_os << "\\n"; break;
+                case '\t': m_os << "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20)
+                    {
+                        char buffer[8];
+                        std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                        m_os << buffer;
+                    }
+                    else
+                    {
+                        m_os << c;
+                    }
+                }
+            }
+            m_os << '"';
+        }
+
+        std::ostream& m_os;
+        std::vector<int> m_counts;
+        bool m_after_key;
+    };
+}
@@ -0,0 +1,221 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "builders.h"
+#include "json_writer.h"
+#include "scene.h"
+
+#include "radeon_rays.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+using namespace Benchmark;
+
+namespace
+{
+    struct Settings
+    {
+        std::vector<std::string> obj_paths;
+        std::vector<std::string> builders;
+        std::string output;
+        bool synthetic = true;
+        int synthetic_size = 5;
+        int num_rays = 512 * 512;
+        int repeat = 3;
+    };
+
+    void PrintUsage()
+    {
+        std::cerr <<
+            "Usage: Benchmark [options]\n"
+            "  --obj <path>            add an OBJ scene, may be repeated\n"
+            "                          (default: ../Resources/CornellBox/orig.objm if present)\n"
+            "  --no-synthetic          skip the generated scenes\n"
+            "  --synthetic-size <n>    sphere grid side, triangle soup has the same face count (default: 5)\n"
+            "  --rays <n>              rays per ray set (default: 262144)\n"
+            "  --repeat <n>            runs per measurement, the best one is reported (default: 3)\n"
+            "  --builder <name>        run only this builder, may be repeated\n"
+            "  --output <path>         write JSON to a file instead of stdout\n";
+    }
+
+    bool ParseSettings(int argc, char** argv, Settings& settings)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+
+            if (arg == "--obj" && has_value)
+                settings.obj_paths.push_back(argv[++i]);
+            else if (arg == "--no-synthetic")
+                settings.synthetic = false;
+            else if (arg == "--synthetic-size" && has_value)
+                settings.synthetic_size = std::max(1, std::atoi(argv[++i]));
+            else if (arg == "--rays" && has_value)
+                settings.num_rays = std::max(1, std::atoi(argv[++i]));
+            else if (arg == "--repeat" && has_value)
+                settings.repeat = std::max(1, std::atoi(argv[++i]));
+            else if (arg == "--builder" && has_value)
+                settings.builders.push_back(argv[++i]);
+            else if (arg == "--output" && has_value)
+                settings.output = argv[++i];
+            else
+                return false;
+        }
+
+        if (settings.obj_paths.empty() && std::ifstream("../Resources/CornellBox/orig.objm"))
+        {
+            settings.obj_paths.push_back("../Resources/CornellBox/orig.objm");
+        }
+
+        return true;
+    }
+
+    bool IsSelected(Settings const& settings, std::string const& builder)
+    {
+        return settings.builders.empty() ||
+            std::find(settings.builders.begin(), settings.builders.end(), builder) != settings.builders.end();
+    }
+
+    void WriteResult(JsonWriter& json, Result const& result)
+    {
+        json.BeginObject();
+        json.Key("builder"); json.Value(result.builder);
+        json.Key("build_ms"); json.ValueOrNull(result.build_ms);
+        json.Key("build_ms_mean"); json.ValueOrNull(result.build_ms_mean);
+        json.Key("memory_bytes"); json.ValueOrNull(result.memory_bytes);
+        json.Key("sah_cost"); json.ValueOrNull(result.sah_cost);
+        json.Key("nodes"); json.ValueOrNull(result.num_nodes);
+        json.Key("leaves"); json.ValueOrNull(result.num_leaves);
+        json.Key("max_depth"); json.ValueOrNull(result.max_depth);
+        json.Key("traces");
+        json.BeginArray();
+        for (auto const& trace : result.traces)
+        {
+            json.BeginObject();
+            json.Key("rays"); json.Value(trace.rays);
+            json.Key("rays_per_sec"); json.Value(trace.rays_per_sec);
+            json.Key("hits"); json.Value(trace.hits);
+            json.EndObject();
+        }
+        json.EndArray();
+        json.EndObject();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    if (!ParseSettings(argc, argv, settings))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::vector<Scene> scenes;
+
+    if (settings.synthetic)
+    {
+        // 2K triangles per sphere
+        int const tessellation = 32;
+        scenes.push_back(CreateSphereGrid(settings.synthetic_size, tessellation));
+        scenes.push_back(CreateTriangleSoup(scenes.back().GetNumFaces(), 1));
+    }
+
+    for (auto const& path : settings.obj_paths)
+    {
+        Scene scene;
+        auto error = LoadObjScene(path, scene);
+        if (!error.empty())
+        {
+            std::cerr << "Failed to load " << path << ": " << error << "\n";
+            return 1;
+        }
+        scenes.push_back(scene);
+    }
+
+    std::unique_ptr<std::ofstream> file;
+    if (!settings.output.empty())
+    {
+        file.reset(new std::ofstream(settings.output));
+        if (!*file)
+        {
+            std::cerr << "Can't open " << settings.output << "\n";
+            return 1;
+        }
+    }
+
+    JsonWriter json(file ? *file : std::cout);
+    json.BeginObject();
+    json.Key("version"); json.Value(1);
+    json.Key("api_version"); json.Value(RADEONRAYS_API_VERSION);
+    json.Key("threads"); json.Value(static_cast<int>(std::thread::hardware_concurrency()));
+    json.Key("repeat"); json.Value(settings.repeat);
+    json.Key("scenes");
+    json.BeginArray();
+
+    for (auto const& scene : scenes)
+    {
+        int side = static_cast<int>(std::sqrt(static_cast<double>(settings.num_rays)));
+        RaySets rays;
+        rays.push_back(std::make_pair(std::string("coherent"), CreateCoherentRays(scene, side, std::max(1, settings.num_rays / side))));
+        rays.push_back(std::make_pair(std::string("incoherent"), CreateIncoherentRays(scene, settings.num_rays, 2)));
+
+        json.BeginObject();
+        json.Key("name"); json.Value(scene.name);
+        json.Key("triangles"); json.Value(scene.GetNumFaces());
+        json.Key("results");
+        json.BeginArray();
+
+        for (auto const& builder : GetBuilderNames())
+        {
+            if (IsSelected(settings, builder))
+            {
+                std::cerr << scene.name << ": " << builder << "\n";
+                WriteResult(json, RunBuilder(builder, scene, rays, settings.repeat));
+            }
+        }
+
+        for (int width : { 2, 4, 8 })
+        {
+            auto builder = "native_bvh2_width" + std::to_string(width);
+            if (IsSelected(settings, builder))
+            {
+                std::cerr << scene.name << ": " << builder << "\n";
+                WriteResult(json, RunNativeDevice(width, scene, rays, settings.repeat));
+            }
+        }
+
+        json.EndArray();
+        json.EndObject();
+    }
+
+    json.EndArray();
+    json.EndObject();
+
+    return 0;
+}
@@ -0,0 +1,203 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "scene.h"
+#include "tiny_obj_loader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace Benchmark
+{
+    static float const kPi = 3.14159265358979f;
+
+    void Scene::GetFaceBounds(std::vector<bbox>& bounds) const
+    {
+        bounds.resize(GetNumFaces());
+
+        for (int i = 0; i < GetNumFaces(); ++i)
+        {
+            bounds[i] = bbox(vertices[indices[3 * i]]);
+            bounds[i].grow(vertices[indices[3 * i + 1]]);
+            bounds[i].grow(vertices[indices[3 * i + 2]]);
+        }
+    }
+
+    bbox Scene::GetBounds() const
+    {
+        bbox bounds;
+        for (auto const& v : vertices)
+            bounds.grow(v);
+        return bounds;
+    }
+
+    Scene CreateSphereGrid(int grid, int tessellation)
+    {
+        Scene scene;
+        scene.name = "sphere_grid_" + std::to_string(grid);
+
+        float const radius = 0.4f;
+
+        for (int i = 0; i < grid * grid * grid; ++i)
+        {
+            float3 center(float(i % grid), float((i / grid) % grid), float(i / (grid * grid)));
+            int base = static_cast<int>(scene.vertices.size());
+
+            for (int t = 0; t <= tessellation; ++t)
+            {
+                float theta = kPi * t / tessellation;
+
+                for (int p = 0; p <= tessellation; ++p)
+                {
+                    float phi = 2.f * kPi * p / tessellation;
+                    float3 n(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+                    scene.vertices.push_back(center + radius * n);
+                }
+            }
+
+            for (int t = 0; t < tessellation; ++t)
+            {
+                for (int p = 0; p < tessellation; ++p)
+                {
+                    int i0 = base + t * (tessellation + 1) + p;
+                    int i1 = i0 + tessellation + 1;
+
+                    int const quad[] = { i0, i1, i0 + 1, i0 + 1, i1, i1 + 1 };
+                    scene.indices.insert(scene.indices.end(), quad, quad + 6);
+                }
+            }
+        }
+
+        return scene;
+    }
+
+    Scene CreateTriangleSoup(int num_faces, unsigned seed)
+    {
+        Scene scene;
+        scene.name = "triangle_soup_" + std::to_string(num_faces);
+
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> position(0.f, 1.f);
+        std::uniform_real_distribution<float> offset(-1.f, 1.f);
+        // Mostly small triangles with a few large ones spanning the scene
+        std::exponential_distribution<float> size(200.f);
+
+        for (int i = 0; i < num_faces; ++i)
+        {
+            float3 p(position(rng), position(rng), position(rng));
+            float s = std::min(size(rng), 0.5f);
+
+            for (int v = 0; v < 3; ++v)
+            {
+                scene.indices.push_back(static_cast<int>(scene.vertices.size()));
+                scene.vertices.push_back(p + s * float3(offset(rng), offset(rng), offset(rng)));
+            }
+        }
+
+        return scene;
+    }
+
+    std::string LoadObjScene(std::string const& path, Scene& scene)
+    {
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+
+        auto res = tinyobj::LoadObj(shapes, materials, path.c_str());
+        if (!res.empty())
+        {
+            return res;
+        }
+
+        auto slash = path.find_last_of("/\\");
+        scene.name = slash == std::string::npos ? path : path.substr(slash + 1);
+        scene.vertices.clear();
+        scene.indices.clear();
+
+        for (auto const& shape : shapes)
+        {
+            int base = static_cast<int>(scene.vertices.size());
+            auto const& positions = shape.mesh.positions;
+
+            for (std::size_t i = 0; i + 2 < positions.size(); i += 3)
+            {
+                scene.vertices.push_back(float3(positions[i], positions[i + 1], positions[i + 2]));
+            }
+
+            for (auto idx : shape.mesh.indices)
+            {
+                scene.indices.push_back(base + idx);
+            }
+        }
+
+        return scene.indices.empty() ? "No triangles in " + path : std::string();
+    }
+
+    std::vector<ray> CreateCoherentRays(Scene const& scene, int width, int height)
+    {
+        auto bounds = scene.GetBounds();
+        auto extents = bounds.extents();
+        float size = std::max(extents.x, extents.y);
+
+        // 45 degree vertical field of view, far enough to see the whole front face
+        float const tan_half_fov = std::tan(kPi / 8.f);
+        float distance = 0.5f * size / tan_half_fov;
+        float3 eye = bounds.center() - float3(0.f, 0.f, 0.5f * extents.z + distance);
+        float aspect = float(width) / float(height);
+
+        std::vector<ray> rays(width * height);
+
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                float u = (2.f * (x + 0.5f) / width - 1.f) * tan_half_fov * aspect;
+                float v = (2.f * (y + 0.5f) / height - 1.f) * tan_half_fov;
+                rays[y * width + x] = ray(eye, normalize(float3(u, v, 1.f)));
+            }
+        }
+
+        return rays;
+    }
+
+    std::vector<ray> CreateIncoherentRays(Scene const& scene, int num_rays, unsigned seed)
+    {
+        auto bounds = scene.GetBounds();
+
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+        std::vector<ray> rays(num_rays);
+
+        for (auto& r : rays)
+        {
+            float3 o = bounds.pmin + float3(unit(rng), unit(rng), unit(rng)) * bounds.extents();
+
+            float z = 1.f - 2.f * unit(rng);
+            float phi = 2.f * kPi * unit(rng);
+            float s = std::sqrt(std::max(0.f, 1.f - z * z));
+
+            r = ray(o, float3(s * std::cos(phi), s * std::sin(phi), z));
+        }
+
+        return rays;
+    }
+}
@@ -0,0 +1,66 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "math/float3.h"
+#include "math/bbox.h"
+#include "math/ray.h"
+
+#include <string>
+#include <vector>
+
+namespace Benchmark
+{
+    using RadeonRays::float3;
+    using RadeonRays::bbox;
+    using RadeonRays::ray;
+
+    // Triangle soup: three indices per face into vertices
+    struct Scene
+    {
+        std::string name;
+        std::vector<float3> vertices;
+        std::vector<int> indices;
+
+        int GetNumFaces() const { return static_cast<int>(indices.size() / 3); }
+
+        // Bounds of every face, as passed to the builders
+        void GetFaceBounds(std::vector<bbox>& bounds) const;
+
+        bbox GetBounds() const;
+    };
+
+    // grid^3 spheres with tessellation^2 quads each: spatially coherent geometry
+    Scene CreateSphereGrid(int grid, int tessellation);
+
+    // Randomly placed and sized triangles in a unit cube: overlapping, hard to split
+    Scene CreateTriangleSoup(int num_faces, unsigned seed);
+
+    // Load all shapes of an OBJ file into a single scene, returns error text or empty string
+    std::string LoadObjScene(std::string const& path, Scene& scene);
+
+    // Pinhole camera rays looking at the scene from -z, covering its bounds
+    std::vector<ray> CreateCoherentRays(Scene const& scene, int width, int height);
+
+    // Rays starting anywhere in the scene bounds in uniformly random directions
+    std::vector<ray> CreateIncoherentRays(Scene const& scene, int num_rays, unsigned seed);
+}
@@ -314,6 +314,27 @@ CLWKernel CLWProgram::GetKernel(std::string const& funcName) const
     return iter->second;
 }
 
+std::size_t CLWProgram::GetBinarySize(int device) const
+{
+    std::uint32_t num_devices;
+    auto status = clGetProgramInfo(*this, CL_PROGRAM_NUM_DEVICES,
+        sizeof(uint32_t),
+        &num_devices,
+        nullptr);
+
+    ThrowIf(status != CL_SUCCESS, status, "clGetProgramInfo failed");
+
+    std::vector<std::size_t> binary_sizes(num_devices);
+    status = clGetProgramInfo(*this, CL_PROGRAM_BINARY_SIZES,
+        sizeof(size_t) * num_devices,
+        &binary_sizes[0],
+        nullptr);
+
+    ThrowIf(status != CL_SUCCESS, status, "clGetProgramInfo failed");
+
+    return binary_sizes[device];
+}
+
 void CLWProgram::GetBinaries(int device, std::vector<std::uint8_t>& data) const
 {
     std::uint32_t num_devices;
@@ -348,7 +369,7 @@ void CLWProgram::GetBinaries(int device, std::vector<std::uint8_t>& data) const
     }
 
     status = clGetProgramInfo(*this, CL_PROGRAM_BINARIES,
-        sizeof(char*),
+        sizeof(char*) * num_devices,
         temp,
         nullptr);
 
@@ -359,7 +380,7 @@ void CLWProgram::GetBinaries(int device, std::vector<std::uint8_t>& data) const
     {
         if (i != device)
         {
-            delete temp[i];
+            delete [] temp[i];
         }
     }
 
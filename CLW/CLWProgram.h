@@ -72,6 +72,7 @@ public:
     CLWKernel    GetKernel(std::string const& funcName) const;
 
     void GetBinaries(int device, std::vector<std::uint8_t>& data) const;
+    std::size_t GetBinarySize(int device) const;
 
 private:
     CLWProgram(cl_program program);
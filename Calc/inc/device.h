@@ -40,6 +40,8 @@ namespace Calc
     {
         char const* name;
         char const* vendor;
+        // nullptr if the platform does not report it
+        char const* driver_version;
 
         DeviceType  type;
         SourceType  sourceTypes;
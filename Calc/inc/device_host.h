@@ -0,0 +1,102 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+#include <functional>
+
+#include "calc_common.h"
+#include "device.h"
+
+namespace Calc
+{
+    // Arguments of a host function in the order set with Function::SetArg:
+    // buffer arguments point to buffer memory, value arguments to a copy
+    // of the value, shared memory arguments are null.
+    class HostArgs
+    {
+    public:
+        HostArgs(void* const* args, std::uint32_t num_args)
+            : m_args(args)
+            , m_num_args(num_args)
+        {
+        }
+
+        std::uint32_t GetCount() const { return m_num_args; }
+
+        template <typename T> T* GetBuffer(std::uint32_t idx) const
+        {
+            assert(idx < m_num_args);
+            return static_cast<T*>(m_args[idx]);
+        }
+
+        template <typename T> T GetValue(std::uint32_t idx) const
+        {
+            assert(idx < m_num_args);
+            T value;
+            std::memcpy(&value, m_args[idx], sizeof(T));
+            return value;
+        }
+
+    private:
+        void* const* m_args;
+        std::uint32_t m_num_args;
+    };
+
+    // Host function: processes work items [begin, end) of an Execute call.
+    // Ranges are made of whole work groups and run concurrently, work items
+    // of a group run in order on one thread, so there are no barriers.
+    typedef void (*HostFunction)(HostArgs const& args, std::size_t begin, std::size_t end);
+
+    struct HostFunctionEntry
+    {
+        char const* name;
+        HostFunction function;
+    };
+
+    // Runs task(i) for i in [0, count) concurrently and returns once all of them
+    // are done, rethrowing the first exception thrown by a task
+    typedef std::function<void(std::size_t count, std::function<void(std::size_t)> const& task)> HostExecutor;
+
+    // Device executing on host memory with a thread pool
+    //  * Buffers live in system memory, mapping returns that memory
+    //  * Commands complete before returning, events are always signaled
+    //  * Executables are tables of C++ functions instead of compiled sources
+    //
+    class DeviceHost : public Device
+    {
+    public:
+        DeviceHost() = default;
+        virtual ~DeviceHost() = default;
+
+        // Create executable from host functions, CreateFunction looks them up by name
+        virtual Executable* CreateExecutable(HostFunctionEntry const* functions, std::size_t num_functions) = 0;
+
+        // Run all work with executor, which has num_threads threads, instead of the device
+        // threads. Lets an application share its scheduler rather than oversubscribe cores,
+        // the device threads are not started then. Set it before submitting any work.
+        virtual void SetExecutor(HostExecutor const& executor, std::uint32_t num_threads) = 0;
+    };
+}
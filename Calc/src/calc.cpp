@@ -20,6 +20,7 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 ********************************************************************/
 #include "calc.h"
+#include "calc_host.h"
 #if USE_OPENCL
 #include "calc_clw.h"
 #endif
@@ -45,6 +46,11 @@ Calc::Calc* CreateCalc(Calc::Platform inPlatform, int reserved)
         }
         else
 #endif // USE_VULKAN
+        if (inPlatform & Calc::Platform::kHost)
+        {
+            return new Calc::CalcHost();
+        }
+        else
         {
             return nullptr;
         }
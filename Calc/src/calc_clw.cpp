@@ -75,6 +75,7 @@ namespace Calc
         // which is pretty much ok
         spec.name = m_devices[idx].GetName().c_str();
         spec.vendor = m_devices[idx].GetVendor().c_str();
+        spec.driver_version = m_devices[idx].GetVersion().c_str();
         spec.type = Convert2CalcDeviceType(m_devices[idx].GetType());
         spec.global_mem_size = m_devices[idx].GetGlobalMemSize();
         spec.local_mem_size = m_devices[idx].GetLocalMemSize();
@@ -184,6 +184,8 @@ namespace Calc
         Function* CreateFunction(char const* name) override;
         void DeleteFunction(Function* func) override;
 
+        CLWProgram GetProgram() const { return m_program; }
+
     private:
         CLWProgram m_program;
     };
@@ -253,6 +255,7 @@ namespace Calc
     {
         spec.name = m_device.GetName().c_str();
         spec.vendor = m_device.GetVendor().c_str();
+        spec.driver_version = m_device.GetVersion().c_str();
         spec.sourceTypes = SourceType::kOpenCL;
 
         spec.type = Convert2CalcDeviceType(m_device.GetType());
@@ -474,7 +477,24 @@ namespace Calc
 
     Executable* DeviceClw::CompileExecutable(std::uint8_t const* binary_code, std::size_t size, char const* options)
     {
-        return nullptr;
+        // Programs are created for every device of the context,
+        // but the binary is only valid for ours
+        if (m_context.GetDeviceCount() != 1)
+        {
+            return nullptr;
+        }
+
+        try
+        {
+            std::uint8_t* binaries[] = { const_cast<std::uint8_t*>(binary_code) };
+            std::size_t sizes[] = { size };
+
+            return new ExecutableClw(CLWProgram::CreateFromBinary(binaries, sizes, m_context));
+        }
+        catch (CLWException& e)
+        {
+            throw ExceptionClw(e.what());
+        }
     }
 
     void DeviceClw::DeleteExecutable(Executable* executable)
@@ -482,14 +502,46 @@ namespace Calc
         delete executable;
     }
 
-    size_t DeviceClw::GetExecutableBinarySize(Executable const* executable) const
+    int DeviceClw::GetContextDeviceIndex() const
     {
+        for (auto i = 0u; i < m_context.GetDeviceCount(); ++i)
+        {
+            if ((cl_device_id)m_context.GetDevice(i) == (cl_device_id)m_device)
+            {
+                return (int)i;
+            }
+        }
+
         return 0;
     }
 
+    size_t DeviceClw::GetExecutableBinarySize(Executable const* executable) const
+    {
+        try
+        {
+            auto program = static_cast<ExecutableClw const*>(executable)->GetProgram();
+            return program.GetBinarySize(GetContextDeviceIndex());
+        }
+        catch (CLWException& e)
+        {
+            throw ExceptionClw(e.what());
+        }
+    }
+
     void DeviceClw::GetExecutableBinary(Executable const* executable, std::uint8_t* binary) const
     {
+        try
+        {
+            auto program = static_cast<ExecutableClw const*>(executable)->GetProgram();
 
+            std::vector<std::uint8_t> data;
+            program.GetBinaries(GetContextDeviceIndex(), data);
+            std::copy(data.begin(), data.end(), binary);
+        }
+        catch (CLWException& e)
+        {
+            throw ExceptionClw(e.what());
+        }
     }
 
     void DeviceClw::Execute(Function const* func, std::uint32_t queue, size_t global_size, size_t local_size, Event** e)
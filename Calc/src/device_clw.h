@@ -92,6 +92,8 @@ namespace Calc
     protected:
         EventClw* CreateEventClw() const;
         void      ReleaseEventClw(EventClw* e) const;
+        // Index of m_device among the context devices
+        int       GetContextDeviceIndex() const;
 
     private:
         CLWDevice m_device;
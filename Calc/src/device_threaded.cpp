@@ -0,0 +1,489 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "device_threaded.h"
+#include "primitives.h"
+#include "buffer.h"
+#include "event.h"
+#include "executable.h"
+#include "except_host.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace Calc
+{
+    // Minimum number of work items processed by a single pool task
+    static std::size_t const kMinItemsPerTask = 4096;
+    // Radix sort digit width and bucket count
+    static std::uint32_t const kRadixBits = 8;
+    static std::uint32_t const kRadixBuckets = 1 << kRadixBits;
+
+    // Buffer implementation in system memory
+    class BufferHost : public Buffer
+    {
+    public:
+        BufferHost(std::size_t size) : m_data(size) {}
+        ~BufferHost() override {};
+
+        std::size_t GetSize() const override { return m_data.size(); }
+
+        std::uint8_t* GetData() const { return const_cast<std::uint8_t*>(m_data.data()); }
+
+    private:
+        std::vector<std::uint8_t> m_data;
+    };
+
+    // Event implementation, commands are complete when they return
+    class EventHost : public Event
+    {
+    public:
+        void Wait() override {}
+        bool IsComplete() const override { return true; }
+    };
+
+    // Function implementation wrapping a host function
+    class FunctionHost : public Function
+    {
+    public:
+        FunctionHost(HostFunction function) : m_function(function) {}
+        ~FunctionHost() override {}
+
+        void SetArg(std::uint32_t idx, std::size_t arg_size, void* arg) override
+        {
+            Resize(idx);
+            m_values[idx].assign(static_cast<std::uint8_t*>(arg), static_cast<std::uint8_t*>(arg) + arg_size);
+            m_args[idx] = m_values[idx].data();
+            m_set[idx] = true;
+        }
+
+        void SetArg(std::uint32_t idx, Buffer const* arg) override
+        {
+            auto buffer = dynamic_cast<BufferHost const*>(arg);
+
+            if (!buffer)
+            {
+                throw ExceptionHost("Buffer has not been created by the host device");
+            }
+
+            Resize(idx);
+            m_args[idx] = buffer->GetData();
+            m_set[idx] = true;
+        }
+
+        void SetArg(std::uint32_t idx, std::size_t /*size*/, SharedMemory /*shmem*/) override
+        {
+            // No local memory on the host, functions keep their group state on the stack
+            Resize(idx);
+            m_args[idx] = nullptr;
+            m_set[idx] = true;
+        }
+
+        HostFunction GetFunction() const { return m_function; }
+
+        HostArgs GetArgs() const
+        {
+            if (std::find(m_set.begin(), m_set.end(), false) != m_set.end())
+            {
+                throw ExceptionHost("Not all function arguments have been set");
+            }
+
+            return HostArgs(m_args.data(), static_cast<std::uint32_t>(m_args.size()));
+        }
+
+    private:
+        void Resize(std::uint32_t idx)
+        {
+            if (idx >= m_args.size())
+            {
+                m_args.resize(idx + 1, nullptr);
+                m_values.resize(idx + 1);
+                m_set.resize(idx + 1, false);
+            }
+        }
+
+        HostFunction m_function;
+        std::vector<void*> m_args;
+        std::vector<std::vector<std::uint8_t>> m_values;
+        std::vector<bool> m_set;
+    };
+
+    // Executable implementation: table of host functions
+    class ExecutableHost : public Executable
+    {
+    public:
+        ExecutableHost(HostFunctionEntry const* functions, std::size_t num_functions)
+        {
+            for (std::size_t i = 0; i < num_functions; ++i)
+            {
+                m_functions.push_back(std::make_pair(std::string(functions[i].name), functions[i].function));
+            }
+        }
+
+        ~ExecutableHost() override {}
+
+        Function* CreateFunction(char const* name) override
+        {
+            for (auto const& f : m_functions)
+            {
+                if (f.first == name)
+                {
+                    return new FunctionHost(f.second);
+                }
+            }
+
+            throw ExceptionHost(std::string("No host function named ") + name);
+        }
+
+        void DeleteFunction(Function* func) override
+        {
+            delete func;
+        }
+
+    private:
+        std::vector<std::pair<std::string, HostFunction>> m_functions;
+    };
+
+    static BufferHost const* ToBufferHost(Buffer const* buffer, std::size_t offset, std::size_t size)
+    {
+        auto host_buffer = dynamic_cast<BufferHost const*>(buffer);
+
+        if (!host_buffer)
+        {
+            throw ExceptionHost("Buffer has not been created by the host device");
+        }
+
+        if (offset > host_buffer->GetSize() || size > host_buffer->GetSize() - offset)
+        {
+            throw ExceptionHost("Buffer range is out of bounds");
+        }
+
+        return host_buffer;
+    }
+
+    // Parallel primitives implementation on the device thread pool
+    class PrimitivesHost : public Primitives
+    {
+    public:
+        PrimitivesHost(DeviceThreaded const& device) : m_device(device) {}
+
+        // Stable LSD radix sort, keys are ordered as unsigned like on the GPU
+        void SortRadixInt32(std::uint32_t /*queueidx*/, Buffer const* from_key, Buffer* to_key, Buffer const* from_value, Buffer* to_value, std::size_t size) override
+        {
+            if (size == 0)
+            {
+                return;
+            }
+
+            auto bytes = size * sizeof(std::uint32_t);
+            auto src_key = reinterpret_cast<std::uint32_t const*>(ToBufferHost(from_key, 0, bytes)->GetData());
+            auto src_value = reinterpret_cast<std::int32_t const*>(ToBufferHost(from_value, 0, bytes)->GetData());
+            auto dst_key = reinterpret_cast<std::uint32_t*>(ToBufferHost(to_key, 0, bytes)->GetData());
+            auto dst_value = reinterpret_cast<std::int32_t*>(ToBufferHost(to_value, 0, bytes)->GetData());
+
+            std::vector<std::uint32_t> keys(src_key, src_key + size);
+            std::vector<std::int32_t> values(src_value, src_value + size);
+            std::vector<std::uint32_t> sorted_keys(size);
+            std::vector<std::int32_t> sorted_values(size);
+
+            std::size_t num_chunks = std::min<std::size_t>(m_device.GetThreadCount(), (size + kMinItemsPerTask - 1) / kMinItemsPerTask);
+            std::size_t chunk_size = (size + num_chunks - 1) / num_chunks;
+            std::vector<std::size_t> histograms(num_chunks * kRadixBuckets);
+
+            for (std::uint32_t shift = 0; shift < 32; shift += kRadixBits)
+            {
+                std::fill(histograms.begin(), histograms.end(), 0);
+
+                m_device.Run(num_chunks, [&](std::size_t chunk)
+                {
+                    auto histogram = &histograms[chunk * kRadixBuckets];
+                    auto end = std::min(size, (chunk + 1) * chunk_size);
+                    for (auto i = chunk * chunk_size; i < end; ++i)
+                        ++histogram[(keys[i] >> shift) & (kRadixBuckets - 1)];
+                });
+
+                // All keys share the digit, nothing to do for this pass
+                auto first_digit = (keys[0] >> shift) & (kRadixBuckets - 1);
+                std::size_t first_digit_count = 0;
+                for (std::size_t c = 0; c < num_chunks; ++c)
+                    first_digit_count += histograms[c * kRadixBuckets + first_digit];
+
+                if (first_digit_count == size)
+                {
+                    continue;
+                }
+
+                // Exclusive scan in digit major, chunk minor order
+                std::size_t offset = 0;
+                for (std::uint32_t d = 0; d < kRadixBuckets; ++d)
+                {
+                    for (std::size_t c = 0; c < num_chunks; ++c)
+                    {
+                        auto count = histograms[c * kRadixBuckets + d];
+                        histograms[c * kRadixBuckets + d] = offset;
+                        offset += count;
+                    }
+                }
+
+                m_device.Run(num_chunks, [&](std::size_t chunk)
+                {
+                    auto offsets = &histograms[chunk * kRadixBuckets];
+                    auto end = std::min(size, (chunk + 1) * chunk_size);
+                    for (auto i = chunk * chunk_size; i < end; ++i)
+                    {
+                        auto dst = offsets[(keys[i] >> shift) & (kRadixBuckets - 1)]++;
+                        sorted_keys[dst] = keys[i];
+                        sorted_values[dst] = values[i];
+                    }
+                });
+
+                keys.swap(sorted_keys);
+                values.swap(sorted_values);
+            }
+
+            std::memcpy(dst_key, keys.data(), size * sizeof(std::uint32_t));
+            std::memcpy(dst_value, values.data(), size * sizeof(std::int32_t));
+        }
+
+    private:
+        DeviceThreaded const& m_device;
+    };
+
+    DeviceThreaded::DeviceThreaded()
+    {
+        auto num_threads = std::thread::hardware_concurrency();
+        m_num_threads = num_threads == 0 ? 2 : num_threads;
+    }
+
+    DeviceThreaded::~DeviceThreaded()
+    {
+    }
+
+    void DeviceThreaded::GetSpec(DeviceSpec& spec)
+    {
+        GetHostSpec(spec);
+    }
+
+    void DeviceThreaded::GetHostSpec(DeviceSpec& spec)
+    {
+        spec.name = "host cpu";
+        spec.vendor = "radeonrays";
+        spec.driver_version = nullptr;
+        spec.type = DeviceType::kCpu;
+        spec.sourceTypes = SourceType::kHostNative;
+        spec.min_alignment = alignof(std::max_align_t);
+        spec.max_num_queues = 1;
+        spec.global_mem_size = std::numeric_limits<std::size_t>::max();
+        spec.local_mem_size = 0;
+        spec.max_alloc_size = std::numeric_limits<std::size_t>::max();
+        spec.max_local_size = std::numeric_limits<std::size_t>::max();
+        spec.has_fp16 = false;
+    }
+
+    Buffer* DeviceThreaded::CreateBuffer(std::size_t size, std::uint32_t /*flags*/)
+    {
+        if (size == 0)
+        {
+            throw ExceptionHost("Buffer size should be greater than zero");
+        }
+
+        return new BufferHost(size);
+    }
+
+    Buffer* DeviceThreaded::CreateBuffer(std::size_t size, std::uint32_t flags, void* initdata)
+    {
+        auto buffer = static_cast<BufferHost*>(CreateBuffer(size, flags));
+
+        if (initdata)
+        {
+            std::memcpy(buffer->GetData(), initdata, size);
+        }
+
+        return buffer;
+    }
+
+    void DeviceThreaded::DeleteBuffer(Buffer* buffer)
+    {
+        delete buffer;
+    }
+
+    void DeviceThreaded::ReadBuffer(Buffer const* buffer, std::uint32_t /*queue*/, std::size_t offset, std::size_t size, void* dst, Event** e) const
+    {
+        std::memcpy(dst, ToBufferHost(buffer, offset, size)->GetData() + offset, size);
+        SetEvent(e);
+    }
+
+    void DeviceThreaded::WriteBuffer(Buffer const* buffer, std::uint32_t /*queue*/, std::size_t offset, std::size_t size, void* src, Event** e)
+    {
+        std::memcpy(ToBufferHost(buffer, offset, size)->GetData() + offset, src, size);
+        SetEvent(e);
+    }
+
+    void DeviceThreaded::MapBuffer(Buffer const* buffer, std::uint32_t /*queue*/, std::size_t offset, std::size_t size, std::uint32_t /*map_type*/, void** mapdata, Event** e)
+    {
+        *mapdata = ToBufferHost(buffer, offset, size)->GetData() + offset;
+        SetEvent(e);
+    }
+
+    void DeviceThreaded::UnmapBuffer(Buffer const* /*buffer*/, std::uint32_t /*queue*/, void* /*mapdata*/, Event** e)
+    {
+        SetEvent(e);
+    }
+
+    Executable* DeviceThreaded::CompileExecutable(char const* /*source_code*/, std::size_t /*size*/, char const* /*options*/)
+    {
+        throw ExceptionHost("Host device can't compile sources, use CreateExecutable");
+    }
+
+    Executable* DeviceThreaded::CompileExecutable(std::uint8_t const* /*binary_code*/, std::size_t /*size*/, char const* /*options*/)
+    {
+        throw ExceptionHost("Host device can't load binaries, use CreateExecutable");
+    }
+
+    Executable* DeviceThreaded::CompileExecutable(char const* /*filename*/, char const** /*headernames*/, int /*numheaders*/, char const* /*options*/)
+    {
+        throw ExceptionHost("Host device can't compile sources, use CreateExecutable");
+    }
+
+    Executable* DeviceThreaded::CreateExecutable(HostFunctionEntry const* functions, std::size_t num_functions)
+    {
+        return new ExecutableHost(functions, num_functions);
+    }
+
+    void DeviceThreaded::DeleteExecutable(Executable* executable)
+    {
+        delete executable;
+    }
+
+    size_t DeviceThreaded::GetExecutableBinarySize(Executable const* /*executable*/) const
+    {
+        throw ExceptionHost("Host executables have no binaries");
+    }
+
+    void DeviceThreaded::GetExecutableBinary(Executable const* /*executable*/, std::uint8_t* /*binary*/) const
+    {
+        throw ExceptionHost("Host executables have no binaries");
+    }
+
+    void DeviceThreaded::Execute(Function const* func, std::uint32_t /*queue*/, size_t global_size, size_t local_size, Event** e)
+    {
+        auto host_func = dynamic_cast<FunctionHost const*>(func);
+
+        if (!host_func)
+        {
+            throw ExceptionHost("Function has not been created by the host device");
+        }
+
+        auto function = host_func->GetFunction();
+        auto args = host_func->GetArgs();
+
+        // Tasks are made of whole work groups
+        local_size = std::max<std::size_t>(local_size, 1);
+        auto num_groups = (global_size + local_size - 1) / local_size;
+        auto groups_per_task = std::max<std::size_t>(1, kMinItemsPerTask / local_size);
+        auto items_per_task = groups_per_task * local_size;
+        auto num_tasks = (num_groups + groups_per_task - 1) / groups_per_task;
+
+        Run(num_tasks, [&](std::size_t task)
+        {
+            auto begin = task * items_per_task;
+            auto end = std::min(global_size, begin + items_per_task);
+            function(args, begin, end);
+        });
+
+        SetEvent(e);
+    }
+
+    void DeviceThreaded::WaitForEvent(Event* e)
+    {
+        e->Wait();
+    }
+
+    void DeviceThreaded::WaitForMultipleEvents(Event** e, std::size_t num_events)
+    {
+        for (std::size_t i = 0; i < num_events; ++i)
+        {
+            e[i]->Wait();
+        }
+    }
+
+    void DeviceThreaded::DeleteEvent(Event* e)
+    {
+        delete e;
+    }
+
+    void DeviceThreaded::Flush(std::uint32_t /*queue*/)
+    {
+    }
+
+    void DeviceThreaded::Finish(std::uint32_t /*queue*/)
+    {
+    }
+
+    bool DeviceThreaded::HasBuiltinPrimitives() const
+    {
+        return true;
+    }
+
+    Primitives* DeviceThreaded::CreatePrimitives() const
+    {
+        return new PrimitivesHost(*this);
+    }
+
+    void DeviceThreaded::DeletePrimitives(Primitives* prims)
+    {
+        delete prims;
+    }
+
+    void DeviceThreaded::SetEvent(Event** e)
+    {
+        if (e)
+        {
+            *e = new EventHost();
+        }
+    }
+
+    void DeviceThreaded::SetExecutor(HostExecutor const& executor, std::uint32_t num_threads)
+    {
+        m_executor = executor;
+        m_num_threads = std::max<std::uint32_t>(num_threads, 1);
+    }
+
+    void DeviceThreaded::Run(std::size_t count, std::function<void(std::size_t)> const& task) const
+    {
+        if (m_executor)
+        {
+            m_executor(count, task);
+            return;
+        }
+
+        std::call_once(m_pool_once, [this]()
+        {
+            m_pool.reset(new ThreadPoolHost(m_num_threads));
+        });
+
+        m_pool->Run(count, task);
+    }
+}
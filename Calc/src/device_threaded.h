@@ -0,0 +1,110 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "device.h"
+#include "device_host.h"
+#include "thread_pool_host.h"
+
+#include <memory>
+#include <mutex>
+
+namespace Calc
+{
+    // Host device implementation executing functions on a thread pool
+    class DeviceThreaded : public DeviceHost
+    {
+    public:
+        DeviceThreaded();
+        ~DeviceThreaded();
+
+        // Device overrides
+        // Return specification of the device
+        void GetSpec(DeviceSpec& spec) override;
+        Platform GetPlatform() const override { return Platform::kHost; }
+
+        // Buffer creation and deletion
+        Buffer* CreateBuffer(std::size_t size, std::uint32_t flags) override;
+        Buffer* CreateBuffer(std::size_t size, std::uint32_t flags, void* initdata) override;
+        void DeleteBuffer(Buffer* buffer) override;
+
+        // Data movement
+        void ReadBuffer(Buffer const* buffer, std::uint32_t queue, std::size_t offset, std::size_t size, void* dst, Event** e) const override;
+        void WriteBuffer(Buffer const* buffer, std::uint32_t queue, std::size_t offset, std::size_t size, void* src, Event** e) override;
+
+        // Buffer mapping
+        void MapBuffer(Buffer const* buffer, std::uint32_t queue, std::size_t offset, std::size_t size, std::uint32_t map_type, void** mapdata, Event** e) override;
+        void UnmapBuffer(Buffer const* buffer, std::uint32_t queue, void* mapdata, Event** e) override;
+
+        // Kernel compilation, not supported: use CreateExecutable
+        Executable* CompileExecutable(char const* source_code, std::size_t size, char const* options) override;
+        Executable* CompileExecutable(std::uint8_t const* binary_code, std::size_t size, char const* options) override;
+        Executable* CompileExecutable(char const* filename, char const** headernames, int numheaders, char const* options) override;
+
+        void DeleteExecutable(Executable* executable) override;
+
+        // Executable management, not supported
+        size_t GetExecutableBinarySize(Executable const* executable) const override;
+        void GetExecutableBinary(Executable const* executable, std::uint8_t* binary) const override;
+
+        // Execution
+        void Execute(Function const* func, std::uint32_t queue, size_t global_size, size_t local_size, Event** e) override;
+
+        // Events handling
+        void WaitForEvent(Event* e) override;
+        void WaitForMultipleEvents(Event** e, std::size_t num_events) override;
+        void DeleteEvent(Event* e) override;
+
+        // Queue management functions
+        void Flush(std::uint32_t queue) override;
+        void Finish(std::uint32_t queue) override;
+
+        // Parallel prims handling
+        bool HasBuiltinPrimitives() const override;
+        Primitives* CreatePrimitives() const override;
+        void DeletePrimitives(Primitives* prims) override;
+
+        // DeviceHost overrides
+        Executable* CreateExecutable(HostFunctionEntry const* functions, std::size_t num_functions) override;
+        void SetExecutor(HostExecutor const& executor, std::uint32_t num_threads) override;
+
+        // Specification shared by all host devices
+        static void GetHostSpec(DeviceSpec& spec);
+
+    private:
+        friend class PrimitivesHost;
+
+        // Signaled event for calls asking for one
+        static void SetEvent(Event** e);
+
+        // Run task(i) for i in [0, count) on the executor or the device threads
+        void Run(std::size_t count, std::function<void(std::size_t)> const& task) const;
+        std::uint32_t GetThreadCount() const { return m_num_threads; }
+
+        // Set by SetExecutor
+        HostExecutor m_executor;
+        std::uint32_t m_num_threads;
+        // Device threads, started by the first Run without an executor
+        mutable std::unique_ptr<ThreadPoolHost> m_pool;
+        mutable std::once_flag m_pool_once;
+    };
+}
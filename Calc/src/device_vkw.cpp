@@ -107,6 +107,7 @@ namespace Calc
 
         spec.name = device->get_device_properties().deviceName;
         spec.vendor = device->get_device_properties().deviceName;
+        spec.driver_version = nullptr;
         spec.type = DeviceType::kGpu;
         spec.sourceTypes = SourceType::kGLSL;
 
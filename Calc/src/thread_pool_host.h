@@ -0,0 +1,198 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+
+namespace Calc
+{
+    // Fixed set of worker threads running index loops for the host device.
+    // The calling thread takes part in the loop, calls are serialized.
+    class ThreadPoolHost
+    {
+    public:
+        typedef std::function<void(std::size_t)> Task;
+
+        explicit ThreadPoolHost(std::uint32_t num_threads)
+            : m_task(nullptr)
+            , m_count(0)
+            , m_next(0)
+            , m_active(0)
+            , m_generation(0)
+            , m_done(false)
+        {
+            // The calling thread is the last worker
+            for (std::uint32_t i = 1; i < num_threads; ++i)
+            {
+                m_threads.push_back(std::thread(&ThreadPoolHost::RunLoop, this));
+            }
+        }
+
+        ~ThreadPoolHost()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done = true;
+            }
+            m_start_cv.notify_all();
+
+            for (auto& t : m_threads)
+            {
+                t.join();
+            }
+        }
+
+        ThreadPoolHost(ThreadPoolHost const&) = delete;
+        ThreadPoolHost& operator = (ThreadPoolHost const&) = delete;
+
+        std::uint32_t GetThreadCount() const
+        {
+            return static_cast<std::uint32_t>(m_threads.size() + 1);
+        }
+
+        // Run task(i) for i in [0, count) and wait for all of them,
+        // the first exception thrown by a task is rethrown here
+        void Run(std::size_t count, Task const& task)
+        {
+            if (count == 0)
+            {
+                return;
+            }
+
+            std::lock_guard<std::mutex> run_lock(m_run_mutex);
+
+            if (count == 1 || m_threads.empty())
+            {
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    task(i);
+                }
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_task = &task;
+                m_count = count;
+                m_next.store(0);
+                m_active = m_threads.size();
+                m_exception = nullptr;
+                ++m_generation;
+            }
+            m_start_cv.notify_all();
+
+            Work();
+
+            std::exception_ptr e;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_finish_cv.wait(lock, [this]() { return m_active == 0; });
+                m_task = nullptr;
+                std::swap(e, m_exception);
+            }
+
+            if (e)
+            {
+                std::rethrow_exception(e);
+            }
+        }
+
+    private:
+        void Work()
+        {
+            for (;;)
+            {
+                auto i = m_next.fetch_add(1);
+                if (i >= m_count)
+                {
+                    break;
+                }
+
+                try
+                {
+                    (*m_task)(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (!m_exception)
+                    {
+                        m_exception = std::current_exception();
+                    }
+                    // Drain the remaining items
+                    m_next.store(m_count);
+                }
+            }
+        }
+
+        void RunLoop()
+        {
+            std::uint64_t generation = 0;
+
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_start_cv.wait(lock, [this, generation]() { return m_done || m_generation != generation; });
+
+                    if (m_done)
+                    {
+                        break;
+                    }
+
+                    generation = m_generation;
+                }
+
+                Work();
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (--m_active == 0)
+                    {
+                        m_finish_cv.notify_all();
+                    }
+                }
+            }
+        }
+
+        std::vector<std::thread> m_threads;
+        std::mutex m_run_mutex;
+        std::mutex m_mutex;
+        std::condition_variable m_start_cv;
+        std::condition_variable m_finish_cv;
+        Task const* m_task;
+        std::size_t m_count;
+        std::atomic<std::size_t> m_next;
+        std::size_t m_active;
+        std::uint64_t m_generation;
+        std::exception_ptr m_exception;
+        bool m_done;
+    };
+}
@@ -30,7 +30,7 @@ THE SOFTWARE.
 #include "math/mathutils.h"
 #include <cstdint>
         
-#define RADEONRAYS_API_VERSION 2.0
+#define RADEONRAYS_API_VERSION 2.1
 
 #if !RR_STATIC_LIBRARY
 #ifdef WIN32
@@ -68,6 +68,7 @@ namespace RadeonRays
             kOpenCL = 0x1,
             kVulkan = 0x2,
             kEmbree = 0x4,
+            kNative = 0x8,
 
             kAny = 0xFF
         };
@@ -126,7 +127,8 @@ namespace RadeonRays
     {
     public:
         virtual ~Event() = 0;
-        // Indicates whether the related action has been completed
+        // Indicates whether the related action has been completed,
+        // host devices rethrow the error of a failed action here and in Wait
         virtual bool Complete() const = 0;
         // Blocks execution until the event is completed
         virtual void Wait() = 0;
@@ -163,6 +165,92 @@ namespace RadeonRays
         kMapWrite = 0x2
     };
 
+    // Rays stored as separate arrays (SoA), each buffer holds one
+    // value per ray. Host devices trace these arrays in place
+    // without converting them to RadeonRays::ray first.
+    struct RayBufferSoA
+    {
+        // Origins, float arrays
+        Buffer const* ox;
+        Buffer const* oy;
+        Buffer const* oz;
+        // Directions, float arrays
+        Buffer const* dx;
+        Buffer const* dy;
+        Buffer const* dz;
+        // Maximum distances, float array
+        Buffer const* maxt;
+        // Ray masks, int array, might be nullptr (all shapes visible).
+        // Rays with zero mask miss everything.
+        Buffer const* mask;
+    };
+
+    // Mesh description for IntersectionApi::CreateMeshes,
+    // the fields match CreateMesh arguments.
+    struct MeshDesc
+    {
+        // Position data
+        float const* vertices;
+        int vnum;
+        int vstride;
+        // Index data for vertices
+        int const* indices;
+        int istride;
+        // Numbers of vertices per face, might be nullptr for triangle meshes
+        int const* numfacevertices;
+        // Number of faces
+        int numfaces;
+    };
+
+    // Acceleration structure statistics, see IntersectionApi::GetBvhStatistics.
+    // Tree metrics describe the binary BVH the device builds before translating it
+    // into the layout it traverses. Costs assume unit node traversal and primitive
+    // intersection costs and are normalized by the root surface area.
+    struct BvhStatistics
+    {
+        enum
+        {
+            kLeafSizeBins = 16,
+            kDepthBins = 64
+        };
+
+        // Layout traversed by the device: "bvh2", "bvh4", "bvh8" (native CPU device),
+        // "bvh" (skip links), "fatbvh", "qbvh" or "hlbvh" (GPU accelerators)
+        char const* layout;
+        // Branching factor of the layout
+        int width;
+
+        // Binary tree size, num_references exceeds the number of triangles with spatial splits
+        int num_nodes;
+        int num_leaves;
+        int num_references;
+        // Longest root to leaf path, the root has depth 0
+        int max_depth;
+        // Surface area heuristic cost, negative if the binary tree is not available
+        // (GPU accelerators mapping a cached BVH)
+        float sah_cost;
+        // End-point overlap, "On Quality Metrics of Bounding Volume Hierarchies" (Aila et al. 2013),
+        // weighted like SAH cost and normalized by the total triangle area.
+        // Negative unless "bvh.statistics.epo" is enabled, it costs more than the build.
+        float epo;
+        // leaf_sizes[i] is the number of leaves with i primitives, the last bin also counts larger leaves
+        int leaf_sizes[kLeafSizeBins];
+        // leaf_depths[i] is the number of leaves at depth i, the last bin also counts deeper leaves
+        int leaf_depths[kDepthBins];
+
+        // Memory of the binary tree as built (nodes and primitive indices) and of everything
+        // the device traverses after translation (nodes and primitive data), bytes
+        std::uint64_t bvh_bytes;
+        std::uint64_t layout_bytes;
+
+        // Build phase timings, milliseconds. build_ms is the BVH cache lookup if cached is set.
+        float build_ms;
+        float optimize_ms;
+        float translate_ms;
+        // Tree has been mapped from the BVH cache ("bvh.cache_path") instead of built
+        bool cached;
+    };
+
     // IntersectionApi is designed to provide fast means for ray-scene intersection
     // for AMD architectures. It effectively absracts underlying AMD hardware and
     // software stack and allows user to issue low-latency batched ray queries.
@@ -182,6 +270,7 @@ namespace RadeonRays
         // if you prefer to specify which platform call SetPlatform before 
         // GetDeviceInfo/GetDeviceCount for each specific platform
         // By default will choose OpenCL if available, and if not Vulkan
+        // Embree (if compiled in) and native CPU devices are enumerated after GPU ones
         // Note: this may be sub optimal in some case. to avoid enum all devices
         // across all platforms explicitly before deciding on platform and 
         // device(s) to use
@@ -295,6 +384,26 @@ namespace RadeonRays
         //         (overlap area which is considered for a spatial splits, fraction of parent bbox)
         // option "bvh.sah.max_split_depth" values {int, default = 10} (max depth in the tree where spatial split can happen)
         // option "bvh.sah.extra_node_budget" values {float, default = 1.f} (maximum node memory budget compared to normal bvh (2*num_tris - 1), for ex. 0.3 = 30% more nodes allowed
+        // option "bvh.max_leaf_size" values {int in [1, 15], default = 1} (maximum number of triangles per leaf,
+        //         with "sah" builder leaves are only created if they are cheaper than the best split)
+        // option "bvh.optimize" values {int, default = 0} (number of treelet restructuring passes run after the build,
+        //         0 disables, 3 gets most of the SAH gain for "median" builds)
+        // option "bvh.width" values {2, 4 (default), 8} (native CPU device only: collapse the binary BVH into
+        //         4 or 8 wide nodes tested with SSE/AVX, 2 traverses the binary BVH)
+        // option "bvh.reinsertion.time_budget" values {float, default = 0.f} (milliseconds spent reinserting
+        //         inefficient nodes after the build, 0 disables, GPU "bvh" accelerators only)
+        // option "bvh.cache_path" values {string, default = "" (disabled)} (existing directory for built BVHs keyed by
+        //         geometry and build options, later commits of the same scene map them instead of building,
+        //         native CPU device and GPU "bvh"/"fatbvh" accelerators only)
+        // option "kernel.cache_path" values {string, default = "" (disabled)} (existing directory for compiled OpenCL
+        //         kernel binaries keyed by source, build options and device, read when the first commit creates the intersector)
+        // option "bvh.statistics.epo" values {0(default), 1} (compute end-point overlap of committed BVHs for GetBvhStatistics,
+        //         roughly as expensive as the build, native CPU device and GPU "bvh"/"fatbvh"/"hlbvh" accelerators only)
+        // option "embree.packet_width" values {0 (default), 4, 8, 16} (Embree device only: rays per rtcIntersect/rtcOccluded
+        //         packet, clamped to what the host ISA supports, 0 picks the widest: 16 with AVX-512, 8 with AVX)
+        // option "embree.task_size" values {int, default = 256} (Embree device only: rays processed by a single task)
+        // option "embree.stream" values {0(default), 1} (Embree device only: trace whole queries with rtcIntersectN/rtcOccludedN,
+        //         packets are used if the Embree build has no stream support)
         // Set API global option: string
         virtual void SetOption(char const* name, char const* value) = 0;
         // Set API global option: float
@@ -306,6 +415,58 @@ namespace RadeonRays
         IntersectionApi& operator = (IntersectionApi const&);
 
         virtual ~IntersectionApi() = 0;
+
+    public:
+        /******************************************
+        API 2.1 additions
+        ******************************************/
+        // Declared after the 2.0 entry points so their vtable slots keep their positions.
+
+        // Create nummeshes meshes at once, shapes[i] receives the mesh for descs[i].
+        // Meshes are loaded in parallel, which makes the call much cheaper than
+        // a CreateMesh call per mesh for scenes with many small meshes.
+        // The call is blocking, so the returned values are ready upon return.
+        // Meshes created by one call share a single vertex and face allocation, which is only
+        // freed when the last of them is deleted. Deleting part of a batch does not free memory,
+        // so meshes with different lifetimes should be created by separate calls.
+        virtual void CreateMeshes(MeshDesc const* descs, int nummeshes, Shape** shapes) const = 0;
+
+        // Create a triangle mesh referencing vertex and index data in place instead of copying it.
+        // The memory is owned by the caller and has to stay valid and unchanged until the mesh
+        // is deleted with DeleteShape. Strides are in bytes, 0 means dense packing.
+        // Devices building their own acceleration structures still keep copies of their own.
+        // The call is blocking, so the returned value is ready upon return.
+        virtual Shape* CreateMeshFromExternalMemory(
+            // Position data
+            float const * vertices, int vnum, int vstride,
+            // Index data for vertices, 3 per face
+            int const * indices, int istride,
+            // Number of faces
+            int  numfaces
+            ) const = 0;
+
+        // Commit all geometry creations/changes without blocking, acceleration structures are
+        // built in the background where the device supports it (native CPU device).
+        // Queries keep using the previous commit until event is complete, later queries use the new one.
+        // Shapes may be changed, attached, detached or deleted right away, the build uses their
+        // state at the time of the call. If event is nullptr the call blocks like Commit.
+        // A failed build is reported by the event, queries keep the previous commit and the next commit builds again.
+        virtual void CommitAsync(Event** event) = 0;
+
+        // Find closest intersection for rays in SoA layout
+        // Only supported by CPU devices (native and Embree).
+        // The call is asynchronous. Event pointers might be nullptrs.
+        virtual void QueryIntersection(RayBufferSoA const& rays, int numrays, Buffer* hitinfos, Event const* waitevent, Event** event) const = 0;
+        // Find any intersection for rays in SoA layout
+        // Only supported by CPU devices (native and Embree).
+        // The call is asynchronous. Event pointers might be nullptrs.
+        virtual void QueryOcclusion(RayBufferSoA const& rays, int numrays, Buffer* hitresults, Event const* waitevent, Event** event) const = 0;
+
+        // Get statistics of the acceleration structure new queries use, after CommitAsync
+        // it describes the previous commit until the event is complete.
+        // Throws if nothing has been committed or the device does not support it
+        // (native CPU device and GPU "bvh"/"fatbvh"/"hlbvh" accelerators, but not 2-level BVHs).
+        virtual void GetBvhStatistics(BvhStatistics& stats) const = 0;
     };
 
     inline IntersectionApi::IntersectionApi(){}
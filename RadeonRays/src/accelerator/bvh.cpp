@@ -20,6 +20,9 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 ********************************************************************/
 #include "bvh.h"
+#include "bvh_statistics.h"
+#include "reinsertion_optimizer.h"
+#include "../async/thread_pool.h"
 
 #include <algorithm>
 #include <thread>
@@ -27,15 +30,34 @@ THE SOFTWARE.
 #include <numeric>
 #include <cassert>
 #include <vector>
-#include <future>
 
 namespace RadeonRays
 {
-    static int constexpr kMaxPrimitivesPerLeaf = 1;
+    // Subtrees with at least that many primitives are built on a separate thread
+    static int constexpr kParallelBuildThreshold = 4096;
+    // Nodes with at least that many primitives are binned on several threads
+    static int constexpr kParallelBinningThreshold = 65536;
 
-    static bool is_nan(float v)
+    // Same as bbox::surface_area for a box in SSE registers
+    static inline float SurfaceArea(__m128 pmin, __m128 pmax)
     {
-        return v != v;
+        alignas(16) float ext[4];
+        _mm_store_ps(ext, _mm_sub_ps(pmax, pmin));
+        return 2.f * (ext[0] * ext[1] + ext[0] * ext[2] + ext[1] * ext[2]);
+    }
+
+    int Bvh::GetMaxForkLevel()
+    {
+        static int const max_fork_level = []()
+        {
+            int num_threads = std::max(1u, std::thread::hardware_concurrency());
+            int level = 1;
+            while ((1 << level) < num_threads) ++level;
+            // Oversubscribe a bit to balance uneven subtrees
+            return level + 1;
+        }();
+
+        return max_fork_level;
     }
 
     void Bvh::Build(bbox const* bounds, int numbounds)
@@ -49,6 +71,113 @@ namespace RadeonRays
         BuildImpl(bounds, numbounds);
     }
 
+    void Bvh::Optimize(int num_passes)
+    {
+        if (!m_root || num_passes <= 0)
+        {
+            return;
+        }
+
+        std::vector<Node*> nodes;
+        std::vector<TreeletOptimizer::Node> flat;
+        Flatten(nodes, flat);
+
+        TreeletOptimizer optimizer(m_traversal_cost);
+        if (optimizer.Optimize(flat, 0, num_passes) > 0)
+        {
+            Relink(nodes, flat, 0);
+        }
+    }
+
+    void Bvh::OptimizeReinsertion(float time_budget)
+    {
+        if (!m_root || time_budget <= 0.f)
+        {
+            return;
+        }
+
+        std::vector<Node*> nodes;
+        std::vector<TreeletOptimizer::Node> flat;
+        Flatten(nodes, flat);
+
+        ReinsertionOptimizer optimizer(time_budget);
+        int root = optimizer.Optimize(flat, 0);
+        Relink(nodes, flat, root);
+    }
+
+    void Bvh::Flatten(std::vector<Node*>& nodes, std::vector<TreeletOptimizer::Node>& flat) const
+    {
+        // Flat node i maps to nodes[i], root goes first
+        std::vector<std::pair<Node*, int>> stack;
+        stack.push_back(std::make_pair(m_root, -1));
+
+        while (!stack.empty())
+        {
+            auto node = stack.back().first;
+            auto parent = stack.back().second;
+            stack.pop_back();
+
+            int idx = static_cast<int>(flat.size());
+            TreeletOptimizer::Node flatnode = { node->bounds, parent, -1, -1, node->type == kLeaf ? node->numprims : 0 };
+            flat.push_back(flatnode);
+            nodes.push_back(node);
+
+            if (parent != -1)
+            {
+                // Left child is popped first
+                (flat[parent].left == -1 ? flat[parent].left : flat[parent].right) = idx;
+            }
+
+            if (node->type == kInternal)
+            {
+                stack.push_back(std::make_pair(node->rc, idx));
+                stack.push_back(std::make_pair(node->lc, idx));
+            }
+        }
+    }
+
+    void Bvh::Relink(std::vector<Node*> const& nodes, std::vector<TreeletOptimizer::Node> const& flat, int root)
+    {
+        for (std::size_t i = 0; i < flat.size(); ++i)
+        {
+            if (flat[i].left != -1)
+            {
+                nodes[i]->bounds = flat[i].bounds;
+                nodes[i]->lc = nodes[flat[i].left];
+                nodes[i]->rc = nodes[flat[i].right];
+            }
+        }
+
+        m_root = nodes[root];
+
+        // Node indices in a complete tree and height have changed
+        struct Entry
+        {
+            Node* node;
+            int index;
+            int level;
+        };
+
+        std::vector<Entry> entries;
+        entries.push_back({ m_root, 1, 0 });
+        m_height = 0;
+
+        while (!entries.empty())
+        {
+            auto entry = entries.back();
+            entries.pop_back();
+
+            entry.node->index = entry.index;
+            m_height = std::max(m_height, entry.level);
+
+            if (entry.node->type == kInternal)
+            {
+                entries.push_back({ entry.node->lc, entry.index << 1, entry.level + 1 });
+                entries.push_back({ entry.node->rc, (entry.index << 1) + 1, entry.level + 1 });
+            }
+        }
+    }
+
     bbox const& Bvh::Bounds() const
     {
         return m_bounds;
@@ -62,34 +191,28 @@ namespace RadeonRays
 
     Bvh::Node* Bvh::AllocateNode()
     {
-        return &m_nodes[m_nodecnt++];
+        // Nodes are preallocated, so concurrent builders only bump the counter
+        int idx = m_nodecnt.fetch_add(1, std::memory_order_relaxed);
+        assert(idx < (int)m_nodes.size());
+        return &m_nodes[idx];
     }
 
-    void Bvh::BuildNode(SplitRequest const& req, bbox const* bounds, float3 const* centroids, int* primindices)
+    int Bvh::BuildNode(SplitRequest const& req, bbox const* bounds, float3 const* centroids, int* primindices)
     {
-        m_height = std::max(m_height, req.level);
-
         Node* node = AllocateNode();
         node->bounds = req.bounds;
         node->index = req.index;
 
-        // Create leaf node if we have enough prims
-        if (req.numprims < 2)
+        int height = req.level;
+
+        // Leaves reference their own range of primindices, so
+        // no shared state has to be touched here.
+        // SAH builds decide on leaf size below, comparing against split cost
+        if (req.numprims < 2 || (!m_usesah && req.numprims <= m_max_leaf_size))
         {
-#ifdef USE_TBB
-            primitive_mutex_.lock();
-#endif
             node->type = kLeaf;
-            node->startidx = static_cast<int>(m_packed_indices.size());
+            node->startidx = req.startidx;
             node->numprims = req.numprims;
-
-            for (auto i = 0U; i < req.numprims; ++i)
-            {
-                m_packed_indices.push_back(primindices[req.startidx + i]);
-            }
-#ifdef USE_TBB
-            primitive_mutex_.unlock();
-#endif
         }
         else
         {
@@ -101,25 +224,23 @@ namespace RadeonRays
             {
                 SahSplit ss = FindSahSplit(req, bounds, centroids, primindices);
 
+                // Intersecting the whole leaf costs numprims (SAH is normalized to
+                // triangle cost). Also stop if the primitives can't be binned at all.
+                if (req.numprims <= m_max_leaf_size &&
+                    (is_nan(ss.split) || req.numprims <= ss.sah))
+                {
+                    node->type = kLeaf;
+                    node->startidx = req.startidx;
+                    node->numprims = req.numprims;
+
+                    if (req.ptr) *req.ptr = node;
+                    return req.level;
+                }
+
                 if (!is_nan(ss.split))
                 {
                     axis = ss.dim;
                     border = ss.split;
-
-                    if (req.numprims < ss.sah && req.numprims < kMaxPrimitivesPerLeaf)
-                    {
-                        node->type = kLeaf;
-                        node->startidx = static_cast<int>(m_packed_indices.size());
-                        node->numprims = req.numprims;
-
-                        for (auto i = 0U; i < req.numprims; ++i)
-                        {
-                            m_packed_indices.push_back(primindices[req.startidx + i]);
-                        }
-
-                        if (req.ptr) *req.ptr = node;
-                        return;
-                    }
                 }
             }
 
@@ -228,25 +349,39 @@ namespace RadeonRays
             // Right request
             SplitRequest rightrequest = { splitidx, req.numprims - (splitidx - req.startidx), &node->rc, rightbounds, rightcentroid_bounds, req.level + 1, (req.index << 1) + 1 };
 
+            // Children work on disjoint primindices ranges, so large
+            // subtrees are forked while the current thread takes the other one
+            if (m_parallel_build && req.numprims >= kParallelBuildThreshold && req.level < GetMaxForkLevel())
             {
-                // Put those to stack
-                BuildNode(leftrequest, bounds, centroids, primindices);
-            }
+                int leftheight = 0;
+                task_group left;
+                left.run([&]()
+                {
+                    leftheight = BuildNode(leftrequest, bounds, centroids, primindices);
+                });
 
+                int rightheight = BuildNode(rightrequest, bounds, centroids, primindices);
+                left.wait();
+                height = std::max(leftheight, rightheight);
+            }
+            else
             {
-                BuildNode(rightrequest, bounds, centroids, primindices);
+                int leftheight = BuildNode(leftrequest, bounds, centroids, primindices);
+                int rightheight = BuildNode(rightrequest, bounds, centroids, primindices);
+                height = std::max(leftheight, rightheight);
             }
         }
 
         // Set parent ptr if any
         if (req.ptr) *req.ptr = node;
+
+        return height;
     }
 
     Bvh::SahSplit Bvh::FindSahSplit(SplitRequest const& req, bbox const* bounds, float3 const* centroids, int* primindices) const
     {
         // SAH implementation
         // calc centroids histogram
-        // int const kNumBins = 128;
         // moving split bin index
         int splitidx = -1;
         // Set SAH to maximum float value as a start
@@ -265,77 +400,108 @@ namespace RadeonRays
             return split;
         }
 
-        // Bin has bbox and occurence count
-        struct Bin
-        {
-            bbox bounds;
-            int count;
-        };
+        int const num_bins = m_num_bins;
 
-        // Keep bins for each dimension
-        std::vector<Bin> bins[3];
-        bins[0].resize(m_num_bins);
-        bins[1].resize(m_num_bins);
-        bins[2].resize(m_num_bins);
+        // Bins for all three axes laid out one after another,
+        // reused across calls on the same thread. They must not be held
+        // across task_group::wait(): a waiting thread runs queued tasks,
+        // which can be subtree builds calling FindSahSplit on this thread
+        thread_local SahBinArray bins;
+        thread_local std::vector<float> rightareas;
 
         // Precompute inverse parent area
         float invarea = 1.f / req.bounds.surface_area();
         // Precompute min point
         float3 rootmin = req.centroid_bounds.pmin;
 
-        // Evaluate all dimensions
-        for (int axis = 0; axis < 3; ++axis)
+        // Degenerate axes get zero scale, all their primitives fall into bin 0
+        // and the axis is skipped during evaluation
+        float3 invcentroid_rng(
+            centroid_extents.x > 0.f ? 1.f / centroid_extents.x : 0.f,
+            centroid_extents.y > 0.f ? 1.f / centroid_extents.y : 0.f,
+            centroid_extents.z > 0.f ? 1.f / centroid_extents.z : 0.f);
+
+        auto const binmin = _mm_set_ps(0.f, rootmin.z, rootmin.y, rootmin.x);
+        auto const bininvrng = _mm_set_ps(0.f, invcentroid_rng.z, invcentroid_rng.y, invcentroid_rng.x);
+
+        if (m_parallel_build && req.numprims >= kParallelBinningThreshold)
         {
-            float rootminc = rootmin[axis];
-            // Range for histogram
-            float centroid_rng = centroid_extents[axis];
-            float invcentroid_rng = 1.f / centroid_rng;
+            // Bin chunks of primitives into private arrays on separate threads and merge them
+            int num_chunks = std::min<int>(std::max(1u, std::thread::hardware_concurrency()), req.numprims / (kParallelBinningThreshold / 4));
+            int chunk_size = (req.numprims + num_chunks - 1) / num_chunks;
 
-            // If the box is degenerate in that dimension skip it
-            if (centroid_rng == 0.f) continue;
+            // The first chunk is binned by this thread, but into a private array
+            // as well, bins are only touched once the wait is over
+            std::vector<SahBinArray> chunk_bins(num_chunks);
+            task_group jobs;
 
-            // Initialize bins
-            for (unsigned i = 0; i < m_num_bins; ++i)
+            for (int c = 1; c < num_chunks; ++c)
             {
-                bins[axis][i].count = 0;
-                bins[axis][i].bounds = bbox();
+                int begin = req.startidx + c * chunk_size;
+                int end = std::min(begin + chunk_size, req.startidx + req.numprims);
+                auto chunk = &chunk_bins[c];
+
+                jobs.run([=]()
+                {
+                    chunk->resize(3 * num_bins);
+                    BinPrimitives(begin, end, bounds, centroids, primindices, binmin, bininvrng, num_bins, chunk->data());
+                });
             }
 
-            // Calc primitive refs histogram
-            for (int i = req.startidx; i < req.startidx + req.numprims; ++i)
-            {
-                int idx = primindices[i];
-                int binidx = (int)std::min<float>(m_num_bins * ((centroids[idx][axis] - rootminc) * invcentroid_rng), m_num_bins - 1);
+            chunk_bins[0].resize(3 * num_bins);
+            BinPrimitives(req.startidx, req.startidx + chunk_size, bounds, centroids, primindices, binmin, bininvrng, num_bins, chunk_bins[0].data());
+
+            jobs.wait();
 
-                ++bins[axis][binidx].count;
-                bins[axis][binidx].bounds.grow(bounds[idx]);
+            bins.assign(chunk_bins[0].begin(), chunk_bins[0].end());
+            for (int c = 1; c < num_chunks; ++c)
+            {
+                MergeBins(chunk_bins[c].data(), 3 * num_bins, bins.data());
             }
+        }
+        else
+        {
+            bins.resize(3 * num_bins);
+            BinPrimitives(req.startidx, req.startidx + req.numprims, bounds, centroids, primindices, binmin, bininvrng, num_bins, bins.data());
+        }
+
+        rightareas.resize(num_bins);
+
+        // Evaluate all dimensions
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            // If the box is degenerate in that dimension skip it
+            if (centroid_extents[axis] == 0.f) continue;
 
-            std::vector<bbox> rightbounds(m_num_bins - 1);
+            SahBin const* axisbins = &bins[axis * num_bins];
 
             // Start with 1-bin right box
-            bbox rightbox = bbox();
-            for (int i = m_num_bins - 1; i > 0; --i)
+            auto rightmin = _mm_set1_ps(std::numeric_limits<float>::max());
+            auto rightmax = _mm_set1_ps(-std::numeric_limits<float>::max());
+            for (int i = num_bins - 1; i > 0; --i)
             {
-                rightbox.grow(bins[axis][i].bounds);
-                rightbounds[i - 1] = rightbox;
+                rightmin = _mm_min_ps(rightmin, axisbins[i].pmin);
+                rightmax = _mm_max_ps(rightmax, axisbins[i].pmax);
+                rightareas[i - 1] = SurfaceArea(rightmin, rightmax);
             }
 
-            bbox leftbox = bbox();
+            auto leftmin = _mm_set1_ps(std::numeric_limits<float>::max());
+            auto leftmax = _mm_set1_ps(-std::numeric_limits<float>::max());
             int  leftcount = 0;
             int  rightcount = req.numprims;
 
             // Start best SAH search
             // i is current split candidate (split between i and i + 1)
             float sahtmp = 0.f;
-            for (int i = 0; i < m_num_bins - 1; ++i)
+            for (int i = 0; i < num_bins - 1; ++i)
             {
-                leftbox.grow(bins[axis][i].bounds);
-                leftcount += bins[axis][i].count;
-                rightcount -= bins[axis][i].count;
+                leftmin = _mm_min_ps(leftmin, axisbins[i].pmin);
+                leftmax = _mm_max_ps(leftmax, axisbins[i].pmax);
+                leftcount += axisbins[i].count;
+                rightcount -= axisbins[i].count;
 
                 // Compute SAH
-                sahtmp = m_traversal_cost + (leftcount * leftbox.surface_area() + rightcount * rightbounds[i].surface_area()) * invarea;
+                sahtmp = m_traversal_cost + (leftcount * SurfaceArea(leftmin, leftmax) + rightcount * rightareas[i]) * invarea;
 
                 // Check if it is better than what we found so far
                 if (sahtmp < sah)
@@ -350,12 +516,71 @@ namespace RadeonRays
         // Choose split plane
         if (splitidx != -1)
         {
-            split.split = rootmin[split.dim] + (splitidx + 1) * (centroid_extents[split.dim] / m_num_bins);
+            split.split = rootmin[split.dim] + (splitidx + 1) * (centroid_extents[split.dim] / num_bins);
         }
 
         return split;
     }
 
+    void Bvh::BinPrimitives(int begin, int end, bbox const* bounds, float3 const* centroids, int const* primindices, __m128 binmin, __m128 bininvrng, int num_bins, SahBin* bins)
+    {
+        auto const flt_max = _mm_set1_ps(std::numeric_limits<float>::max());
+        auto const neg_flt_max = _mm_set1_ps(-std::numeric_limits<float>::max());
+
+        for (int i = 0; i < 3 * num_bins; ++i)
+        {
+            bins[i].pmin = flt_max;
+            bins[i].pmax = neg_flt_max;
+            bins[i].count = 0;
+        }
+
+        auto const numbins = _mm_set1_ps(static_cast<float>(num_bins));
+        auto const maxbin = _mm_set1_ps(static_cast<float>(num_bins - 1));
+
+        SahBin* xbins = bins;
+        SahBin* ybins = bins + num_bins;
+        SahBin* zbins = bins + 2 * num_bins;
+
+        // Calc primitive refs histogram for all axes at once
+        for (int i = begin; i < end; ++i)
+        {
+            int idx = primindices[i];
+
+            auto const pmin = _mm_loadu_ps(&bounds[idx].pmin.x);
+            auto const pmax = _mm_loadu_ps(&bounds[idx].pmax.x);
+            auto const c = _mm_loadu_ps(&centroids[idx].x);
+
+            // Same as min(num_bins * ((c - min) * invrng), num_bins - 1) per axis
+            auto const binf = _mm_min_ps(_mm_mul_ps(numbins, _mm_mul_ps(_mm_sub_ps(c, binmin), bininvrng)), maxbin);
+            alignas(16) int binidx[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(binidx), _mm_cvttps_epi32(binf));
+
+            SahBin& bx = xbins[binidx[0]];
+            SahBin& by = ybins[binidx[1]];
+            SahBin& bz = zbins[binidx[2]];
+
+            bx.pmin = _mm_min_ps(bx.pmin, pmin);
+            bx.pmax = _mm_max_ps(bx.pmax, pmax);
+            ++bx.count;
+            by.pmin = _mm_min_ps(by.pmin, pmin);
+            by.pmax = _mm_max_ps(by.pmax, pmax);
+            ++by.count;
+            bz.pmin = _mm_min_ps(bz.pmin, pmin);
+            bz.pmax = _mm_max_ps(bz.pmax, pmax);
+            ++bz.count;
+        }
+    }
+
+    void Bvh::MergeBins(SahBin const* src, int count, SahBin* dst)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            dst[i].pmin = _mm_min_ps(dst[i].pmin, src[i].pmin);
+            dst[i].pmax = _mm_max_ps(dst[i].pmax, src[i].pmax);
+            dst[i].count += src[i].count;
+        }
+    }
+
     void Bvh::BuildImpl(bbox const* bounds, int numbounds)
     {
         // Structure describing split request
@@ -484,7 +709,10 @@ namespace RadeonRays
             if (req.ptr) *req.ptr = node;
         }
 #else
-        BuildNode(init, bounds, &centroids[0], &m_indices[0]);
+        m_height = BuildNode(init, bounds, &centroids[0], &m_indices[0]);
+
+        // Leaves point straight into partitioned indices
+        m_packed_indices = m_indices;
 #endif
 
         // Set root_ pointer
@@ -496,9 +724,44 @@ namespace RadeonRays
         os << "Class name: " << "Bvh\n";
         os << "SAH: " << (m_usesah ? "enabled\n" : "disabled\n");
         os << "SAH bins: " << m_num_bins << "\n";
+        os << "Max leaf size: " << m_max_leaf_size << "\n";
         os << "Number of triangles: " << m_indices.size() << "\n";
         os << "Number of nodes: " << m_nodecnt << "\n";
         os << "Tree height: " << GetHeight() << "\n";
     }
 
+    void Bvh::GetStatistics(BvhStatistics& stats, float3 const* triangles) const
+    {
+        std::vector<Node*> nodes;
+        std::vector<TreeletOptimizer::Node> flat;
+
+        if (m_root)
+        {
+            Flatten(nodes, flat);
+        }
+
+        BvhStatisticsCollector::Collect(flat, 0, stats);
+        stats.bvh_bytes = m_nodecnt * sizeof(Node) + m_packed_indices.size() * sizeof(int);
+
+        if (triangles && m_root)
+        {
+            // Leaves reference ranges of packed indices
+            std::vector<int> first(flat.size(), 0);
+            for (std::size_t i = 0; i < flat.size(); ++i)
+            {
+                if (flat[i].left == -1)
+                {
+                    first[i] = nodes[i]->startidx;
+                }
+            }
+
+            std::vector<float3> leaf_triangles(3 * m_packed_indices.size());
+            for (std::size_t i = 0; i < m_packed_indices.size(); ++i)
+            {
+                std::copy(triangles + 3 * m_packed_indices[i], triangles + 3 * m_packed_indices[i] + 3, &leaf_triangles[3 * i]);
+            }
+
+            stats.epo = BvhStatisticsCollector::CalculateEpo(flat, 0, first, leaf_triangles);
+        }
+    }
 }
@@ -27,27 +27,39 @@ THE SOFTWARE.
 #include <list>
 #include <atomic>
 #include <iostream>
-
+#include <algorithm>
+#include <xmmintrin.h>
+#include <smmintrin.h>
 
 #include "math/bbox.h"
+#include "../util/alignedalloc.h"
+#include "treelet_optimizer.h"
 
 namespace RadeonRays
 {
+    struct BvhStatistics;
+
     ///< The class represents bounding volume hierarachy
     ///< intersection accelerator
     ///<
     class Bvh
     {
     public:
-        Bvh(float traversal_cost, int num_bins = 64, bool usesah = false)
+        // Leaf size is clamped to [1, kMaxLeafSize]
+        Bvh(float traversal_cost, int num_bins = 64, bool usesah = false, int max_leaf_size = 1)
             : m_root(nullptr)
             , m_num_bins(num_bins)
             , m_usesah(usesah)
             , m_height(0)
             , m_traversal_cost(traversal_cost)
+            , m_max_leaf_size(std::min(std::max(max_leaf_size, 1), static_cast<int>(kMaxLeafSize)))
+            , m_parallel_build(true)
         {
         }
 
+        // Upper limit for primitives per leaf (leaf encodings reserve 4 bits for the count)
+        static int constexpr kMaxLeafSize = 15;
+
         ~Bvh();
 
         // World space bounding box
@@ -57,6 +69,18 @@ namespace RadeonRays
         // bounds is an array of bounding boxes
         void Build(bbox const* bounds, int numbounds);
 
+        // Build subtrees and bin large nodes on the shared scheduler (default),
+        // the resulting tree is the same either way
+        void SetParallelBuild(bool parallel) { m_parallel_build = parallel; }
+
+        // Post-build treelet restructuring (see TreeletOptimizer),
+        // relinks internal nodes to lower SAH cost, leaves are kept as is
+        void Optimize(int num_passes);
+
+        // Post-build node reinsertion (see ReinsertionOptimizer),
+        // runs for up to time_budget milliseconds
+        void OptimizeReinsertion(float time_budget);
+
         // Get tree height
         int GetHeight() const;
 
@@ -70,6 +94,11 @@ namespace RadeonRays
 
         // Print BVH statistics
         virtual void PrintStatistics(std::ostream& os) const;
+
+        // Fill tree metrics and bvh_bytes of stats (see BvhStatisticsCollector).
+        // End-point overlap needs triangles, 3 vertices per primitive in the order of
+        // the bounds passed to Build, it is skipped if triangles is nullptr.
+        void GetStatistics(BvhStatistics& stats, float3 const* triangles) const;
     protected:
         // Build function
         virtual void BuildImpl(bbox const* bounds, int numbounds);
@@ -105,10 +134,34 @@ namespace RadeonRays
             float overlap;
         };
 
-        void BuildNode(SplitRequest const& req, bbox const* bounds, float3 const* centroids, int* primindices);
+        // Flat view of the tree for optimizers, flat node i maps to nodes[i]
+        void Flatten(std::vector<Node*>& nodes, std::vector<TreeletOptimizer::Node>& flat) const;
+        // Write optimized links and bounds back, update root, indices and height
+        void Relink(std::vector<Node*> const& nodes, std::vector<TreeletOptimizer::Node> const& flat, int root);
+
+        // Limit fork depth so the number of build threads stays close to hardware concurrency
+        static int GetMaxForkLevel();
+
+        // Build subtree for the request, returns its height
+        int BuildNode(SplitRequest const& req, bbox const* bounds, float3 const* centroids, int* primindices);
+
+        // SAH bin: bounds of binned primitives and their count
+        struct SahBin
+        {
+            __m128 pmin;
+            __m128 pmax;
+            int count;
+        };
+
+        using SahBinArray = std::vector<SahBin, aligned_allocator<SahBin, 16>>;
 
         SahSplit FindSahSplit(SplitRequest const& req, bbox const* bounds, float3 const* centroids, int* primindices) const;
 
+        // Reset bins (3 axes * num_bins) and fill them with primitives from [begin, end)
+        static void BinPrimitives(int begin, int end, bbox const* bounds, float3 const* centroids, int const* primindices, __m128 binmin, __m128 bininvrng, int num_bins, SahBin* bins);
+        // Accumulate count bins from src into dst
+        static void MergeBins(SahBin const* src, int count, SahBin* dst);
+
         // Enum for node type
         enum NodeType
         {
@@ -138,6 +191,10 @@ namespace RadeonRays
         float m_traversal_cost;
         // Number of spatial bins to use for SAH
         int m_num_bins;
+        // Maximum number of primitives in a leaf
+        int m_max_leaf_size;
+        // Use the scheduler for the build
+        bool m_parallel_build;
 
 
     private:
@@ -146,6 +203,7 @@ namespace RadeonRays
 
         friend class PlainBvhTranslator;
         friend class FatNodeBvhTranslator;
+        template <int W> friend class WideBvhTranslator;
     };
 
     struct Bvh::Node
@@ -20,9 +20,10 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 ********************************************************************/
 #include "bvh2.h"
+#include "bvh_statistics.h"
+#include "../async/thread_pool.h"
 
-#include <atomic>
-#include <mutex>
+#include <functional>
 #include <numeric>
 
 #define PARALLEL_BUILD
@@ -120,6 +121,17 @@ namespace RadeonRays
                point[2] <= aabb_max[2];
     }
 
+    // Minimum number of levels below a node with num_refs primitives,
+    // reached by splitting them in half down to single primitives
+    inline
+    std::uint32_t min_subtree_depth(std::size_t num_refs)
+    {
+        std::uint32_t depth = 0u;
+        while ((std::size_t(1) << depth) < num_refs)
+            ++depth;
+        return depth;
+    }
+
     struct Bvh2::SplitRequest
     {
         __m128 aabb_min;
@@ -134,13 +146,29 @@ namespace RadeonRays
 
     void Bvh2::Clear()
     {
-        for (auto i = 0u; i < m_nodecount; ++i)
-            m_nodes[i].~Node();
-        Deallocate(m_nodes);
+        if (m_storage)
+        {
+            m_storage.reset();
+        }
+        else
+        {
+            for (auto i = 0u; i < m_nodecount; ++i)
+                m_nodes[i].~Node();
+            Deallocate(m_nodes);
+        }
         m_nodes = nullptr;
         m_nodecount = 0;
     }
 
+    void Bvh2::Assign(Node* nodes, std::size_t nodecount, std::shared_ptr<void> storage)
+    {
+        Clear();
+
+        m_nodes = nodes;
+        m_nodecount = nodecount;
+        m_storage = std::move(storage);
+    }
+
     void Bvh2::BuildImpl(
         __m128 scene_min,
         __m128 scene_max,
@@ -217,114 +245,70 @@ namespace RadeonRays
             }
         }
 #else
-        // Parallel build variables
-        // Global requests stack
-        std::stack<SplitRequest> requests;
-        // Condition to wait on the global stack
-        std::condition_variable cv;
-        // Mutex to guard cv
-        std::mutex mutex;
-        // Indicates if we need to shutdown all the threads
-        std::atomic<bool> shutdown;
-        // Number of primitives processed so far
-        std::atomic<std::uint32_t> num_refs_processed;
-
-		num_refs_processed.store(0);
-		shutdown.store(false);
-
-        requests.push(SplitRequest{
-            scene_min,
-            scene_max,
-            centroid_scene_min,
-            centroid_scene_max,
-            0,
-            num_aabbs,
-            0u,
-            0u
-        });
+        // Subtrees larger than this are built by separate tasks
+        std::size_t constexpr kParallelSubtreeSize = 4096u;
 
-        auto worker_thread = [&]()
+        // Build the subtree of request, the right child of a large
+        // split becomes a task of its own, the rest is built in place.
+        // Declared before the group, whose destructor waits for the tasks using it
+        std::function<void(SplitRequest const&)> build_subtree;
+        task_group tasks;
+
+        build_subtree = [&](SplitRequest const& root)
         {
-            thread_local std::stack<SplitRequest> local_requests;
+            std::stack<SplitRequest> local_requests;
+            local_requests.push(root);
 
-            for (;;)
+            _MM_ALIGN16 SplitRequest request;
+            _MM_ALIGN16 SplitRequest request_left;
+            _MM_ALIGN16 SplitRequest request_right;
+
+            while (!local_requests.empty())
             {
-                // Wait for signal
+                request = local_requests.top();
+                local_requests.pop();
+
+                auto node_type = HandleRequest(
+                    request,
+                    aabb_min,
+                    aabb_max,
+                    aabb_centroid,
+                    metadata,
+                    refs,
+                    num_aabbs,
+                    request_left,
+                    request_right);
+
+                if (node_type == kLeaf)
                 {
-                    std::unique_lock<std::mutex> lock(mutex);
-                    cv.wait(lock, [&]() { return !requests.empty() || shutdown; });
-
-                    if (shutdown) return;
-
-                    local_requests.push(requests.top());
-                    requests.pop();
+                    continue;
                 }
 
-                _MM_ALIGN16 SplitRequest request;
-                _MM_ALIGN16 SplitRequest request_left;
-                _MM_ALIGN16 SplitRequest request_right;
-
-                // Process local requests
-                while (!local_requests.empty())
+                if (request_right.num_refs > kParallelSubtreeSize)
                 {
-                    request = local_requests.top();
-                    local_requests.pop();
-
-                    auto node_type = HandleRequest(
-                        request,
-                        aabb_min,
-                        aabb_max,
-                        aabb_centroid,
-                        metadata,
-                        refs,
-                        num_aabbs,
-                        request_left,
-                        request_right);
-
-                    if (node_type == kLeaf)
-                    {
-                        num_refs_processed += static_cast<std::uint32_t>(request.num_refs);
-                        continue;
-                    }
-
-                    if (request_right.num_refs > 4096u)
-                    {
-                        std::unique_lock<std::mutex> lock(mutex);
-                        requests.push(request_right);
-                        cv.notify_one();
-                    }
-                    else
-                    {
-                        local_requests.push(request_right);
-                    }
-
-                    local_requests.push(request_left);
+                    tasks.run([&build_subtree, request_right]() { build_subtree(request_right); });
                 }
+                else
+                {
+                    local_requests.push(request_right);
+                }
+
+                local_requests.push(request_left);
             }
         };
 
-        auto num_threads = std::thread::hardware_concurrency();
-        std::vector<std::thread> threads(num_threads);
-
-        for (auto i = 0u; i < num_threads; ++i)
-        {
-            threads[i] = std::thread(worker_thread);
-        }
-
-        while (num_refs_processed != num_aabbs)
-        {
-            std::this_thread::sleep_for(std::chrono::milliseconds(20));
-        }
+        build_subtree(SplitRequest{
+            scene_min,
+            scene_max,
+            centroid_scene_min,
+            centroid_scene_max,
+            0,
+            num_aabbs,
+            0u,
+            0u
+        });
 
-         // Signal shutdown and wake up all the threads
-        shutdown.store(true);
-        cv.notify_all();
-            
-        // Wait for all the threads to finish
-        for (auto i = 0u; i < num_threads; ++i)
-        {
-            threads[i].join();
-        }
+        tasks.wait();
 #endif
     }
 
@@ -334,7 +318,8 @@ namespace RadeonRays
         const float3 *aabb_min,
         const float3 *aabb_max,
         const float3 *aabb_centroid,
-        const std::uint32_t *refs)
+        const std::uint32_t *refs,
+        float &split_cost)
     {
         auto sah = std::numeric_limits<float>::max();
 
@@ -488,9 +473,252 @@ namespace RadeonRays
             }
         }
 
+        split_cost = sah;
+
         return mm_select(centroid_min, 0u) + (split_idx + 1) * (mm_select(centroid_extent, 0u) / m_num_bins);
     }
 
+    void Bvh2::EncodeLeafRange(
+        const SplitRequest &request,
+        const MetaDataArray &metadata,
+        const RefArray &refs)
+    {
+        // Leaf triangles go to consecutive nodes starting at request.index.
+        // Subtree of num_refs triangles reserves 2 * num_refs - 1 nodes,
+        // so there is always enough room for them.
+        auto num_refs = static_cast<std::uint32_t>(request.num_refs);
+
+        for (auto i = 0u; i < num_refs; ++i)
+        {
+            auto &node = m_nodes[request.index + i];
+            EncodeLeaf(node, num_refs - i);
+            SetPrimitive(
+                node,
+                i,
+                metadata[refs[request.start_index + i]]);
+        }
+    }
+
+    void Bvh2::Optimize(int num_passes)
+    {
+        if (!m_nodes || num_passes <= 0 || !IsInternal(m_nodes[0]))
+        {
+            return;
+        }
+
+        std::vector<std::uint32_t> addrs;
+        std::vector<TreeletOptimizer::Node> flat;
+        Flatten(addrs, flat);
+
+        TreeletOptimizer optimizer(m_traversal_cost);
+        if (optimizer.Optimize(flat, 0, num_passes) == 0)
+        {
+            return;
+        }
+
+        // Restructuring can make paths longer, keep the tree as built if it exceeds kMaxDepth
+        BvhStatistics stats;
+        BvhStatisticsCollector::Collect(flat, 0, stats);
+        if (stats.max_depth > static_cast<int>(kMaxDepth))
+        {
+            return;
+        }
+
+        for (std::size_t i = 0; i < flat.size(); ++i)
+        {
+            if (flat[i].left == -1)
+            {
+                continue;
+            }
+
+            auto &node = m_nodes[addrs[i]];
+            node.addr_left = addrs[flat[i].left];
+            node.addr_right = addrs[flat[i].right];
+
+            auto const &left = flat[flat[i].left].bounds;
+            auto const &right = flat[flat[i].right].bounds;
+
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                node.aabb_left_min_or_v0[axis] = left.pmin[axis];
+                node.aabb_left_max_or_v1[axis] = left.pmax[axis];
+                node.aabb_right_min_or_v2[axis] = right.pmin[axis];
+                node.aabb_right_max[axis] = right.pmax[axis];
+            }
+        }
+    }
+
+    void Bvh2::GetStatistics(BvhStatistics &stats, bool epo) const
+    {
+        std::vector<std::uint32_t> addrs;
+        std::vector<TreeletOptimizer::Node> flat;
+
+        if (m_nodes)
+        {
+            Flatten(addrs, flat);
+        }
+
+        BvhStatisticsCollector::Collect(flat, 0, stats);
+        stats.bvh_bytes = GetSizeInBytes();
+
+        if (epo && m_nodes)
+        {
+            // Leaf triangles are stored in consecutive nodes starting at the leaf
+            std::vector<int> first(flat.size(), 0);
+            std::vector<float3> triangles;
+
+            for (std::size_t i = 0; i < flat.size(); ++i)
+            {
+                if (flat[i].left != -1)
+                {
+                    continue;
+                }
+
+                first[i] = static_cast<int>(triangles.size() / 3);
+
+                for (int j = 0; j < flat[i].numprims; ++j)
+                {
+                    auto const &node = m_nodes[addrs[i] + j];
+                    triangles.push_back(float3(node.aabb_left_min_or_v0[0], node.aabb_left_min_or_v0[1], node.aabb_left_min_or_v0[2]));
+                    triangles.push_back(float3(node.aabb_left_max_or_v1[0], node.aabb_left_max_or_v1[1], node.aabb_left_max_or_v1[2]));
+                    triangles.push_back(float3(node.aabb_right_min_or_v2[0], node.aabb_right_min_or_v2[1], node.aabb_right_min_or_v2[2]));
+                }
+            }
+
+            stats.epo = BvhStatisticsCollector::CalculateEpo(flat, 0, first, triangles);
+        }
+    }
+
+    void Bvh2::Flatten(std::vector<std::uint32_t> &addrs, std::vector<TreeletOptimizer::Node> &flat) const
+    {
+        // Flat node i maps to m_nodes[addrs[i]], root goes first.
+        // Child AABBs live in the parent, root bounds are their union.
+        auto child_bounds = [this](std::uint32_t parent, int child)
+        {
+            auto const &node = m_nodes[parent];
+            auto pmin = child == 0 ? node.aabb_left_min_or_v0 : node.aabb_right_min_or_v2;
+            auto pmax = child == 0 ? node.aabb_left_max_or_v1 : node.aabb_right_max;
+            return bbox(float3(pmin[0], pmin[1], pmin[2]), float3(pmax[0], pmax[1], pmax[2]));
+        };
+
+        struct Entry
+        {
+            std::uint32_t addr;
+            int parent;
+            int child;
+        };
+
+        std::stack<Entry> s;
+        s.push({ 0u, -1, 0 });
+
+        while (!s.empty())
+        {
+            auto entry = s.top();
+            s.pop();
+
+            auto const &node = m_nodes[entry.addr];
+            int idx = static_cast<int>(flat.size());
+
+            TreeletOptimizer::Node flatnode;
+            flatnode.parent = entry.parent;
+            flatnode.left = -1;
+            flatnode.right = -1;
+            flatnode.numprims = IsInternal(node) ? 0 : static_cast<int>(node.addr_right);
+
+            if (entry.parent == -1)
+            {
+                if (IsInternal(node))
+                {
+                    flatnode.bounds = bboxunion(child_bounds(entry.addr, 0), child_bounds(entry.addr, 1));
+                }
+                else
+                {
+                    GetLeafBounds(&node, &flatnode.bounds.pmin.x, &flatnode.bounds.pmax.x);
+                }
+            }
+            else
+            {
+                flatnode.bounds = child_bounds(addrs[entry.parent], entry.child);
+                (entry.child == 0 ? flat[entry.parent].left : flat[entry.parent].right) = idx;
+            }
+
+            flat.push_back(flatnode);
+            addrs.push_back(entry.addr);
+
+            if (IsInternal(node))
+            {
+                s.push({ node.addr_right, idx, 1 });
+                s.push({ node.addr_left, idx, 0 });
+            }
+        }
+    }
+
+    void Bvh2::Compact()
+    {
+        // Assign new addresses in depth-first order
+        std::vector<std::uint32_t> remap(m_nodecount, kInvalidId);
+        std::stack<std::uint32_t> s;
+        s.push(0u);
+
+        auto num_nodes = 0u;
+        while (!s.empty())
+        {
+            auto idx = s.top();
+            s.pop();
+
+            auto const &node = m_nodes[idx];
+            remap[idx] = num_nodes;
+
+            if (IsInternal(node))
+            {
+                ++num_nodes;
+                s.push(node.addr_right);
+                s.push(node.addr_left);
+            }
+            else
+            {
+                num_nodes += node.addr_right;
+            }
+        }
+
+        if (num_nodes == m_nodecount)
+        {
+            return;
+        }
+
+        auto nodes = reinterpret_cast<Node*>(
+            Allocate(sizeof(Node) * num_nodes, 16u));
+
+        for (auto i = 0u; i < m_nodecount; ++i)
+        {
+            if (remap[i] == kInvalidId)
+            {
+                continue;
+            }
+
+            auto const &node = m_nodes[i];
+
+            if (IsInternal(node))
+            {
+                auto &new_node = *new (&nodes[remap[i]]) Node(node);
+                new_node.addr_left = remap[node.addr_left];
+                new_node.addr_right = remap[node.addr_right];
+            }
+            else
+            {
+                for (auto j = 0u; j < node.addr_right; ++j)
+                {
+                    new (&nodes[remap[i] + j]) Node(m_nodes[i + j]);
+                }
+            }
+        }
+
+        Clear();
+
+        m_nodes = nodes;
+        m_nodecount = num_nodes;
+    }
+
     Bvh2::NodeType Bvh2::HandleRequest(
         const SplitRequest &request,
         const float3 *aabb_min,
@@ -502,18 +730,10 @@ namespace RadeonRays
         SplitRequest &request_left,
         SplitRequest &request_right)
     {
-        // Do we have enough primitives?
-        if (request.num_refs <= kMaxLeafPrimitives)
+        // Single triangle always goes to a leaf
+        if (request.num_refs <= 1u)
         {
-            EncodeLeaf(m_nodes[request.index], static_cast<std::uint32_t>(request.num_refs));
-            for (auto i = 0u; i < request.num_refs; ++i)
-            {
-                auto face_data = metadata[refs[request.start_index + i]];
-                SetPrimitive(
-                    m_nodes[request.index],
-                    i,
-                    face_data);
-            }
+            EncodeLeafRange(request, metadata, refs);
             return kLeaf;
         }
 
@@ -550,11 +770,23 @@ namespace RadeonRays
         auto rcmin = m128_plus_inf;
         auto rcmax = m128_minus_inf;
 
+        auto fits_leaf = request.num_refs <= m_max_leaf_size;
+
+        // Median splits and small SAH nodes go to a leaf as soon as they fit,
+        // as well as the ones we can't split by centroids
+        if (fits_leaf && (!m_usesah || request.num_refs <= kMinSAHPrimitives || split_axis_extent <= 0.0f))
+        {
+            EncodeLeafRange(request, metadata, refs);
+            return kLeaf;
+        }
+
         // Partition the primitives
         if (split_axis_extent > 0.0f)
         {
             if (m_usesah && request.num_refs > kMinSAHPrimitives)
             {
+                auto split_cost = std::numeric_limits<float>::max();
+
                 switch (split_axis)
                 {
                 case 0:
@@ -563,7 +795,8 @@ namespace RadeonRays
                         aabb_min,
                         aabb_max,
                         aabb_centroid,
-                        &refs[0]);
+                        &refs[0],
+                        split_cost);
                     break;
                 case 1:
                     split_value = FindSahSplit<1>(
@@ -571,7 +804,8 @@ namespace RadeonRays
                         aabb_min,
                         aabb_max,
                         aabb_centroid,
-                        &refs[0]);
+                        &refs[0],
+                        split_cost);
                     break;
                 case 2:
                     split_value = FindSahSplit<2>(
@@ -579,9 +813,17 @@ namespace RadeonRays
                         aabb_min,
                         aabb_max,
                         aabb_centroid,
-                        &refs[0]);
+                        &refs[0],
+                        split_cost);
                     break;
                 }
+
+                // SAH is normalized to triangle cost, so leaf costs num_refs
+                if (fits_leaf && request.num_refs <= split_cost)
+                {
+                    EncodeLeafRange(request, metadata, refs);
+                    return kLeaf;
+                }
             }
 
             auto first = request.start_index;
@@ -643,8 +885,15 @@ namespace RadeonRays
             split_idx = first;
         }
 
+        // Fall back to splitting in half if either side could not be built
+        // within kMaxDepth anymore, halving keeps the remaining depth in bounds
+        // (the root needs at most 32 levels)
+        auto const child_level = request.level + 1u;
+
         if (split_idx == request.start_index ||
-            split_idx == request.start_index + request.num_refs)
+            split_idx == request.start_index + request.num_refs ||
+            child_level + min_subtree_depth(split_idx - request.start_index) > kMaxDepth ||
+            child_level + min_subtree_depth(request.start_index + request.num_refs - split_idx) > kMaxDepth)
         {
             split_idx = request.start_index + (request.num_refs >> 1);
 
@@ -21,18 +21,22 @@ THE SOFTWARE.
 ********************************************************************/
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <stack>
 #include <utility>
 #include <vector>
 #include <thread>
 #include <condition_variable>
+#include <memory>
 #include <mmintrin.h>
 #include <xmmintrin.h>
 #include <smmintrin.h>
 
 #include "../primitive/mesh.h"
 #include "../primitive/instance.h"
+#include "treelet_optimizer.h"
 
 #ifndef WIN32
 #define _MM_ALIGN16
@@ -40,6 +44,7 @@ THE SOFTWARE.
 
 namespace RadeonRays
 {
+    struct BvhStatistics;
 
     class Bvh2
     {
@@ -47,24 +52,47 @@ namespace RadeonRays
         struct SplitRequest;
 
     public:
+        // Maximum depth of a leaf, the root has depth 0. Builds and
+        // Optimize keep trees within it, so traversal stacks can be small
+        static std::uint32_t constexpr kMaxDepth = 64u;
+
         // Constructor
-        Bvh2(float traversal_cost, int num_bins = 64, bool usesah = false)
+        // Leaf size is clamped to [1, kMaxLeafPrimitives]
+        Bvh2(float traversal_cost, int num_bins = 64, bool usesah = false, int max_leaf_size = 1)
             : m_num_bins(num_bins)
             , m_usesah(usesah)
             , m_traversal_cost(traversal_cost)
+            , m_max_leaf_size(static_cast<std::uint32_t>(std::min(std::max(max_leaf_size, 1), static_cast<int>(kMaxLeafPrimitives))))
             , m_nodes(nullptr)
             , m_nodecount(0)
         {
         }
 
+        ~Bvh2()
+        {
+            Clear();
+        }
+
         // Build function
         template <typename Iter>
         void Build(Iter begin, Iter end);
 
+        // Use nodes built earlier (e.g. mapped from a BvhCache entry) instead of
+        // building, storage owns the nodes and is released by Clear()
+        void Assign(Node* nodes, std::size_t nodecount, std::shared_ptr<void> storage);
+
+        // Post-build treelet restructuring (see TreeletOptimizer),
+        // relinks internal nodes to lower SAH cost, leaves are kept as is
+        void Optimize(int num_passes);
+
         void Clear();
 
         inline std::size_t GetSizeInBytes() const;
 
+        // Fill tree metrics and bvh_bytes of stats (see BvhStatisticsCollector),
+        // end-point overlap is only calculated if epo is set
+        void GetStatistics(BvhStatistics& stats, bool epo) const;
+
     protected:
         using RefArray = std::vector<std::uint32_t>;
         using MetaDataArray = std::vector<std::pair<const Shape *, std::size_t> >;
@@ -74,8 +102,8 @@ namespace RadeonRays
         {
             // Invalid index marker
             kInvalidId = 0xffffffffu,
-            // Max triangles per leaf
-            kMaxLeafPrimitives = 1u,
+            // Upper limit for triangles per leaf
+            kMaxLeafPrimitives = 15u,
             // Threshold number of primitives to disable SAH split
             kMinSAHPrimitives = 8u,
             // Maximum stack size for non-parallel builds
@@ -95,6 +123,8 @@ namespace RadeonRays
         float m_traversal_cost;
         // Number of spatial bins to use for SAH
         uint32_t m_num_bins;
+        // Maximum number of triangles per leaf
+        std::uint32_t m_max_leaf_size;
 
         static void *Allocate(std::size_t size, std::size_t alignment)
         {
@@ -132,7 +162,8 @@ namespace RadeonRays
             const float3 *aabb_min,
             const float3 *aabb_max,
             const float3 *aabb_centroid,
-            const std::uint32_t *refs);
+            const std::uint32_t *refs,
+            float &split_cost);
 
         NodeType HandleRequest(
             const SplitRequest &request,
@@ -145,6 +176,18 @@ namespace RadeonRays
             SplitRequest &request_left,
             SplitRequest &request_right);
 
+        void EncodeLeafRange(
+            const SplitRequest &request,
+            const MetaDataArray &metadata,
+            const RefArray &refs);
+
+        // Remove unused node slots left by multi-triangle leaves
+        void Compact();
+
+        // Flat view of the tree for optimizers and translators,
+        // flat node i maps to m_nodes[addrs[i]]
+        void Flatten(std::vector<std::uint32_t> &addrs, std::vector<TreeletOptimizer::Node> &flat) const;
+
         static inline void EncodeLeaf(
             Node &node,
             std::uint32_t num_refs);
@@ -161,6 +204,7 @@ namespace RadeonRays
 
         static inline bool IsInternal(const Node &node);
         static inline std::uint32_t GetChildIndex(const Node &node, std::uint8_t idx);
+        static inline void GetLeafBounds(const Node *leaf, float *aabb_min, float *aabb_max);
         static inline void PropagateBounds(Bvh2 &bvh);
 
     private:
@@ -168,12 +212,16 @@ namespace RadeonRays
         Bvh2 &operator = (const Bvh2 &);
 
         friend class QBvhTranslator;
+        template <int W> friend class WideBvhTranslator;
         friend class IntersectorLDS;
+        friend class CpuIntersectionDevice;
 
         // Buffer of encoded nodes
         Node *m_nodes;
         // Number of encoded nodes
         std::size_t m_nodecount;
+        // Owner of assigned nodes, nullptr if m_nodes is allocated by Bvh2
+        std::shared_ptr<void> m_storage;
     };
 
     // Encoded node format
@@ -189,9 +237,10 @@ namespace RadeonRays
         uint32_t mesh_id = kInvalidId;
         // Right AABB min or vertex 2 for a leaf node
         float aabb_right_min_or_v2[3] = { 0.0f, 0.0f, 0.0f };
-        // Right child node address
+        // Right child node address or number of remaining leaf triangles
+        // (leaf triangles occupy consecutive nodes)
         uint32_t addr_right = kInvalidId;
-        // Left AABB max
+        // Right AABB max or shape mask (bits of the first component) for a leaf node
         float aabb_right_max[3] = { 0.0f, 0.0f, 0.0f };
         // Primitive ID for a leaf node
         uint32_t prim_id = kInvalidId;
@@ -249,23 +298,20 @@ namespace RadeonRays
         for (auto iter = begin; iter != end; ++iter)
         {
             auto shape = static_cast<const ShapeImpl *>(*iter);
-            auto isinstance = shape->is_instance();
-            auto mesh = static_cast<const Mesh *>(isinstance ? static_cast<const Instance *>(shape)->GetBaseShape() : shape);
+            auto mesh = static_cast<const Mesh *>(shape->is_instance() ? static_cast<const Instance *>(shape)->GetBaseShape() : shape);
 
             matrix m, minv;
             shape->GetTransform(m, minv);
 
             for (std::size_t face_index = 0; face_index < mesh->num_faces(); ++face_index, ++current_face)
             {
-                bbox bounds;
-                mesh->GetFaceBounds(face_index, isinstance, bounds);
-
-                // Instance is using its own transform for base shape geometry
-                // so we need to get object space bounds and transform them manually
-                if(isinstance)
-                {
-                    bounds = transform_bbox(bounds, m);
-                }
+                // Instance is using its own transform for base shape geometry,
+                // so bounds come from vertices in the shape's world space
+                auto face = mesh->GetFace(static_cast<int>(face_index));
+                bbox bounds(
+                    transform_point(mesh->GetVertex(face.idx[0]), m),
+                    transform_point(mesh->GetVertex(face.idx[1]), m));
+                bounds.grow(transform_point(mesh->GetVertex(face.idx[2]), m));
 
                 auto pmin = _mm_set_ps(bounds.pmin.w, bounds.pmin.z, bounds.pmin.y, bounds.pmin.x);
                 auto pmax = _mm_set_ps(bounds.pmax.w, bounds.pmax.z, bounds.pmax.y, bounds.pmax.x);
@@ -298,6 +344,11 @@ namespace RadeonRays
             metadata,
             num_items);
 
+        if (m_max_leaf_size > 1u)
+        {
+            Compact();
+        }
+
         // We set 1 AABB for each node during BVH build process,
         // however our resulting structure keeps two AABBs for
         // left and right child nodes in the parent node. To
@@ -317,10 +368,9 @@ namespace RadeonRays
         Node &node,
         std::uint32_t num_refs)
     {
-        // This node only supports 1 triangle
-        assert(num_refs == 1);
+        assert(num_refs > 0 && num_refs <= kMaxLeafPrimitives);
         node.addr_left = kInvalidId;
-        node.addr_right = kInvalidId;
+        node.addr_right = num_refs;
     }
 
     void Bvh2::EncodeInternal(
@@ -345,10 +395,10 @@ namespace RadeonRays
         matrix worldmat, worldmatinv;
         shape->GetTransform(worldmat, worldmatinv);
         auto mesh = static_cast<const Mesh *>(static_cast<const ShapeImpl *>(shape)->is_instance() ? static_cast<const Instance *>(shape)->GetBaseShape() : shape);
-        auto face = mesh->GetFaceData()[ref.second];
-        auto v0 = transform_point(mesh->GetVertexData()[face.idx[0]], worldmat);
-        auto v1 = transform_point(mesh->GetVertexData()[face.idx[1]], worldmat);
-        auto v2 = transform_point(mesh->GetVertexData()[face.idx[2]], worldmat);
+        auto face = mesh->GetFace(static_cast<int>(ref.second));
+        auto v0 = transform_point(mesh->GetVertex(face.idx[0]), worldmat);
+        auto v1 = transform_point(mesh->GetVertex(face.idx[1]), worldmat);
+        auto v2 = transform_point(mesh->GetVertex(face.idx[2]), worldmat);
         node.aabb_left_min_or_v0[0] = v0.x;
         node.aabb_left_min_or_v0[1] = v0.y;
         node.aabb_left_min_or_v0[2] = v0.z;
@@ -360,6 +410,9 @@ namespace RadeonRays
         node.aabb_right_min_or_v2[2] = v2.z;
         node.mesh_id = shape->GetId();
         node.prim_id = static_cast<std::uint32_t>(ref.second);
+        // Leaves have no right AABB, so keep the mask there for CPU traversal
+        auto mask = shape->GetMask();
+        std::memcpy(&node.aabb_right_max[0], &mask, sizeof(mask));
     }
 
     bool Bvh2::IsInternal(const Node &node)
@@ -376,6 +429,36 @@ namespace RadeonRays
             : kInvalidId);
     }
 
+    void Bvh2::GetLeafBounds(const Node *leaf, float *aabb_min, float *aabb_max)
+    {
+        auto constexpr inf = std::numeric_limits<float>::infinity();
+
+        for (auto axis = 0u; axis < 3u; ++axis)
+        {
+            aabb_min[axis] = inf;
+            aabb_max[axis] = -inf;
+        }
+
+        // Leaf triangles occupy consecutive nodes
+        for (auto i = 0u; i < leaf->addr_right; ++i)
+        {
+            auto const &node = leaf[i];
+
+            for (auto axis = 0u; axis < 3u; ++axis)
+            {
+                aabb_min[axis] = std::min(aabb_min[axis], std::min(
+                    node.aabb_left_min_or_v0[axis],
+                    std::min(node.aabb_left_max_or_v1[axis],
+                        node.aabb_right_min_or_v2[axis])));
+
+                aabb_max[axis] = std::max(aabb_max[axis], std::max(
+                    node.aabb_left_min_or_v0[axis],
+                    std::max(node.aabb_left_max_or_v1[axis],
+                        node.aabb_right_min_or_v2[axis])));
+            }
+        }
+    }
+
     void Bvh2::PropagateBounds(Bvh2 &bvh)
     {
         // Traversal stack
@@ -403,7 +486,7 @@ namespace RadeonRays
                 // up the tree into its parent. If the child node is
                 // a leaf, then we do not have AABB for it (we store 
                 // vertices directly in the leaf), so we calculate 
-                // AABB on the fly.
+                // AABB on the fly over all the leaf triangles.
                 if (IsInternal(*child0))
                 {
                     node->aabb_left_min_or_v0[0] = child0->aabb_left_min_or_v0[0];
@@ -416,42 +499,14 @@ namespace RadeonRays
                 }
                 else
                 {
-                    node->aabb_left_min_or_v0[0] = std::min(
-                        child0->aabb_left_min_or_v0[0],
-                        std::min(child0->aabb_left_max_or_v1[0],
-                            child0->aabb_right_min_or_v2[0]));
-
-                    node->aabb_left_min_or_v0[1] = std::min(
-                        child0->aabb_left_min_or_v0[1],
-                        std::min(child0->aabb_left_max_or_v1[1],
-                            child0->aabb_right_min_or_v2[1]));
-
-                    node->aabb_left_min_or_v0[2] = std::min(
-                        child0->aabb_left_min_or_v0[2],
-                        std::min(child0->aabb_left_max_or_v1[2],
-                            child0->aabb_right_min_or_v2[2]));
-
-                    node->aabb_left_max_or_v1[0] = std::max(
-                        child0->aabb_left_min_or_v0[0],
-                        std::max(child0->aabb_left_max_or_v1[0],
-                            child0->aabb_right_min_or_v2[0]));
-
-                    node->aabb_left_max_or_v1[1] = std::max(
-                        child0->aabb_left_min_or_v0[1],
-                        std::max(child0->aabb_left_max_or_v1[1],
-                            child0->aabb_right_min_or_v2[1]));
-
-                    node->aabb_left_max_or_v1[2] = std::max(
-                        child0->aabb_left_min_or_v0[2],
-                        std::max(child0->aabb_left_max_or_v1[2],
-                            child0->aabb_right_min_or_v2[2]));
+                    GetLeafBounds(child0, node->aabb_left_min_or_v0, node->aabb_left_max_or_v1);
                 }
 
                 // If the child is internal node itself we pull it
                 // up the tree into its parent. If the child node is
                 // a leaf, then we do not have AABB for it (we store 
                 // vertices directly in the leaf), so we calculate 
-                // AABB on the fly.
+                // AABB on the fly over all the leaf triangles.
                 if (IsInternal(*child1))
                 {
                     node->aabb_right_min_or_v2[0] = child1->aabb_left_min_or_v0[0];
@@ -464,35 +519,7 @@ namespace RadeonRays
                 }
                 else
                 {
-                    node->aabb_right_min_or_v2[0] = std::min(
-                        child1->aabb_left_min_or_v0[0],
-                        std::min(child1->aabb_left_max_or_v1[0],
-                            child1->aabb_right_min_or_v2[0]));
-
-                    node->aabb_right_min_or_v2[1] = std::min(
-                        child1->aabb_left_min_or_v0[1],
-                        std::min(child1->aabb_left_max_or_v1[1],
-                            child1->aabb_right_min_or_v2[1]));
-
-                    node->aabb_right_min_or_v2[2] = std::min(
-                        child1->aabb_left_min_or_v0[2],
-                        std::min(child1->aabb_left_max_or_v1[2],
-                            child1->aabb_right_min_or_v2[2]));
-
-                    node->aabb_right_max[0] = std::max(
-                        child1->aabb_left_min_or_v0[0],
-                        std::max(child1->aabb_left_max_or_v1[0],
-                            child1->aabb_right_min_or_v2[0]));
-
-                    node->aabb_right_max[1] = std::max(
-                        child1->aabb_left_min_or_v0[1],
-                        std::max(child1->aabb_left_max_or_v1[1],
-                            child1->aabb_right_min_or_v2[1]));
-
-                    node->aabb_right_max[2] = std::max(
-                        child1->aabb_left_min_or_v0[2],
-                        std::max(child1->aabb_left_max_or_v1[2],
-                            child1->aabb_right_min_or_v2[2]));
+                    GetLeafBounds(child1, node->aabb_right_min_or_v2, node->aabb_right_max);
                 }
             }
         }
@@ -0,0 +1,456 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "bvh_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+
+#include "../primitive/mesh.h"
+#include "../primitive/instance.h"
+#include "../async/thread_pool.h"
+
+#ifdef WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace RadeonRays
+{
+    // Vertices or faces hashed by a single task
+    static int const kHashChunkSize = 64 * 1024;
+    // Vertices or faces gathered before hashing
+    static int const kHashBatchSize = 1024;
+    // Alignment of array data in entry files
+    static std::size_t const kArrayAlignment = 64;
+
+    static char const kMagic[8] = { 'R', 'R', 'B', 'V', 'H', 'C', 0, 0 };
+
+    // Entry file layout: FileHeader, numarrays ArrayHeaders, then array data
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t numarrays;
+        std::uint64_t key;
+        // Whole file size
+        std::uint64_t size;
+    };
+
+    struct ArrayHeader
+    {
+        std::uint64_t elemsize;
+        std::uint64_t count;
+        // From the beginning of the file, multiple of kArrayAlignment
+        std::uint64_t offset;
+    };
+
+    static std::uint64_t const kPrime1 = 0x9e3779b185ebca87ull;
+    static std::uint64_t const kPrime2 = 0xc2b2ae3d27d4eb4full;
+    static std::uint64_t const kPrime3 = 0x165667b19e3779f9ull;
+    static std::uint64_t const kPrime4 = 0x85ebca77c2b2ae63ull;
+
+    static inline std::uint64_t Rotl(std::uint64_t v, int r)
+    {
+        return (v << r) | (v >> (64 - r));
+    }
+
+    // xxHash64 merge step
+    static inline std::uint64_t Mix(std::uint64_t h, std::uint64_t v)
+    {
+        h ^= Rotl(v * kPrime2, 31) * kPrime1;
+        return Rotl(h, 27) * kPrime1 + kPrime4;
+    }
+
+    BvhCache::Hasher::Hasher()
+        : m_state(kPrime3)
+    {
+    }
+
+    void BvhCache::Hasher::Add(void const* data, std::size_t size)
+    {
+        auto bytes = static_cast<char const*>(data);
+        auto state = m_state;
+
+        std::size_t i = 0;
+        for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t))
+        {
+            std::uint64_t v;
+            std::memcpy(&v, bytes + i, sizeof(v));
+            state = Mix(state, v);
+        }
+
+        if (i < size)
+        {
+            std::uint64_t v = 0;
+            std::memcpy(&v, bytes + i, size - i);
+            state = Mix(state, v);
+        }
+
+        m_state = Mix(state, size);
+    }
+
+    void BvhCache::Hasher::Add(std::string const& value)
+    {
+        Add(value.data(), value.size());
+    }
+
+    std::uint64_t BvhCache::Hasher::GetValue() const
+    {
+        auto h = m_state;
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    // Object space vertices and face indices of a mesh.
+    // Chunks are hashed in parallel, so large meshes do not hash on one core.
+    static std::uint64_t HashMesh(Mesh const& mesh)
+    {
+        int numvertices = mesh.num_vertices();
+        int numfaces = mesh.num_faces();
+        int numvertexchunks = (numvertices + kHashChunkSize - 1) / kHashChunkSize;
+        int numfacechunks = (numfaces + kHashChunkSize - 1) / kHashChunkSize;
+
+        std::vector<std::uint64_t> chunks(numvertexchunks + numfacechunks);
+
+        parallel_for(0, (int)chunks.size(), 1, [&](int begin, int end)
+        {
+            float vertices[kHashBatchSize * 3];
+            int faces[kHashBatchSize * 4];
+
+            for (int c = begin; c < end; ++c)
+            {
+                BvhCache::Hasher hasher;
+
+                if (c < numvertexchunks)
+                {
+                    int first = c * kHashChunkSize;
+                    int last = std::min(first + kHashChunkSize, numvertices);
+
+                    for (int i = first; i < last; i += kHashBatchSize)
+                    {
+                        int count = std::min(kHashBatchSize, last - i);
+                        for (int j = 0; j < count; ++j)
+                        {
+                            float3 v = mesh.GetVertex(i + j);
+                            vertices[3 * j] = v.x;
+                            vertices[3 * j + 1] = v.y;
+                            vertices[3 * j + 2] = v.z;
+                        }
+                        hasher.Add(vertices, count * 3 * sizeof(float));
+                    }
+                }
+                else
+                {
+                    int first = (c - numvertexchunks) * kHashChunkSize;
+                    int last = std::min(first + kHashChunkSize, numfaces);
+
+                    for (int i = first; i < last; i += kHashBatchSize)
+                    {
+                        int count = std::min(kHashBatchSize, last - i);
+                        for (int j = 0; j < count; ++j)
+                        {
+                            Mesh::Face face = mesh.GetFace(i + j);
+                            faces[4 * j] = face.i0;
+                            faces[4 * j + 1] = face.i1;
+                            faces[4 * j + 2] = face.i2;
+                            faces[4 * j + 3] = face.type_ == Mesh::QUAD ? face.i3 : -1;
+                        }
+                        hasher.Add(faces, count * 4 * sizeof(int));
+                    }
+                }
+
+                chunks[c] = hasher.GetValue();
+            }
+        });
+
+        BvhCache::Hasher hasher;
+        hasher.Add(numvertices);
+        hasher.Add(numfaces);
+        if (!chunks.empty())
+        {
+            hasher.Add(chunks.data(), chunks.size() * sizeof(std::uint64_t));
+        }
+        return hasher.GetValue();
+    }
+
+    void BvhCache::Hasher::AddShapes(Shape const* const* shapes, std::size_t numshapes)
+    {
+        std::vector<Mesh const*> meshes;
+        std::unordered_map<Mesh const*, std::size_t> meshindex;
+        std::vector<std::size_t> shapemesh(numshapes);
+
+        for (std::size_t i = 0; i < numshapes; ++i)
+        {
+            auto shape = static_cast<ShapeImpl const*>(shapes[i]);
+            auto mesh = static_cast<Mesh const*>(shape->is_instance() ? static_cast<Instance const*>(shape)->GetBaseShape() : shape);
+
+            auto iter = meshindex.emplace(mesh, meshes.size());
+            if (iter.second)
+            {
+                meshes.push_back(mesh);
+            }
+
+            shapemesh[i] = iter.first->second;
+        }
+
+        std::vector<std::uint64_t> meshhashes(meshes.size());
+        for (std::size_t i = 0; i < meshes.size(); ++i)
+        {
+            meshhashes[i] = HashMesh(*meshes[i]);
+        }
+
+        Add(numshapes);
+
+        for (std::size_t i = 0; i < numshapes; ++i)
+        {
+            auto shape = static_cast<ShapeImpl const*>(shapes[i]);
+
+            matrix m, minv;
+            shape->GetTransform(m, minv);
+
+            Add(meshhashes[shapemesh[i]]);
+            Add(shape->is_instance());
+            Add(m.m, sizeof(m.m));
+            Add(shape->GetId());
+            Add(shape->GetMask());
+        }
+    }
+
+    BvhCache::Entry::Entry()
+        : m_data(nullptr)
+        , m_size(0)
+    {
+    }
+
+    BvhCache::Entry::~Entry()
+    {
+        if (m_data)
+        {
+#ifdef WIN32
+            UnmapViewOfFile(m_data);
+#else
+            munmap(m_data, m_size);
+#endif
+        }
+    }
+
+    BvhCache::BvhCache(std::string const& path)
+        : m_path(path)
+    {
+        if (!m_path.empty() && m_path.back() != '/' && m_path.back() != '\\')
+        {
+            m_path += '/';
+        }
+    }
+
+    std::string BvhCache::GetFileName(char const* name, std::uint64_t key) const
+    {
+        char keystr[17];
+        std::snprintf(keystr, sizeof(keystr), "%016llx", (unsigned long long)key);
+        return m_path + name + "_" + keystr + ".rrbvh";
+    }
+
+    // Map the whole file copy-on-write, nullptr on failure
+    static void* MapFile(std::string const& filename, std::size_t& size)
+    {
+#ifdef WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return nullptr;
+        }
+
+        void* data = nullptr;
+        LARGE_INTEGER filesize;
+        if (GetFileSizeEx(file, &filesize) && filesize.QuadPart >= (LONGLONG)sizeof(FileHeader))
+        {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+            if (mapping)
+            {
+                data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+                size = (std::size_t)filesize.QuadPart;
+                CloseHandle(mapping);
+            }
+        }
+
+        CloseHandle(file);
+        return data;
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+
+        void* data = nullptr;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(FileHeader))
+        {
+            data = mmap(nullptr, (std::size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                data = nullptr;
+            }
+            size = (std::size_t)st.st_size;
+        }
+
+        close(fd);
+        return data;
+#endif
+    }
+
+    std::shared_ptr<BvhCache::Entry> BvhCache::Load(char const* name, std::uint64_t key) const
+    {
+        std::shared_ptr<Entry> entry(new Entry());
+
+        entry->m_data = MapFile(GetFileName(name, key), entry->m_size);
+        if (!entry->m_data)
+        {
+            return nullptr;
+        }
+
+        auto data = static_cast<char const*>(entry->m_data);
+        auto size = entry->m_size;
+
+        FileHeader header;
+        std::memcpy(&header, data, sizeof(header));
+
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+            header.version != kVersion ||
+            header.key != key ||
+            header.size != size ||
+            header.numarrays > (size - sizeof(FileHeader)) / sizeof(ArrayHeader))
+        {
+            return nullptr;
+        }
+
+        entry->m_arrays.resize(header.numarrays);
+
+        for (std::uint32_t i = 0; i < header.numarrays; ++i)
+        {
+            ArrayHeader array;
+            std::memcpy(&array, data + sizeof(FileHeader) + i * sizeof(ArrayHeader), sizeof(array));
+
+            // Truncated or damaged files are rejected
+            if (array.elemsize == 0 ||
+                array.offset % kArrayAlignment != 0 ||
+                array.offset > size ||
+                array.count > (size - array.offset) / array.elemsize)
+            {
+                return nullptr;
+            }
+
+            entry->m_arrays[i].data = data + array.offset;
+            entry->m_arrays[i].elemsize = (std::size_t)array.elemsize;
+            entry->m_arrays[i].count = (std::size_t)array.count;
+        }
+
+        return entry;
+    }
+
+    bool BvhCache::Store(char const* name, std::uint64_t key, Array const* arrays, std::size_t numarrays) const
+    {
+        FileHeader header;
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.numarrays = (std::uint32_t)numarrays;
+        header.key = key;
+
+        std::vector<ArrayHeader> arrayheaders(numarrays);
+        std::uint64_t offset = sizeof(FileHeader) + numarrays * sizeof(ArrayHeader);
+        for (std::size_t i = 0; i < numarrays; ++i)
+        {
+            offset = (offset + kArrayAlignment - 1) / kArrayAlignment * kArrayAlignment;
+            arrayheaders[i].elemsize = arrays[i].elemsize;
+            arrayheaders[i].count = arrays[i].count;
+            arrayheaders[i].offset = offset;
+            offset += arrays[i].elemsize * arrays[i].count;
+        }
+        header.size = offset;
+
+        // Unique among threads and processes writing the same entry
+        static std::atomic<unsigned> counter(0);
+#ifdef WIN32
+        unsigned long pid = GetCurrentProcessId();
+#else
+        unsigned long pid = (unsigned long)getpid();
+#endif
+        auto filename = GetFileName(name, key);
+        auto tmpname = filename + "." + std::to_string(pid) + "." +
+            std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "." +
+            std::to_string(counter++) + ".tmp";
+
+        {
+            std::ofstream out(tmpname, std::ios::binary | std::ios::trunc);
+            if (!out)
+            {
+                return false;
+            }
+
+            out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+            if (numarrays > 0)
+            {
+                out.write(reinterpret_cast<char const*>(arrayheaders.data()), numarrays * sizeof(ArrayHeader));
+            }
+
+            char const padding[kArrayAlignment] = {};
+            std::uint64_t position = sizeof(FileHeader) + numarrays * sizeof(ArrayHeader);
+            for (std::size_t i = 0; i < numarrays && out; ++i)
+            {
+                out.write(padding, (std::streamsize)(arrayheaders[i].offset - position));
+                out.write(static_cast<char const*>(arrays[i].data), (std::streamsize)(arrays[i].elemsize * arrays[i].count));
+                position = arrayheaders[i].offset + arrays[i].elemsize * arrays[i].count;
+            }
+
+            out.close();
+            if (!out)
+            {
+                std::remove(tmpname.c_str());
+                return false;
+            }
+        }
+
+        // Readers never see partially written entries
+        if (std::rename(tmpname.c_str(), filename.c_str()) != 0)
+        {
+            std::remove(tmpname.c_str());
+            return false;
+        }
+
+        return true;
+    }
+}
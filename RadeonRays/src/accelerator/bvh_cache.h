@@ -0,0 +1,134 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace RadeonRays
+{
+    class Shape;
+
+    ///< On-disk cache of built acceleration structures ("bvh.cache_path" option).
+    ///< An entry is a few flat arrays (translated nodes, primitive indices) keyed
+    ///< by a hash of the geometry and the build options. Entry files are memory
+    ///< mapped on load and the arrays are used in place, nothing is parsed.
+    ///< Entries are written to a temporary file which is then renamed, so processes
+    ///< sharing a cache directory either see a complete entry or none at all.
+    ///< Cache failures are never fatal: a missing, stale or damaged entry is
+    ///< simply rebuilt.
+    ///<
+    class BvhCache
+    {
+    public:
+        // Bump when a cached node layout or the build output changes
+        static std::uint32_t constexpr kVersion = 1;
+
+        // Incremental 64 bit content hash
+        class Hasher
+        {
+        public:
+            Hasher();
+
+            void Add(void const* data, std::size_t size);
+            void Add(std::string const& value);
+
+            template <typename T>
+            void Add(T const& value)
+            {
+                Add(&value, sizeof(T));
+            }
+
+            // Geometry, transforms, ids and masks of triangle mesh shapes and instances.
+            // Shape order is significant, base meshes shared by instances are hashed once.
+            void AddShapes(Shape const* const* shapes, std::size_t numshapes);
+
+            std::uint64_t GetValue() const;
+
+        private:
+            std::uint64_t m_state;
+        };
+
+        // Array to store
+        struct Array
+        {
+            void const* data;
+            std::size_t elemsize;
+            std::size_t count;
+        };
+
+        // Mapped entry, arrays stay valid as long as the entry is alive.
+        // The mapping is copy-on-write, so arrays might be modified in place
+        // without affecting the file.
+        class Entry
+        {
+        public:
+            ~Entry();
+
+            std::size_t GetNumArrays() const
+            {
+                return m_arrays.size();
+            }
+
+            // Array at idx, nullptr if its elements are not of type T
+            template <typename T>
+            T* GetArray(std::size_t idx, std::size_t& count) const
+            {
+                if (idx >= m_arrays.size() || m_arrays[idx].elemsize != sizeof(T))
+                {
+                    return nullptr;
+                }
+
+                count = m_arrays[idx].count;
+                return static_cast<T*>(const_cast<void*>(m_arrays[idx].data));
+            }
+
+        private:
+            friend class BvhCache;
+
+            Entry();
+            Entry(Entry const&);
+            Entry& operator = (Entry const&);
+
+            // Mapped file
+            void* m_data;
+            std::size_t m_size;
+            std::vector<Array> m_arrays;
+        };
+
+        // Entries are stored in directory path, which has to exist
+        explicit BvhCache(std::string const& path);
+
+        // Map entry name/key, nullptr if there is no valid entry
+        std::shared_ptr<Entry> Load(char const* name, std::uint64_t key) const;
+        // Write entry name/key, returns false on failure
+        bool Store(char const* name, std::uint64_t key, Array const* arrays, std::size_t numarrays) const;
+
+    private:
+        std::string GetFileName(char const* name, std::uint64_t key) const;
+
+        std::string m_path;
+    };
+}
@@ -0,0 +1,240 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "bvh_statistics.h"
+#include "../async/thread_pool.h"
+#include "../primitive/mesh.h"
+#include "../primitive/instance.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace RadeonRays
+{
+    // Nodes whose overlap is measured by a single task
+    static int const kEpoNodesPerTask = 64;
+
+    // Clipping a triangle by the 6 box planes adds at most one vertex per plane
+    static int const kMaxClippedVertices = 9;
+
+    static float TriangleArea(float3 const* v)
+    {
+        float3 n = cross(v[1] - v[0], v[2] - v[0]);
+        return 0.5f * std::sqrt(n.sqnorm());
+    }
+
+    // Area of the part of the triangle inside box (Sutherland-Hodgman)
+    static float ClippedTriangleArea(float3 const* v, bbox const& box)
+    {
+        bbox tribox(v[0], v[1]);
+        tribox.grow(v[2]);
+
+        if (contains(box, tribox))
+        {
+            return TriangleArea(v);
+        }
+
+        float3 poly[kMaxClippedVertices];
+        float3 clipped[kMaxClippedVertices];
+        int n = 3;
+        std::copy(v, v + 3, poly);
+
+        for (int plane = 0; plane < 6; ++plane)
+        {
+            int axis = plane >> 1;
+            // Inside is above the min plane and below the max one
+            float sign = (plane & 1) ? -1.f : 1.f;
+            float offset = (plane & 1) ? box.pmax[axis] : box.pmin[axis];
+
+            int m = 0;
+            for (int i = 0; i < n; ++i)
+            {
+                float3 const& a = poly[i];
+                float3 const& b = poly[(i + 1) % n];
+                float da = sign * (a[axis] - offset);
+                float db = sign * (b[axis] - offset);
+
+                if (da >= 0.f)
+                {
+                    clipped[m++] = a;
+                }
+
+                if ((da >= 0.f) != (db >= 0.f))
+                {
+                    clipped[m++] = a + (b - a) * (da / (da - db));
+                }
+            }
+
+            n = m;
+            if (n < 3)
+            {
+                return 0.f;
+            }
+
+            std::copy(clipped, clipped + n, poly);
+        }
+
+        float3 sum;
+        for (int i = 1; i + 1 < n; ++i)
+        {
+            sum += cross(poly[i] - poly[0], poly[i + 1] - poly[0]);
+        }
+
+        return 0.5f * std::sqrt(sum.sqnorm());
+    }
+
+    void BvhStatisticsCollector::Collect(std::vector<TreeletOptimizer::Node> const& nodes, int root, BvhStatistics& stats)
+    {
+        stats = BvhStatistics();
+        stats.epo = -1.f;
+
+        if (nodes.empty())
+        {
+            return;
+        }
+
+        double cost = 0.0;
+
+        // Node index and depth
+        std::vector<std::pair<int, int>> stack;
+        stack.push_back(std::make_pair(root, 0));
+
+        while (!stack.empty())
+        {
+            auto const& node = nodes[stack.back().first];
+            int depth = stack.back().second;
+            stack.pop_back();
+
+            ++stats.num_nodes;
+            float area = node.bounds.surface_area();
+
+            if (node.left == -1)
+            {
+                ++stats.num_leaves;
+                stats.num_references += node.numprims;
+                stats.max_depth = std::max(stats.max_depth, depth);
+                ++stats.leaf_sizes[std::min(node.numprims, static_cast<int>(BvhStatistics::kLeafSizeBins) - 1)];
+                ++stats.leaf_depths[std::min(depth, static_cast<int>(BvhStatistics::kDepthBins) - 1)];
+                cost += static_cast<double>(area) * node.numprims;
+            }
+            else
+            {
+                cost += area;
+                stack.push_back(std::make_pair(node.right, depth + 1));
+                stack.push_back(std::make_pair(node.left, depth + 1));
+            }
+        }
+
+        float root_area = nodes[root].bounds.surface_area();
+        stats.sah_cost = root_area > 0.f ? static_cast<float>(cost / root_area) : 0.f;
+    }
+
+    float BvhStatisticsCollector::CalculateEpo(std::vector<TreeletOptimizer::Node> const& nodes, int root,
+                                               std::vector<int> const& first, std::vector<float3> const& triangles)
+    {
+        double total_area = 0.0;
+        for (std::size_t i = 0; i + 2 < triangles.size(); i += 3)
+        {
+            total_area += TriangleArea(&triangles[i]);
+        }
+
+        if (total_area <= 0.0)
+        {
+            return 0.f;
+        }
+
+        int num_nodes = static_cast<int>(nodes.size());
+        std::vector<double> overlap(num_nodes, 0.0);
+
+        parallel_for(0, num_nodes, kEpoNodesPerTask, [&](int begin, int end)
+        {
+            std::vector<int> stack;
+
+            for (int i = begin; i < end; ++i)
+            {
+                auto const& box = nodes[i].bounds;
+                double area = 0.0;
+
+                // Everything except the subtree of i, it is only reachable through i
+                stack.push_back(root);
+                while (!stack.empty())
+                {
+                    int idx = stack.back();
+                    stack.pop_back();
+
+                    auto const& node = nodes[idx];
+                    if (idx == i || !intersects(node.bounds, box))
+                    {
+                        continue;
+                    }
+
+                    if (node.left == -1)
+                    {
+                        for (int j = 0; j < node.numprims; ++j)
+                        {
+                            area += ClippedTriangleArea(&triangles[3 * (first[idx] + j)], box);
+                        }
+                    }
+                    else
+                    {
+                        stack.push_back(node.right);
+                        stack.push_back(node.left);
+                    }
+                }
+
+                overlap[i] = area * (nodes[i].left == -1 ? nodes[i].numprims : 1);
+            }
+        });
+
+        double epo = 0.0;
+        for (auto value : overlap)
+        {
+            epo += value;
+        }
+
+        return static_cast<float>(epo / total_area);
+    }
+
+    void BvhStatisticsCollector::GetTriangles(Shape const* const* shapes, std::size_t numshapes, std::vector<float3>& triangles)
+    {
+        triangles.clear();
+
+        for (std::size_t i = 0; i < numshapes; ++i)
+        {
+            auto shape = static_cast<ShapeImpl const*>(shapes[i]);
+            auto mesh = static_cast<Mesh const*>(shape->is_instance() ? static_cast<Instance const*>(shape)->GetBaseShape() : shape);
+
+            // Instances place the base mesh with their own transform
+            matrix m, minv;
+            shape->GetTransform(m, minv);
+
+            for (int face_index = 0; face_index < mesh->num_faces(); ++face_index)
+            {
+                auto face = mesh->GetFace(face_index);
+                for (int j = 0; j < 3; ++j)
+                {
+                    triangles.push_back(transform_point(mesh->GetVertex(face.idx[j]), m));
+                }
+            }
+        }
+    }
+}
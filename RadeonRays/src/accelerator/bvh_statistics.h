@@ -0,0 +1,64 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "radeon_rays.h"
+#include "treelet_optimizer.h"
+
+namespace RadeonRays
+{
+    ///< BvhStatistics quality metrics of a binary BVH given as the flat view
+    ///< TreeletOptimizer works on. SAH cost uses unit traversal and intersection
+    ///< costs relative to the root surface area. End-point overlap follows
+    ///< "On Quality Metrics of Bounding Volume Hierarchies",
+    ///< Timo Aila, Tero Karras, Samuli Laine, HPG 2013: for every node the
+    ///< area of triangles outside its subtree clipped to its bounds, weighted
+    ///< like SAH cost and divided by the total triangle area.
+    ///<
+    class BvhStatisticsCollector
+    {
+    public:
+        typedef std::chrono::high_resolution_clock Clock;
+
+        // Milliseconds since start, for build phase timings
+        static float GetElapsedMs(Clock::time_point start)
+        {
+            return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+        }
+
+        // Reset stats and fill tree sizes, histograms and SAH cost,
+        // epo is set to -1, memory and timings are up to the caller
+        static void Collect(std::vector<TreeletOptimizer::Node> const& nodes, int root, BvhStatistics& stats);
+
+        // End-point overlap. Triangles hold 3 vertices per leaf primitive, the primitives
+        // of leaf i are consecutive starting at triangle first[i].
+        static float CalculateEpo(std::vector<TreeletOptimizer::Node> const& nodes, int root,
+                                  std::vector<int> const& first, std::vector<float3> const& triangles);
+
+        // World space triangles of the shapes in order, 3 vertices per face
+        static void GetTriangles(Shape const* const* shapes, std::size_t numshapes, std::vector<float3>& triangles);
+    };
+}
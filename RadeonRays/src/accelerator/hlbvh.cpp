@@ -20,17 +20,27 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 ********************************************************************/
 #include "hlbvh.h"
+#include "bvh_statistics.h"
 #include "buffer.h"
 #include "primitives.h"
 #include "executable.h"
 #include "../except/except.h"
+#include "../async/thread_pool.h"
+#include "../device/kernel_cache.h"
 #include "calc.h"
+#include "device_host.h"
 #include "event.h"
 
 #include <vector>
 #include <numeric>
 #include <chrono>
 #include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <algorithm>
 #include <iostream>
 #include <assert.h>
 
@@ -49,12 +59,292 @@ namespace RadeonRays
 {
     
     static int kWorkGroupSize = 64;
+
+    // Minimum number of items processed by a single host task
+    static int const kHostTaskSize = 16384;
+    // Radix sort digit width and bucket count
+    static int const kRadixBits = 8;
+    static int const kRadixBuckets = 1 << kRadixBits;
+
+    // Splits [0, count) into contiguous chunks and runs func(chunk, begin, end)
+    // on each of them, the first one on the calling thread.
+    template <typename Func>
+    static int ParallelChunks(int count, Func const& func)
+    {
+        int num_chunks = std::max(1, std::min((int)std::thread::hardware_concurrency(), count / kHostTaskSize));
+        int chunk_size = (count + num_chunks - 1) / num_chunks;
+
+        task_group tasks;
+
+        for (int c = 1; c < num_chunks; ++c)
+        {
+            int begin = std::min(c * chunk_size, count);
+            int end = std::min(begin + chunk_size, count);
+            tasks.run([&func, c, begin, end]() { func(c, begin, end); });
+        }
+
+        func(0, 0, std::min(chunk_size, count));
+        tasks.wait();
+
+        return num_chunks;
+    }
+
+    // Host versions of build_hlbvh.cl helpers, they should produce bit identical results.
+    // Expands a 10-bit integer into 30 bits
+    // by inserting 2 zeros after each bit.
+    static inline std::uint32_t ExpandBits(std::uint32_t v)
+    {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    // Calculates a 30-bit Morton code for the
+    // given 3D point located within the unit cube [0,1].
+    // fmin/fmax follow OpenCL min/max and map NaN (degenerate extents) to 0.
+    static inline std::uint32_t CalculateMortonCode(float px, float py, float pz)
+    {
+        float x = std::fmin(std::fmax(px * 1024.f, 0.f), 1023.f);
+        float y = std::fmin(std::fmax(py * 1024.f, 0.f), 1023.f);
+        float z = std::fmin(std::fmax(pz * 1024.f, 0.f), 1023.f);
+        return ExpandBits((std::uint32_t)x) * 4 + ExpandBits((std::uint32_t)y) * 2 + ExpandBits((std::uint32_t)z);
+    }
+
+    static inline int CountLeadingZeros(std::uint32_t v)
+    {
+        if (v == 0)
+        {
+            return 32;
+        }
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_clz(v);
+#else
+        int n = 0;
+        while (!(v & 0x80000000u))
+        {
+            v <<= 1;
+            ++n;
+        }
+        return n;
+#endif
+    }
+
+    // Longest common prefix of the codes at i1 and i2, indices are used
+    // to break ties between duplicated codes, -1 is returned out of range.
+    static inline int Delta(std::uint32_t const* codes, int num_prims, int i1, int i2)
+    {
+        int left = std::min(i1, i2);
+        int right = std::max(i1, i2);
+
+        if (left < 0 || right >= num_prims)
+        {
+            return -1;
+        }
+
+        return codes[left] != codes[right] ?
+            CountLeadingZeros(codes[left] ^ codes[right]) :
+            (32 + CountLeadingZeros((std::uint32_t)(left ^ right)));
+    }
+
+    // Find span [x, y] occupied by internal node idx
+    static inline void FindSpan(std::uint32_t const* codes, int num_prims, int idx, int& x, int& y)
+    {
+        // Direction of the range
+        int d = Delta(codes, num_prims, idx, idx + 1) - Delta(codes, num_prims, idx, idx - 1) > 0 ? 1 : -1;
+
+        // Minimum number of bits for the break on the other side
+        int delta_min = Delta(codes, num_prims, idx, idx - d);
+
+        // Conservative far end
+        int lmax = 2;
+        while (Delta(codes, num_prims, idx, idx + lmax * d) > delta_min)
+            lmax *= 2;
+
+        // Binary search for the exact bound
+        int l = 0;
+        int t = lmax;
+        do
+        {
+            t /= 2;
+            if (Delta(codes, num_prims, idx, idx + (l + t) * d) > delta_min)
+            {
+                l = l + t;
+            }
+        }
+        while (t > 1);
+
+        x = std::min(idx, idx + l * d);
+        y = std::max(idx, idx + l * d);
+    }
+
+    // Find split position within the span
+    static inline int FindSplit(std::uint32_t const* codes, int num_prims, int left, int right)
+    {
+        int num_identical = Delta(codes, num_prims, left, right);
+
+        do
+        {
+            int new_split = (right + left) / 2;
+
+            if (Delta(codes, num_prims, left, new_split) > num_identical)
+            {
+                left = new_split;
+            }
+            else
+            {
+                right = new_split;
+            }
+        }
+        while (right > left + 1);
+
+        return left;
+    }
+    
+    // Build steps shared by the host kernels and BuildOnHost,
+    // each processes primitives [begin, end).
+    static void CalculateMortonCodes(bbox const* bounds, bbox const& scene_bound, std::uint32_t* codes, int begin, int end)
+    {
+        float3 const scene_min = scene_bound.pmin;
+        float3 const scene_extents = scene_bound.pmax - scene_bound.pmin;
+
+        for (int i = begin; i < end; ++i)
+        {
+            float3 const center = (bounds[i].pmax + bounds[i].pmin) * 0.5f;
+            codes[i] = CalculateMortonCode((center.x - scene_min.x) / scene_extents.x,
+                                           (center.y - scene_min.y) / scene_extents.y,
+                                           (center.z - scene_min.z) / scene_extents.z);
+        }
+    }
+
+    // First N-1 nodes are internal, last N are leafs
+    static void EmitHierarchy(std::uint32_t const* sorted_codes, bbox const* bounds, int const* sorted_indices, int num_prims,
+                              Hlbvh::Node* nodes, bbox* sorted_bounds, int begin, int end)
+    {
+        int const leaf_base = num_prims - 1;
+
+        for (int i = begin; i < end; ++i)
+        {
+            // Set child
+            Hlbvh::Node& leaf = nodes[leaf_base + i];
+            leaf.left = leaf.right = sorted_indices[i];
+            leaf.next = -1;
+            sorted_bounds[leaf_base + i] = bounds[sorted_indices[i]];
+
+            // Set internal nodes
+            if (i < num_prims - 1)
+            {
+                int x = 0;
+                int y = 0;
+                FindSpan(sorted_codes, num_prims, i, x, y);
+
+                int split = FindSplit(sorted_codes, num_prims, x, y);
+
+                int c1idx = (split == x) ? leaf_base + split : split;
+                int c2idx = (split + 1 == y) ? leaf_base + split + 1 : split + 1;
+
+                nodes[i].left = c1idx;
+                nodes[i].right = c2idx;
+                nodes[i].next = -1;
+                nodes[c1idx].parent = i;
+                nodes[c2idx].parent = i;
+            }
+        }
+    }
+
+    // Refit bounds bottom up: the second child to arrive at a node
+    // computes its bounds, the first one bails out. flags start zeroed.
+    static void RefitBounds(bbox* bounds, int num_prims, Hlbvh::Node const* nodes, std::atomic<int>* flags, int begin, int end)
+    {
+        int const leaf_base = num_prims - 1;
+
+        for (int i = begin; i < end; ++i)
+        {
+            int idx = leaf_base + i;
+
+            do
+            {
+                idx = nodes[idx].parent;
+
+                if (flags[idx].fetch_add(1, std::memory_order_acq_rel) == 0)
+                {
+                    break;
+                }
+
+                bbox b = bounds[nodes[idx].left];
+                b.grow(bounds[nodes[idx].right]);
+                bounds[idx] = b;
+            }
+            while (idx != 0);
+        }
+    }
+
+    // Host device versions of the build_hlbvh.cl kernels,
+    // arguments follow the OpenCL kernel signatures.
+    static void CalculateMortonCodeHost(Calc::HostArgs const& args, std::size_t begin, std::size_t end)
+    {
+        auto primitive_bounds = args.GetBuffer<bbox const>(0);
+        auto num_primitive_bounds = args.GetValue<int>(1);
+        auto scene_bound = args.GetBuffer<bbox const>(2);
+        auto morton_codes = args.GetBuffer<std::uint32_t>(3);
+
+        CalculateMortonCodes(primitive_bounds, *scene_bound, morton_codes,
+            static_cast<int>(begin), std::min(static_cast<int>(end), num_primitive_bounds));
+    }
+
+    static void EmitHierarchyHost(Calc::HostArgs const& args, std::size_t begin, std::size_t end)
+    {
+        auto morton_codes = args.GetBuffer<std::uint32_t const>(0);
+        auto bounds = args.GetBuffer<bbox const>(1);
+        auto indices = args.GetBuffer<int const>(2);
+        auto num_prims = args.GetValue<int>(3);
+        auto nodes = args.GetBuffer<Hlbvh::Node>(4);
+        auto bounds_sorted = args.GetBuffer<bbox>(5);
+
+        EmitHierarchy(morton_codes, bounds, indices, num_prims, nodes, bounds_sorted,
+            static_cast<int>(begin), std::min(static_cast<int>(end), num_prims));
+    }
+
+    static void RefitBoundsHost(Calc::HostArgs const& args, std::size_t begin, std::size_t end)
+    {
+        static_assert(sizeof(std::atomic<int>) == sizeof(int), "Flags buffer is accessed as atomics");
+
+        auto bounds = args.GetBuffer<bbox>(0);
+        auto num_prims = args.GetValue<int>(1);
+        auto nodes = args.GetBuffer<Hlbvh::Node const>(2);
+        auto flags = reinterpret_cast<std::atomic<int>*>(args.GetBuffer<int>(3));
+
+        RefitBounds(bounds, num_prims, nodes, flags,
+            static_cast<int>(begin), std::min(static_cast<int>(end), num_prims));
+    }
+
+    // Host device work runs on the scheduler shared with the builders,
+    // so the device does not start threads of its own
+    static void RunOnScheduler(std::size_t count, std::function<void(std::size_t)> const& task)
+    {
+        parallel_for(0, static_cast<int>(count), 1, [&task](int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                task(static_cast<std::size_t>(i));
+            }
+        });
+    }
+
+    static Calc::HostFunctionEntry const kHostFunctions[] =
+    {
+        { "calculate_morton_code_main", CalculateMortonCodeHost },
+        { "emit_hierarchy_main", EmitHierarchyHost },
+        { "refit_bounds_main", RefitBoundsHost }
+    };
     
-    Hlbvh::Hlbvh(Calc::Device* device)
+    Hlbvh::Hlbvh(Calc::Device* device, std::string const& kernel_cache_path)
     : m_device(device)
     , m_gpudata(new GpuData(device))
+    , m_num_prims(0)
     {
-        InitGpuData();
+        InitGpuData(kernel_cache_path);
     }
     
     
@@ -64,11 +354,11 @@ namespace RadeonRays
     
     void Hlbvh::AllocateBuffers(size_t num_prims)
     {
+        // Buffers are reallocated when the scene outgrows them
+        m_gpudata->DeleteBuffers();
+
         // * 3 since only triangles are supported just yet
         m_gpudata->positions = m_device->CreateBuffer(num_prims * sizeof(float3), Calc::BufferType::kWrite);
-        // * 3 since 3 vertex indices + 1 material idx
-        m_gpudata->morton_codes = m_device->CreateBuffer(num_prims * sizeof(int), Calc::BufferType::kWrite);
-        
         
         std::vector<int> iota(num_prims);
         std::iota(iota.begin(), iota.end(), 0);
@@ -82,38 +372,51 @@ namespace RadeonRays
         // Bounds
         m_gpudata->bounds = m_device->CreateBuffer(num_prims * sizeof(bbox), Calc::BufferType::kWrite);
         m_gpudata->scene_bound = m_device->CreateBuffer(sizeof(bbox), Calc::BufferType::kRead);
-        m_gpudata->sorted_bounds = m_device->CreateBuffer(num_prims * sizeof(bbox), Calc::BufferType::kWrite);
+        // Leafs and internal nodes
+        m_gpudata->sorted_bounds = m_device->CreateBuffer(2 * num_prims * sizeof(bbox), Calc::BufferType::kWrite);
         // Propagation flags
         m_gpudata->flags = m_device->CreateBuffer(2 * num_prims * sizeof(int), Calc::BufferType::kWrite);
     }
     
-    void Hlbvh::InitGpuData()
+    void Hlbvh::InitGpuData(std::string const& kernel_cache_path)
     {
+        KernelCache kernels(m_device, kernel_cache_path);
         
+        // Host device runs the C++ versions of the kernels
+        if (m_device->GetPlatform() == Calc::Platform::kHost)
+        {
+            auto host_device = static_cast<Calc::DeviceHost*>(m_device);
+            host_device->SetExecutor(RunOnScheduler, static_cast<std::uint32_t>(task_scheduler::instance().num_threads()));
+            m_gpudata->executable = host_device->CreateExecutable(kHostFunctions, sizeof(kHostFunctions) / sizeof(kHostFunctions[0]));
+        }
 #ifndef RR_EMBED_KERNELS
-        if ( m_device->GetPlatform() == Calc::Platform::kOpenCL )
+        else if ( m_device->GetPlatform() == Calc::Platform::kOpenCL )
         {
-            m_gpudata->executable = m_device->CompileExecutable( "../RadeonRays/src/kernels/CL/build_hlbvh.cl", nullptr, 0, nullptr );
+            char const* headers[] = { "../RadeonRays/src/kernels/CL/common.cl" };
+
+            int numheaders = sizeof( headers ) / sizeof( char const* );
+
+            m_gpudata->executable = kernels.CompileExecutable( "../RadeonRays/src/kernels/CL/build_hlbvh.cl", headers, numheaders, nullptr );
         }
 
         else
         {
             assert( m_device->GetPlatform() == Calc::Platform::kVulkan );
-            m_gpudata->executable = m_device->CompileExecutable( "../RadeonRays/src/kernels/GLSL/hlbvh_build.comp", nullptr, 0, nullptr );
+            m_gpudata->executable = kernels.CompileExecutable( "../RadeonRays/src/kernels/GLSL/hlbvh_build.comp", nullptr, 0, nullptr );
         }
 #else
         auto& device = m_device;
 #if USE_OPENCL
-        if (device->GetPlatform() == Calc::Platform::kOpenCL)
+        if (m_gpudata->executable == nullptr && device->GetPlatform() == Calc::Platform::kOpenCL)
         {
-            m_gpudata->executable = m_device->CompileExecutable(g_build_hlbvh_opencl, std::strlen(g_build_hlbvh_opencl), nullptr);
+            m_gpudata->executable = kernels.CompileExecutable(g_build_hlbvh_opencl, std::strlen(g_build_hlbvh_opencl), nullptr);
         }
 #endif
 
 #if USE_VULKAN
         if (m_gpudata->executable == nullptr && device->GetPlatform() == Calc::Platform::kVulkan)
         {
-            m_gpudata->executable = m_device->CompileExecutable(g_hlbvh_build_vulkan, std::strlen(g_hlbvh_build_vulkan), nullptr);
+            m_gpudata->executable = kernels.CompileExecutable(g_hlbvh_build_vulkan, std::strlen(g_hlbvh_build_vulkan), nullptr);
         }
 #endif
 
@@ -125,38 +428,78 @@ namespace RadeonRays
         // Allocate GPU buffers
         AllocateBuffers(INITIAL_TRIANGLE_CAPACITY);
         
-        // Initialize parallel primitives
-        if (!m_device->HasBuiltinPrimitives())
+        // Initialize parallel primitives,
+        // if there are none BuildImpl falls back to the host build
+        if (m_device->HasBuiltinPrimitives())
         {
-            throw ExceptionImpl("This device does not support HLBVH construction\n");
+            m_gpudata->pp = m_device->CreatePrimitives();
         }
-        
-        m_gpudata->pp = m_device->CreatePrimitives();
     }
     
     // Build function
     void Hlbvh::Build(bbox const* bounds, int numbounds)
     {
-//#ifdef _DEBUG
+#ifdef _DEBUG
         auto s = std::chrono::high_resolution_clock::now();
-//#endif
+#endif
         BuildImpl(bounds, numbounds);
-//#ifdef _DEBUG
         m_device->Finish(0);
+#ifdef _DEBUG
         // Note, that this is total time spent for setup and construction 
         // including the time spent waiting in the queue.
         auto d = std::chrono::high_resolution_clock::now() - s;
         std::cout << "HLBVH setup + construction CPU time: " << std::chrono::duration_cast<std::chrono::milliseconds>(d).count() << "ms\n";
-//#endif
+#endif
     }
     
     
     // World space bounding box
     bbox const& Hlbvh::Bounds() const
     {
-        // TODO: implement me
-        static bbox s_tmp;
-        return s_tmp;
+        return m_bounds;
+    }
+
+    void Hlbvh::GetStatistics(BvhStatistics& stats, float3 const* triangles) const
+    {
+        int num_nodes = m_num_prims > 0 ? 2 * m_num_prims - 1 : 0;
+        std::vector<Node> nodes(num_nodes);
+        std::vector<bbox> node_bounds(num_nodes);
+        std::vector<TreeletOptimizer::Node> flat(num_nodes);
+
+        if (num_nodes > 0)
+        {
+            m_device->ReadTypedBuffer(m_gpudata->nodes, 0, 0, num_nodes, &nodes[0], nullptr);
+            m_device->ReadTypedBuffer(m_gpudata->sorted_bounds, 0, 0, num_nodes, &node_bounds[0], nullptr);
+            m_device->Finish(0);
+        }
+
+        // First N-1 nodes are internal, last N are leafs holding the primitive index in left
+        for (int i = 0; i < num_nodes; ++i)
+        {
+            bool leaf = i >= m_num_prims - 1;
+            TreeletOptimizer::Node node = { node_bounds[i], i == 0 ? -1 : nodes[i].parent,
+                leaf ? -1 : nodes[i].left, leaf ? -1 : nodes[i].right, leaf ? 1 : 0 };
+            flat[i] = node;
+        }
+
+        BvhStatisticsCollector::Collect(flat, 0, stats);
+
+        if (triangles && num_nodes > 0)
+        {
+            std::vector<int> first(num_nodes, 0);
+            std::vector<float3> leaf_triangles(3 * m_num_prims);
+
+            for (int i = m_num_prims - 1; i < num_nodes; ++i)
+            {
+                int leaf = i - (m_num_prims - 1);
+                first[i] = leaf;
+                std::copy(triangles + 3 * nodes[i].left, triangles + 3 * nodes[i].left + 3, &leaf_triangles[3 * leaf]);
+            }
+
+            stats.epo = BvhStatisticsCollector::CalculateEpo(flat, 0, first, leaf_triangles);
+        }
+
+        stats.bvh_bytes = num_nodes * (sizeof(Node) + sizeof(bbox));
     }
     
     // Build function
@@ -167,7 +510,7 @@ namespace RadeonRays
         // Make sure to allocate enough mem on GPU
         // We are trying to reuse space as reallocation takes time
         // but this call might be really frequent
-        if (size > m_gpudata->positions->GetSize())
+        if (static_cast<std::size_t>(size) > m_gpudata->positions->GetSize() / sizeof(float3))
         {
             AllocateBuffers(size);
         }
@@ -177,8 +520,24 @@ namespace RadeonRays
         for (auto i = 0; i < numbounds; ++i)
             scene_bound.grow(bounds[i]);
 
+        m_bounds = scene_bound;
+        m_num_prims = numbounds;
+
         m_device->WriteBuffer(m_gpudata->scene_bound, 0, 0, sizeof(bbox), &scene_bound, nullptr);
 
+        // No parallel primitives on this device: build on the host and upload
+        if (!m_gpudata->pp)
+        {
+            std::vector<Node> nodes;
+            std::vector<bbox> node_bounds;
+            BuildOnHost(bounds, numbounds, nodes, node_bounds, m_prim_indices);
+
+            m_device->WriteBuffer(m_gpudata->nodes, 0, 0, sizeof(Node) * nodes.size(), &nodes[0], nullptr);
+            m_device->WriteBuffer(m_gpudata->sorted_bounds, 0, 0, sizeof(bbox) * node_bounds.size(), &node_bounds[0], nullptr);
+            m_device->Finish(0);
+            return;
+        }
+
         // Write bounds buffer
         {
             bbox* tmp = nullptr;
@@ -216,8 +575,8 @@ namespace RadeonRays
         // Sort primitives according to their Morton codes
         m_gpudata->pp->SortRadixInt32(0, m_gpudata->morton_codes, m_gpudata->sorted_morton_codes, m_gpudata->prim_indices, m_gpudata->sorted_prim_indices, size);
 
-        std::vector<int> codes(size);
-        m_device->ReadBuffer(m_gpudata->sorted_prim_indices, 0, 0, sizeof(int) * size, &codes[0], nullptr);
+        m_prim_indices.resize(size);
+        m_device->ReadBuffer(m_gpudata->sorted_prim_indices, 0, 0, sizeof(int) * size, &m_prim_indices[0], nullptr);
         m_device->Finish(0);
        
         // Prepare tree construction kernel
@@ -247,4 +606,123 @@ namespace RadeonRays
         // Launch refit kernel
         m_device->Execute(m_gpudata->refit_func, 0, globalsize, kWorkGroupSize, nullptr);
     }
+
+    void Hlbvh::BuildOnHost(bbox const* bounds, int numbounds,
+                            std::vector<Node>& nodes,
+                            std::vector<bbox>& node_bounds,
+                            std::vector<int>& prim_indices)
+    {
+        int num_prims = numbounds;
+
+        nodes.resize(std::max(2 * num_prims - 1, 0));
+        node_bounds.resize(nodes.size());
+        prim_indices.resize(num_prims);
+
+        if (num_prims == 0)
+        {
+            return;
+        }
+
+        // Evaluate scene bounds
+        std::vector<bbox> chunk_bounds(std::thread::hardware_concurrency() + 1);
+        int num_chunks = ParallelChunks(num_prims, [&](int chunk, int begin, int end)
+        {
+            bbox b;
+            for (int i = begin; i < end; ++i)
+                b.grow(bounds[i]);
+            chunk_bounds[chunk] = b;
+        });
+
+        bbox scene_bound;
+        for (int c = 0; c < num_chunks; ++c)
+            scene_bound.grow(chunk_bounds[c]);
+
+        // Calculate Morton codes
+        std::vector<std::uint32_t> codes(num_prims);
+        std::vector<std::uint32_t> sorted_codes(num_prims);
+        std::vector<int> indices(num_prims);
+
+        ParallelChunks(num_prims, [&](int, int begin, int end)
+        {
+            CalculateMortonCodes(bounds, scene_bound, &codes[0], begin, end);
+            std::iota(&indices[0] + begin, &indices[0] + end, begin);
+        });
+
+        // Sort primitives according to their Morton codes:
+        // LSD radix sort, stable so duplicated codes keep input order like on GPU.
+        // Each chunk histograms its range, then scatters into its own slice of every bucket.
+        std::vector<int> histograms(chunk_bounds.size() * kRadixBuckets);
+
+        for (int shift = 0; shift < 30; shift += kRadixBits)
+        {
+            std::fill(histograms.begin(), histograms.end(), 0);
+
+            num_chunks = ParallelChunks(num_prims, [&](int chunk, int begin, int end)
+            {
+                int* histogram = &histograms[chunk * kRadixBuckets];
+                for (int i = begin; i < end; ++i)
+                    ++histogram[(codes[i] >> shift) & (kRadixBuckets - 1)];
+            });
+
+            // All keys share the digit, nothing to do for this pass
+            int first_digit = (codes[0] >> shift) & (kRadixBuckets - 1);
+            int first_digit_count = 0;
+            for (int c = 0; c < num_chunks; ++c)
+                first_digit_count += histograms[c * kRadixBuckets + first_digit];
+
+            if (first_digit_count == num_prims)
+            {
+                continue;
+            }
+
+            // Exclusive scan in digit major, chunk minor order
+            int offset = 0;
+            for (int d = 0; d < kRadixBuckets; ++d)
+            {
+                for (int c = 0; c < num_chunks; ++c)
+                {
+                    int count = histograms[c * kRadixBuckets + d];
+                    histograms[c * kRadixBuckets + d] = offset;
+                    offset += count;
+                }
+            }
+
+            ParallelChunks(num_prims, [&](int chunk, int begin, int end)
+            {
+                int* offsets = &histograms[chunk * kRadixBuckets];
+                for (int i = begin; i < end; ++i)
+                {
+                    int dst = offsets[(codes[i] >> shift) & (kRadixBuckets - 1)]++;
+                    sorted_codes[dst] = codes[i];
+                    prim_indices[dst] = indices[i];
+                }
+            });
+
+            codes.swap(sorted_codes);
+            indices.swap(prim_indices);
+        }
+
+        prim_indices.swap(indices);
+
+        // Emit hierarchy
+        nodes[0].parent = -1;
+
+        ParallelChunks(num_prims, [&](int, int begin, int end)
+        {
+            EmitHierarchy(&codes[0], bounds, &prim_indices[0], num_prims, &nodes[0], &node_bounds[0], begin, end);
+        });
+
+        // Refit bounds
+        if (num_prims > 1)
+        {
+            std::vector<std::atomic<int>> flags(num_prims - 1);
+            for (auto& f : flags)
+                f.store(0, std::memory_order_relaxed);
+
+            ParallelChunks(num_prims, [&](int, int begin, int end)
+            {
+                RefitBounds(&node_bounds[0], num_prims, &nodes[0], &flags[0], begin, end);
+            });
+        }
+    }
 }
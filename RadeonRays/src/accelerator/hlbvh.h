@@ -29,16 +29,22 @@ THE SOFTWARE.
 #include "../accelerator/bvh.h"
 
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace RadeonRays
 {
+    struct BvhStatistics;
+
     ///< The class represents hierarchical LBVH constructed fully on GPU
     ///< https://research.nvidia.com/sites/default/files/publications/HLBVH-final.pdf
+    ///< If the device has no parallel primitives the same algorithm runs on the host
+    ///< and the result is uploaded in the layout the GPU kernels produce.
     ///
     class Hlbvh
     {
     public:
-        Hlbvh(Calc::Device* device);
+        Hlbvh(Calc::Device* device, std::string const& kernel_cache_path);
         
         virtual ~Hlbvh();
         
@@ -56,13 +62,28 @@ namespace RadeonRays
         // Get reordered indices
         int const* GetIndices() const { return &m_prim_indices[0]; }
 
+        // Read the tree back and fill tree metrics and bvh_bytes of stats (see BvhStatisticsCollector).
+        // End-point overlap needs triangles, 3 vertices per primitive in the order of
+        // the bounds passed to Build, it is skipped if triangles is nullptr.
+        void GetStatistics(BvhStatistics& stats, float3 const* triangles) const;
+
+        // BVH node
+        struct Node;
+
+        // Host side build: Morton codes, radix sort, hierarchy emission and refit.
+        // Fills 2 * numbounds - 1 nodes (first N-1 internal, last N leafs),
+        // their bounds and primitive indices in Morton order.
+        static void BuildOnHost(bbox const* bounds, int numbounds,
+                                std::vector<Node>& nodes,
+                                std::vector<bbox>& node_bounds,
+                                std::vector<int>& prim_indices);
     
     protected:
         // Build function
         virtual void BuildImpl(bbox const* bounds, int numbounds);
         
     private:
-        void InitGpuData();
+        void InitGpuData(std::string const& kernel_cache_path);
         void AllocateBuffers(size_t numprims);
         
         Hlbvh(Hlbvh const&);
@@ -74,13 +95,17 @@ namespace RadeonRays
         // Device data types
         struct Box;
         struct SplitRequest;
-        struct Node;
         
         // GPU data
         std::unique_ptr<GpuData> m_gpudata;
         
         // Primitive indices
         std::vector<int> m_prim_indices;
+
+        // Bounds of the last build
+        bbox m_bounds;
+        // Number of primitives of the last build
+        int m_num_prims;
     };
     
     // BVH node
@@ -133,26 +158,50 @@ namespace RadeonRays
 
         GpuData(Calc::Device* dev)
             : device(dev)
+            , pp(nullptr)
+            , executable(nullptr)
+            , morton_code_func(nullptr)
+            , build_func(nullptr)
+            , refit_func(nullptr)
+            , positions(nullptr)
+            , morton_codes(nullptr)
+            , prim_indices(nullptr)
+            , sorted_morton_codes(nullptr)
+            , sorted_prim_indices(nullptr)
+            , nodes(nullptr)
+            , bounds(nullptr)
+            , sorted_bounds(nullptr)
+            , scene_bound(nullptr)
+            , flags(nullptr)
         {
         }
 
+        void DeleteBuffers()
+        {
+            Calc::Buffer** buffers[] = { &positions, &morton_codes, &prim_indices, &sorted_morton_codes,
+                &sorted_prim_indices, &nodes, &bounds, &sorted_bounds, &scene_bound, &flags };
+
+            for (auto buffer : buffers)
+            {
+                if (*buffer)
+                {
+                    device->DeleteBuffer(*buffer);
+                    *buffer = nullptr;
+                }
+            }
+        }
+
         ~GpuData()
         {
             executable->DeleteFunction(morton_code_func);
             executable->DeleteFunction(build_func);
             executable->DeleteFunction(refit_func);
             device->DeleteExecutable(executable);
-            device->DeletePrimitives(pp);
-            device->DeleteBuffer(positions);
-            device->DeleteBuffer(morton_codes);
-            device->DeleteBuffer(prim_indices);
-            device->DeleteBuffer(sorted_morton_codes);
-            device->DeleteBuffer(sorted_prim_indices);
-            device->DeleteBuffer(nodes);
-            device->DeleteBuffer(bounds);
-            device->DeleteBuffer(sorted_bounds);
-            device->DeleteBuffer(scene_bound);
-            device->DeleteBuffer(flags);
+            if (pp)
+            {
+                device->DeletePrimitives(pp);
+            }
+            DeleteBuffers();
         }
     };
 }
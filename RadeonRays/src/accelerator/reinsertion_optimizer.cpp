@@ -0,0 +1,239 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "reinsertion_optimizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace RadeonRays
+{
+    // Fraction of internal nodes reinserted per round
+    static float constexpr kBatchFraction = 0.01f;
+    // Minimum relative cost reduction for a round to be kept
+    static double constexpr kMinImprovement = 1e-4;
+
+    int ReinsertionOptimizer::Optimize(std::vector<Node>& nodes, int root) const
+    {
+        if (m_time_budget <= 0.f || nodes.empty() || nodes[root].left == -1)
+        {
+            return root;
+        }
+
+        auto deadline = std::chrono::steady_clock::now() +
+            std::chrono::microseconds(static_cast<long long>(m_time_budget * 1000.f));
+
+        // Internal nodes stay internal: removed ones are reused for insertions
+        std::vector<int> internals;
+        for (int i = 0; i < static_cast<int>(nodes.size()); ++i)
+        {
+            if (nodes[i].left != -1)
+            {
+                internals.push_back(i);
+            }
+        }
+
+        auto batch_size = std::max<std::size_t>(1u, static_cast<std::size_t>(internals.size() * kBatchFraction));
+
+        double best_cost = InternalArea(nodes, internals);
+        std::vector<Node> best_nodes(nodes);
+        int best_root = root;
+
+        std::vector<std::pair<float, int>> candidates;
+        candidates.reserve(internals.size());
+
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            // Rank nodes by inefficiency: large nodes with small children go first
+            candidates.clear();
+            for (auto idx : internals)
+            {
+                if (nodes[idx].parent == -1)
+                {
+                    continue;
+                }
+
+                float area = nodes[idx].bounds.surface_area();
+                float left_area = nodes[nodes[idx].left].bounds.surface_area();
+                float right_area = nodes[nodes[idx].right].bounds.surface_area();
+                float denom = 0.5f * (left_area + right_area) * std::min(left_area, right_area);
+
+                candidates.push_back(std::make_pair(area * area * area / std::max(denom, std::numeric_limits<float>::min()), idx));
+            }
+
+            auto count = std::min(batch_size, candidates.size());
+            std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                std::greater<std::pair<float, int>>());
+
+            for (std::size_t i = 0; i < count && std::chrono::steady_clock::now() < deadline; ++i)
+            {
+                int idx = candidates[i].second;
+                int left = nodes[idx].left;
+                int right = nodes[idx].right;
+
+                // Earlier reinsertions could have moved the node next to the root
+                int parent = Remove(nodes, idx);
+                if (parent == -1)
+                {
+                    continue;
+                }
+
+                // Larger child picks its position first
+                if (nodes[left].bounds.surface_area() < nodes[right].bounds.surface_area())
+                {
+                    std::swap(left, right);
+                }
+
+                Insert(nodes, left, idx, root);
+                Insert(nodes, right, parent, root);
+            }
+
+            double cost = InternalArea(nodes, internals);
+
+            if (cost < best_cost * (1.0 - kMinImprovement))
+            {
+                best_cost = cost;
+                best_nodes = nodes;
+                best_root = root;
+            }
+            else
+            {
+                // The round did not pay off, keep the best tree and stop
+                break;
+            }
+        }
+
+        nodes.swap(best_nodes);
+        return best_root;
+    }
+
+    int ReinsertionOptimizer::Remove(std::vector<Node>& nodes, int idx)
+    {
+        int parent = nodes[idx].parent;
+        if (parent == -1 || nodes[parent].parent == -1)
+        {
+            return -1;
+        }
+
+        int grandparent = nodes[parent].parent;
+        int sibling = nodes[parent].left == idx ? nodes[parent].right : nodes[parent].left;
+
+        (nodes[grandparent].left == parent ? nodes[grandparent].left : nodes[grandparent].right) = sibling;
+        nodes[sibling].parent = grandparent;
+        Refit(nodes, grandparent);
+
+        nodes[nodes[idx].left].parent = -1;
+        nodes[nodes[idx].right].parent = -1;
+        return parent;
+    }
+
+    void ReinsertionOptimizer::Insert(std::vector<Node>& nodes, int idx, int free_node, int& root)
+    {
+        bbox const& bounds = nodes[idx].bounds;
+        float const area = bounds.surface_area();
+
+        // Branch and bound: cost of a position is the area of the new node
+        // plus area increase induced on its ancestors
+        using Entry = std::pair<float, int>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+        queue.push(std::make_pair(0.f, root));
+
+        float best_cost = std::numeric_limits<float>::max();
+        int best = root;
+
+        while (!queue.empty())
+        {
+            auto induced = queue.top().first;
+            auto current = queue.top().second;
+            queue.pop();
+
+            // Lower bound for this node and everything after it in the queue
+            if (induced + area >= best_cost)
+            {
+                break;
+            }
+
+            auto const& node = nodes[current];
+            float cost = induced + bboxunion(node.bounds, bounds).surface_area();
+
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best = current;
+            }
+
+            if (node.left != -1)
+            {
+                float child_induced = cost - node.bounds.surface_area();
+
+                if (child_induced + area < best_cost)
+                {
+                    queue.push(std::make_pair(child_induced, node.left));
+                    queue.push(std::make_pair(child_induced, node.right));
+                }
+            }
+        }
+
+        // New internal node takes the place of best
+        int parent = nodes[best].parent;
+
+        auto& node = nodes[free_node];
+        node.parent = parent;
+        node.left = best;
+        node.right = idx;
+        node.bounds = bboxunion(nodes[best].bounds, bounds);
+
+        nodes[best].parent = free_node;
+        nodes[idx].parent = free_node;
+
+        if (parent == -1)
+        {
+            root = free_node;
+        }
+        else
+        {
+            (nodes[parent].left == best ? nodes[parent].left : nodes[parent].right) = free_node;
+            Refit(nodes, parent);
+        }
+    }
+
+    void ReinsertionOptimizer::Refit(std::vector<Node>& nodes, int idx)
+    {
+        for (; idx != -1; idx = nodes[idx].parent)
+        {
+            nodes[idx].bounds = bboxunion(nodes[nodes[idx].left].bounds, nodes[nodes[idx].right].bounds);
+        }
+    }
+
+    double ReinsertionOptimizer::InternalArea(std::vector<Node> const& nodes, std::vector<int> const& internals)
+    {
+        double area = 0.0;
+        for (auto idx : internals)
+        {
+            area += nodes[idx].bounds.surface_area();
+        }
+        return area;
+    }
+}
@@ -0,0 +1,68 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <vector>
+
+#include "treelet_optimizer.h"
+
+namespace RadeonRays
+{
+    ///< Insertion based BVH optimization
+    ///< "Fast Insertion-Based Optimization of Bounding Volume Hierarchies",
+    ///< Jiri Bittner, Michal Hapala, Vlastimil Havran, CGF 2013.
+    ///< Repeatedly removes the least efficient internal nodes and reinserts
+    ///< their children at the positions minimizing SAH cost found with
+    ///< branch and bound search, until the time budget runs out or a round
+    ///< stops paying off. Leaves and the number of nodes are preserved,
+    ///< so it works on the same flat view as TreeletOptimizer.
+    ///<
+    class ReinsertionOptimizer
+    {
+    public:
+        using Node = TreeletOptimizer::Node;
+
+        // Time budget in milliseconds
+        ReinsertionOptimizer(float time_budget)
+            : m_time_budget(time_budget)
+        {
+        }
+
+        // Optimize the tree rooted at root,
+        // returns the new root (the root can be reinserted as well)
+        int Optimize(std::vector<Node>& nodes, int root) const;
+
+    private:
+        // Detach node idx and its parent, sibling takes the parent's place.
+        // Returns the parent which is free now or -1 if idx is too close
+        // to the root to be removed.
+        static int Remove(std::vector<Node>& nodes, int idx);
+        // Insert subtree idx as a sibling of the best node found from root
+        static void Insert(std::vector<Node>& nodes, int idx, int free_node, int& root);
+        // Recompute bounds from idx up to the root
+        static void Refit(std::vector<Node>& nodes, int idx);
+        // Sum of internal node areas, the only part of SAH cost reinsertion changes
+        static double InternalArea(std::vector<Node> const& nodes, std::vector<int> const& internals);
+
+        float m_time_budget;
+    };
+}
@@ -1,9 +1,58 @@
 #include "split_bvh.h"
 #include "math/mathutils.h"
+#include "../async/thread_pool.h"
 #include <cassert>
+#include <algorithm>
+#include <cstdint>
+#include <stack>
+#include <thread>
 
 namespace RadeonRays
 {
+    // Subtrees with at least that many refs are built on a separate thread
+    static int constexpr kParallelBuildThreshold = 4096;
+    // Nodes with at least that many refs are binned on several threads
+    static int constexpr kParallelBinningThreshold = 65536;
+
+    // Fill bins from refs [begin, end) with bin(begin, end, bins), splitting
+    // large ranges into chunks binned on separate threads and merged in order
+    template <typename Bins, typename BinFunc, typename MergeFunc>
+    static void ParallelBin(int begin, int end, Bins& bins, BinFunc const& bin, MergeFunc const& merge)
+    {
+        int count = end - begin;
+
+        if (count < kParallelBinningThreshold)
+        {
+            bin(begin, end, bins);
+            return;
+        }
+
+        int num_chunks = std::min<int>(std::max(1u, std::thread::hardware_concurrency()), count / (kParallelBinningThreshold / 4));
+        int chunk_size = (count + num_chunks - 1) / num_chunks;
+
+        std::vector<Bins> chunk_bins(num_chunks - 1, bins);
+        task_group chunk_tasks;
+
+        for (int i = 1; i < num_chunks; ++i)
+        {
+            int chunk_begin = std::min(begin + i * chunk_size, end);
+            int chunk_end = std::min(chunk_begin + chunk_size, end);
+
+            chunk_tasks.run([&, i, chunk_begin, chunk_end]()
+            {
+                bin(chunk_begin, chunk_end, chunk_bins[i - 1]);
+            });
+        }
+
+        bin(begin, std::min(begin + chunk_size, end), bins);
+        chunk_tasks.wait();
+
+        for (int i = 1; i < num_chunks; ++i)
+        {
+            merge(chunk_bins[i - 1], bins);
+        }
+    }
+
     static float3 clamp3(float3 val, float3 a, float3 b)
     {
         return float3{ clamp(val.x, a.x, b.x), clamp(val.y, a.y, b.y), clamp(val.z, a.z, b.z) };
@@ -11,11 +60,13 @@ namespace RadeonRays
 
     void SplitBvh::BuildImpl(bbox const* bounds, int numbounds)
     {
+        // Spatial splits can add up to the budget of extra refs, reserve
+        // space for them up front so the array never has to grow
+        int max_refs = numbounds + static_cast<int>(numbounds * m_extra_refs_budget);
+
         // Initialize prim refs structures
-        PrimRefArray primrefs(numbounds);
+        PrimRefArray primrefs(max_refs);
 
-        // Keep centroids to speed up partitioning
-        std::vector<float3> centroids(numbounds);
         bbox centroid_bounds;
 
         for (auto i = 0; i < numbounds; ++i)
@@ -27,36 +78,76 @@ namespace RadeonRays
         }
 
         m_num_nodes_for_regular = (2 * numbounds - 1);
-        m_num_nodes_required = (int)(m_num_nodes_for_regular * (1.f + m_extra_refs_budget));
+        // Every leaf holds at least one ref
+        m_num_nodes_required = (2 * max_refs - 1);
 
         InitNodeAllocator(m_num_nodes_required);
 
         SplitRequest init = { 0, numbounds, nullptr, m_bounds, centroid_bounds, 0 };
 
-        // Start from the top
-        BuildNode(init, primrefs);
+        // Start from the top, the whole array is the arena of the root
+        m_height = BuildNode(init, max_refs, primrefs);
+
+        m_root = &m_nodes[0];
+
+        // Leaves point into their arenas, which have gaps in between,
+        // so gather their refs in depth first order
+        m_packed_indices.clear();
+        m_packed_indices.reserve(max_refs);
+
+        std::stack<Node*> stack;
+        stack.push(m_root);
+
+        while (!stack.empty())
+        {
+            auto node = stack.top();
+            stack.pop();
+
+            if (node->type == kLeaf)
+            {
+                auto startidx = node->startidx;
+                node->startidx = static_cast<int>(m_packed_indices.size());
+
+                for (int i = startidx; i < startidx + node->numprims; ++i)
+                {
+                    m_packed_indices.push_back(primrefs[i].idx);
+                }
+            }
+            else
+            {
+                stack.push(node->rc);
+                stack.push(node->lc);
+            }
+        }
     }
 
-    void SplitBvh::BuildNode(SplitRequest& req, PrimRefArray& primrefs)
+    int SplitBvh::BuildNode(SplitRequest& req, int arena_end, PrimRefArray& primrefs)
     {
-        // Update current height
-        m_height = std::max(m_height, req.level);
-
         // Allocate new node
         Node* node = AllocateNode();
         node->bounds = req.bounds;
 
-        // Create leaf node if we have enough prims
-        if (req.numprims < 2)
+        int height = req.level;
+
+        SahSplit os;
+        bool make_leaf = req.numprims < 2;
+
+        if (!make_leaf)
+        {
+            os = FindObjectSahSplit(req, primrefs);
+            // Create leaf node if intersecting all its prims (cost of numprims
+            // as SAH is normalized to triangle cost) is cheaper than splitting
+            make_leaf = req.numprims <= m_max_leaf_size &&
+                (is_nan(os.split) || req.numprims <= os.sah);
+        }
+
+        // Create leaf node if we have enough prims.
+        // Leaf refs are packed once the whole tree is built.
+        if (make_leaf)
         {
             node->type = kLeaf;
-            node->startidx = (int)m_packed_indices.size();
+            node->startidx = req.startidx;
             node->numprims = req.numprims;
-
-            for (int i = req.startidx; i < req.startidx + req.numprims; ++i)
-            {
-                m_packed_indices.push_back(primrefs[i].idx);
-            }
         }
         else
         {
@@ -66,22 +157,25 @@ namespace RadeonRays
             int axis = req.centroid_bounds.maxdim();
             float border = req.centroid_bounds.center()[axis];
 
-            SahSplit os = FindObjectSahSplit(req, primrefs);
             SahSplit ss;
             auto split_type = SplitType::kObject;
 
+            // Space left in the arena for extra refs
+            int free_refs = arena_end - (req.startidx + req.numprims);
+
             // Only use split if
             // 1. Maximum depth is not exceeded
             // 2. We found spatial split
             // 3. It is better than object split
             // 4. Object split is not good enought (too much overlap)
-            // 5. Our node budget still allows us to split references
-            if (req.level < m_max_split_depth && m_nodecnt < m_num_nodes_required && os.overlap > m_min_overlap)
+            // 5. Our arena still has room for the split references
+            if (req.level < m_max_split_depth && free_refs > 0 && os.overlap > m_min_overlap)
             {
                 ss = FindSpatialSahSplit(req, primrefs);
 
                 if (!is_nan(ss.split) &&
-                    ss.sah < os.sah)
+                    ss.sah < os.sah &&
+                    CountSplitPrimRefs(ss, req, primrefs) <= free_refs)
                 {
                     split_type = SplitType::kSpatial;
                 }
@@ -89,12 +183,6 @@ namespace RadeonRays
 
             if (split_type == SplitType::kSpatial)
             {
-                // First we need maximum 2x numprims elements allocated
-                if (primrefs.size() < req.startidx + req.numprims * 2)
-                {
-                    primrefs.resize(req.startidx + req.numprims * 2);
-                }
-
                 // Split prim refs and add extra refs to request
                 int extra_refs = 0;
                 SplitPrimRefs(ss, req, primrefs, extra_refs);
@@ -175,25 +263,53 @@ namespace RadeonRays
                 }
             }
 
+            int leftcount = splitidx - req.startidx;
+            int rightcount = req.numprims - leftcount;
+
+            // Give children their own arenas: the rest of the free space is shared
+            // proportionally to their ref counts, right refs move to the start of theirs
+            int end = req.startidx + req.numprims;
+            int leftfree = static_cast<int>(static_cast<std::int64_t>(arena_end - end) * leftcount / req.numprims);
+
+            if (leftfree > 0)
+            {
+                std::move_backward(primrefs.begin() + splitidx, primrefs.begin() + end, primrefs.begin() + end + leftfree);
+            }
+
             // Left request
-            SplitRequest leftrequest = { req.startidx, splitidx - req.startidx, &node->lc, leftbounds, leftcentroid_bounds, req.level + 1 };
+            SplitRequest leftrequest = { req.startidx, leftcount, &node->lc, leftbounds, leftcentroid_bounds, req.level + 1 };
             // Right request
-            SplitRequest rightrequest = { splitidx, req.numprims - (splitidx - req.startidx), &node->rc, rightbounds, rightcentroid_bounds, req.level + 1 };
+            SplitRequest rightrequest = { splitidx + leftfree, rightcount, &node->rc, rightbounds, rightcentroid_bounds, req.level + 1 };
 
+            int leftarena_end = splitidx + leftfree;
 
-            // The order is very important here since right node uses the space at the end of the array to partition
+            // Children work on disjoint arenas, so large subtrees
+            // are forked while the current thread takes the other one
+            if (req.numprims >= kParallelBuildThreshold && req.level < GetMaxForkLevel())
             {
-                BuildNode(rightrequest, primrefs);
-            }
+                int leftheight = 0;
+                task_group left;
+                left.run([&]()
+                {
+                    leftheight = BuildNode(leftrequest, leftarena_end, primrefs);
+                });
 
+                int rightheight = BuildNode(rightrequest, arena_end, primrefs);
+                left.wait();
+                height = std::max(leftheight, rightheight);
+            }
+            else
             {
-                // Put those to stack
-                BuildNode(leftrequest, primrefs);
+                int leftheight = BuildNode(leftrequest, leftarena_end, primrefs);
+                int rightheight = BuildNode(rightrequest, arena_end, primrefs);
+                height = std::max(leftheight, rightheight);
             }
         }
 
         // Set parent ptr if any
         if (req.ptr) *req.ptr = node;
+
+        return height;
     }
 
     SplitBvh::SahSplit SplitBvh::FindObjectSahSplit(SplitRequest const& req, PrimRefArray const& refs) const
@@ -208,6 +324,7 @@ namespace RadeonRays
         split.dim = 0;
         split.split = std::numeric_limits<float>::quiet_NaN();
         split.sah = sah;
+        split.overlap = 0.f;
 
         // if we cannot apply histogram algorithm
         // put NAN sentinel as split border
@@ -226,52 +343,66 @@ namespace RadeonRays
             int count;
         };
 
-        // Keep bins for each dimension
-        std::vector<Bin> bins[3];
-        bins[0].resize(m_num_bins);
-        bins[1].resize(m_num_bins);
-        bins[2].resize(m_num_bins);
+        // Keep bins for each dimension laid out one after another
+        std::vector<Bin> bins(3 * m_num_bins);
 
         // Precompute inverse parent area
         auto invarea = 1.f / req.bounds.surface_area();
         // Precompute min point
         auto rootmin = req.centroid_bounds.pmin;
+        auto invcentroid_extents = float3(1.f / centroid_extents.x, 1.f / centroid_extents.y, 1.f / centroid_extents.z);
 
-        // Evaluate all dimensions
-        for (int axis = 0; axis < 3; ++axis)
+        // Calc primitive refs histogram for all dimensions at once
+        auto bin_refs = [&](int begin, int end, std::vector<Bin>& chunk_bins)
         {
-            float rootminc = rootmin[axis];
-            // Range for histogram
-            auto centroid_rng = centroid_extents[axis];
-            auto invcentroid_rng = 1.f / centroid_rng;
-
-            // If the box is degenerate in that dimension skip it
-            if (centroid_rng == 0.f) continue;
-
-            // Initialize bins
-            for (unsigned i = 0; i < m_num_bins; ++i)
+            for (auto& bin : chunk_bins)
             {
-                bins[axis][i].count = 0;
-                bins[axis][i].bounds = bbox();
+                bin.count = 0;
+                bin.bounds = bbox();
             }
 
-            // Calc primitive refs histogram
-            for (int i = req.startidx; i < req.startidx + req.numprims; ++i)
+            for (int i = begin; i < end; ++i)
             {
-                auto idx = i;
-                auto binidx = (int)std::min<float>(m_num_bins * ((refs[idx].center[axis] - rootminc) * invcentroid_rng), m_num_bins - 1);
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    // If the box is degenerate in that dimension skip it
+                    if (centroid_extents[axis] == 0.f) continue;
+
+                    auto binidx = (int)std::min<float>(m_num_bins * ((refs[i].center[axis] - rootmin[axis]) * invcentroid_extents[axis]), m_num_bins - 1);
 
-                ++bins[axis][binidx].count;
-                bins[axis][binidx].bounds.grow(refs[idx].bounds);
+                    auto& bin = chunk_bins[axis * m_num_bins + binidx];
+                    ++bin.count;
+                    bin.bounds.grow(refs[i].bounds);
+                }
             }
+        };
+
+        auto merge_bins = [](std::vector<Bin> const& src, std::vector<Bin>& dst)
+        {
+            for (std::size_t i = 0; i < dst.size(); ++i)
+            {
+                dst[i].count += src[i].count;
+                dst[i].bounds.grow(src[i].bounds);
+            }
+        };
+
+        ParallelBin(req.startidx, req.startidx + req.numprims, bins, bin_refs, merge_bins);
+
+        std::vector<bbox> rightbounds(m_num_bins - 1);
 
-            std::vector<bbox> rightbounds(m_num_bins - 1);
+        // Evaluate all dimensions
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            // If the box is degenerate in that dimension skip it
+            if (centroid_extents[axis] == 0.f) continue;
+
+            auto axisbins = &bins[axis * m_num_bins];
 
             // Start with 1-bin right box
             bbox rightbox = bbox();
             for (int i = m_num_bins - 1; i > 0; --i)
             {
-                rightbox.grow(bins[axis][i].bounds);
+                rightbox.grow(axisbins[i].bounds);
                 rightbounds[i - 1] = rightbox;
             }
 
@@ -284,9 +415,9 @@ namespace RadeonRays
             float sahtmp = 0.f;
             for (int i = 0; i < m_num_bins - 1; ++i)
             {
-                leftbox.grow(bins[axis][i].bounds);
-                leftcount += bins[axis][i].count;
-                rightcount -= bins[axis][i].count;
+                leftbox.grow(axisbins[i].bounds);
+                leftcount += axisbins[i].count;
+                rightcount -= axisbins[i].count;
 
                 // Compute SAH
                 sahtmp = m_traversal_cost + (leftcount * leftbox.surface_area() + rightcount * rightbounds[i].surface_area()) * invarea;
@@ -346,60 +477,75 @@ namespace RadeonRays
             int exit;
         };
 
-        Bin bins[3][kNumBins];
+        // Keep bins for each dimension laid out one after another
+        std::vector<Bin> bins(3 * kNumBins);
 
         // Prepcompute some useful stuff
         float3 origin = req.bounds.pmin;
         float3 binsize = req.bounds.extents() * (1.f / kNumBins);
         float3 invbinsize = float3(1.f / binsize.x, 1.f / binsize.y, 1.f / binsize.z);
 
-        // Initialize bins
-        for (int axis = 0; axis < 3; ++axis)
+        auto bin_refs = [&](int begin, int end, std::vector<Bin>& chunk_bins)
         {
-            for (int i = 0; i < kNumBins; ++i)
+            // Initialize bins
+            for (auto& bin : chunk_bins)
             {
-                bins[axis][i].bounds = bbox();
-                bins[axis][i].enter = 0;
-                bins[axis][i].exit = 0;
+                bin.bounds = bbox();
+                bin.enter = 0;
+                bin.exit = 0;
             }
-        }
 
-        // Iterate thru all primitive refs
-        for (int i = req.startidx; i < req.startidx + req.numprims; ++i)
-        {
-            PrimRef const& primref(refs[i]);
-            // Determine starting bin for this primitive
-            float3 firstbin = clamp3((primref.bounds.pmin - origin) * invbinsize, float3(0, 0, 0), float3(kNumBins - 1, kNumBins - 1, kNumBins - 1));
-            // Determine finishing bin
-            float3 lastbin = clamp3((primref.bounds.pmax - origin) * invbinsize, firstbin, float3(kNumBins - 1, kNumBins - 1, kNumBins - 1));
-            // Iterate over axis
-            for (int axis = 0; axis < 3; ++axis)
+            // Iterate thru all primitive refs
+            for (int i = begin; i < end; ++i)
             {
-                // Skip in case of a degenerate dimension
-                if (extents[axis] == 0.f) continue;
-                // Break the prim into bins
-                auto tempref = primref;
-
-                for (int j = (int)firstbin[axis]; j < (int)lastbin[axis]; ++j)
+                PrimRef const& primref(refs[i]);
+                // Determine starting bin for this primitive
+                float3 firstbin = clamp3((primref.bounds.pmin - origin) * invbinsize, float3(0, 0, 0), float3(kNumBins - 1, kNumBins - 1, kNumBins - 1));
+                // Determine finishing bin
+                float3 lastbin = clamp3((primref.bounds.pmax - origin) * invbinsize, firstbin, float3(kNumBins - 1, kNumBins - 1, kNumBins - 1));
+                // Iterate over axis
+                for (int axis = 0; axis < 3; ++axis)
                 {
-                    PrimRef leftref, rightref;
-                    // Split primitive ref into left and right
-                    float splitval = origin[axis] + binsize[axis] * (j + 1);
-                    if (SplitPrimRef(tempref, axis, splitval, leftref, rightref))
+                    // Skip in case of a degenerate dimension
+                    if (extents[axis] == 0.f) continue;
+
+                    auto axisbins = &chunk_bins[axis * kNumBins];
+                    // Break the prim into bins
+                    auto tempref = primref;
+
+                    for (int j = (int)firstbin[axis]; j < (int)lastbin[axis]; ++j)
                     {
-                        // Add left one
-                        bins[axis][j].bounds.grow(leftref.bounds);
-                        // Save right to add part of it into the next bin
-                        tempref = rightref;
+                        PrimRef leftref, rightref;
+                        // Split primitive ref into left and right
+                        float splitval = origin[axis] + binsize[axis] * (j + 1);
+                        if (SplitPrimRef(tempref, axis, splitval, leftref, rightref))
+                        {
+                            // Add left one
+                            axisbins[j].bounds.grow(leftref.bounds);
+                            // Save right to add part of it into the next bin
+                            tempref = rightref;
+                        }
                     }
+                    // Add the last piece into the last bin
+                    axisbins[(int)lastbin[axis]].bounds.grow(tempref.bounds);
+                    // Adjust enter & exit counters
+                    axisbins[(int)firstbin[axis]].enter++;
+                    axisbins[(int)lastbin[axis]].exit++;
                 }
-                // Add the last piece into the last bin
-                bins[axis][(int)lastbin[axis]].bounds.grow(tempref.bounds);
-                // Adjust enter & exit counters
-                bins[axis][(int)firstbin[axis]].enter++;
-                bins[axis][(int)lastbin[axis]].exit++;
             }
-        }
+        };
+
+        auto merge_bins = [](std::vector<Bin> const& src, std::vector<Bin>& dst)
+        {
+            for (std::size_t i = 0; i < dst.size(); ++i)
+            {
+                dst[i].bounds.grow(src[i].bounds);
+                dst[i].enter += src[i].enter;
+                dst[i].exit += src[i].exit;
+            }
+        };
+
+        ParallelBin(req.startidx, req.startidx + req.numprims, bins, bin_refs, merge_bins);
 
         // Prepare moving window data
         bbox rightbounds[kNumBins - 1];
@@ -412,11 +558,13 @@ namespace RadeonRays
             if (extents[axis] == 0.f)
                 continue;
 
+            auto axisbins = &bins[axis * kNumBins];
+
             // Start with 1-bin right box
             bbox rightbox = bbox();
             for (int i = kNumBins - 1; i > 0; --i)
             {
-                rightbox = bboxunion(rightbox, bins[axis][i].bounds);
+                rightbox = bboxunion(rightbox, axisbins[i].bounds);
                 rightbounds[i - 1] = rightbox;
             }
 
@@ -428,14 +576,14 @@ namespace RadeonRays
             for (int i = 1; i < kNumBins; ++i)
             {
                 // New left box
-                leftbox.grow(bins[axis][i - 1].bounds);
+                leftbox.grow(axisbins[i - 1].bounds);
                 // New left box count
-                leftcount += bins[axis][i - 1].enter;
+                leftcount += axisbins[i - 1].enter;
                 // Adjust right box
-                rightcount -= bins[axis][i - 1].exit;
+                rightcount -= axisbins[i - 1].exit;
                 // Calc SAH
-                float sah = m_traversal_cost + (leftbox.surface_area() *
-                    +rightbounds[i - 1].surface_area() * rightcount)  * invarea;
+                float sah = m_traversal_cost + (leftbox.surface_area() * leftcount +
+                    rightbounds[i - 1].surface_area() * rightcount) * invarea;
 
                 // Update SAH if it is needed
                 if (sah < split.sah)
@@ -456,8 +604,7 @@ namespace RadeonRays
     bool SplitBvh::SplitPrimRef(PrimRef const& ref, int axis, float split, PrimRef& leftref, PrimRef& rightref) const
     {
         // Start with left and right refs equal to original ref
-        leftref.idx = rightref.idx = ref.idx;
-        leftref.bounds = rightref.bounds = ref.bounds;
+        leftref = rightref = ref;
 
         // Only split if split value is within our bounds range
         if (split > ref.bounds.pmin[axis] && split < ref.bounds.pmax[axis])
@@ -466,25 +613,45 @@ namespace RadeonRays
             leftref.bounds.pmax[axis] = split;
             // Trim right box on the left
             rightref.bounds.pmin[axis] = split;
+            // Partitioning goes by centers, keep them in sync
+            leftref.center = leftref.bounds.center();
+            rightref.center = rightref.bounds.center();
             return true;
         }
 
         return false;
     }
 
+    int SplitBvh::CountSplitPrimRefs(SahSplit const& split, SplitRequest const& req, PrimRefArray const& refs) const
+    {
+        // Same condition as in SplitPrimRef
+        int count = 0;
+        for (int i = req.startidx; i < req.startidx + req.numprims; ++i)
+        {
+            auto const& bounds = refs[i].bounds;
+            if (split.split > bounds.pmin[split.dim] && split.split < bounds.pmax[split.dim])
+            {
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
     void SplitBvh::SplitPrimRefs(SahSplit const& split, SplitRequest const& req, PrimRefArray& refs, int& extra_refs)
     {
-        // We are going to append new primitives at the end of the array
+        // We are going to append new primitives at the end of the range,
+        // request arena has been checked to have enough space for them
         int appendprims = req.numprims;
 
         // Split refs if any of them require to be split
         for (int i = req.startidx; i < req.startidx + req.numprims; ++i)
         {
-            assert(req.startidx + appendprims < refs.size());
-
             PrimRef leftref, rightref;
             if (SplitPrimRef(refs[i], split.dim, split.split, leftref, rightref))
             {
+                assert(req.startidx + appendprims < (int)refs.size());
+
                 // Copy left ref instead of original
                 refs[i] = leftref;
                 // Append right one at the end
@@ -496,28 +663,6 @@ namespace RadeonRays
         extra_refs = appendprims - req.numprims;
     }
 
-    SplitBvh::Node* SplitBvh::AllocateNode()
-    {
-        if (m_nodecnt - m_num_nodes_archived >= m_num_nodes_for_regular)
-        {
-            m_node_archive.push_back(std::move(m_nodes));
-            m_num_nodes_archived += m_num_nodes_for_regular;
-            m_nodes = std::vector<Node>(m_num_nodes_for_regular);
-        }
-
-        return &m_nodes[m_nodecnt++ - m_num_nodes_archived];
-    }
-
-    void SplitBvh::InitNodeAllocator(size_t maxnum)
-    {
-        m_node_archive.clear();
-        m_nodecnt = 0;
-        m_nodes.resize(maxnum);
-
-        // Set root_ pointer
-        m_root = &m_nodes[0];
-    }
-
     void SplitBvh::PrintStatistics(std::ostream& os) const
     {
         size_t num_triangles = (m_num_nodes_for_regular + 1) / 2;
@@ -527,6 +672,7 @@ namespace RadeonRays
         os << "SAH bins: " << m_num_bins << "\n";
         os << "Max split depth: " << m_max_split_depth << "\n";
         os << "Min node overlap: " << m_min_overlap << "\n";
+        os << "Max leaf size: " << m_max_leaf_size << "\n";
         os << "Number of triangles: " << num_triangles << "\n";
         os << "Number of triangle refs: " << num_refs << "\n";
         os << "Ref duplication: " << ((float)(num_refs - num_triangles) / num_triangles) * 100.f << "%\n";
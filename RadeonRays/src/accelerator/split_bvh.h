@@ -33,14 +33,14 @@ namespace RadeonRays
                  int num_bins,
                  int max_split_depth, 
                  float min_overlap,
-                 float extra_refs_budget)
-        : Bvh(traversal_cost, num_bins, true)
+                 float extra_refs_budget,
+                 int max_leaf_size = 1)
+        : Bvh(traversal_cost, num_bins, true, max_leaf_size)
         , m_max_split_depth(max_split_depth)
         , m_min_overlap(min_overlap)
         , m_extra_refs_budget(extra_refs_budget)
         , m_num_nodes_required(0)
         , m_num_nodes_for_regular(0)
-        , m_num_nodes_archived(0)
         {
         }
 
@@ -58,38 +58,31 @@ namespace RadeonRays
 
         // Build function
         void BuildImpl(bbox const* bounds, int numbounds) override;
-        void BuildNode(SplitRequest& req, PrimRefArray& primrefs);
+        // Build subtree for the request, returns its height.
+        // Refs of the request can grow up to arena_end by spatial splits,
+        // so subtrees own disjoint parts of primrefs and can be built in parallel.
+        int BuildNode(SplitRequest& req, int arena_end, PrimRefArray& primrefs);
         
         SahSplit FindObjectSahSplit(SplitRequest const& req, PrimRefArray const& refs) const;
         SahSplit FindSpatialSahSplit(SplitRequest const& req, PrimRefArray const& refs) const;
         
+        // Number of refs spatial split is going to add
+        int CountSplitPrimRefs(SahSplit const& split, SplitRequest const& req, PrimRefArray const& refs) const;
         void SplitPrimRefs(SahSplit const& split, SplitRequest const& req, PrimRefArray& refs, int& extra_refs);
         bool SplitPrimRef(PrimRef const& ref, int axis, float split, PrimRef& leftref, PrimRef& rightref) const;
 
         // Print BVH statistics
         void PrintStatistics(std::ostream& os) const override;
 
-    protected:
-        Node* AllocateNode() override;
-        void  InitNodeAllocator(size_t maxnum) override;
-
     private:
 
         int m_max_split_depth;
         float m_min_overlap;
         float m_extra_refs_budget;
+        // Node capacity (binary tree over maximum number of refs)
         int m_num_nodes_required;
         int m_num_nodes_for_regular;
 
-        // Node archive for memory management
-        // As m_nodes fills up we archive it into m_node_archive
-        // allocate new chunk and work there.
-
-        // How many nodes have been archived so far
-        int m_num_nodes_archived;
-        // Container for archived chunks
-        std::list<std::vector<Node>> m_node_archive;
-
         SplitBvh(SplitBvh const&);
         SplitBvh& operator = (SplitBvh const&);
 
@@ -0,0 +1,314 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "treelet_optimizer.h"
+#include "../async/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+#include <cassert>
+
+namespace RadeonRays
+{
+    // Minimum number of leaves walked up by a single task
+    static int const kMinLeavesPerTask = 4096;
+
+    // Splits [0, count) into contiguous chunks and runs func(begin, end)
+    // on each of them, the first one on the calling thread.
+    template <typename Func>
+    static void ParallelChunks(int count, Func const& func)
+    {
+        int num_chunks = std::max(1, std::min((int)std::thread::hardware_concurrency(), count / kMinLeavesPerTask));
+        int chunk_size = (count + num_chunks - 1) / num_chunks;
+
+        task_group tasks;
+
+        for (int c = 1; c < num_chunks; ++c)
+        {
+            int begin = std::min(c * chunk_size, count);
+            int end = std::min(begin + chunk_size, count);
+            tasks.run([&func, begin, end]() { func(begin, end); });
+        }
+
+        func(0, std::min(chunk_size, count));
+        tasks.wait();
+    }
+
+    static inline int PopCount(unsigned v)
+    {
+        int n = 0;
+        for (; v; v &= v - 1)
+            ++n;
+        return n;
+    }
+
+    static inline int LowestBit(unsigned v)
+    {
+        int n = 0;
+        while (!(v & 1u))
+        {
+            v >>= 1;
+            ++n;
+        }
+        return n;
+    }
+
+    int TreeletOptimizer::Optimize(std::vector<Node>& nodes, int root, int num_passes) const
+    {
+        if (nodes.empty() || nodes[root].left == -1)
+        {
+            return 0;
+        }
+
+        // Leaves never change, collect them once
+        std::vector<int> leaves;
+        std::vector<int> stack;
+        stack.push_back(root);
+
+        while (!stack.empty())
+        {
+            int idx = stack.back();
+            stack.pop_back();
+
+            if (nodes[idx].left == -1)
+            {
+                leaves.push_back(idx);
+            }
+            else
+            {
+                stack.push_back(nodes[idx].right);
+                stack.push_back(nodes[idx].left);
+            }
+        }
+
+        std::vector<float> costs(nodes.size());
+        std::vector<int> sizes(nodes.size());
+
+        int num_restructured = 0;
+        for (int pass = 0; pass < num_passes; ++pass)
+        {
+            // Later passes skip small subtrees which had their chance already
+            int min_size = pass == 0 ? 0 : (kMaxTreeletLeaves << (pass - 1));
+            int count = RunPass(nodes, root, leaves, min_size, costs, sizes);
+
+            // Converged, next passes won't find anything either
+            if (count == 0)
+            {
+                break;
+            }
+
+            num_restructured += count;
+        }
+
+        return num_restructured;
+    }
+
+    int TreeletOptimizer::RunPass(std::vector<Node>& nodes, int root, std::vector<int> const& leaves, int min_size, std::vector<float>& costs, std::vector<int>& sizes) const
+    {
+        // Bottom-up schedule: the second child to arrive at a node processes it,
+        // at this point both subtrees are final and the node owns them exclusively.
+        std::vector<std::atomic<int>> flags(nodes.size());
+        for (auto& f : flags)
+            f.store(0, std::memory_order_relaxed);
+
+        std::atomic<int> num_restructured(0);
+
+        ParallelChunks((int)leaves.size(), [&](int begin, int end)
+        {
+            int count = 0;
+
+            for (int i = begin; i < end; ++i)
+            {
+                int idx = leaves[i];
+                costs[idx] = nodes[idx].bounds.surface_area() * nodes[idx].numprims;
+                sizes[idx] = 1;
+
+                while (idx != root)
+                {
+                    idx = nodes[idx].parent;
+
+                    if (flags[idx].fetch_add(1, std::memory_order_acq_rel) == 0)
+                    {
+                        break;
+                    }
+
+                    costs[idx] = m_traversal_cost * nodes[idx].bounds.surface_area() +
+                        costs[nodes[idx].left] + costs[nodes[idx].right];
+                    // Only valid for nodes on the way up, treelets don't maintain it
+                    sizes[idx] = sizes[nodes[idx].left] + sizes[nodes[idx].right];
+
+                    if (sizes[idx] >= min_size && OptimizeTreelet(nodes, idx, costs))
+                    {
+                        ++count;
+                    }
+                }
+            }
+
+            num_restructured += count;
+        });
+
+        return num_restructured;
+    }
+
+    bool TreeletOptimizer::OptimizeTreelet(std::vector<Node>& nodes, int root, std::vector<float>& costs) const
+    {
+        // Form the treelet: keep expanding the treelet leaf with the largest area
+        int treelet_leaves[kMaxTreeletLeaves] = { nodes[root].left, nodes[root].right };
+        int treelet_internals[kMaxTreeletLeaves - 1] = { root };
+        int num_leaves = 2;
+        int num_internals = 1;
+
+        while (num_leaves < kMaxTreeletLeaves)
+        {
+            int best = -1;
+            float best_area = -1.f;
+
+            for (int i = 0; i < num_leaves; ++i)
+            {
+                auto const& node = nodes[treelet_leaves[i]];
+                if (node.left != -1 && node.bounds.surface_area() > best_area)
+                {
+                    best_area = node.bounds.surface_area();
+                    best = i;
+                }
+            }
+
+            if (best == -1)
+            {
+                break;
+            }
+
+            int expanded = treelet_leaves[best];
+            treelet_internals[num_internals++] = expanded;
+            treelet_leaves[best] = nodes[expanded].left;
+            treelet_leaves[num_leaves++] = nodes[expanded].right;
+        }
+
+        // Two leaves have a single topology
+        if (num_leaves < 3)
+        {
+            return false;
+        }
+
+        // Optimal cost for each subset of treelet leaves,
+        // subsets are visited in increasing order so all their
+        // proper subsets are already evaluated.
+        unsigned const num_subsets = 1u << num_leaves;
+        bbox subset_bounds[1u << kMaxTreeletLeaves];
+        float subset_cost[1u << kMaxTreeletLeaves];
+        unsigned subset_partition[1u << kMaxTreeletLeaves];
+
+        for (unsigned s = 1; s < num_subsets; ++s)
+        {
+            unsigned lowest = s & (~s + 1u);
+
+            if (s == lowest)
+            {
+                int leaf = treelet_leaves[LowestBit(s)];
+                subset_bounds[s] = nodes[leaf].bounds;
+                subset_cost[s] = costs[leaf];
+                subset_partition[s] = 0;
+                continue;
+            }
+
+            subset_bounds[s] = bboxunion(subset_bounds[lowest], subset_bounds[s ^ lowest]);
+
+            // Visit each unordered partition once: the part holding the lowest bit
+            // is lowest plus a proper subset of the rest
+            unsigned rest = s ^ lowest;
+            float best_cost = std::numeric_limits<float>::max();
+            unsigned best_partition = lowest;
+
+            for (unsigned q = (rest - 1) & rest; ; q = (q - 1) & rest)
+            {
+                unsigned p = q | lowest;
+
+                float cost = subset_cost[p] + subset_cost[s ^ p];
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_partition = p;
+                }
+
+                if (q == 0)
+                {
+                    break;
+                }
+            }
+
+            subset_cost[s] = m_traversal_cost * subset_bounds[s].surface_area() + best_cost;
+            subset_partition[s] = best_partition;
+        }
+
+        unsigned const all = num_subsets - 1;
+
+        // Keep the current topology unless the gain is above float noise
+        if (!(subset_cost[all] < costs[root] * (1.f - 1e-5f)))
+        {
+            return false;
+        }
+
+        // Rebuild the treelet reusing its internal nodes
+        struct Assignment
+        {
+            unsigned subset;
+            int node;
+        };
+
+        Assignment stack[kMaxTreeletLeaves];
+        int stack_size = 0;
+        int next_internal = 1;
+        stack[stack_size++] = { all, root };
+
+        while (stack_size > 0)
+        {
+            auto current = stack[--stack_size];
+            unsigned parts[2] = { subset_partition[current.subset], current.subset ^ subset_partition[current.subset] };
+            int children[2];
+
+            for (int c = 0; c < 2; ++c)
+            {
+                if (PopCount(parts[c]) == 1)
+                {
+                    children[c] = treelet_leaves[LowestBit(parts[c])];
+                }
+                else
+                {
+                    assert(next_internal < num_internals);
+                    children[c] = treelet_internals[next_internal++];
+                    stack[stack_size++] = { parts[c], children[c] };
+                }
+
+                nodes[children[c]].parent = current.node;
+            }
+
+            auto& node = nodes[current.node];
+            node.left = children[0];
+            node.right = children[1];
+            node.bounds = subset_bounds[current.subset];
+            costs[current.node] = subset_cost[current.subset];
+        }
+
+        return true;
+    }
+}
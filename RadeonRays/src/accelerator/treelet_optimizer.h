@@ -0,0 +1,73 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <vector>
+
+#include "math/bbox.h"
+
+namespace RadeonRays
+{
+    ///< Treelet restructuring post-build pass (TRBVH)
+    ///< "Fast Parallel Construction of High-Quality Bounding Volume Hierarchies",
+    ///< Tero Karras, Timo Aila, HPG 2013.
+    ///< Treelets of up to kMaxTreeletLeaves nodes are formed bottom-up
+    ///< and their topology is replaced with the SAH optimal one found by
+    ///< dynamic programming. Leaves are never modified, only internal nodes
+    ///< are relinked, so the caller can write the result back in place.
+    ///<
+    class TreeletOptimizer
+    {
+    public:
+        // Number of treelet leaves (costs 3^n per treelet)
+        static int constexpr kMaxTreeletLeaves = 7;
+
+        // Flat node view of a binary BVH, left == -1 marks a leaf
+        struct Node
+        {
+            bbox bounds;
+            int parent;
+            int left;
+            int right;
+            // Number of primitives for leaves
+            int numprims;
+        };
+
+        // Costs are relative to a primitive intersection
+        TreeletOptimizer(float traversal_cost)
+            : m_traversal_cost(traversal_cost)
+        {
+        }
+
+        // Run num_passes restructuring passes over the tree rooted at root,
+        // returns the number of treelets restructured
+        int Optimize(std::vector<Node>& nodes, int root, int num_passes) const;
+
+    private:
+        // One bottom-up pass over internal nodes with at least min_size leaves below
+        int RunPass(std::vector<Node>& nodes, int root, std::vector<int> const& leaves, int min_size, std::vector<float>& costs, std::vector<int>& sizes) const;
+        // Restructure the treelet rooted at root, returns true if it has changed
+        bool OptimizeTreelet(std::vector<Node>& nodes, int root, std::vector<float>& costs) const;
+
+        float m_traversal_cost;
+    };
+}
@@ -26,6 +26,7 @@ THE SOFTWARE.
 #include "device.h"
 
 #include "../device/calc_intersection_device.h"
+#include "../device/cpu_intersection_device.h"
 #include <cassert>
 
 #if USE_OPENCL
@@ -177,42 +178,42 @@ namespace RadeonRays
         s_calc_platform = platform;
     }
 
-    std::uint32_t IntersectionApi::GetDeviceCount()
+    static std::uint32_t GetCalcDeviceCount()
     {
         auto* calc = GetCalc();
-        std::uint32_t result = 0;
-        if (calc != nullptr)
-        {
-            result += GetCalc()->GetDeviceCount();
-        }
-        // embree is always the last device
+        return calc != nullptr ? calc->GetDeviceCount() : 0;
+    }
+
+    static std::uint32_t GetEmbreeDeviceCount()
+    {
 #ifdef USE_EMBREE
         if (s_calc_platform & DeviceInfo::Platform::kEmbree)
         {
-            ++result;
+            return 1;
         }
 #endif //USE_EMBREE
+        return 0;
+    }
+
+    static std::uint32_t GetNativeDeviceCount()
+    {
+        return (s_calc_platform & DeviceInfo::Platform::kNative) ? 1 : 0;
+    }
 
-        return result;
+    std::uint32_t IntersectionApi::GetDeviceCount()
+    {
+        // embree and native cpu devices go after calc ones
+        return GetCalcDeviceCount() + GetEmbreeDeviceCount() + GetNativeDeviceCount();
     }
+
     static bool IsDeviceIndexEmbree(uint32_t devidx)
     {
+        return GetEmbreeDeviceCount() > 0 && devidx == GetCalcDeviceCount();
+    }
 
-#ifdef USE_EMBREE
-        auto* calc = GetCalc();
-        if (calc != nullptr)
-        {
-            if (devidx == GetCalc()->GetDeviceCount())
-            {
-                return true;
-            }
-        }
-        else if(devidx == 0)
-        {
-            return true;
-        }
-#endif //USE_EMBREE
-        return false;
+    static bool IsDeviceIndexNative(uint32_t devidx)
+    {
+        return GetNativeDeviceCount() > 0 && devidx == GetCalcDeviceCount() + GetEmbreeDeviceCount();
     }
 
     void IntersectionApi::GetDeviceInfo(std::uint32_t devidx, DeviceInfo& devinfo)
@@ -232,6 +233,15 @@ namespace RadeonRays
 #endif //USE_EMBREE
             return;
         }
+
+        if (IsDeviceIndexNative(devidx))
+        {
+            devinfo.name = "native cpu";
+            devinfo.vendor = "radeonrays";
+            devinfo.type = DeviceInfo::kCpu;
+            devinfo.platform = DeviceInfo::kNative;
+            return;
+        }
         assert(calc);
 
         Calc::DeviceSpec spec;
@@ -251,10 +261,14 @@ namespace RadeonRays
             return new IntersectionApiImpl(new EmbreeIntersectionDevice());
 #endif //USE_EMBREE
         }
+        else if (IsDeviceIndexNative(devidx))
+        {
+            return new IntersectionApiImpl(new CpuIntersectionDevice());
+        }
         else
         {
             auto* calc = GetCalc();
-            if (calc != nullptr)
+            if (calc != nullptr && devidx < calc->GetDeviceCount())
             {
                 return new IntersectionApiImpl(new CalcIntersectionDevice(calc, calc->CreateDevice(devidx)));
             }
@@ -36,6 +36,7 @@ THE SOFTWARE.
 #endif
 
 #include <vector>
+#include <memory>
 #include <cfloat>
 
 namespace RadeonRays
@@ -57,6 +58,11 @@ namespace RadeonRays
         world_.options_.SetValue(name, value);
     }
 
+    void IntersectionApiImpl::GetBvhStatistics(BvhStatistics& stats) const
+    {
+        m_device->GetBvhStatistics(stats);
+    }
+
     IntersectionApiImpl::~IntersectionApiImpl()
     {
     }
@@ -80,6 +86,37 @@ namespace RadeonRays
     }
 
 
+    void IntersectionApiImpl::CreateMeshes(MeshDesc const* descs, int nummeshes, Shape** shapes) const
+    {
+        ThrowIf(nummeshes < 0 || (nummeshes > 0 && (!descs || !shapes)), "Invalid mesh descriptions.");
+
+        auto meshes = Mesh::CreateMeshes(descs, nummeshes);
+
+        // Ids are consecutive and in order of descs
+        Id id = nextid_.fetch_add(nummeshes);
+        for (int i = 0; i < nummeshes; ++i)
+        {
+            meshes[i]->SetId(id + i);
+            shapes[i] = meshes[i].release();
+        }
+    }
+
+    Shape* IntersectionApiImpl::CreateMeshFromExternalMemory(
+        // Position data
+        float const * vertices, int vnum, int vstride,
+        // Index data for vertices
+        int const * indices, int istride,
+        // Number of faces
+        int  numfaces
+        ) const
+    {
+        Mesh* mesh = new Mesh(vertices, vnum, vstride, indices, istride, numfaces);
+
+        mesh->SetId(nextid_++);
+
+        return mesh;
+    }
+
     Shape* IntersectionApiImpl::CreateInstance(Shape const* shape) const
     {
         Mesh const* mesh = static_cast<Mesh const*>(shape);
@@ -93,7 +130,11 @@ namespace RadeonRays
 
     void IntersectionApiImpl::DeleteShape(Shape const* shape)
     {
-        delete shape;
+        // The device may refuse the deletion, nothing is changed before it agrees.
+        // Never leave deleted shapes in the scene
+        m_device->OnShapeDeleted(shape);
+        world_.DetachShape(shape);
+        m_device->ReleaseShape(shape);
     }
 
     void IntersectionApiImpl::AttachShape(Shape const* shape)
@@ -120,6 +161,14 @@ namespace RadeonRays
         world_.OnCommit();
     }
 
+    void IntersectionApiImpl::CommitAsync(Event** event)
+    {
+        ThrowIf(world_.shapes_.empty(), "Scene is empty.");
+        m_device->PreprocessAsync(world_, event);
+
+        world_.OnCommit();
+    }
+
     void IntersectionApiImpl::DeleteBuffer(Buffer* buffer) const
     {
         m_device->DeleteBuffer(buffer);
@@ -145,6 +194,16 @@ namespace RadeonRays
         m_device->QueryOcclusion(rays, numrays, maxrays, hitresults, waitevent, event);
     }
 
+    void IntersectionApiImpl::QueryIntersection(RayBufferSoA const& rays, int numrays, Buffer* hitinfos, Event const* waitevent, Event** event) const
+    {
+        m_device->QueryIntersection(rays, numrays, hitinfos, waitevent, event);
+    }
+
+    void IntersectionApiImpl::QueryOcclusion(RayBufferSoA const& rays, int numrays, Buffer* hitresults, Event const* waitevent, Event** event) const
+    {
+        m_device->QueryOcclusion(rays, numrays, hitresults, waitevent, event);
+    }
+
     void IntersectionApiImpl::DeleteEvent(Event* event) const
     {
         m_device->DeleteEvent(event);
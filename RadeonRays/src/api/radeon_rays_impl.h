@@ -62,6 +62,19 @@ namespace RadeonRays
             int  numfaces
             ) const override;
 
+        // Create meshes in parallel, see IntersectionApi::CreateMeshes
+        void CreateMeshes(MeshDesc const* descs, int nummeshes, Shape** shapes) const override;
+
+        // Create a mesh referencing caller memory, see IntersectionApi::CreateMeshFromExternalMemory
+        Shape* CreateMeshFromExternalMemory(
+            // Position data
+            float const * vertices, int vnum, int vstride,
+            // Index data for vertices
+            int const * indices, int istride,
+            // Number of faces
+            int  numfaces
+            ) const override;
+
         // Create an instance of a shape with its own transform (set via Shape interface).
         // The call is blocking, so the returned value is ready upon return.
         Shape* CreateInstance(Shape const* shape) const override;
@@ -75,6 +88,8 @@ namespace RadeonRays
         void DetachAll() override;
         // Commit all geometry creations/changes
         void Commit() override;
+        // Commit without blocking, see IntersectionApi::CommitAsync
+        void CommitAsync(Event** event) override;
 
         //Sets the shape id allocator to its default value (1)
         void ResetIdCounter() override;
@@ -121,6 +136,10 @@ namespace RadeonRays
         // The call is asynchronous. Event pointer mights be nullptrs.
         void QueryOcclusion(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hitresults, Event const* waitevent, Event** event) const override;
 
+        // Same for rays in SoA layout
+        void QueryIntersection(RayBufferSoA const& rays, int numrays, Buffer* hitinfos, Event const* waitevent, Event** event) const override;
+        void QueryOcclusion(RayBufferSoA const& rays, int numrays, Buffer* hitresults, Event const* waitevent, Event** event) const override;
+
         /******************************************
         Utility
         ******************************************/
@@ -128,6 +147,8 @@ namespace RadeonRays
         void SetOption(char const* name, char const* value) override;
         // Set API global option: float
         void SetOption(char const* name, float value) override;
+        // Get BVH statistics, see IntersectionApi::GetBvhStatistics
+        void GetBvhStatistics(BvhStatistics& stats) const override;
         
 
         IntersectionDevice* GetDevice() const { return m_device.get(); }
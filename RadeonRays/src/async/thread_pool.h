@@ -22,150 +22,394 @@ THE SOFTWARE.
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
-#include <queue>
+#include <deque>
+#include <vector>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
 #include <future>
-#include <iostream>
+#include <functional>
+#include <exception>
+#include <memory>
 
 namespace RadeonRays
 {
-    ///< An implementation of a concurrent queue
-    ///< which is providing the means to wait until 
-    ///< elements are available or use non-blocking
-    ///< try_pop method.
+    ///< Per worker task queue: the owner pushes and pops
+    ///< at the back (LIFO, keeps recursive work hot in cache),
+    ///< other threads steal the oldest tasks from the front.
     ///<
-    template <typename T> class thread_safe_queue
+    template <typename T> class work_stealing_queue
     {
     public:
-        thread_safe_queue(){}
-        ~thread_safe_queue(){}
-
-        // Push element: one of the threads is going to 
-        // be woken up to process this if any
-        void push(T const& t)
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            queue_.push(t);
-            cv_.notify_one();
-        }
-
-        // Push element: one of the threads is going to 
-        // be woken up to process this if any
         void push(T&& t)
         {
             std::lock_guard<std::mutex> lock(mutex_);
-            queue_.push(std::move(t));
-            cv_.notify_one();
+            queue_.push_back(std::move(t));
         }
 
-        // Wait until there are element to process.
-        void wait_and_pop(T& t)
+        bool pop(T& t)
         {
-            std::unique_lock<std::mutex> lock(mutex_);
-            cv_.wait(lock, [this](){return !queue_.empty();});
-            t = queue_.front();
-            queue_.pop();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.empty())
+                return false;
+            t = std::move(queue_.back());
+            queue_.pop_back();
+            return true;
         }
 
-        // Try to pop element. Returns true if element has been popped, 
-        // false if there are no element in the queue
-        bool try_pop(T& t)
+        bool steal(T& t)
         {
             std::lock_guard<std::mutex> lock(mutex_);
             if (queue_.empty())
                 return false;
             t = std::move(queue_.front());
-            queue_.pop();
+            queue_.pop_front();
             return true;
         }
 
-        size_t size() const
-        {
-            std::unique_lock<std::mutex> lock(mutex_);
-            return queue_.size();
-        }
-
     private:
-        mutable std::mutex mutex_;
-        std::condition_variable cv_;
-        std::queue<T> queue_;
+        std::mutex mutex_;
+        std::deque<T> queue_;
     };
 
 
-    ///< Thread pool implementation which is using concurrency
-    ///< available in the system
+    ///< Work stealing scheduler shared by the builders and the devices.
+    ///< Each worker owns a queue, idle workers steal from the others and
+    ///< block on a condition variable when there is nothing left to do.
+    ///< Workers waiting for a task_group help executing its tasks,
+    ///< so tasks are free to spawn and wait for nested tasks.
     ///<
-    template <typename RetType> class thread_pool
+    class task_scheduler
     {
     public:
-        explicit thread_pool(int sleep_time = 50)
-            : sleep_time_(sleep_time)
+        typedef std::function<void()> task;
+
+        explicit task_scheduler(int num_threads = 0)
+            : done_(false)
+            , pending_(0)
+            , sleepers_(0)
+            , next_queue_(0)
         {
-            done_ = false;
-            int num_threads = std::thread::hardware_concurrency();
-            num_threads = num_threads == 0 ? 2 : num_threads;
+            if (num_threads <= 0)
+            {
+                num_threads = std::thread::hardware_concurrency();
+                num_threads = num_threads == 0 ? 2 : num_threads;
+            }
 
-            //#ifdef _DEBUG
-            //        std::cout << num_threads << " hardware threads available\n";
-            //#endif
+            queues_.resize(num_threads);
+            for (auto& q : queues_)
+            {
+                q.reset(new work_stealing_queue<task>());
+            }
 
-            for (int i=0; i < num_threads; ++i)
+            for (int i = 0; i < num_threads; ++i)
             {
-                threads_.push_back(std::thread(&thread_pool::run_loop, this));
+                threads_.push_back(std::thread(&task_scheduler::run_loop, this, i));
             }
         }
 
-        ~thread_pool()
+        ~task_scheduler()
         {
-            done_ = true;
-            std::for_each(threads_.begin(), threads_.end(), std::mem_fun_ref(&std::thread::join));
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex_);
+                done_ = true;
+            }
+            wake_cv_.notify_all();
+
+            for (auto& t : threads_)
+            {
+                t.join();
+            }
         }
 
-        // Submit a new task into the pool. Future is returned in
-        // order for caller to track the execution of the task
-        std::future<RetType> submit(std::function<RetType()>&& f)
+        task_scheduler(task_scheduler const&) = delete;
+        task_scheduler& operator = (task_scheduler const&) = delete;
+
+        // Process wide scheduler
+        static task_scheduler& instance()
         {
-            std::packaged_task<RetType()> task(std::move(f));
-            auto future = task.get_future();
-            work_queue_.push(std::move(task));
-            return future;
+            static task_scheduler scheduler;
+            return scheduler;
+        }
+
+        // Queue a task: workers push into their own queue,
+        // other threads distribute tasks round robin
+        void spawn(task&& t)
+        {
+            int self = current_worker();
+            int idx = self >= 0 ? self : (int)(next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size());
+            queues_[idx]->push(std::move(t));
+
+            pending_.fetch_add(1);
+            if (sleepers_.load() > 0)
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex_);
+                wake_cv_.notify_one();
+            }
         }
 
-        size_t size() const
+        // True if called from one of the worker threads
+        bool is_worker() const
         {
-            return work_queue_.size();
+            return current_worker() >= 0;
         }
 
-        void setSleepTime(int sleep_time)
+        int num_threads() const
         {
-            sleep_time_ = sleep_time;
+            return static_cast<int>(threads_.size());
         }
 
     private:
-        void run_loop()
+        // Index of the calling thread in this scheduler or -1
+        int current_worker() const
         {
-            std::packaged_task<RetType()> f;
-            while(!done_)
+            return tls_scheduler() == this ? tls_index() : -1;
+        }
+
+        static task_scheduler const*& tls_scheduler()
+        {
+            static thread_local task_scheduler const* scheduler = nullptr;
+            return scheduler;
+        }
+
+        static int& tls_index()
+        {
+            static thread_local int index = -1;
+            return index;
+        }
+
+        bool try_get(int self, task& t)
+        {
+            int num_queues = static_cast<int>(queues_.size());
+
+            if (self >= 0 && queues_[self]->pop(t))
+            {
+                pending_.fetch_sub(1);
+                return true;
+            }
+
+            int start = self >= 0 ? self + 1 : (int)(next_queue_.load(std::memory_order_relaxed) % num_queues);
+            for (int i = 0; i < num_queues; ++i)
             {
-                if (work_queue_.try_pop(f))
+                int victim = (start + i) % num_queues;
+                if (victim != self && queues_[victim]->steal(t))
                 {
-                    f();
+                    pending_.fetch_sub(1);
+                    return true;
                 }
-                else
+            }
+
+            return false;
+        }
+
+        void run_loop(int index)
+        {
+            tls_scheduler() = this;
+            tls_index() = index;
+
+            task t;
+            for (;;)
+            {
+                if (try_get(index, t))
                 {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
+                    t();
+                    t = nullptr;
+                    continue;
                 }
+
+                std::unique_lock<std::mutex> lock(sleep_mutex_);
+                sleepers_.fetch_add(1);
+                wake_cv_.wait(lock, [this]() { return done_ || pending_.load() > 0; });
+                sleepers_.fetch_sub(1);
+
+                if (done_)
+                    break;
             }
         }
 
-
-        thread_safe_queue<std::packaged_task<RetType()> > work_queue_;
-        std::atomic_bool done_;
+        std::vector<std::unique_ptr<work_stealing_queue<task> > > queues_;
         std::vector<std::thread> threads_;
-        int sleep_time_;
+        std::mutex sleep_mutex_;
+        std::condition_variable wake_cv_;
+        bool done_;
+        std::atomic<int> pending_;
+        std::atomic<int> sleepers_;
+        std::atomic<unsigned> next_queue_;
+    };
+
+
+    ///< Set of tasks which can be waited on together. The first
+    ///< exception thrown by a task is rethrown from wait().
+    ///< Tasks are queued in the group, the scheduler gets one proxy task
+    ///< per task which runs whatever the group has left. This way a waiting
+    ///< worker can help with the tasks of its own group only and never picks
+    ///< up unrelated work which could keep it from returning.
+    ///<
+    class task_group
+    {
+    public:
+        explicit task_group(task_scheduler& scheduler = task_scheduler::instance())
+            : scheduler_(scheduler)
+            , state_(std::make_shared<state>())
+        {
+        }
+
+        ~task_group()
+        {
+            // Tasks reference data of the caller, never leave them running
+            try { wait(); } catch (...) {}
+        }
+
+        task_group(task_group const&) = delete;
+        task_group& operator = (task_group const&) = delete;
+
+        template <typename Func> void run(Func&& f)
+        {
+            {
+                std::lock_guard<std::mutex> lock(state_->mutex);
+                state_->tasks.push_back(task_scheduler::task(std::forward<Func>(f)));
+                ++state_->count;
+            }
+
+            // Proxies keep the state alive, they can run after wait() has returned
+            // and find the queue empty if the waiting thread took their task
+            auto s = state_;
+            scheduler_.spawn([s]() { s->run_one(false); });
+        }
+
+        // Wait until all tasks of the group are done. Workers of the scheduler
+        // execute the group's queued tasks meanwhile, other threads block.
+        void wait()
+        {
+            if (scheduler_.is_worker())
+            {
+                while (state_->run_one(true))
+                {
+                }
+            }
+
+            std::exception_ptr e;
+            {
+                // The rest is running on other threads
+                std::unique_lock<std::mutex> lock(state_->mutex);
+                state_->cv.wait(lock, [this]() { return state_->count == 0; });
+                std::swap(e, state_->exception);
+            }
+
+            if (e)
+                std::rethrow_exception(e);
+        }
+
+    private:
+        struct state
+        {
+            // Run a queued task, the newest for the waiting thread (keeps
+            // recursive work hot in cache) and the oldest for proxies.
+            // Returns false if there was nothing left to run
+            bool run_one(bool newest)
+            {
+                task_scheduler::task t;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (tasks.empty())
+                        return false;
+                    if (newest)
+                    {
+                        t = std::move(tasks.back());
+                        tasks.pop_back();
+                    }
+                    else
+                    {
+                        t = std::move(tasks.front());
+                        tasks.pop_front();
+                    }
+                }
+
+                std::exception_ptr e;
+                try
+                {
+                    t();
+                }
+                catch (...)
+                {
+                    e = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (e && !exception)
+                    exception = e;
+                if (--count == 0)
+                    cv.notify_all();
+                return true;
+            }
+
+            std::mutex mutex;
+            std::condition_variable cv;
+            // Tasks not started yet
+            std::deque<task_scheduler::task> tasks;
+            // Tasks not done yet
+            int count = 0;
+            std::exception_ptr exception;
+        };
+
+        task_scheduler& scheduler_;
+        std::shared_ptr<state> state_;
+    };
+
+
+    // Runs func(begin, end) over [begin, end) split into grain sized
+    // ranges, the last range is processed on the calling thread.
+    template <typename Func>
+    void parallel_for(int begin, int end, int grain, Func const& func)
+    {
+        if (end - begin <= grain)
+        {
+            if (end > begin)
+                func(begin, end);
+            return;
+        }
+
+        task_group group;
+        int i = begin;
+        for (; i + grain < end; i += grain)
+        {
+            int range_end = i + grain;
+            group.run([&func, i, range_end]() { func(i, range_end); });
+        }
+
+        func(i, end);
+        group.wait();
+    }
+
+
+    ///< Future based front end of the shared scheduler
+    ///<
+    template <typename RetType> class thread_pool
+    {
+    public:
+        explicit thread_pool(task_scheduler& scheduler = task_scheduler::instance())
+            : scheduler_(scheduler)
+        {
+        }
+
+        // Submit a new task into the pool. Future is returned in
+        // order for caller to track the execution of the task
+        std::future<RetType> submit(std::function<RetType()>&& f)
+        {
+            auto task = std::make_shared<std::packaged_task<RetType()> >(std::move(f));
+            auto future = task->get_future();
+            scheduler_.spawn([task]() { (*task)(); });
+            return future;
+        }
+
+        int size() const
+        {
+            return scheduler_.num_threads();
+        }
+
+    private:
+        task_scheduler& scheduler_;
     };
 }
 
@@ -67,14 +67,18 @@ namespace RadeonRays
             m_event = decltype(m_event)(event, [device](Calc::Event* event) { device->DeleteEvent(event); });
         }
 
+        // Holders without Calc event are complete
         bool Complete() const override
         {
-            return m_event->IsComplete();
+            return !m_event || m_event->IsComplete();
         }
 
         void Wait() override
         {
-            return m_event->Wait();
+            if (m_event)
+            {
+                m_event->Wait();
+            }
         }
 
         Calc::Event* GetData()
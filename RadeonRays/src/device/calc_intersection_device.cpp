@@ -37,15 +37,14 @@ THE SOFTWARE.
 #include "../intersector/intersector_hlbvh.h"
 #include "../intersector/intersector_bittrail.h"
 #include "../world/world.h"
+#include "../except/except.h"
 #include <iostream>
 
 namespace RadeonRays
 {
-    // TODO: handle different BVH strategies, for now hardcoded
+    // Intersectors are created on the first commit, once the options are known
     CalcIntersectionDevice::CalcIntersectionDevice(Calc::Calc* calc, Calc::Device* device)
         : m_device(device, [calc](Calc::Device* device) { calc->DeleteDevice(device); })
-        , m_intersector(new IntersectorSkipLinks(device))
-        , m_intersector_string("bvh")
     {
         // Initialize event pool
         for (auto i = 0; i < EVENT_POOL_INITIAL_SIZE; ++i)
@@ -68,6 +67,10 @@ namespace RadeonRays
     {
         bool use2level = false;
 
+        // Intersector kernels are cached there
+        auto optcachepath = world.options_.GetOption("kernel.cache_path");
+        std::string kernel_cache_path = optcachepath ? optcachepath->AsString() : "";
+
         // First check if 2 level BVH has been forced
         auto opt2level = world.options_.GetOption("bvh.force2level");
         if (opt2level && opt2level->AsFloat() > 0.f)
@@ -99,7 +102,7 @@ namespace RadeonRays
         {
             if (m_intersector_string != "bvh2l")
             {
-                m_intersector.reset(new IntersectorTwoLevel(m_device.get()));
+                m_intersector.reset(new IntersectorTwoLevel(m_device.get(), kernel_cache_path));
                 m_intersector_string = "bvh2l";
             }
         }
@@ -113,7 +116,7 @@ namespace RadeonRays
                 {
                     if (m_intersector_string != "bvh")
                     {
-                        m_intersector.reset(new IntersectorSkipLinks(m_device.get()));
+                        m_intersector.reset(new IntersectorSkipLinks(m_device.get(), kernel_cache_path));
                         m_intersector_string = "bvh";
                     }
                 }
@@ -125,7 +128,7 @@ namespace RadeonRays
                         m_intersector.reset(new IntersectorShortStack(m_device.get()));
                         m_intersector_string = "fatbvh";
 #else
-                        m_intersector.reset(new IntersectorLDS(m_device.get()));
+                        m_intersector.reset(new IntersectorLDS(m_device.get(), kernel_cache_path));
                         m_intersector_string = "fatbvh";
 #endif
                     }
@@ -134,7 +137,7 @@ namespace RadeonRays
                 {
                     if (m_intersector_string != "hlbvh")
                     {
-                        m_intersector.reset(new IntersectorHlbvh(m_device.get()));
+                        m_intersector.reset(new IntersectorHlbvh(m_device.get(), kernel_cache_path));
                         m_intersector_string = "hlbvh";
                     }
                 }
@@ -149,6 +152,13 @@ namespace RadeonRays
             }
         }
 
+        // Unknown accelerator types use the default one
+        if (!m_intersector)
+        {
+            m_intersector.reset(new IntersectorSkipLinks(m_device.get(), kernel_cache_path));
+            m_intersector_string = "bvh";
+        }
+
         try
         {
             // Let intersector to do its preprocessing job
@@ -161,6 +171,25 @@ namespace RadeonRays
         }
     }
 
+    void CalcIntersectionDevice::PreprocessAsync(World const& world, Event** event)
+    {
+        // Intersectors upload the scene right away, so it is built synchronously
+        Preprocess(world);
+
+        if (event)
+        {
+            auto holder = CreateEventHolder();
+            holder->m_event.reset();
+            *event = holder;
+        }
+    }
+
+    void CalcIntersectionDevice::GetBvhStatistics(BvhStatistics& stats) const
+    {
+        ThrowIf(!m_intersector, "Scene has not been committed.");
+        m_intersector->GetStatistics(stats);
+    }
+
     Buffer* CalcIntersectionDevice::CreateBuffer(size_t size, void* initdata) const
     {
         // If initdata is passed in use different Calc call with init data
@@ -246,6 +275,8 @@ namespace RadeonRays
         // If waitevent is passed in we have to extract it as well
         auto e = waitevent ? static_cast<CalcEventHolder const*>(waitevent)->m_event.get() : nullptr;
 
+        ThrowIf(!m_intersector, "Scene has not been committed.");
+
         if (event)
         {
             // event pointer has been provided, so construct holder and return event to the user
@@ -270,6 +301,8 @@ namespace RadeonRays
         // If waitevent is passed in we have to extract it as well
         auto e = waitevent ? static_cast<CalcEventHolder const*>(waitevent)->m_event.get() : nullptr;
 
+        ThrowIf(!m_intersector, "Scene has not been committed.");
+
         if (event)
         {
             // event pointer has been provided, so construct holder and return event to the user
@@ -295,6 +328,8 @@ namespace RadeonRays
         // If waitevent is passed in we have to extract it as well
         auto e = waitevent ? static_cast<CalcEventHolder const*>(waitevent)->m_event.get() : nullptr;
 
+        ThrowIf(!m_intersector, "Scene has not been committed.");
+
         if (event)
         {
             // event pointer has been provided, so construct holder and return event to the user
@@ -320,6 +355,8 @@ namespace RadeonRays
         // If waitevent is passed in we have to extract it as well
         auto e = waitevent ? static_cast<CalcEventHolder const*>(waitevent)->m_event.get() : nullptr;
 
+        ThrowIf(!m_intersector, "Scene has not been committed.");
+
         if (event)
         {
             // event pointer has been provided, so construct holder and return event to the user
@@ -48,6 +48,8 @@ namespace RadeonRays
 
         void Preprocess(World const& world) override;
 
+        void PreprocessAsync(World const& world, Event** event) override;
+
         Buffer* CreateBuffer(size_t size, void* initdata) const override;
 
         void DeleteBuffer(Buffer* const) const override;
@@ -66,6 +68,8 @@ namespace RadeonRays
 
         void QueryOcclusion(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hitresults, Event const* waitevent, Event** event) const override;
 
+        void GetBvhStatistics(BvhStatistics& stats) const override;
+
         Calc::Platform GetPlatform() const { return m_device->GetPlatform(); }
     protected:
         CalcEventHolder* CreateEventHolder() const;
@@ -0,0 +1,216 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "cpu_event.h"
+#include "../async/thread_pool.h"
+#include "../except/except.h"
+
+namespace RadeonRays
+{
+    CpuEvent::CpuEvent()
+        : m_complete(true)
+    {
+    }
+
+    bool CpuEvent::Complete() const
+    {
+        std::exception_ptr exception;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_complete)
+                return false;
+            exception = m_exception;
+        }
+
+        if (exception)
+            std::rethrow_exception(exception);
+        return true;
+    }
+
+    void CpuEvent::Wait()
+    {
+        std::exception_ptr exception;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]() { return m_complete; });
+            exception = m_exception;
+        }
+
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+
+    void CpuEvent::Sync() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_complete; });
+    }
+
+    void CpuEvent::Then(std::function<void(std::exception_ptr)>&& f) const
+    {
+        std::exception_ptr exception;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_complete)
+            {
+                m_continuations.push_back(std::move(f));
+                return;
+            }
+            exception = m_exception;
+        }
+
+        f(exception);
+    }
+
+    void CpuEvent::Reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_complete = false;
+        m_exception = nullptr;
+    }
+
+    void CpuEvent::Signal(std::exception_ptr exception)
+    {
+        std::vector<std::function<void(std::exception_ptr)>> continuations;
+        {
+            // Notify under the lock: once Wait() returns the event may be recycled
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_complete = true;
+            m_exception = exception;
+            continuations.swap(m_continuations);
+            m_cv.notify_all();
+        }
+
+        for (auto& f : continuations)
+        {
+            f(exception);
+        }
+    }
+
+    CpuCommandQueue::CpuCommandQueue()
+        : m_num_inflight(0)
+    {
+    }
+
+    CpuCommandQueue::~CpuCommandQueue()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_num_inflight == 0; });
+    }
+
+    void CpuCommandQueue::Execute(std::function<void()>&& f, Event const* waitevent, Event** event)
+    {
+        CpuEvent const* dependency = nullptr;
+        if (waitevent)
+        {
+            dependency = dynamic_cast<CpuEvent const*>(waitevent);
+            ThrowIf(!dependency, "Invalid cpu event.");
+        }
+
+        if (!event)
+        {
+            if (dependency)
+                const_cast<CpuEvent*>(dependency)->Wait();
+            f();
+            return;
+        }
+
+        CpuEvent* ev = AcquireEvent();
+        ev->Reset();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_num_inflight;
+        }
+
+        auto command = [this, ev, f = std::move(f)](std::exception_ptr exception)
+        {
+            // Waiters are released either way, they get the exception from the event
+            if (!exception)
+            {
+                try
+                {
+                    f();
+                }
+                catch (...)
+                {
+                    exception = std::current_exception();
+                }
+            }
+
+            ev->Signal(exception);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_num_inflight == 0)
+                m_cv.notify_all();
+        };
+
+        // Never run the command on the continuation thread,
+        // it might be the one signalling a long chain
+        auto spawn = [command](std::exception_ptr exception) mutable
+        {
+            task_scheduler::instance().spawn([command, exception]() mutable { command(exception); });
+        };
+
+        if (dependency)
+            dependency->Then(std::move(spawn));
+        else
+            spawn(nullptr);
+
+        *event = ev;
+    }
+
+    Event* CpuCommandQueue::CreateCompletedEvent()
+    {
+        // Recycled events may still hold the exception of their last command
+        CpuEvent* ev = AcquireEvent();
+        ev->Reset();
+        ev->Signal(nullptr);
+        return ev;
+    }
+
+    void CpuCommandQueue::DeleteEvent(Event* event)
+    {
+        CpuEvent* ev = dynamic_cast<CpuEvent*>(event);
+        ThrowIf(!ev, "Invalid cpu event.");
+
+        // The command's exception is reported by Wait and Complete only
+        ev->Sync();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free_events.push_back(ev);
+    }
+
+    CpuEvent* CpuCommandQueue::AcquireEvent()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_free_events.empty())
+        {
+            m_events.emplace_back(new CpuEvent());
+            return m_events.back().get();
+        }
+
+        CpuEvent* ev = m_free_events.back();
+        m_free_events.pop_back();
+        return ev;
+    }
+}
@@ -0,0 +1,101 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "radeon_rays.h"
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace RadeonRays
+{
+    class CpuCommandQueue;
+
+    ///< Event used by host devices. Events are recycled by
+    ///< CpuCommandQueue, so pointers stay valid for queue lifetime.
+    ///< An exception thrown by the command is rethrown by Complete and Wait.
+    ///<
+    class CpuEvent : public Event
+    {
+    public:
+        CpuEvent();
+
+        bool Complete() const override;
+        void Wait() override;
+
+        // Run f once the event is complete, right away if it already is.
+        // f gets the exception of the command, nullptr if it succeeded
+        void Then(std::function<void(std::exception_ptr)>&& f) const;
+
+    private:
+        friend class CpuCommandQueue;
+
+        void Reset();
+        void Signal(std::exception_ptr exception);
+        // Wait without rethrowing
+        void Sync() const;
+
+        mutable std::mutex m_mutex;
+        mutable std::condition_variable m_cv;
+        mutable std::vector<std::function<void(std::exception_ptr)>> m_continuations;
+        bool m_complete;
+        std::exception_ptr m_exception;
+    };
+
+    ///< Executes host device commands on the shared task scheduler.
+    ///< Commands waiting for an event are chained to it instead of
+    ///< blocking a thread, and events come from a recycled pool.
+    ///<
+    class CpuCommandQueue
+    {
+    public:
+        CpuCommandQueue();
+        // Waits for all commands in flight
+        ~CpuCommandQueue();
+
+        // Run f once waitevent is complete: asynchronously if event
+        // is requested, in place (blocking) otherwise. f is skipped if
+        // waitevent failed, its exception is passed on to event instead
+        void Execute(std::function<void()>&& f, Event const* waitevent, Event** event);
+        // Event for commands completed in place
+        Event* CreateCompletedEvent();
+        // Wait for the event and return it to the pool
+        void DeleteEvent(Event* event);
+
+    private:
+        CpuCommandQueue(CpuCommandQueue const&) = delete;
+        CpuCommandQueue& operator = (CpuCommandQueue const&) = delete;
+
+        CpuEvent* AcquireEvent();
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        // All events ever created and the ones free for reuse
+        std::vector<std::unique_ptr<CpuEvent>> m_events;
+        std::vector<CpuEvent*> m_free_events;
+        int m_num_inflight;
+    };
+}
@@ -0,0 +1,1274 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "cpu_intersection_device.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "../world/world.h"
+#include "../primitive/mesh.h"
+#include "../primitive/instance.h"
+#include "../accelerator/bvh2.h"
+#include "../accelerator/bvh_cache.h"
+#include "../accelerator/bvh_statistics.h"
+#include "../translator/wide_bvh_translator.h"
+#include "buffer.h"
+#include "cpu_event.h"
+#include "event.h"
+#include "../except/except.h"
+#include "../async/thread_pool.h"
+
+#include <xmmintrin.h>
+#include <smmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+//count of rays for one thread pool task
+#define TASK_SIZE 256
+
+namespace RadeonRays
+{
+    // Traversal stack size: an entry per level above the deepest leaf and the
+    // sentinel. Built trees stay within Bvh2::kMaxDepth, cached ones are checked
+    static int const kTraversalStackSize = Bvh2::kMaxDepth + 1;
+
+    //simple RadeonRays::Buffer implementation
+    class CpuBuffer : public Buffer
+    {
+    public:
+        CpuBuffer(size_t size, void* init)
+            : m_data(new char[size])
+        {
+            if (init)
+                memcpy(m_data, init, size);
+        }
+
+        virtual ~CpuBuffer()
+        {
+            delete[] m_data;
+        }
+
+        void* GetData()
+        {
+            return m_data;
+        }
+
+        const void* GetData() const
+        {
+            return m_data;
+        }
+
+    private:
+        char* m_data;
+    };
+
+    // Host pointers to the arrays of RayBufferSoA
+    struct CpuRayArrays
+    {
+        float const* o[3];
+        float const* d[3];
+        float const* maxt;
+        int const* mask;
+
+        explicit CpuRayArrays(RayBufferSoA const& rays)
+        {
+            Buffer const* buffers[] = { rays.ox, rays.oy, rays.oz, rays.dx, rays.dy, rays.dz, rays.maxt };
+            float const* data[7];
+            for (int i = 0; i < 7; ++i)
+            {
+                const CpuBuffer* buffer = dynamic_cast<const CpuBuffer*>(buffers[i]); ThrowIf(!buffer, "Invalid cpu buffer.");
+                data[i] = static_cast<float const*>(buffer->GetData());
+            }
+
+            for (int i = 0; i < 3; ++i)
+            {
+                o[i] = data[i];
+                d[i] = data[3 + i];
+            }
+            maxt = data[6];
+
+            mask = nullptr;
+            if (rays.mask)
+            {
+                const CpuBuffer* buffer = dynamic_cast<const CpuBuffer*>(rays.mask); ThrowIf(!buffer, "Invalid cpu buffer.");
+                mask = static_cast<int const*>(buffer->GetData());
+            }
+        }
+
+        // Traversal takes rays by reference, assemble one on the stack
+        ray Get(int i) const
+        {
+            ray r(float3(o[0][i], o[1][i], o[2][i]), float3(d[0][i], d[1][i], d[2][i]), maxt[i]);
+            if (mask)
+                r.SetMask(mask[i]);
+            return r;
+        }
+    };
+
+    // Same as safe_invdir in kernels: avoid infinities for axis aligned rays
+    static inline __m128 SafeInvDir(__m128 d)
+    {
+        auto const ooeps = _mm_set1_ps(1e-8f);
+        auto const sign = _mm_and_ps(d, _mm_set1_ps(-0.f));
+        auto const abs = _mm_andnot_ps(_mm_set1_ps(-0.f), d);
+        auto const safe = _mm_blendv_ps(_mm_or_ps(ooeps, sign), d, _mm_cmpgt_ps(abs, ooeps));
+        return _mm_div_ps(_mm_set1_ps(1.f), safe);
+    }
+
+    static inline __m128 Cross(__m128 a, __m128 b)
+    {
+        auto const a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+        auto const b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+        auto const c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+        return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+    }
+
+    static inline float Dot(__m128 a, __m128 b)
+    {
+        return _mm_cvtss_f32(_mm_dp_ps(a, b, 0x71));
+    }
+
+    // Test the ray against both child AABBs of an internal Bvh2 node at once.
+    // Node data is four float4 (left min, left max, right min, right max),
+    // w components hold addresses and ids and are ignored.
+    // Returns hit mask (bit 0 - left, bit 1 - right) and entry distances in t_near lanes 0 and 1.
+    static inline int IntersectChildBoxes(float const* node, __m128 invd, __m128 oxinvd, __m128 t_max, __m128& t_near)
+    {
+        auto const l0 = _mm_sub_ps(_mm_mul_ps(_mm_load_ps(node + 0), invd), oxinvd);
+        auto const l1 = _mm_sub_ps(_mm_mul_ps(_mm_load_ps(node + 4), invd), oxinvd);
+        auto const r0 = _mm_sub_ps(_mm_mul_ps(_mm_load_ps(node + 8), invd), oxinvd);
+        auto const r1 = _mm_sub_ps(_mm_mul_ps(_mm_load_ps(node + 12), invd), oxinvd);
+
+        // Interleave left and right slabs: (lx, rx, ly, ry) and (lz, rz, lw, rw)
+        auto const near_xy = _mm_unpacklo_ps(_mm_min_ps(l0, l1), _mm_min_ps(r0, r1));
+        auto const near_zw = _mm_unpackhi_ps(_mm_min_ps(l0, l1), _mm_min_ps(r0, r1));
+        auto const far_xy = _mm_unpacklo_ps(_mm_max_ps(l0, l1), _mm_max_ps(r0, r1));
+        auto const far_zw = _mm_unpackhi_ps(_mm_max_ps(l0, l1), _mm_max_ps(r0, r1));
+
+        auto tn = _mm_max_ps(_mm_max_ps(near_xy, _mm_movehl_ps(near_xy, near_xy)), near_zw);
+        auto tf = _mm_min_ps(_mm_min_ps(far_xy, _mm_movehl_ps(far_xy, far_xy)), far_zw);
+
+        tn = _mm_max_ps(tn, _mm_setzero_ps());
+        tf = _mm_min_ps(tf, t_max);
+
+        t_near = tn;
+        return _mm_movemask_ps(_mm_cmple_ps(tn, tf)) & 0x3;
+    }
+
+    // Ray data for wide node tests, splatted per axis
+    struct WideRay
+    {
+        __m128 invd[3];
+        __m128 oxinvd[3];
+#ifdef __AVX__
+        __m256 invd8[3];
+        __m256 oxinvd8[3];
+#endif
+        // Index of the near plane (0 - min, 1 - max) for each axis
+        int near_plane[3];
+
+        WideRay(__m128 invd_xyz, __m128 oxinvd_xyz)
+        {
+            alignas(16) float id[4];
+            alignas(16) float oid[4];
+            _mm_store_ps(id, invd_xyz);
+            _mm_store_ps(oid, oxinvd_xyz);
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                invd[axis] = _mm_set1_ps(id[axis]);
+                oxinvd[axis] = _mm_set1_ps(oid[axis]);
+#ifdef __AVX__
+                invd8[axis] = _mm256_set1_ps(id[axis]);
+                oxinvd8[axis] = _mm256_set1_ps(oid[axis]);
+#endif
+                near_plane[axis] = id[axis] < 0.f ? 1 : 0;
+            }
+        }
+    };
+
+    // Test the ray against all children of a wide node, 4 at a time.
+    // Near/far planes are picked by ray direction so empty slots
+    // (inverted infinite bounds) always miss.
+    // Returns hit mask and entry distances in t_near.
+    template <int W>
+    static inline int IntersectWideNode(float const (&bounds)[3][2][W], WideRay const& r, float t_max, float* t_near)
+    {
+        auto const zero = _mm_setzero_ps();
+        auto const tmax = _mm_set1_ps(t_max);
+        int mask = 0;
+
+        for (int i = 0; i < W; i += 4)
+        {
+            __m128 tn = zero;
+            __m128 tf = tmax;
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                auto const near_bound = _mm_load_ps(&bounds[axis][r.near_plane[axis]][i]);
+                auto const far_bound = _mm_load_ps(&bounds[axis][1 - r.near_plane[axis]][i]);
+                tn = _mm_max_ps(tn, _mm_sub_ps(_mm_mul_ps(near_bound, r.invd[axis]), r.oxinvd[axis]));
+                tf = _mm_min_ps(tf, _mm_sub_ps(_mm_mul_ps(far_bound, r.invd[axis]), r.oxinvd[axis]));
+            }
+
+            _mm_storeu_ps(t_near + i, tn);
+            mask |= _mm_movemask_ps(_mm_cmple_ps(tn, tf)) << i;
+        }
+
+        return mask;
+    }
+
+#ifdef __AVX__
+    // All 8 children in one go
+    template <>
+    inline int IntersectWideNode<8>(float const (&bounds)[3][2][8], WideRay const& r, float t_max, float* t_near)
+    {
+        __m256 tn = _mm256_setzero_ps();
+        __m256 tf = _mm256_set1_ps(t_max);
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            auto const near_bound = _mm256_load_ps(bounds[axis][r.near_plane[axis]]);
+            auto const far_bound = _mm256_load_ps(bounds[axis][1 - r.near_plane[axis]]);
+            tn = _mm256_max_ps(tn, _mm256_sub_ps(_mm256_mul_ps(near_bound, r.invd8[axis]), r.oxinvd8[axis]));
+            tf = _mm256_min_ps(tf, _mm256_sub_ps(_mm256_mul_ps(far_bound, r.invd8[axis]), r.oxinvd8[axis]));
+        }
+
+        _mm256_storeu_ps(t_near, tn);
+        return _mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ));
+    }
+#endif
+
+    // Moller-Trumbore test, same semantics as fast_intersect_triangle in kernels.
+    // Leaf data is three float4 vertices with ids in w components.
+    static inline bool IntersectTriangle(float const* leaf, __m128 o, __m128 d, float t_max, float& t, float& b1, float& b2)
+    {
+        auto const v0 = _mm_load_ps(leaf + 0);
+        auto const e1 = _mm_sub_ps(_mm_load_ps(leaf + 4), v0);
+        auto const e2 = _mm_sub_ps(_mm_load_ps(leaf + 8), v0);
+        auto const s1 = Cross(d, e2);
+
+        auto const denom = Dot(s1, e1);
+        if (denom == 0.f)
+        {
+            return false;
+        }
+
+        auto const invd = 1.f / denom;
+        auto const dv = _mm_sub_ps(o, v0);
+        auto const u = Dot(dv, s1) * invd;
+        auto const s2 = Cross(dv, e1);
+        auto const v = Dot(d, s2) * invd;
+        auto const temp = Dot(e2, s2) * invd;
+
+        if (u < 0.f || u > 1.f || v < 0.f || u + v > 1.f || temp < 0.f || temp > t_max)
+        {
+            return false;
+        }
+
+        t = temp;
+        b1 = u;
+        b2 = v;
+        return true;
+    }
+
+    CpuIntersectionDevice::CpuIntersectionDevice()
+        : m_scene(std::make_shared<Scene>())
+        , m_scene_commit(0)
+        , m_commit_count(0)
+        , m_build_failed(false)
+        , m_num_builds(0)
+    {
+    }
+
+    CpuIntersectionDevice::~CpuIntersectionDevice()
+    {
+    }
+
+    void CpuIntersectionDevice::Preprocess(World const& world)
+    {
+        auto build = CreateBuild(world);
+        if (!build)
+        {
+            // Nothing changed since the last commit, which might still be building
+            // after CommitAsync. Once it is done check again in case it has failed.
+            WaitForBuilds();
+            build = CreateBuild(world);
+        }
+
+        if (build)
+        {
+            build();
+        }
+    }
+
+    void CpuIntersectionDevice::PreprocessAsync(World const& world, Event** event)
+    {
+        auto build = CreateBuild(world);
+        if (!build)
+        {
+            if (event)
+            {
+                *event = m_queue.CreateCompletedEvent();
+            }
+            return;
+        }
+
+        // Queries keep using the current scene until the build is done
+        m_queue.Execute(std::move(build), nullptr, event);
+    }
+
+    void CpuIntersectionDevice::ReleaseShape(Shape const* shape)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_release_mutex);
+            if (m_num_builds > 0)
+            {
+                m_released_shapes.push_back(shape);
+                return;
+            }
+        }
+
+        delete shape;
+    }
+
+    void CpuIntersectionDevice::OnBuildDone()
+    {
+        std::vector<Shape const*> released;
+        {
+            std::lock_guard<std::mutex> lock(m_release_mutex);
+            if (--m_num_builds == 0)
+            {
+                released.swap(m_released_shapes);
+                m_builds_done.notify_all();
+            }
+        }
+
+        for (auto shape : released)
+        {
+            delete shape;
+        }
+    }
+
+    void CpuIntersectionDevice::WaitForBuilds()
+    {
+        std::unique_lock<std::mutex> lock(m_release_mutex);
+        m_builds_done.wait(lock, [this]() { return m_num_builds == 0; });
+    }
+
+    // Shape state read by a build, taken when the build is created. Every shape
+    // becomes an instance of its mesh, keeping transform, id and mask.
+    struct ShapeSnapshot
+    {
+        std::vector<std::unique_ptr<Instance>> instances;
+        std::vector<Shape const*> shapes;
+    };
+
+    std::function<void()> CpuIntersectionDevice::CreateBuild(World const& world)
+    {
+        // If something has been changed we need to rebuild BVH,
+        // after a failed build the current scene is outdated as well
+        bool retry = m_build_failed.exchange(false);
+        if (m_commit_count > 0 && !retry && !world.has_changed() && world.GetStateChange() == ShapeImpl::kStateChangeNone)
+        {
+            return nullptr;
+        }
+
+        std::size_t num_faces = 0;
+        for (auto i : world.shapes_)
+        {
+            const ShapeImpl* shape = dynamic_cast<const ShapeImpl*>(i);
+            ThrowIf(!shape, "Invalid shape.");
+
+            const Mesh* mesh = dynamic_cast<const Mesh*>(shape->is_instance() ? static_cast<const Instance*>(shape)->GetBaseShape() : shape);
+            ThrowIf(!mesh, "Invalid mesh.");
+            ThrowIf(!mesh->puretriangle(), "Only triangle meshes supported by now.");
+
+            num_faces += mesh->num_faces();
+        }
+
+        // Look up build options for world
+        auto builder = world.options_.GetOption("bvh.builder");
+        auto nbins = world.options_.GetOption("bvh.sah.num_bins");
+        auto tcost = world.options_.GetOption("bvh.sah.traversal_cost");
+        auto leafsize = world.options_.GetOption("bvh.max_leaf_size");
+        auto optimize = world.options_.GetOption("bvh.optimize");
+        auto width = world.options_.GetOption("bvh.width");
+        auto cachepath = world.options_.GetOption("bvh.cache_path");
+        auto statsepo = world.options_.GetOption("bvh.statistics.epo");
+
+        bool use_sah = builder && builder->AsString() == "sah";
+        int num_bins = (nbins ? static_cast<int>(nbins->AsFloat()) : 64);
+        float traversal_cost = (tcost ? tcost->AsFloat() : 10.0f);
+        int max_leaf_size = (leafsize ? static_cast<int>(leafsize->AsFloat()) : 1);
+        int optimize_passes = (optimize ? static_cast<int>(optimize->AsFloat()) : 0);
+        int bvh_width = (width ? static_cast<int>(width->AsFloat()) : 4);
+        std::string cache_path = (cachepath ? cachepath->AsString() : "");
+        bool collect_epo = (statsepo && statsepo->AsFloat() > 0.f);
+
+        // The world can change while the build is running
+        auto snapshot = std::make_shared<ShapeSnapshot>();
+        if (num_faces > 0)
+        {
+            snapshot->instances.reserve(world.shapes_.size());
+            snapshot->shapes.reserve(world.shapes_.size());
+            for (auto i : world.shapes_)
+            {
+                auto shape = static_cast<const ShapeImpl*>(i);
+                auto mesh = shape->is_instance() ? static_cast<const Instance*>(shape)->GetBaseShape() : shape;
+
+                matrix m, minv;
+                shape->GetTransform(m, minv);
+
+                std::unique_ptr<Instance> instance(new Instance(mesh));
+                instance->SetTransform(m, minv);
+                instance->SetId(shape->GetId());
+                instance->SetMask(shape->GetMask());
+                snapshot->shapes.push_back(instance.get());
+                snapshot->instances.push_back(std::move(instance));
+            }
+        }
+
+        std::uint64_t commit = ++m_commit_count;
+
+        auto build = [this, commit, snapshot, use_sah, num_bins, traversal_cost, max_leaf_size, optimize_passes, bvh_width, cache_path, collect_epo]()
+        {
+            typedef BvhStatisticsCollector::Clock Clock;
+
+            std::shared_ptr<Scene> scene = std::make_shared<Scene>();
+            float build_ms = 0.f, optimize_ms = 0.f, translate_ms = 0.f;
+            bool cached = false;
+
+            auto const& shapes = snapshot->shapes;
+            if (!shapes.empty())
+            {
+                std::unique_ptr<BvhCache> cache;
+                std::uint64_t key = 0;
+
+                if (!cache_path.empty())
+                {
+                    cache.reset(new BvhCache(cache_path));
+
+                    BvhCache::Hasher hasher;
+                    hasher.Add(use_sah);
+                    hasher.Add(num_bins);
+                    hasher.Add(traversal_cost);
+                    hasher.Add(max_leaf_size);
+                    hasher.Add(optimize_passes);
+                    hasher.Add(bvh_width);
+                    hasher.AddShapes(shapes.data(), shapes.size());
+                    key = hasher.GetValue();
+                }
+
+                auto start = Clock::now();
+                cached = cache && LoadScene(*cache, key, bvh_width, *scene);
+                build_ms = BvhStatisticsCollector::GetElapsedMs(start);
+
+                if (!cached)
+                {
+                    start = Clock::now();
+                    scene->bvh.reset(new Bvh2(traversal_cost, num_bins, use_sah, max_leaf_size));
+                    scene->bvh->Build(shapes.begin(), shapes.end());
+                    build_ms = BvhStatisticsCollector::GetElapsedMs(start);
+
+                    start = Clock::now();
+                    scene->bvh->Optimize(optimize_passes);
+                    optimize_ms = BvhStatisticsCollector::GetElapsedMs(start);
+
+                    start = Clock::now();
+                    if (bvh_width == 8)
+                    {
+                        scene->bvh8.reset(new WideBvhTranslator<8>());
+                        scene->bvh8->Process(*scene->bvh);
+                    }
+                    else if (bvh_width == 4)
+                    {
+                        scene->bvh4.reset(new WideBvhTranslator<4>());
+                        scene->bvh4->Process(*scene->bvh);
+                    }
+                    translate_ms = BvhStatisticsCollector::GetElapsedMs(start);
+
+                    if (cache)
+                    {
+                        StoreScene(*cache, key, *scene);
+                    }
+                }
+            }
+
+            CollectStatistics(collect_epo, *scene);
+            scene->statistics.build_ms = build_ms;
+            scene->statistics.optimize_ms = optimize_ms;
+            scene->statistics.translate_ms = translate_ms;
+            scene->statistics.cached = cached;
+
+            SetScene(std::move(scene), commit);
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(m_release_mutex);
+            ++m_num_builds;
+        }
+
+        // Errors reach the caller through Commit or the CommitAsync event
+        return [this, build]()
+        {
+            try
+            {
+                build();
+            }
+            catch (...)
+            {
+                m_build_failed.store(true);
+                OnBuildDone();
+                throw;
+            }
+            OnBuildDone();
+        };
+    }
+
+    // Cache entry arrays: Bvh2 nodes, then wide nodes if the scene has them
+    static char const* const kCacheEntryName = "cpu";
+
+    bool CpuIntersectionDevice::IsValidBvh2(Bvh2 const& bvh)
+    {
+        auto const nodes = bvh.m_nodes;
+        auto const count = bvh.m_nodecount;
+
+        // Children follow their parents, so depths are final once reached
+        std::vector<std::uint32_t> depth(count, 0u);
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (Bvh2::IsInternal(nodes[i]))
+            {
+                if (nodes[i].addr_left <= i || nodes[i].addr_left >= count ||
+                    nodes[i].addr_right <= i || nodes[i].addr_right >= count ||
+                    depth[i] >= Bvh2::kMaxDepth)
+                {
+                    return false;
+                }
+
+                depth[nodes[i].addr_left] = std::max(depth[nodes[i].addr_left], depth[i] + 1u);
+                depth[nodes[i].addr_right] = std::max(depth[nodes[i].addr_right], depth[i] + 1u);
+            }
+            // Leaf triangles occupy addr_right consecutive nodes
+            else if (nodes[i].addr_right == 0 || nodes[i].addr_right > count - i)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Same for wide nodes, leaf children address num_leaves Bvh2 nodes
+    template <int W>
+    static bool IsValidWideBvh(typename WideBvhTranslator<W>::Node const* nodes, std::size_t count, std::size_t num_leaves)
+    {
+        std::vector<std::uint32_t> depth(count, 0u);
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (depth[i] >= Bvh2::kMaxDepth)
+            {
+                return false;
+            }
+
+            for (int j = 0; j < W; ++j)
+            {
+                auto child = nodes[i].child[j];
+                auto num_prims = nodes[i].num_prims[j];
+
+                if (child == WideBvhTranslator<W>::kInvalidId)
+                {
+                    // Empty slots must never be hit
+                    if (num_prims != 0 || !(nodes[i].bounds[0][0][j] > nodes[i].bounds[0][1][j]))
+                    {
+                        return false;
+                    }
+                }
+                else if (num_prims == 0)
+                {
+                    if (child <= i || child >= count)
+                    {
+                        return false;
+                    }
+
+                    depth[child] = std::max(depth[child], depth[i] + 1u);
+                }
+                else if (child >= num_leaves || num_prims > num_leaves - child)
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    template <int W>
+    static bool LoadWideBvh(BvhCache::Entry const& entry, std::size_t num_leaves, std::unique_ptr<WideBvhTranslator<W>>& bvh)
+    {
+        std::size_t count = 0;
+        auto nodes = entry.GetArray<typename WideBvhTranslator<W>::Node>(1, count);
+        if (!nodes || count == 0 || !IsValidWideBvh<W>(nodes, count, num_leaves))
+        {
+            return false;
+        }
+
+        // Traversal expects an aligned vector, a single copy is still far cheaper than collapsing
+        bvh.reset(new WideBvhTranslator<W>());
+        bvh->nodes_.assign(nodes, nodes + count);
+        return true;
+    }
+
+    bool CpuIntersectionDevice::LoadScene(BvhCache const& cache, std::uint64_t key, int bvh_width, Scene& scene)
+    {
+        auto entry = cache.Load(kCacheEntryName, key);
+        if (!entry)
+        {
+            return false;
+        }
+
+        std::size_t count = 0;
+        auto nodes = entry->GetArray<Bvh2::Node>(0, count);
+        if (!nodes || count == 0)
+        {
+            return false;
+        }
+
+        // Leaf nodes hold transformed triangles, so Bvh2 nodes are traversed in place.
+        // Bvh2 parameters do not matter for a tree which is not built again.
+        scene.bvh.reset(new Bvh2(0.f));
+        scene.bvh->Assign(nodes, count, entry);
+
+        if (!IsValidBvh2(*scene.bvh) ||
+            (bvh_width == 8 && !LoadWideBvh(*entry, count, scene.bvh8)) ||
+            (bvh_width == 4 && !LoadWideBvh(*entry, count, scene.bvh4)))
+        {
+            scene.bvh.reset();
+            scene.bvh8.reset();
+            scene.bvh4.reset();
+            return false;
+        }
+
+        return true;
+    }
+
+    void CpuIntersectionDevice::StoreScene(BvhCache const& cache, std::uint64_t key, Scene const& scene)
+    {
+        BvhCache::Array arrays[2] =
+        {
+            { scene.bvh->m_nodes, sizeof(Bvh2::Node), scene.bvh->m_nodecount },
+            { nullptr, 0, 0 }
+        };
+
+        if (scene.bvh8)
+        {
+            arrays[1] = { scene.bvh8->nodes_.data(), sizeof(WideBvhTranslator<8>::Node), scene.bvh8->nodes_.size() };
+        }
+        else if (scene.bvh4)
+        {
+            arrays[1] = { scene.bvh4->nodes_.data(), sizeof(WideBvhTranslator<4>::Node), scene.bvh4->nodes_.size() };
+        }
+
+        // Failing to write the cache only costs a rebuild next time
+        cache.Store(kCacheEntryName, key, arrays, arrays[1].elemsize ? 2 : 1);
+    }
+
+    void CpuIntersectionDevice::CollectStatistics(bool epo, Scene& scene)
+    {
+        auto& stats = scene.statistics;
+
+        if (scene.bvh)
+        {
+            scene.bvh->GetStatistics(stats, epo);
+        }
+        else
+        {
+            stats = BvhStatistics();
+            stats.epo = -1.f;
+        }
+
+        // Wide nodes are traversed down to Bvh2 leaves, which keep the triangles
+        stats.layout_bytes = stats.bvh_bytes;
+
+        if (scene.bvh8)
+        {
+            stats.layout = "bvh8";
+            stats.width = 8;
+            stats.layout_bytes += scene.bvh8->GetSizeInBytes();
+        }
+        else if (scene.bvh4)
+        {
+            stats.layout = "bvh4";
+            stats.width = 4;
+            stats.layout_bytes += scene.bvh4->GetSizeInBytes();
+        }
+        else
+        {
+            stats.layout = "bvh2";
+            stats.width = 2;
+        }
+    }
+
+    void CpuIntersectionDevice::GetBvhStatistics(BvhStatistics& stats) const
+    {
+        std::lock_guard<std::mutex> lock(m_scene_mutex);
+
+        // The device starts with an empty scene, which has no statistics
+        ThrowIf(m_scene_commit == 0, "Scene has not been committed.");
+        stats = m_scene->statistics;
+    }
+
+    void CpuIntersectionDevice::SetScene(std::shared_ptr<Scene const> scene, std::uint64_t commit)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_scene_mutex);
+
+            // Builds may finish out of order
+            if (commit < m_scene_commit)
+            {
+                return;
+            }
+
+            // The previous scene is released outside of the lock
+            // unless queries are still using it
+            m_scene.swap(scene);
+            m_scene_commit = commit;
+        }
+    }
+
+    std::shared_ptr<CpuIntersectionDevice::Scene const> CpuIntersectionDevice::GetScene() const
+    {
+        std::lock_guard<std::mutex> lock(m_scene_mutex);
+        return m_scene;
+    }
+
+    Buffer* CpuIntersectionDevice::CreateBuffer(size_t size, void* initdata) const
+    {
+        return new CpuBuffer(size, initdata);
+    }
+
+    void CpuIntersectionDevice::DeleteBuffer(Buffer* const buffer) const
+    {
+        delete buffer;
+    }
+
+    void CpuIntersectionDevice::DeleteEvent(Event* const event) const
+    {
+        m_queue.DeleteEvent(event);
+    }
+
+    void CpuIntersectionDevice::MapBuffer(Buffer* buffer, MapType /*type*/, size_t offset, size_t /*size*/, void** data, Event** event) const
+    {
+        if (data)
+        {
+            CpuBuffer* buf = dynamic_cast<CpuBuffer*>(buffer);
+            ThrowIf(!buf, "Invalid cpu buffer.");
+            *data = static_cast<char*>(buf->GetData()) + offset;
+        }
+
+        if (event)
+        {
+            *event = m_queue.CreateCompletedEvent();
+        }
+    }
+
+    void CpuIntersectionDevice::UnmapBuffer(Buffer* /*buffer*/, void* /*ptr*/, Event** event) const
+    {
+        if (event)
+        {
+            *event = m_queue.CreateCompletedEvent();
+        }
+    }
+
+    void CpuIntersectionDevice::QueryIntersection(Buffer const* rays, int numrays, Buffer* hits, Event const* waitevent, Event** event) const
+    {
+        const CpuBuffer* ray_buffer = dynamic_cast<const CpuBuffer*>(rays); ThrowIf(!ray_buffer, "Invalid cpu buffer.");
+        CpuBuffer* hit_buffer = dynamic_cast<CpuBuffer*>(hits); ThrowIf(!hit_buffer, "Invalid cpu buffer.");
+
+        Execute([this, ray_buffer, hit_buffer, numrays]()
+        {
+            const ray* src_ray = static_cast<const ray*>(ray_buffer->GetData());
+            Intersection* hit = static_cast<Intersection*>(hit_buffer->GetData());
+
+            auto scene = GetScene();
+            ParallelFor(numrays, [this, &scene, src_ray, hit](int begin, int end)
+            {
+                for (int i = begin; i < end; ++i)
+                {
+                    if (src_ray[i].IsActive())
+                    {
+                        IntersectRay(*scene, src_ray[i], hit[i]);
+                    }
+                }
+            });
+        }, waitevent, event);
+    }
+
+    void CpuIntersectionDevice::QueryOcclusion(Buffer const* rays, int numrays, Buffer* hits, Event const* waitevent, Event** event) const
+    {
+        const CpuBuffer* ray_buffer = dynamic_cast<const CpuBuffer*>(rays); ThrowIf(!ray_buffer, "Invalid cpu buffer.");
+        CpuBuffer* hit_buffer = dynamic_cast<CpuBuffer*>(hits); ThrowIf(!hit_buffer, "Invalid cpu buffer.");
+
+        Execute([this, ray_buffer, hit_buffer, numrays]()
+        {
+            const ray* src_ray = static_cast<const ray*>(ray_buffer->GetData());
+            int* hit = static_cast<int*>(hit_buffer->GetData());
+
+            auto scene = GetScene();
+            ParallelFor(numrays, [this, &scene, src_ray, hit](int begin, int end)
+            {
+                for (int i = begin; i < end; ++i)
+                {
+                    if (src_ray[i].IsActive())
+                    {
+                        hit[i] = OccludeRay(*scene, src_ray[i]) ? 1 : -1;
+                    }
+                }
+            });
+        }, waitevent, event);
+    }
+
+    void CpuIntersectionDevice::QueryIntersection(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hits, Event const* waitevent, Event** event) const
+    {
+        const CpuBuffer* ray_buffer = dynamic_cast<const CpuBuffer*>(rays); ThrowIf(!ray_buffer, "Invalid cpu buffer.");
+        const CpuBuffer* count_buffer = dynamic_cast<const CpuBuffer*>(numrays); ThrowIf(!count_buffer, "Invalid cpu buffer.");
+        CpuBuffer* hit_buffer = dynamic_cast<CpuBuffer*>(hits); ThrowIf(!hit_buffer, "Invalid cpu buffer.");
+
+        Execute([this, ray_buffer, count_buffer, maxrays, hit_buffer]()
+        {
+            // Number of rays is only known once waitevent is resolved
+            int count = std::min(*static_cast<const int*>(count_buffer->GetData()), maxrays);
+            const ray* src_ray = static_cast<const ray*>(ray_buffer->GetData());
+            Intersection* hit = static_cast<Intersection*>(hit_buffer->GetData());
+
+            auto scene = GetScene();
+            ParallelFor(count, [this, &scene, src_ray, hit](int begin, int end)
+            {
+                for (int i = begin; i < end; ++i)
+                {
+                    if (src_ray[i].IsActive())
+                    {
+                        IntersectRay(*scene, src_ray[i], hit[i]);
+                    }
+                }
+            });
+        }, waitevent, event);
+    }
+
+    void CpuIntersectionDevice::QueryOcclusion(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hits, Event const* waitevent, Event** event) const
+    {
+        const CpuBuffer* ray_buffer = dynamic_cast<const CpuBuffer*>(rays); ThrowIf(!ray_buffer, "Invalid cpu buffer.");
+        const CpuBuffer* count_buffer = dynamic_cast<const CpuBuffer*>(numrays); ThrowIf(!count_buffer, "Invalid cpu buffer.");
+        CpuBuffer* hit_buffer = dynamic_cast<CpuBuffer*>(hits); ThrowIf(!hit_buffer, "Invalid cpu buffer.");
+
+        Execute([this, ray_buffer, count_buffer, maxrays, hit_buffer]()
+        {
+            // Number of rays is only known once waitevent is resolved
+            int count = std::min(*static_cast<const int*>(count_buffer->GetData()), maxrays);
+            const ray* src_ray = static_cast<const ray*>(ray_buffer->GetData());
+            int* hit = static_cast<int*>(hit_buffer->GetData());
+
+            auto scene = GetScene();
+            ParallelFor(count, [this, &scene, src_ray, hit](int begin, int end)
+            {
+                for (int i = begin; i < end; ++i)
+                {
+                    if (src_ray[i].IsActive())
+                    {
+                        hit[i] = OccludeRay(*scene, src_ray[i]) ? 1 : -1;
+                    }
+                }
+            });
+        }, waitevent, event);
+    }
+
+    void CpuIntersectionDevice::QueryIntersection(RayBufferSoA const& rays, int numrays, Buffer* hits, Event const* waitevent, Event** event) const
+    {
+        CpuRayArrays src(rays);
+        CpuBuffer* hit_buffer = dynamic_cast<CpuBuffer*>(hits); ThrowIf(!hit_buffer, "Invalid cpu buffer.");
+
+        Execute([this, src, hit_buffer, numrays]()
+        {
+            Intersection* hit = static_cast<Intersection*>(hit_buffer->GetData());
+
+            auto scene = GetScene();
+            ParallelFor(numrays, [this, &scene, &src, hit](int begin, int end)
+            {
+                for (int i = begin; i < end; ++i)
+                {
+                    IntersectRay(*scene, src.Get(i), hit[i]);
+                }
+            });
+        }, waitevent, event);
+    }
+
+    void CpuIntersectionDevice::QueryOcclusion(RayBufferSoA const& rays, int numrays, Buffer* hits, Event const* waitevent, Event** event) const
+    {
+        CpuRayArrays src(rays);
+        CpuBuffer* hit_buffer = dynamic_cast<CpuBuffer*>(hits); ThrowIf(!hit_buffer, "Invalid cpu buffer.");
+
+        Execute([this, src, hit_buffer, numrays]()
+        {
+            int* hit = static_cast<int*>(hit_buffer->GetData());
+
+            auto scene = GetScene();
+            ParallelFor(numrays, [this, &scene, &src, hit](int begin, int end)
+            {
+                for (int i = begin; i < end; ++i)
+                {
+                    hit[i] = OccludeRay(*scene, src.Get(i)) ? 1 : -1;
+                }
+            });
+        }, waitevent, event);
+    }
+
+    void CpuIntersectionDevice::Execute(std::function<void()>&& f, Event const* waitevent, Event** event) const
+    {
+        m_queue.Execute(std::move(f), waitevent, event);
+    }
+
+    void CpuIntersectionDevice::ParallelFor(int numrays, std::function<void(int, int)> const& f) const
+    {
+        // Chunks are spread over the shared scheduler, the calling
+        // thread takes the last one and helps with the rest
+        parallel_for(0, numrays, TASK_SIZE, f);
+    }
+
+    void CpuIntersectionDevice::IntersectRay(Scene const& scene, ray const& r, Intersection& hit) const
+    {
+        hit.shapeid = kNullId;
+        hit.primid = kNullId;
+
+        if (!scene.bvh)
+        {
+            return;
+        }
+
+        if (scene.bvh8)
+        {
+            IntersectRayWide(scene, *scene.bvh8, r, hit);
+            return;
+        }
+
+        if (scene.bvh4)
+        {
+            IntersectRayWide(scene, *scene.bvh4, r, hit);
+            return;
+        }
+
+        auto const nodes = scene.bvh->m_nodes;
+        auto const o = _mm_loadu_ps(&r.o.x);
+        auto const d = _mm_loadu_ps(&r.d.x);
+        auto const invd = SafeInvDir(d);
+        auto const oxinvd = _mm_mul_ps(o, invd);
+        auto const mask = r.GetMask();
+
+        float closest_t = r.GetMaxT();
+        auto t_max = _mm_set1_ps(closest_t);
+
+        std::uint32_t stack[kTraversalStackSize];
+        std::uint32_t* ptr = stack;
+        *ptr++ = Bvh2::kInvalidId;
+        std::uint32_t addr = 0;
+
+        while (addr != Bvh2::kInvalidId)
+        {
+            auto const& node = nodes[addr];
+            auto const data = reinterpret_cast<float const*>(&node);
+
+            if (Bvh2::IsInternal(node))
+            {
+                __m128 t_near;
+                int hits = IntersectChildBoxes(data, invd, oxinvd, t_max, t_near);
+
+                if (hits == 0x3)
+                {
+                    // Visit closer child first
+                    float t_left = _mm_cvtss_f32(t_near);
+                    float t_right = _mm_cvtss_f32(_mm_shuffle_ps(t_near, t_near, _MM_SHUFFLE(1, 1, 1, 1)));
+                    bool left_first = t_left <= t_right;
+                    *ptr++ = left_first ? node.addr_right : node.addr_left;
+                    addr = left_first ? node.addr_left : node.addr_right;
+                    continue;
+                }
+                else if (hits)
+                {
+                    addr = (hits & 0x1) ? node.addr_left : node.addr_right;
+                    continue;
+                }
+            }
+            else
+            {
+                // Leaf triangles occupy node.addr_right consecutive nodes
+                for (auto leaf = &node; leaf != &node + node.addr_right; ++leaf)
+                {
+                    int shape_mask;
+                    std::memcpy(&shape_mask, &leaf->aabb_right_max[0], sizeof(shape_mask));
+
+                    float t, b1, b2;
+                    if ((shape_mask & mask) && IntersectTriangle(reinterpret_cast<float const*>(leaf), o, d, closest_t, t, b1, b2) && t < closest_t)
+                    {
+                        closest_t = t;
+                        t_max = _mm_set1_ps(closest_t);
+                        hit.shapeid = static_cast<Id>(leaf->mesh_id);
+                        hit.primid = static_cast<Id>(leaf->prim_id);
+                        hit.uvwt = float4(b1, b2, 0.f, t);
+                    }
+                }
+            }
+
+            addr = *--ptr;
+        }
+    }
+
+    bool CpuIntersectionDevice::OccludeRay(Scene const& scene, ray const& r) const
+    {
+        if (!scene.bvh)
+        {
+            return false;
+        }
+
+        if (scene.bvh8)
+        {
+            return OccludeRayWide(scene, *scene.bvh8, r);
+        }
+
+        if (scene.bvh4)
+        {
+            return OccludeRayWide(scene, *scene.bvh4, r);
+        }
+
+        auto const nodes = scene.bvh->m_nodes;
+        auto const o = _mm_loadu_ps(&r.o.x);
+        auto const d = _mm_loadu_ps(&r.d.x);
+        auto const invd = SafeInvDir(d);
+        auto const oxinvd = _mm_mul_ps(o, invd);
+        auto const mask = r.GetMask();
+        auto const max_t = r.GetMaxT();
+        auto const t_max = _mm_set1_ps(max_t);
+
+        std::uint32_t stack[kTraversalStackSize];
+        std::uint32_t* ptr = stack;
+        *ptr++ = Bvh2::kInvalidId;
+        std::uint32_t addr = 0;
+
+        while (addr != Bvh2::kInvalidId)
+        {
+            auto const& node = nodes[addr];
+            auto const data = reinterpret_cast<float const*>(&node);
+
+            if (Bvh2::IsInternal(node))
+            {
+                __m128 t_near;
+                int hits = IntersectChildBoxes(data, invd, oxinvd, t_max, t_near);
+
+                if (hits == 0x3)
+                {
+                    *ptr++ = node.addr_right;
+                    addr = node.addr_left;
+                    continue;
+                }
+                else if (hits)
+                {
+                    addr = (hits & 0x1) ? node.addr_left : node.addr_right;
+                    continue;
+                }
+            }
+            else
+            {
+                // Leaf triangles occupy node.addr_right consecutive nodes
+                for (auto leaf = &node; leaf != &node + node.addr_right; ++leaf)
+                {
+                    int shape_mask;
+                    std::memcpy(&shape_mask, &leaf->aabb_right_max[0], sizeof(shape_mask));
+
+                    float t, b1, b2;
+                    if ((shape_mask & mask) && IntersectTriangle(reinterpret_cast<float const*>(leaf), o, d, max_t, t, b1, b2))
+                    {
+                        return true;
+                    }
+                }
+            }
+
+            addr = *--ptr;
+        }
+
+        return false;
+    }
+
+    // Traversal stack entry for wide trees: child as encoded in the node
+    // and its entry distance to skip it once a closer hit is found
+    struct WideStackEntry
+    {
+        std::uint32_t child;
+        std::uint32_t num_prims;
+        float t_near;
+    };
+
+    template <int W>
+    void CpuIntersectionDevice::IntersectRayWide(Scene const& scene, WideBvhTranslator<W> const& bvh, ray const& r, Intersection& hit) const
+    {
+        auto const nodes = bvh.nodes_.data();
+        auto const leaves = scene.bvh->m_nodes;
+        auto const o = _mm_loadu_ps(&r.o.x);
+        auto const d = _mm_loadu_ps(&r.d.x);
+        auto const invd = SafeInvDir(d);
+        WideRay const wide_ray(invd, _mm_mul_ps(o, invd));
+        auto const mask = r.GetMask();
+
+        float closest_t = r.GetMaxT();
+
+        // Each level pushes up to W - 1 children
+        WideStackEntry stack[kTraversalStackSize * (W - 1)];
+        WideStackEntry* ptr = stack;
+        WideStackEntry current = { 0u, 0u, 0.f };
+
+        for (;;)
+        {
+            if (current.num_prims == 0)
+            {
+                auto const& node = nodes[current.child];
+
+                alignas(32) float t_near[W];
+                int hits = IntersectWideNode<W>(node.bounds, wide_ray, closest_t, t_near);
+
+                if (hits)
+                {
+                    // Sort hit children front to back
+                    WideStackEntry sorted[W];
+                    int num_hits = 0;
+
+                    for (; hits; hits &= hits - 1)
+                    {
+                        int i = 0;
+                        while (!(hits & (1 << i))) ++i;
+
+                        WideStackEntry entry = { node.child[i], node.num_prims[i], t_near[i] };
+                        int j = num_hits++;
+                        for (; j > 0 && sorted[j - 1].t_near > entry.t_near; --j)
+                        {
+                            sorted[j] = sorted[j - 1];
+                        }
+                        sorted[j] = entry;
+                    }
+
+                    // Visit the closest child next, push the rest far to near
+                    for (int i = num_hits - 1; i > 0; --i)
+                    {
+                        *ptr++ = sorted[i];
+                    }
+
+                    current = sorted[0];
+                    continue;
+                }
+            }
+            else
+            {
+                // Leaf triangles occupy num_prims consecutive Bvh2 nodes
+                for (auto leaf = leaves + current.child; leaf != leaves + current.child + current.num_prims; ++leaf)
+                {
+                    int shape_mask;
+                    std::memcpy(&shape_mask, &leaf->aabb_right_max[0], sizeof(shape_mask));
+
+                    float t, b1, b2;
+                    if ((shape_mask & mask) && IntersectTriangle(reinterpret_cast<float const*>(leaf), o, d, closest_t, t, b1, b2) && t < closest_t)
+                    {
+                        closest_t = t;
+                        hit.shapeid = static_cast<Id>(leaf->mesh_id);
+                        hit.primid = static_cast<Id>(leaf->prim_id);
+                        hit.uvwt = float4(b1, b2, 0.f, t);
+                    }
+                }
+            }
+
+            // Pop the next child which is still in front of the closest hit
+            do
+            {
+                if (ptr == stack)
+                {
+                    return;
+                }
+
+                current = *--ptr;
+            }
+            while (current.t_near > closest_t);
+        }
+    }
+
+    template <int W>
+    bool CpuIntersectionDevice::OccludeRayWide(Scene const& scene, WideBvhTranslator<W> const& bvh, ray const& r) const
+    {
+        auto const nodes = bvh.nodes_.data();
+        auto const leaves = scene.bvh->m_nodes;
+        auto const o = _mm_loadu_ps(&r.o.x);
+        auto const d = _mm_loadu_ps(&r.d.x);
+        auto const invd = SafeInvDir(d);
+        WideRay const wide_ray(invd, _mm_mul_ps(o, invd));
+        auto const mask = r.GetMask();
+        auto const max_t = r.GetMaxT();
+
+        WideStackEntry stack[kTraversalStackSize * (W - 1)];
+        WideStackEntry* ptr = stack;
+        *ptr++ = { 0u, 0u, 0.f };
+
+        while (ptr != stack)
+        {
+            auto const current = *--ptr;
+
+            if (current.num_prims == 0)
+            {
+                auto const& node = nodes[current.child];
+
+                alignas(32) float t_near[W];
+                int hits = IntersectWideNode<W>(node.bounds, wide_ray, max_t, t_near);
+
+                for (; hits; hits &= hits - 1)
+                {
+                    int i = 0;
+                    while (!(hits & (1 << i))) ++i;
+
+                    *ptr++ = { node.child[i], node.num_prims[i], t_near[i] };
+                }
+            }
+            else
+            {
+                for (auto leaf = leaves + current.child; leaf != leaves + current.child + current.num_prims; ++leaf)
+                {
+                    int shape_mask;
+                    std::memcpy(&shape_mask, &leaf->aabb_right_max[0], sizeof(shape_mask));
+
+                    float t, b1, b2;
+                    if ((shape_mask & mask) && IntersectTriangle(reinterpret_cast<float const*>(leaf), o, d, max_t, t, b1, b2))
+                    {
+                        return true;
+                    }
+                }
+            }
+        }
+
+        return false;
+    }
+}
@@ -0,0 +1,145 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "intersection_device.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_event.h"
+
+namespace RadeonRays
+{
+    class Bvh2;
+    class BvhCache;
+    template <int W> class WideBvhTranslator;
+    ///< The class represents native CPU intersection device.
+    ///< It builds Bvh2 on the host and traverses it on host cores using
+    ///< SSE ray-box and ray-triangle tests, so no third party ray tracing
+    ///< library is required. Bvh2 can be collapsed into 4 or 8 wide nodes
+    ///< ("bvh.width" option) which test all children at once.
+    ///<
+    class CpuIntersectionDevice : public IntersectionDevice
+    {
+    public:
+        //
+        CpuIntersectionDevice();
+        ~CpuIntersectionDevice();
+
+        //IntersectionDevice
+        void Preprocess(World const& world) override;
+        void PreprocessAsync(World const& world, Event** event) override;
+        void ReleaseShape(Shape const* shape) override;
+        Buffer* CreateBuffer(size_t size, void* initdata) const override;
+        void DeleteBuffer(Buffer* const) const override;
+        void DeleteEvent(Event* const) const override;
+        void MapBuffer(Buffer* buffer, MapType type, size_t offset, size_t size, void** data, Event** event) const override;
+        void UnmapBuffer(Buffer* buffer, void* ptr, Event** event) const override;
+        void QueryIntersection(Buffer const* rays, int numrays, Buffer* hitinfos, Event const* waitevent, Event** event) const override;
+        void QueryOcclusion(Buffer const* rays, int numrays, Buffer* hitresults, Event const* waitevent, Event** event) const override;
+        void QueryIntersection(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hitinfos, Event const* waitevent, Event** event) const override;
+        void QueryOcclusion(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hitresults, Event const* waitevent, Event** event) const override;
+        void QueryIntersection(RayBufferSoA const& rays, int numrays, Buffer* hitinfos, Event const* waitevent, Event** event) const override;
+        void QueryOcclusion(RayBufferSoA const& rays, int numrays, Buffer* hitresults, Event const* waitevent, Event** event) const override;
+        void GetBvhStatistics(BvhStatistics& stats) const override;
+
+    protected:
+        // Acceleration structures of a committed scene. Queries hold on to the
+        // scene they started with, so a new one can be swapped in at any time.
+        struct Scene
+        {
+            // nullptr if the scene has no triangles
+            std::unique_ptr<Bvh2> bvh;
+            // Collapsed bvh for wide traversal, leaf triangles stay in bvh
+            std::unique_ptr<WideBvhTranslator<4>> bvh4;
+            std::unique_ptr<WideBvhTranslator<8>> bvh8;
+            // Collected once the scene is built
+            BvhStatistics statistics;
+        };
+
+        // Check the world and return a function building and installing its scene,
+        // or an empty function if the current scene is up to date.
+        // The function uses a snapshot of shape transforms, ids and masks, so it can
+        // run on any thread. Meshes are read in place, ReleaseShape keeps them until
+        // the function has run.
+        std::function<void()> CreateBuild(World const& world);
+        // Called by the function from CreateBuild when it is done, successful or not
+        void OnBuildDone();
+        // Wait until all builds created so far are done
+        void WaitForBuilds();
+        // Cached nodes are checked before use: a damaged entry or one of another scene
+        // hashed to the same key must not send traversal out of bounds or exceed its
+        // stack (Bvh2::kMaxDepth). Children always follow their parent, which also rules out cycles.
+        static bool IsValidBvh2(Bvh2 const& bvh);
+        // Map scene from the cache, false if it has no valid entry for key
+        static bool LoadScene(BvhCache const& cache, std::uint64_t key, int bvh_width, Scene& scene);
+        // Write built scene to the cache
+        static void StoreScene(BvhCache const& cache, std::uint64_t key, Scene const& scene);
+        // Fill scene statistics from its trees, timings are up to the caller
+        static void CollectStatistics(bool epo, Scene& scene);
+        // Install the scene unless a later commit has been installed already
+        void SetScene(std::shared_ptr<Scene const> scene, std::uint64_t commit);
+        // Scene for a query to use
+        std::shared_ptr<Scene const> GetScene() const;
+        // Run f once waitevent is resolved: asynchronously if event is requested, in place otherwise
+        void Execute(std::function<void()>&& f, Event const* waitevent, Event** event) const;
+        // Split [0, numrays) into thread pool tasks and wait for all of them
+        void ParallelFor(int numrays, std::function<void(int, int)> const& f) const;
+        // Find closest hit for a single ray
+        void IntersectRay(Scene const& scene, ray const& r, Intersection& hit) const;
+        // Find any hit for a single ray
+        bool OccludeRay(Scene const& scene, ray const& r) const;
+        // Same for collapsed trees
+        template <int W>
+        void IntersectRayWide(Scene const& scene, WideBvhTranslator<W> const& bvh, ray const& r, Intersection& hit) const;
+        template <int W>
+        bool OccludeRayWide(Scene const& scene, WideBvhTranslator<W> const& bvh, ray const& r) const;
+
+        // Scene used by new queries
+        std::shared_ptr<Scene const> m_scene;
+        // Guards m_scene and m_scene_commit
+        mutable std::mutex m_scene_mutex;
+        // Number of the commit m_scene was built for
+        std::uint64_t m_scene_commit;
+        // Commits which needed a build so far, only used by the committing thread
+        std::uint64_t m_commit_count;
+        // Set by a failed build, the next commit builds again even without changes
+        std::atomic<bool> m_build_failed;
+        // Guards m_num_builds and m_released_shapes
+        std::mutex m_release_mutex;
+        // Signalled when m_num_builds drops to zero
+        std::condition_variable m_builds_done;
+        // Builds created but not done yet
+        int m_num_builds;
+        // Shapes deleted while builds were running, deleted with the last build
+        std::vector<Shape const*> m_released_shapes;
+
+        // Executes queries, declared last to be destroyed first:
+        // its destructor waits for queries still in flight
+        mutable CpuCommandQueue m_queue;
+    };
+}
@@ -21,13 +21,13 @@ THE SOFTWARE.
 ********************************************************************/
 #include "embree_intersection_device.h"
 
+#include <algorithm>
 #include <iostream>
-#include <future>
-#include <thread>
 #include "../world/world.h"
 #include "../primitive/mesh.h"
 #include "../primitive/instance.h"
 #include "buffer.h"
+#include "cpu_event.h"
 #include "device.h"
 #include "event.h"
 #include "../except/except.h"
@@ -38,15 +38,76 @@ THE SOFTWARE.
 #include <xmmintrin.h>
 #include <pmmintrin.h>
 
-//count of elements for one thread pool task
-#define TASK_SIZE 256
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
 
-//switch between rtcIntersect4 and rtcIntercetN
-//#define INTERSECTN
+//default count of rays for one scheduler task
+#define TASK_SIZE 256
 
+//algorithms enabled for every scene, RTC_INTERSECTN enables the rtcIntersectN/rtcOccludedN streams
+#define EMBREE_SCENE_ALGORITHMS (RTC_INTERSECT1 | RTC_INTERSECT4 | RTC_INTERSECT8 | RTC_INTERSECT16 | RTC_INTERSECTN)
 
 namespace RadeonRays
 {
+    //packet type and entry points for each packet width
+    template <int W> struct EmbreePacket;
+
+    template <> struct EmbreePacket<4>
+    {
+        typedef RTCRay4 Ray;
+        static void Intersect(const int* valid, RTCScene scene, Ray& r) { rtcIntersect4(valid, scene, r); }
+        static void Occluded(const int* valid, RTCScene scene, Ray& r) { rtcOccluded4(valid, scene, r); }
+    };
+
+    template <> struct EmbreePacket<8>
+    {
+        typedef RTCRay8 Ray;
+        static void Intersect(const int* valid, RTCScene scene, Ray& r) { rtcIntersect8(valid, scene, r); }
+        static void Occluded(const int* valid, RTCScene scene, Ray& r) { rtcOccluded8(valid, scene, r); }
+    };
+
+    template <> struct EmbreePacket<16>
+    {
+        typedef RTCRay16 Ray;
+        static void Intersect(const int* valid, RTCScene scene, Ray& r) { rtcIntersect16(valid, scene, r); }
+        static void Occluded(const int* valid, RTCScene scene, Ray& r) { rtcOccluded16(valid, scene, r); }
+    };
+
+    //widest packet the host ISA runs natively: 16 needs AVX-512, 8 needs AVX
+    static int GetHostPacketWidth()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int max_leaf = info[0];
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+        bool avx512 = false;
+        if (max_leaf >= 7)
+        {
+            __cpuidex(info, 7, 0);
+            avx512 = (info[1] & (1 << 16)) != 0;
+        }
+        if (avx512 && (xcr0 & 0xe6) == 0xe6)
+            return 16;
+        if (avx && (xcr0 & 0x6) == 0x6)
+            return 8;
+        return 4;
+#elif defined(__GNUC__)
+        if (__builtin_cpu_supports("avx512f"))
+            return 16;
+        if (__builtin_cpu_supports("avx"))
+            return 8;
+        return 4;
+#else
+        return 4;
+#endif
+    }
+
     //simple RadeonRays::Buffer implementation
     class EmbreeBuffer : public Buffer
     {
@@ -78,52 +139,48 @@ namespace RadeonRays
         void* m_data;
     };
 
-    //simple RadeonRays::Event implementation
-    class EmbreeEvent : public Event
-    {
-    public:
-        EmbreeEvent(std::function<void()>&& f)
-            : m_ftr()
-        {
-            std::packaged_task<void()> task(std::move(f));
-            m_ftr = task.get_future();
-            std::thread(std::move(task)).detach();
-        }
-
-        virtual ~EmbreeEvent()
-        {
-            Wait();
-        }
-
-        virtual bool Complete() const
-        {
-            return m_ftr.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
-        }
-
-        virtual void Wait()
-        {
-            m_ftr.wait();
-        }
-    private:
-        std::future<void> m_ftr;
-    };
-
     EmbreeIntersectionDevice::EmbreeIntersectionDevice()
-        : m_pool(1)
+        : m_max_packet_width(4)
+        , m_packet_width(4)
+        , m_task_size(TASK_SIZE)
+        , m_stream_supported(false)
+        , m_stream(false)
     {
         m_device = rtcNewDevice(nullptr);
         RTCError result = rtcDeviceGetError(m_device);
         if (result != RTC_NO_ERROR)
             std::cout << "Failed to create embree rtcDevice: " << result << std::endl;
 
-        m_scene = rtcDeviceNewScene(m_device, RTC_SCENE_STATIC, RTC_INTERSECT1 | RTC_INTERSECT4 | RTC_INTERSECT8 | RTC_INTERSECT16 );
+        m_scene = rtcDeviceNewScene(m_device, RTC_SCENE_DYNAMIC, EMBREE_SCENE_ALGORITHMS);
         result = rtcDeviceGetError(m_device);
         if (result != RTC_NO_ERROR)
             std::cout << "Failed to create embree scene: " << result << std::endl;
+
+        //packets have to be supported by both the CPU and the embree build
+        int host_width = GetHostPacketWidth();
+        if (host_width >= 16 && rtcDeviceGetParameter1i(m_device, RTC_CONFIG_INTERSECT16))
+            m_max_packet_width = 16;
+        else if (host_width >= 8 && rtcDeviceGetParameter1i(m_device, RTC_CONFIG_INTERSECT8))
+            m_max_packet_width = 8;
+        m_packet_width = m_max_packet_width;
+
+        //embree builds without stream support fall back to packets
+        m_stream_supported = rtcDeviceGetParameter1i(m_device, RTC_CONFIG_INTERSECTN) != 0;
     }
     
     EmbreeIntersectionDevice::~EmbreeIntersectionDevice()
     {
+        for (auto& it : m_meshes)
+            rtcDeleteScene(it.second.scene);
+        m_meshes.clear();
+        m_instances.clear();
+
+        if (m_scene)
+        {
+            rtcDeleteScene(m_scene);
+            m_scene = nullptr;
+        }
+
         if (m_device)
         {
             rtcDeleteDevice(m_device);
@@ -134,90 +191,117 @@ namespace RadeonRays
 
     void EmbreeIntersectionDevice::Preprocess(World const& world)
     {
-        for (auto& it : m_instances)
-            it.second.updated = false;
-
-        //checking removed shapes
-        for (auto it = world.shapes_.begin(); it != world.shapes_.end(); ++it)
-        {
-            auto& i = *it;
-            const ShapeImpl* shape = dynamic_cast<const ShapeImpl*>(i);
-            if (m_instances.count(shape))
-                m_instances[shape].updated = true;
-        }
-
-        //cleanup not updated instances
-        auto itr = m_instances.begin();
-        while (itr != m_instances.end())
+        auto width = world.options_.GetOption("embree.packet_width");
+        auto task_size = world.options_.GetOption("embree.task_size");
+        auto stream = world.options_.GetOption("embree.stream");
+
+        //requested width is clamped to what the host supports, 0 picks the widest
+        int packet_width = width ? static_cast<int>(width->AsFloat()) : 0;
+        m_packet_width = m_max_packet_width;
+        if (packet_width > 0 && packet_width < 16)
+            m_packet_width = std::min(packet_width < 8 ? 4 : 8, m_max_packet_width);
+
+        //keep tasks a whole number of the widest packets
+        int rays_per_task = task_size ? static_cast<int>(task_size->AsFloat()) : TASK_SIZE;
+        m_task_size = std::max(16, (rays_per_task + 15) & ~15);
+        m_stream = m_stream_supported && stream && stream->AsFloat() != 0.f;
+
+        // m_scene is dynamic: only attached, detached and changed
+        // shapes are touched, everything else keeps its instance
+        bool changed = false;
+
+        // Without attached or detached shapes the dirty list has all the changes
+        if (!world.has_changed())
         {
-            if (!itr->second.updated)
+            for (auto i : world.shapes_dirty_)
             {
-                //if no instances left => clear stored mesh
-                auto& mesh = m_meshes[itr->first];
-                ThrowIf(mesh.instance_count <= 0, "Invalid embree mesh");
-                --mesh.instance_count;
-                if (mesh.instance_count == 0)
-                {
-                    rtcDeleteScene(itr->second.scene);
-                    CheckEmbreeError();
-                    m_meshes.erase(itr->first);
-                }
-                itr = m_instances.erase(itr);
+                const ShapeImpl* shape = static_cast<const ShapeImpl*>(i);
+                changed |= UpdateShape(shape);
             }
-            else
+
+            if (changed)
             {
-                ++itr;
+                rtcCommit(m_scene);
+                CheckEmbreeError();
             }
+            return;
         }
-        m_instances.clear();
-        rtcDeleteScene(m_scene); CheckEmbreeError();
-        m_scene = rtcDeviceNewScene(m_device, RTC_SCENE_STATIC, RTC_INTERSECT1 | RTC_INTERSECT4 | RTC_INTERSECT8 | RTC_INTERSECT16 ); CheckEmbreeError();
+
+        for (auto& it : m_instances)
+            it.second.updated = false;
 
         for (auto i : world.shapes_)
         {
             const ShapeImpl* shape = dynamic_cast<const ShapeImpl*>(i);
             ThrowIf(!shape, "Invalid shape.");
 
-            //update only if shape already precessed before
-            EmbreeSceneData& data = m_instances[shape];
-            data.mesh_id = shape->GetId();
-            data.updated = true;
-
-            //for each new Shape creating new embree scene with geometry
-            //and adding its instance to m_scene
-            const Mesh* mesh = dynamic_cast<const Mesh*> (shape);
-            if (mesh)
+            auto it = m_instances.find(shape);
+            if (it == m_instances.end())
             {
-                data.scene = GetEmbreeMesh(mesh);
+                AddShape(shape);
+                changed = true;
             }
-            else // instance
+            else
             {
-                const Instance* inst = dynamic_cast<const Instance*> (shape);
-                ThrowIf(!inst, "Invalid shape.");
-                mesh = dynamic_cast<const Mesh*> (inst->GetBaseShape());
-                ThrowIf(!mesh, "Invalid mesh.");
-                //adding mesh of instance if it's not being processed before
-                data.scene = GetEmbreeMesh(mesh);
-                ++m_meshes[mesh].instance_count;
+                it->second.updated = true;
+                changed |= UpdateShape(shape);
             }
+        }
 
-            unsigned geom = rtcNewInstance(m_scene, data.scene);
-            CheckEmbreeError();
-            matrix trans, transInv;
-            shape->GetTransform(trans, transInv);
-            rtcSetTransform(m_scene, geom, RTC_MATRIX_ROW_MAJOR, &trans.m00);
-            CheckEmbreeError();
-            rtcSetMask(m_scene, geom, shape->GetMask());
-            CheckEmbreeError();
-            rtcSetUserData(m_scene, geom, &data);
+        //remove instances of detached shapes
+        auto itr = m_instances.begin();
+        while (itr != m_instances.end())
+        {
+            auto next = std::next(itr);
+            if (!itr->second.updated)
+            {
+                RemoveShape(static_cast<const ShapeImpl*>(itr->first));
+                changed = true;
+            }
+            itr = next;
+        }
+
+        if (changed)
+        {
+            rtcCommit(m_scene);
             CheckEmbreeError();
+        }
+    }
+
+    void EmbreeIntersectionDevice::PreprocessAsync(World const& world, Event** event)
+    {
+        //embree scenes can't be traced while being committed, so m_scene is updated in place
+        Preprocess(world);
 
-            data.geom = geom;
+        if (event)
+        {
+            *event = m_queue.CreateCompletedEvent();
+        }
+    }
 
+    void EmbreeIntersectionDevice::OnShapeDeleted(Shape const* shape)
+    {
+        //validate before anything is released, the shape is kept intact if this throws
+        auto it = m_meshes.find(shape);
+        auto instance = m_instances.find(shape);
+        if (it != m_meshes.end())
+        {
+            //an attached mesh counts as an instance of itself
+            int self = (instance != m_instances.end()) ? 1 : 0;
+            ThrowIf(it->second.instance_count > self, "Mesh is still used by attached instances.");
         }
 
-        rtcCommit(m_scene);
-        CheckEmbreeError();
+        //the shape is being deleted, so drop it from m_scene right away
+        if (instance != m_instances.end())
+            RemoveShape(static_cast<const ShapeImpl*>(shape));
+
+        //mesh geometry is immutable, so its scene only goes away with the mesh
+        if (it != m_meshes.end())
+        {
+            rtcDeleteScene(it->second.scene);
+            CheckEmbreeError();
+            m_meshes.erase(it);
+        }
     }
 
     Buffer* EmbreeIntersectionDevice::CreateBuffer(size_t size, void* initdata) const
@@ -232,12 +316,11 @@ namespace RadeonRays
 
     void EmbreeIntersectionDevice::DeleteEvent(Event* const event) const
     {
-        delete event;
+        m_queue.DeleteEvent(event);
     }
 
     void EmbreeIntersectionDevice::MapBuffer(Buffer* buffer, MapType type, size_t offset, size_t size, void** data, Event** event) const
     {
-        EmbreeEvent* ev = new EmbreeEvent([]() {});
         if (data)
         {
             EmbreeBuffer* buf = dynamic_cast<EmbreeBuffer*>(buffer);
@@ -247,27 +330,15 @@ namespace RadeonRays
 
         if (event)
         {
-            *event = ev;
-        }
-        else
-        {
-            ev->Wait();
-            DeleteEvent(ev);
+            *event = m_queue.CreateCompletedEvent();
         }
     }
 
     void EmbreeIntersectionDevice::UnmapBuffer(Buffer* buffer, void* ptr, Event** event) const
     {
-        EmbreeEvent* ev = new EmbreeEvent([]() {});
-
         if (event)
         {
-            *event = ev;
-        }
-        else
-        {
-            ev->Wait();
-            DeleteEvent(ev);
+            *event = m_queue.CreateCompletedEvent();
         }
     }
     
@@ -277,261 +348,307 @@ namespace RadeonRays
         const EmbreeBuffer* fireRays = dynamic_cast<const EmbreeBuffer*>(rays); ThrowIf(!fireRays, "Invalid embree buffer.");
         EmbreeBuffer* fireHits = dynamic_cast<EmbreeBuffer*>(hits); ThrowIf(!fireHits, "Invalid embree buffer.");
 
-        EmbreeEvent* ev = new EmbreeEvent([this, fireRays, fireHits, numrays]() 
-        {
-            m_pool.setSleepTime(0);
-            //processing buffers workflow:
-            //1. convert RadeonRays::ray to RTCRay
-            //2. rtcIntersect
-            //3. convert RTCRay hit result to RadeonRays::Intersection
-            std::vector<std::future<void> > jobs;
-            jobs.reserve(numrays / TASK_SIZE);
-#ifndef INTERSECTN
-            for (int i = 0; i < numrays; i += TASK_SIZE)
-            {
-                const ray* src_ray = &static_cast<const ray*>(fireRays->GetData())[i];
-                Intersection* hit = &static_cast<Intersection*>(fireHits->GetData())[i];
-                int count = (i + TASK_SIZE) < numrays ? TASK_SIZE : numrays - i;
+        m_queue.Execute([this, fireRays, fireHits, numrays]()
+        {
+            IntersectRays(static_cast<const ray*>(fireRays->GetData()), numrays, static_cast<Intersection*>(fireHits->GetData()));
+        }, waitevent, event);
+    }
 
-                jobs.push_back(std::move(m_pool.submit(([this, src_ray, hit, count]()
-                {
-                    RTCRay4 data;
-                    for (int i = 0; i < count; i+=4)
-                    {
-                        int rays_count = (i + 4) < count ? 4 : count - i; // count of valid rays
-                        RTCORE_ALIGN(16) int valid[4] = { 0, 0, 0, 0,}; //disable all rays
-                        for (int j = 0; j < rays_count; ++j)
-                        {
-                            valid[j] = src_ray[i + j].IsActive() ? -1 : 0;
-                            FillRTCRay(data, j, src_ray[i+j]);
-                        }
-                        rtcIntersect4(valid, m_scene, data); CheckEmbreeError();
-                        for (int j = 0; j < rays_count; ++j)
-                            FillIntersection(hit[i+j], data, j);
-                    }
-                }))));
-            }
-#else
-            std::vector<RTCRay> data(numrays);
-            for (int i = 0; i < numrays; i += TASK_SIZE)
-            {
-                const ray* src_ray = &static_cast<const ray*>(fireRays->GetData())[i];
-                RTCRay* dst_ray = &data[i];
-                Intersection* hit = &static_cast<Intersection*>(fireHits->GetData())[i];
-                int count = (i + TASK_SIZE) < numrays ? TASK_SIZE : numrays - i;
-                jobs.push_back(std::move(m_pool.submit([this, dst_ray, src_ray, count]()
-                {
-                    for (int j = 0; j < count; ++j)
-                        FillRTCRay(dst_ray[j], src_ray[j]);
-                })));
-            }
-            std::for_each(jobs.begin(), jobs.end(), [](std::future<void>& j) {j.wait(); });
-            jobs.clear();
-            rtcIntersectN(m_scene, &data[0], numrays, sizeof(RTCRay));
-            CheckEmbreeError();
-            for (int i = 0; i < numrays; i += TASK_SIZE)
-            {
-                const ray* src_ray = &static_cast<const ray*>(fireRays->GetData())[i];
-                RTCRay* src_hit = &data[i];
-                Intersection* hit = &static_cast<Intersection*>(fireHits->GetData())[i];
-                int count = (i + TASK_SIZE) < numrays ? TASK_SIZE : numrays - i;
+    void EmbreeIntersectionDevice::QueryOcclusion(Buffer const* rays, int numrays, Buffer* hits, Event const* waitevent, Event** event) const
+    {
+        const EmbreeBuffer* fireRays = dynamic_cast<const EmbreeBuffer*>(rays); ThrowIf(!fireRays, "Invalid embree buffer.");
+        EmbreeBuffer* fireHits = dynamic_cast<EmbreeBuffer*>(hits); ThrowIf(!fireHits, "Invalid embree buffer.");
 
-                jobs.push_back(std::move(m_pool.submit([this, hit, src_hit, src_ray, count]()
-                {
-                    for (int i = 0; i < count; ++i)
-                        if (src_ray[i].IsActive())
-                        {
-                            FillIntersection(hit[i], src_hit[i]);
-                        }
-                })));
-            }
-            
-#endif // INTERSECTN
+        m_queue.Execute([this, fireRays, fireHits, numrays]()
+        {
+            OccludeRays(static_cast<const ray*>(fireRays->GetData()), numrays, static_cast<int*>(fireHits->GetData()));
+        }, waitevent, event);
+    }
 
-            std::for_each(jobs.begin(), jobs.end(), [](std::future<void>& j) {j.wait(); });
-            m_pool.setSleepTime(1);
-        });
+    void EmbreeIntersectionDevice::QueryIntersection(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hits, Event const* waitevent, Event** event) const
+    {
+        const EmbreeBuffer* fireRays = dynamic_cast<const EmbreeBuffer*>(rays); ThrowIf(!fireRays, "Invalid embree buffer.");
+        const EmbreeBuffer* fireCount = dynamic_cast<const EmbreeBuffer*>(numrays); ThrowIf(!fireCount, "Invalid embree buffer.");
+        EmbreeBuffer* fireHits = dynamic_cast<EmbreeBuffer*>(hits); ThrowIf(!fireHits, "Invalid embree buffer.");
 
-        if (event)
+        m_queue.Execute([this, fireRays, fireCount, maxrays, fireHits]()
+        {
+            //ray count is only known once waitevent is complete
+            int count = std::min(*static_cast<const int*>(fireCount->GetData()), maxrays);
+            IntersectRays(static_cast<const ray*>(fireRays->GetData()), count, static_cast<Intersection*>(fireHits->GetData()));
+        }, waitevent, event);
+    }
+
+    void EmbreeIntersectionDevice::QueryOcclusion(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hits, Event const* waitevent, Event** event) const
+    {
+        const EmbreeBuffer* fireRays = dynamic_cast<const EmbreeBuffer*>(rays); ThrowIf(!fireRays, "Invalid embree buffer.");
+        const EmbreeBuffer* fireCount = dynamic_cast<const EmbreeBuffer*>(numrays); ThrowIf(!fireCount, "Invalid embree buffer.");
+        EmbreeBuffer* fireHits = dynamic_cast<EmbreeBuffer*>(hits); ThrowIf(!fireHits, "Invalid embree buffer.");
+
+        m_queue.Execute([this, fireRays, fireCount, maxrays, fireHits]()
+        {
+            //ray count is only known once waitevent is complete
+            int count = std::min(*static_cast<const int*>(fireCount->GetData()), maxrays);
+            OccludeRays(static_cast<const ray*>(fireRays->GetData()), count, static_cast<int*>(fireHits->GetData()));
+        }, waitevent, event);
+    }
+
+    void EmbreeIntersectionDevice::QueryIntersection(RayBufferSoA const& rays, int numrays, Buffer* hits, Event const* waitevent, Event** event) const
+    {
+        RayArrays src = GetRayArrays(rays);
+        EmbreeBuffer* fireHits = dynamic_cast<EmbreeBuffer*>(hits); ThrowIf(!fireHits, "Invalid embree buffer.");
+
+        m_queue.Execute([this, src, fireHits, numrays]()
+        {
+            IntersectRays(src, numrays, static_cast<Intersection*>(fireHits->GetData()));
+        }, waitevent, event);
+    }
+
+    void EmbreeIntersectionDevice::QueryOcclusion(RayBufferSoA const& rays, int numrays, Buffer* hits, Event const* waitevent, Event** event) const
+    {
+        RayArrays src = GetRayArrays(rays);
+        EmbreeBuffer* fireHits = dynamic_cast<EmbreeBuffer*>(hits); ThrowIf(!fireHits, "Invalid embree buffer.");
+
+        m_queue.Execute([this, src, fireHits, numrays]()
+        {
+            OccludeRays(src, numrays, static_cast<int*>(fireHits->GetData()));
+        }, waitevent, event);
+    }
+
+    EmbreeIntersectionDevice::RayArrays EmbreeIntersectionDevice::GetRayArrays(RayBufferSoA const& rays)
+    {
+        Buffer const* buffers[] = { rays.ox, rays.oy, rays.oz, rays.dx, rays.dy, rays.dz, rays.maxt };
+        const float* data[7];
+        for (int i = 0; i < 7; ++i)
         {
-            *event = ev;
+            const EmbreeBuffer* buffer = dynamic_cast<const EmbreeBuffer*>(buffers[i]); ThrowIf(!buffer, "Invalid embree buffer.");
+            data[i] = static_cast<const float*>(buffer->GetData());
         }
-        else
+
+        RayArrays result;
+        for (int i = 0; i < 3; ++i)
         {
-            ev->Wait();
-            DeleteEvent(ev);
+            result.o[i] = data[i];
+            result.d[i] = data[3 + i];
         }
+        result.maxt = data[6];
+
+        result.mask = nullptr;
+        if (rays.mask)
+        {
+            const EmbreeBuffer* buffer = dynamic_cast<const EmbreeBuffer*>(rays.mask); ThrowIf(!buffer, "Invalid embree buffer.");
+            result.mask = static_cast<const int*>(buffer->GetData());
+        }
+
+        return result;
     }
 
-    void EmbreeIntersectionDevice::QueryOcclusion(Buffer const* rays, int numrays, Buffer* hits, Event const* waitevent, Event** event) const
+    static inline bool IsRayActive(const ray* rays, int i)
     {
-        const EmbreeBuffer* fireRays = dynamic_cast<const EmbreeBuffer*>(rays); ThrowIf(!fireRays, "Invalid embree buffer.");
-        EmbreeBuffer* fireHits = dynamic_cast<EmbreeBuffer*>(hits); ThrowIf(!fireHits, "Invalid embree buffer.");
+        return rays[i].IsActive();
+    }
 
-        EmbreeEvent* ev = new EmbreeEvent([this, fireRays, fireHits, numrays]()
-        {
-            m_pool.setSleepTime(0);
-            //processing buffers workflow:
-            //1. convert RadeonRays::ray to RTCRay
-            //2. rtcOccluded
-            //3. convert RTCRay hit result
-            std::vector<std::future<void> > jobs;
-            jobs.reserve(numrays / TASK_SIZE);
-#ifndef INTERSECTN
-            for (int i = 0; i < numrays; i += TASK_SIZE)
-            {
+    //SoA rays have no activity flag, a zero mask is used instead
+    template <typename Rays>
+    static inline bool IsRayActive(Rays const& /*rays*/, int /*i*/)
+    {
+        return true;
+    }
 
-                const ray* src_ray = &static_cast<const ray*>(fireRays->GetData())[i];
-                int* hit = &static_cast<int*>(fireHits->GetData())[i];
-                int count = (i + TASK_SIZE) < numrays ? TASK_SIZE : numrays - i;
+    template <typename Rays>
+    void EmbreeIntersectionDevice::IntersectRays(Rays const& rays, int numrays, Intersection* hits) const
+    {
+        if (m_stream)
+        {
+            IntersectStream(rays, numrays, hits);
+            return;
+        }
 
-                jobs.push_back(std::move(m_pool.submit(([this, src_ray, hit, count]()
-                {
-                    RTCRay4 data;
-                    for (int i = 0; i < count; i += 4)
-                    {
-                        int rays_count = (i + 4) < count ? 4 : count - i; // count of valid rays
-                        RTCORE_ALIGN(16) int valid[4] = { 0, 0, 0, 0, }; //disable all rays
-                        for (int j = 0; j < 4; ++j)
-                        {
-                            data.orgx[j] = 0;
-                            data.orgy[j] = 0;
-                            data.orgz[j] = 0;
-
-                            data.dirx[j] = 0;
-                            data.diry[j] = 0;
-                            data.dirz[j] = 0;
-
-                            data.tnear[j] = 0;
-                            data.tfar[j] = 0;
-                            data.geomID[j] = RTC_INVALID_GEOMETRY_ID;
-                            data.primID[j] = RTC_INVALID_GEOMETRY_ID;
-                            data.instID[j] = RTC_INVALID_GEOMETRY_ID;
-                            data.time[j] = 0;
-                            data.mask[j] = 0xFFFFFF;
-                        }
-                        for (int j = 0; j < rays_count; ++j)
-                        {
-                            valid[j] = src_ray[i + j].IsActive() ? -1 : 0;
-                            FillRTCRay(data, j, src_ray[i + j]);
-                        }
-                        rtcOccluded4(valid, m_scene, data); CheckEmbreeError();
-                        for (int j = 0; j < rays_count; ++j)
-                        {
-                            if (data.instID[j] == RTC_INVALID_GEOMETRY_ID || data.geomID[j] == RTC_INVALID_GEOMETRY_ID)
-                            {
-                                hit[i + j] = RTC_INVALID_GEOMETRY_ID;
-                                continue;
-                            }
-                            hit[i + j] = data.instID[j];
-                            EmbreeSceneData* data = static_cast<EmbreeSceneData*>(rtcGetUserData(m_scene, hit[i + j]));
-                            hit[i + j] = data->mesh_id;
-                        }
-                    }
-                }))));
-            }
-#else
-            std::vector<RTCRay> data(numrays);
-            for (int i = 0; i < numrays; i += TASK_SIZE)
+        switch (m_packet_width)
+        {
+        case 16: IntersectPackets<16>(rays, numrays, hits); break;
+        case 8: IntersectPackets<8>(rays, numrays, hits); break;
+        default: IntersectPackets<4>(rays, numrays, hits); break;
+        }
+    }
+
+    template <typename Rays>
+    void EmbreeIntersectionDevice::OccludeRays(Rays const& rays, int numrays, int* hits) const
+    {
+        if (m_stream)
+        {
+            OccludeStream(rays, numrays, hits);
+            return;
+        }
+
+        switch (m_packet_width)
+        {
+        case 16: OccludePackets<16>(rays, numrays, hits); break;
+        case 8: OccludePackets<8>(rays, numrays, hits); break;
+        default: OccludePackets<4>(rays, numrays, hits); break;
+        }
+    }
+
+    template <int W, typename Rays>
+    void EmbreeIntersectionDevice::IntersectPackets(Rays const& rays, int numrays, Intersection* hits) const
+    {
+        //processing buffers workflow:
+        //1. fill RTCRayN from the rays
+        //2. rtcIntersectN
+        //3. convert RTCRayN hit result to RadeonRays::Intersection
+        parallel_for(0, numrays, m_task_size, [&](int begin, int end)
+        {
+            RTCORE_ALIGN(64) typename EmbreePacket<W>::Ray data = {};
+            RTCORE_ALIGN(64) int valid[W];
+            for (int i = begin; i < end; i += W)
             {
-                const ray* src_ray = &static_cast<const ray*>(fireRays->GetData())[i];
-                RTCRay* dst_ray = &data[i];
-                Intersection* hit = &static_cast<Intersection*>(fireHits->GetData())[i];
-                int count = (i + TASK_SIZE) < numrays ? TASK_SIZE : numrays - i;
-                jobs.push_back(std::move(m_pool.submit([this, dst_ray, src_ray, count]()
-                {
-                    for (int j = 0; j < count; ++j)
-                        FillRTCRay(dst_ray[j], src_ray[j]);
-                })));
+                int rays_count = std::min(W, end - i); // count of valid rays
+                FillRTCRays(data, valid, rays, i, rays_count);
+                EmbreePacket<W>::Intersect(valid, m_scene, data); CheckEmbreeError();
+                for (int j = 0; j < rays_count; ++j)
+                    FillIntersection(hits[i + j], data, j);
             }
-            std::for_each(jobs.begin(), jobs.end(), [](std::future<void>& j) {j.wait(); });
-            jobs.clear();
-            rtcOccludedN(m_scene, &data[0], numrays, sizeof(RTCRay));
-            CheckEmbreeError();
-            for (int i = 0; i < numrays; i += TASK_SIZE)
+        });
+    }
+
+    template <int W, typename Rays>
+    void EmbreeIntersectionDevice::OccludePackets(Rays const& rays, int numrays, int* hits) const
+    {
+        //processing buffers workflow:
+        //1. fill RTCRayN from the rays
+        //2. rtcOccludedN
+        //3. convert RTCRayN hit result
+        parallel_for(0, numrays, m_task_size, [&](int begin, int end)
+        {
+            //lanes past the last ray are disabled in valid, embree ignores them
+            RTCORE_ALIGN(64) typename EmbreePacket<W>::Ray data = {};
+            RTCORE_ALIGN(64) int valid[W];
+            for (int i = begin; i < end; i += W)
             {
-                const ray* src_ray = &static_cast<const ray*>(fireRays->GetData())[i];
-                int* hit = &static_cast<int*>(fireHits->GetData())[i];
-                int count = (i + TASK_SIZE) < numrays ? TASK_SIZE : numrays - i;
-                RTCRay* hit_src = &data[i];
-                jobs.push_back(std::move(m_pool.submit([this, hit, hit_src, src_ray, count]()
+                int rays_count = std::min(W, end - i); // count of valid rays
+                FillRTCRays(data, valid, rays, i, rays_count);
+                EmbreePacket<W>::Occluded(valid, m_scene, data); CheckEmbreeError();
+                for (int j = 0; j < rays_count; ++j)
                 {
-                    for (int i = 0; i < count; ++i)
+                    if (data.instID[j] == RTC_INVALID_GEOMETRY_ID || data.geomID[j] == RTC_INVALID_GEOMETRY_ID)
                     {
-                        if (hit_src[i].instID == RTC_INVALID_GEOMETRY_ID || hit_src[i].geomID == RTC_INVALID_GEOMETRY_ID)
-                        {
-                            hit[i] = RTC_INVALID_GEOMETRY_ID;
-                            continue;
-                        }
-                        hit[i] = hit_src[i].instID;
-                        EmbreeSceneData* data = static_cast<EmbreeSceneData*>(rtcGetUserData(m_scene, hit[i]));
-                        hit[i] = data->mesh_id;
+                        hits[i + j] = RTC_INVALID_GEOMETRY_ID;
+                        continue;
                     }
-                })));
+                    EmbreeSceneData* scene_data = static_cast<EmbreeSceneData*>(rtcGetUserData(m_scene, data.instID[j]));
+                    hits[i + j] = scene_data->mesh_id;
+                }
             }
-#endif // INTERSECTN
-
-            std::for_each(jobs.begin(), jobs.end(), [](std::future<void>& j) {j.wait(); });
-            m_pool.setSleepTime(1);
         });
-
-        if (event)
-        {
-            *event = ev;
-        }
-        else
-        {
-            ev->Wait();
-            DeleteEvent(ev);
-        }
     }
 
-    void EmbreeIntersectionDevice::QueryIntersection(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hits, Event const* waitevent, Event** event) const
+    template <typename Rays>
+    void EmbreeIntersectionDevice::IntersectStream(Rays const& rays, int numrays, Intersection* hits) const
     {
-        Throw("Not implemented for embree device.");
+        //convert all rays, let embree trace the whole stream and convert results back
+        std::vector<RTCRay> data(numrays);
+        parallel_for(0, numrays, m_task_size, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+                FillRTCRay(data[i], rays, i);
+        });
+        rtcIntersectN(m_scene, data.data(), numrays, sizeof(RTCRay));
+        CheckEmbreeError();
+        parallel_for(0, numrays, m_task_size, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+                if (IsRayActive(rays, i))
+                {
+                    FillIntersection(hits[i], data[i]);
+                }
+        });
     }
 
-    void EmbreeIntersectionDevice::QueryOcclusion(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hits, Event const* waitevent, Event** event) const
+    template <typename Rays>
+    void EmbreeIntersectionDevice::OccludeStream(Rays const& rays, int numrays, int* hits) const
     {
-        Throw("Not implemented for embree device.");
+        std::vector<RTCRay> data(numrays);
+        parallel_for(0, numrays, m_task_size, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+                FillRTCRay(data[i], rays, i);
+        });
+        rtcOccludedN(m_scene, data.data(), numrays, sizeof(RTCRay));
+        CheckEmbreeError();
+        parallel_for(0, numrays, m_task_size, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                if (data[i].instID == RTC_INVALID_GEOMETRY_ID || data[i].geomID == RTC_INVALID_GEOMETRY_ID)
+                {
+                    hits[i] = RTC_INVALID_GEOMETRY_ID;
+                    continue;
+                }
+                EmbreeSceneData* scene_data = static_cast<EmbreeSceneData*>(rtcGetUserData(m_scene, data[i].instID));
+                hits[i] = scene_data->mesh_id;
+            }
+        });
     }
 
     RTCScene EmbreeIntersectionDevice::GetEmbreeMesh(const RadeonRays::Mesh* mesh)
     {
-        if (m_meshes.count(mesh))
-            return m_meshes[mesh].scene;
-        RTCScene result = rtcDeviceNewScene(m_device, RTC_SCENE_STATIC, RTC_INTERSECT1 | RTC_INTERSECT4 | RTC_INTERSECT8 | RTC_INTERSECT16 );
+        auto it = m_meshes.find(mesh);
+        if (it != m_meshes.end())
+        {
+            ++it->second.instance_count;
+            return it->second.scene;
+        }
+
+        RTCScene result = rtcDeviceNewScene(m_device, RTC_SCENE_STATIC, EMBREE_SCENE_ALGORITHMS);
         CheckEmbreeError();
         ThrowIf(!mesh->puretriangle(), "Only triangle meshes supported by now.");
 
         unsigned id = rtcNewTriangleMesh(result, RTC_GEOMETRY_STATIC, mesh->num_faces(), mesh->num_vertices());
         CheckEmbreeError();
         
-        const float3* kMeshVerts = mesh->GetVertexData();
-        float* verts = static_cast<float*>(rtcMapBuffer(result, id, RTC_VERTEX_BUFFER));
-        CheckEmbreeError();
-        ThrowIf(!verts, "Failed to map embree buffer.");
-        for (int i = 0; i < mesh->num_vertices(); ++i)
+        //external meshes share their data with embree where the layout allows it,
+        //vertices are loaded as 16 bytes, so shared ones need padding past the last one
+        if (mesh->external() && mesh->vertex_stride() >= (int)(4 * sizeof(float)))
         {
-            verts[4 * i] = kMeshVerts[i].x;
-            verts[4 * i + 1] = kMeshVerts[i].y;
-            verts[4 * i + 2] = kMeshVerts[i].z;
-            verts[4 * i + 3] = kMeshVerts[i].w;
+            rtcSetBuffer(result, id, RTC_VERTEX_BUFFER, mesh->GetRawVertexData(), 0, mesh->vertex_stride());
+            CheckEmbreeError();
+        }
+        else
+        {
+            float* verts = static_cast<float*>(rtcMapBuffer(result, id, RTC_VERTEX_BUFFER));
+            CheckEmbreeError();
+            ThrowIf(!verts, "Failed to map embree buffer.");
+            for (int i = 0; i < mesh->num_vertices(); ++i)
+            {
+                float3 v = mesh->GetVertex(i);
+                verts[4 * i] = v.x;
+                verts[4 * i + 1] = v.y;
+                verts[4 * i + 2] = v.z;
+                verts[4 * i + 3] = v.w;
+            }
+            rtcUnmapBuffer(result, id, RTC_VERTEX_BUFFER);
         }
-        rtcUnmapBuffer(result, id, RTC_VERTEX_BUFFER);
 
-        int* indices = static_cast<int*>(rtcMapBuffer(result, id, RTC_INDEX_BUFFER));
-        CheckEmbreeError();
-        ThrowIf(!indices, "Failed to map embree buffer.");
-        const Mesh::Face* kFaces = mesh->GetFaceData();
-        for (int i = 0; i < mesh->num_faces(); ++i)
+        if (mesh->external())
+        {
+            rtcSetBuffer(result, id, RTC_INDEX_BUFFER, mesh->GetRawIndexData(), 0, mesh->index_stride());
+            CheckEmbreeError();
+        }
+        else
         {
-            indices[3 * i] = kFaces[i].i0;
-            indices[3 * i + 1] = kFaces[i].i1;
-            indices[3 * i + 2] = kFaces[i].i2;
+            int* indices = static_cast<int*>(rtcMapBuffer(result, id, RTC_INDEX_BUFFER));
+            CheckEmbreeError();
+            ThrowIf(!indices, "Failed to map embree buffer.");
+            for (int i = 0; i < mesh->num_faces(); ++i)
+            {
+                Mesh::Face face = mesh->GetFace(i);
+                indices[3 * i] = face.i0;
+                indices[3 * i + 1] = face.i1;
+                indices[3 * i + 2] = face.i2;
+            }
+            rtcUnmapBuffer(result, id, RTC_INDEX_BUFFER);
+            CheckEmbreeError();
         }
-        rtcUnmapBuffer(result, id, RTC_INDEX_BUFFER);
-        CheckEmbreeError();
         rtcCommit(result);
 
         m_meshes[mesh].scene = result;
@@ -540,12 +657,66 @@ namespace RadeonRays
         return result;
     }
 
-    void EmbreeIntersectionDevice::UpdateShape(const RadeonRays::ShapeImpl* shape)
+    void EmbreeIntersectionDevice::ReleaseEmbreeMesh(const RadeonRays::Mesh* mesh)
+    {
+        auto it = m_meshes.find(mesh);
+        ThrowIf(it == m_meshes.end() || it->second.instance_count <= 0, "Invalid embree mesh");
+
+        //the scene is kept for the next attach, see OnShapeDeleted
+        --it->second.instance_count;
+    }
+
+    void EmbreeIntersectionDevice::AddShape(const RadeonRays::ShapeImpl* shape)
+    {
+        //meshes and instances both refer to a mesh scene
+        //which is instantiated in m_scene with shape transform
+        const Mesh* mesh = dynamic_cast<const Mesh*>(shape);
+        if (!mesh)
+        {
+            const Instance* inst = dynamic_cast<const Instance*>(shape);
+            ThrowIf(!inst, "Invalid shape.");
+            mesh = dynamic_cast<const Mesh*>(inst->GetBaseShape());
+            ThrowIf(!mesh, "Invalid mesh.");
+        }
+
+        EmbreeSceneData& data = m_instances[shape];
+        data.mesh = mesh;
+        data.scene = GetEmbreeMesh(mesh);
+        data.mesh_id = shape->GetId();
+        data.updated = true;
+
+        unsigned geom = rtcNewInstance(m_scene, data.scene);
+        CheckEmbreeError();
+        matrix trans, transInv;
+        shape->GetTransform(trans, transInv);
+        rtcSetTransform(m_scene, geom, RTC_MATRIX_ROW_MAJOR, &trans.m00);
+        CheckEmbreeError();
+        rtcSetMask(m_scene, geom, shape->GetMask());
+        CheckEmbreeError();
+        //map nodes are stable, so user data stays valid until the shape is removed
+        rtcSetUserData(m_scene, geom, &data);
+        CheckEmbreeError();
+
+        data.geom = geom;
+    }
+
+    void EmbreeIntersectionDevice::RemoveShape(const RadeonRays::ShapeImpl* shape)
+    {
+        auto it = m_instances.find(shape);
+        ThrowIf(it == m_instances.end(), "Invalid shape.");
+
+        rtcDeleteGeometry(m_scene, it->second.geom);
+        CheckEmbreeError();
+        ReleaseEmbreeMesh(it->second.mesh);
+        m_instances.erase(it);
+    }
+
+    bool EmbreeIntersectionDevice::UpdateShape(const RadeonRays::ShapeImpl* shape)
     {
-        const EmbreeSceneData& data = m_instances[shape];
+        EmbreeSceneData& data = m_instances[shape];
         int state = shape->GetStateChange();
         if (state == ShapeImpl::kStateChangeNone)
-            return;
+            return false;
 
         if (state & ShapeImpl::kStateChangeMask)
         {
@@ -561,10 +732,13 @@ namespace RadeonRays
         }
         if (state & ShapeImpl::kStateChangeId)
         {
-            m_instances[shape].mesh_id = shape->GetId();
+            data.mesh_id = shape->GetId();
         }
 
         ThrowIf((state & ShapeImpl::kStateChangeMotion) ? true : false, "Not implemented for embree device");
+
+        //id changes do not touch the embree scene
+        return (state & (ShapeImpl::kStateChangeMask | ShapeImpl::kStateChangeTransform)) != 0;
     }
 
     void EmbreeIntersectionDevice::FillRTCRay(RTCRay& dst, const ray& src) const
@@ -586,7 +760,8 @@ namespace RadeonRays
         dst.mask = src.GetMask();
     }
 
-    void EmbreeIntersectionDevice::FillRTCRay(RTCRay4& dst, int i, const ray& src) const
+    template <typename RTCRayN>
+    void EmbreeIntersectionDevice::FillRTCRay(RTCRayN& dst, int i, const ray& src) const
     {
         dst.orgx[i] = src.o.x;
         dst.orgy[i] = src.o.y;
@@ -606,6 +781,70 @@ namespace RadeonRays
     }
 
 
+    template <typename RTCRayN>
+    void EmbreeIntersectionDevice::FillRTCRays(RTCRayN& dst, int* valid, const ray* rays, int first, int count) const
+    {
+        int const width = sizeof(dst.tfar) / sizeof(dst.tfar[0]);
+        for (int j = 0; j < count; ++j)
+        {
+            valid[j] = rays[first + j].IsActive() ? -1 : 0;
+            FillRTCRay(dst, j, rays[first + j]);
+        }
+        for (int j = count; j < width; ++j)
+            valid[j] = 0;
+    }
+
+    template <typename RTCRayN>
+    void EmbreeIntersectionDevice::FillRTCRays(RTCRayN& dst, int* valid, RayArrays const& rays, int first, int count) const
+    {
+        //packets are SoA as well: plain copies of each component
+        int const width = sizeof(dst.tfar) / sizeof(dst.tfar[0]);
+        memcpy(dst.orgx, rays.o[0] + first, count * sizeof(float));
+        memcpy(dst.orgy, rays.o[1] + first, count * sizeof(float));
+        memcpy(dst.orgz, rays.o[2] + first, count * sizeof(float));
+        memcpy(dst.dirx, rays.d[0] + first, count * sizeof(float));
+        memcpy(dst.diry, rays.d[1] + first, count * sizeof(float));
+        memcpy(dst.dirz, rays.d[2] + first, count * sizeof(float));
+        memcpy(dst.tfar, rays.maxt + first, count * sizeof(float));
+
+        for (int j = 0; j < count; ++j)
+        {
+            valid[j] = -1;
+            dst.tnear[j] = 0;
+            dst.time[j] = 0;
+            dst.mask[j] = rays.mask ? rays.mask[first + j] : 0xFFFFFFFF;
+            dst.geomID[j] = RTC_INVALID_GEOMETRY_ID;
+            dst.primID[j] = RTC_INVALID_GEOMETRY_ID;
+            dst.instID[j] = RTC_INVALID_GEOMETRY_ID;
+        }
+        for (int j = count; j < width; ++j)
+            valid[j] = 0;
+    }
+
+    void EmbreeIntersectionDevice::FillRTCRay(RTCRay& dst, const ray* rays, int i) const
+    {
+        FillRTCRay(dst, rays[i]);
+    }
+
+    void EmbreeIntersectionDevice::FillRTCRay(RTCRay& dst, RayArrays const& rays, int i) const
+    {
+        dst.org[0] = rays.o[0][i];
+        dst.org[1] = rays.o[1][i];
+        dst.org[2] = rays.o[2][i];
+
+        dst.dir[0] = rays.d[0][i];
+        dst.dir[1] = rays.d[1][i];
+        dst.dir[2] = rays.d[2][i];
+
+        dst.tnear = 0;
+        dst.tfar = rays.maxt[i];
+        dst.geomID = RTC_INVALID_GEOMETRY_ID;
+        dst.primID = RTC_INVALID_GEOMETRY_ID;
+        dst.instID = RTC_INVALID_GEOMETRY_ID;
+        dst.time = 0;
+        dst.mask = rays.mask ? rays.mask[i] : 0xFFFFFFFF;
+    }
+
     void EmbreeIntersectionDevice::FillIntersection(Intersection& dst, const RTCRay& src) const
     {
         dst.shapeid = src.instID;
@@ -621,7 +860,8 @@ namespace RadeonRays
         dst.uvwt.z = 0;
         dst.uvwt.w = src.tfar;
     }
-    void EmbreeIntersectionDevice::FillIntersection(Intersection& dst, const RTCRay4& src, int i) const
+    template <typename RTCRayN>
+    void EmbreeIntersectionDevice::FillIntersection(Intersection& dst, const RTCRayN& src, int i) const
     {
         dst.shapeid = src.instID[i];
         if (dst.shapeid != RTC_INVALID_GEOMETRY_ID)
@@ -25,7 +25,7 @@ THE SOFTWARE.
 #include <map>
 
 #include <embree2/rtcore.h>
-#include "../async/thread_pool.h"
+#include "cpu_event.h"
 
 namespace RadeonRays
 {
@@ -44,6 +44,8 @@ namespace RadeonRays
 
         //IntersectionDevice
         void Preprocess(World const& world) override;
+        void PreprocessAsync(World const& world, Event** event) override;
+        void OnShapeDeleted(Shape const* shape) override;
         Buffer* CreateBuffer(size_t size, void* initdata) const override;
         void DeleteBuffer(Buffer* const) const override;
         void DeleteEvent(Event* const) const override;
@@ -53,15 +55,58 @@ namespace RadeonRays
         void QueryOcclusion(Buffer const* rays, int numrays, Buffer* hitresults, Event const* waitevent, Event** event) const override;
         void QueryIntersection(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hitinfos, Event const* waitevent, Event** event) const override;
         void QueryOcclusion(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hitresults, Event const* waitevent, Event** event) const override;
+        void QueryIntersection(RayBufferSoA const& rays, int numrays, Buffer* hitinfos, Event const* waitevent, Event** event) const override;
+        void QueryOcclusion(RayBufferSoA const& rays, int numrays, Buffer* hitresults, Event const* waitevent, Event** event) const override;
     
     protected:
+        //host pointers to RayBufferSoA arrays
+        struct RayArrays
+        {
+            const float* o[3];
+            const float* d[3];
+            const float* maxt;
+            const int* mask;
+        };
+
+        static RayArrays GetRayArrays(RayBufferSoA const& rays);
+
+        // Get embree scene for the mesh and add a reference to it.
+        // The scene is built once and kept until the mesh is deleted.
         RTCScene GetEmbreeMesh(const Mesh*);
-        void UpdateShape(const ShapeImpl*);
+        // Drop a reference, unreferenced scenes stay cached for reattaching
+        void ReleaseEmbreeMesh(const Mesh*);
+        void AddShape(const ShapeImpl*);
+        void RemoveShape(const ShapeImpl*);
+        bool UpdateShape(const ShapeImpl*);
         void FillRTCRay(RTCRay& dst, const ray& src) const;
-        void FillRTCRay(RTCRay4& dst, int i, const ray& src) const;
+        template <typename RTCRayN>
+        void FillRTCRay(RTCRayN& dst, int i, const ray& src) const;
+        //fill count packet lanes from AoS or SoA rays starting at first, the rest is disabled in valid
+        template <typename RTCRayN>
+        void FillRTCRays(RTCRayN& dst, int* valid, const ray* rays, int first, int count) const;
+        template <typename RTCRayN>
+        void FillRTCRays(RTCRayN& dst, int* valid, RayArrays const& rays, int first, int count) const;
+        void FillRTCRay(RTCRay& dst, const ray* rays, int i) const;
+        void FillRTCRay(RTCRay& dst, RayArrays const& rays, int i) const;
         void FillIntersection(Intersection& dst, const RTCRay& src) const;
-        void FillIntersection(Intersection& dst, const RTCRay4& src, int i) const;
+        template <typename RTCRayN>
+        void FillIntersection(Intersection& dst, const RTCRayN& src, int i) const;
         void CheckEmbreeError() const;
+        //trace rays in scheduler sized chunks, called once the query dependencies are complete.
+        //Rays is either const ray* or RayArrays
+        template <typename Rays>
+        void IntersectRays(Rays const& rays, int numrays, Intersection* hits) const;
+        template <typename Rays>
+        void OccludeRays(Rays const& rays, int numrays, int* hits) const;
+        //W wide packets or a single embree stream call
+        template <int W, typename Rays>
+        void IntersectPackets(Rays const& rays, int numrays, Intersection* hits) const;
+        template <int W, typename Rays>
+        void OccludePackets(Rays const& rays, int numrays, int* hits) const;
+        template <typename Rays>
+        void IntersectStream(Rays const& rays, int numrays, Intersection* hits) const;
+        template <typename Rays>
+        void OccludeStream(Rays const& rays, int numrays, int* hits) const;
         
         // embree device
         RTCDevice m_device;
@@ -69,13 +114,20 @@ namespace RadeonRays
         // scene for intersection
         RTCScene m_scene; 
 
-        //thread pool for parallelizing work with buffers
-        mutable thread_pool<void> m_pool;
+        //widest packet supported by host and embree, width used for queries
+        int m_max_packet_width;
+        int m_packet_width;
+        //rays per scheduler task
+        int m_task_size;
+        //embree build has rtcIntersectN/rtcOccludedN
+        bool m_stream_supported;
+        //trace whole queries with the stream API instead of packets
+        bool m_stream;
 
         struct EmbreeMesh
         {
             RTCScene scene = nullptr; // scene with mesh geometry
-            int instance_count = 0; //instances of the mesh
+            int instance_count = 0; //instances of the mesh attached to m_scene, 0 for cached scenes
         };
 
 
@@ -83,11 +135,13 @@ namespace RadeonRays
         {
             EmbreeSceneData()
                 : scene(nullptr)
+                , mesh(nullptr)
                 , mesh_id(kNullId)
                 , geom(RTC_INVALID_GEOMETRY_ID)
                 , updated(false)
             {}
             RTCScene scene; //instantiated scene
+            const Mesh* mesh; //mesh owning the instantiated scene
             Id mesh_id; //FireRays::Shape id
             unsigned geom; //embree geometry id
             bool updated;  //shows is data updated through last IntersectionDevice::Preprocess call
@@ -95,7 +149,10 @@ namespace RadeonRays
 
         //used for synchronization embree and FireRays::Shape ids
         std::map<const Shape*, EmbreeSceneData> m_instances; //scenes to instantiate
-        std::map<const Shape*, EmbreeMesh> m_meshes; // contains all original embree meshes. Any geometry used in m_scene is an instance.
+        std::map<const Shape*, EmbreeMesh> m_meshes; // contains all original embree meshes, shared by all instances of a mesh. Any geometry used in m_scene is an instance.
+
+        //executes queries, destroyed first to wait for the ones in flight
+        mutable CpuCommandQueue m_queue;
     };
 }
 
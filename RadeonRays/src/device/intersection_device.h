@@ -24,6 +24,7 @@ THE SOFTWARE.
 #ifndef INTERSECTION_DEVICE_H
 #define INTERSECTION_DEVICE_H
 #include "radeon_rays.h"
+#include "../except/except.h"
 
 namespace RadeonRays
 {
@@ -41,6 +42,21 @@ namespace RadeonRays
         // The call is blocking.
         virtual void Preprocess(World const& world) = 0;
 
+        // Same as Preprocess, but the call is non-blocking if event is passed in.
+        // Everything needed is read from world before the call returns. Queries keep using
+        // the previous scene until event is complete. Devices unable to preprocess
+        // in the background do it synchronously and return a completed event.
+        virtual void PreprocessAsync(World const& world, Event** event) = 0;
+
+        // Called right before the shape is detached and deleted, so the device can release data
+        // it keeps for the shape between Preprocess calls. Throwing here cancels the deletion,
+        // so checks come before any data is released.
+        virtual void OnShapeDeleted(Shape const* /*shape*/) {}
+
+        // Delete a shape which is detached already. Devices still reading the shape
+        // in the background may hold on to it until they are done.
+        virtual void ReleaseShape(Shape const* shape) { delete shape; }
+
         // Create a buffer of a specified size with specified initial data.
         // if initdata == nullptr the buffer is allocated, but not initialized.
         virtual Buffer* CreateBuffer(size_t size, void* initdata) const = 0;
@@ -88,6 +104,25 @@ namespace RadeonRays
         // The call waits until waitevent is resolved (on a target device) if waitevent != nullptr.
         // The call is non-blocking if event is passed it, otherwise (event == nullptr) it is blocking.
         virtual void QueryOcclusion(Buffer const* rays, Buffer const* numrays, int maxrays, Buffer* hits, Event const* waitevent, Event** event) const = 0;
+
+        // Same as QueryIntersection/QueryOcclusion above for rays in SoA layout.
+        // Only host devices can read the arrays in place, others do not support it.
+        virtual void QueryIntersection(RayBufferSoA const& /*rays*/, int /*numrays*/, Buffer* /*hits*/, Event const* /*waitevent*/, Event** /*event*/) const
+        {
+            Throw("SoA rays are not supported by the device.");
+        }
+
+        virtual void QueryOcclusion(RayBufferSoA const& /*rays*/, int /*numrays*/, Buffer* /*hits*/, Event const* /*waitevent*/, Event** /*event*/) const
+        {
+            Throw("SoA rays are not supported by the device.");
+        }
+
+        // Get statistics of the acceleration structure new queries use.
+        // Only devices building their own BVHs support it.
+        virtual void GetBvhStatistics(BvhStatistics& /*stats*/) const
+        {
+            Throw("BVH statistics are not supported by the device.");
+        }
     
         IntersectionDevice(IntersectionDevice const&) = delete;
         IntersectionDevice& operator = (IntersectionDevice const&) = delete;
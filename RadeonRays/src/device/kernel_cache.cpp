@@ -0,0 +1,175 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "kernel_cache.h"
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "executable.h"
+#include "except.h"
+#include "../accelerator/bvh_cache.h"
+
+namespace RadeonRays
+{
+    // Cache entry name, entries hold a single byte array
+    static char const* const kCacheEntryName = "kernel";
+
+    // Read the whole file, false if it can not be read
+    static bool ReadFile(char const* filename, std::vector<char>& contents)
+    {
+        std::ifstream in(filename, std::ios::binary);
+        if (!in)
+        {
+            return false;
+        }
+
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return !in.bad();
+    }
+
+    KernelCache::KernelCache(Calc::Device* device, std::string const& path)
+        : m_device(device)
+        // Only OpenCL devices return binaries
+        , m_path(device->GetPlatform() == Calc::Platform::kOpenCL ? path : std::string())
+    {
+    }
+
+    Calc::Executable* KernelCache::CompileExecutable(char const* source_code, std::size_t size, char const* options) const
+    {
+        auto compile = [&]()
+        {
+            return m_device->CompileExecutable(source_code, size, options);
+        };
+
+        if (m_path.empty())
+        {
+            return compile();
+        }
+
+        BvhCache::Hasher hasher;
+        hasher.Add(source_code, size);
+
+        return LoadOrCompile(GetKey(hasher.GetValue(), options), options, compile);
+    }
+
+    Calc::Executable* KernelCache::CompileExecutable(char const* filename, char const** headernames, int numheaders, char const* options) const
+    {
+        auto compile = [&]()
+        {
+            return m_device->CompileExecutable(filename, headernames, numheaders, options);
+        };
+
+        if (m_path.empty())
+        {
+            return compile();
+        }
+
+        BvhCache::Hasher hasher;
+        std::vector<char> contents;
+
+        // Let the device report missing files
+        if (!ReadFile(filename, contents))
+        {
+            return compile();
+        }
+        hasher.Add(contents.data(), contents.size());
+
+        for (int i = 0; i < numheaders; ++i)
+        {
+            if (!ReadFile(headernames[i], contents))
+            {
+                return compile();
+            }
+            hasher.Add(std::string(headernames[i]));
+            hasher.Add(contents.data(), contents.size());
+        }
+
+        return LoadOrCompile(GetKey(hasher.GetValue(), options), options, compile);
+    }
+
+    std::uint64_t KernelCache::GetKey(std::uint64_t source_hash, char const* options) const
+    {
+        Calc::DeviceSpec spec;
+        m_device->GetSpec(spec);
+
+        BvhCache::Hasher hasher;
+        hasher.Add(source_hash);
+        hasher.Add(std::string(options ? options : ""));
+        hasher.Add(std::string(spec.name ? spec.name : ""));
+        hasher.Add(std::string(spec.vendor ? spec.vendor : ""));
+        // Binaries of another driver might still load but behave differently
+        hasher.Add(std::string(spec.driver_version ? spec.driver_version : ""));
+        return hasher.GetValue();
+    }
+
+    template <typename Compile>
+    Calc::Executable* KernelCache::LoadOrCompile(std::uint64_t key, char const* options, Compile const& compile) const
+    {
+        BvhCache cache(m_path);
+
+        if (auto entry = cache.Load(kCacheEntryName, key))
+        {
+            std::size_t size = 0;
+            auto binary = entry->GetArray<std::uint8_t>(0, size);
+
+            if (binary && size > 0)
+            {
+                try
+                {
+                    auto executable = m_device->CompileExecutable(binary, size, options);
+                    if (executable)
+                    {
+                        return executable;
+                    }
+                }
+                catch (Calc::Exception&)
+                {
+                    // Binary of another driver version, compile from source and replace it
+                }
+            }
+        }
+
+        auto executable = compile();
+
+        try
+        {
+            auto size = m_device->GetExecutableBinarySize(executable);
+            if (size > 0)
+            {
+                std::vector<std::uint8_t> binary(size);
+                m_device->GetExecutableBinary(executable, binary.data());
+
+                // Failing to write the cache only costs a compilation next time
+                BvhCache::Array array = { binary.data(), sizeof(std::uint8_t), binary.size() };
+                cache.Store(kCacheEntryName, key, &array, 1);
+            }
+        }
+        catch (Calc::Exception&)
+        {
+            // The executable is fine, it just is not cached
+        }
+
+        return executable;
+    }
+}
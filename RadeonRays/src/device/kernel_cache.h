@@ -0,0 +1,59 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "calc.h"
+#include "device.h"
+
+namespace RadeonRays
+{
+    ///< Cache of compiled Calc executables ("kernel.cache_path" option).
+    ///< Binaries are keyed by a hash of the kernel source (headers included),
+    ///< build options, the device name and driver version, and stored in the BvhCache
+    ///< entry format. A binary the driver no longer accepts is compiled from source again.
+    ///< Only OpenCL devices provide binaries, other devices always compile.
+    ///<
+    class KernelCache
+    {
+    public:
+        // Empty path disables the cache
+        KernelCache(Calc::Device* device, std::string const& path);
+
+        // Same as Calc::Device::CompileExecutable overloads
+        Calc::Executable* CompileExecutable(char const* source_code, std::size_t size, char const* options) const;
+        Calc::Executable* CompileExecutable(char const* filename, char const** headernames, int numheaders, char const* options) const;
+
+    private:
+        // Load binary for key or compile and store it
+        template <typename Compile>
+        Calc::Executable* LoadOrCompile(std::uint64_t key, char const* options, Compile const& compile) const;
+        // Key of source hash, options, device and driver version
+        std::uint64_t GetKey(std::uint64_t source_hash, char const* options) const;
+
+        Calc::Device* m_device;
+        std::string m_path;
+    };
+}
@@ -1,5 +1,6 @@
 #include "intersector.h"
 #include "device.h"
+#include "../except/except.h"
 
 namespace RadeonRays
 {
@@ -28,6 +29,12 @@ namespace RadeonRays
     {
         return true;
     }
+
+    void Intersector::GetStatistics(BvhStatistics& stats) const
+    {
+        ThrowIf(!m_statistics, "BVH statistics are not supported by the intersector.");
+        stats = *m_statistics;
+    }
     
     void Intersector::QueryIntersection(std::uint32_t queue_idx, Calc::Buffer const *rays, std::uint32_t num_rays,
         Calc::Buffer *hits, Calc::Event const *wait_event, Calc::Event **event) const
@@ -135,6 +135,13 @@ namespace RadeonRays
         void QueryOcclusion(std::uint32_t queue_idx, Calc::Buffer const* rays, Calc::Buffer const* num_rays,
             std::uint32_t max_rays, Calc::Buffer* hits, Calc::Event const* wait_event, Calc::Event** event) const;
 
+        /**
+        \brief Get statistics of the acceleration structure built by the last SetWorld call
+
+        Throws if the intersector does not collect them.
+        */
+        void GetStatistics(BvhStatistics& stats) const;
+
         // Disallow intersector copies
         Intersector(Intersector const&) = delete;
         Intersector& operator = (Intersector const&) = delete;
@@ -158,6 +165,8 @@ namespace RadeonRays
         Calc::Device* m_device;
         // Buffer holding ray count
         std::unique_ptr<Calc::Buffer, std::function<void(Calc::Buffer*)>> m_counter;
+        // Filled by Process in intersectors supporting BVH statistics
+        std::unique_ptr<BvhStatistics> m_statistics;
     };
 }
 
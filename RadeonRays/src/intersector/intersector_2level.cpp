@@ -21,6 +21,7 @@ THE SOFTWARE.
 ********************************************************************/
 #include "intersector_2level.h"
 #include "../accelerator/bvh.h"
+#include "../device/kernel_cache.h"
 #include "../translator/plain_bvh_translator.h"
 #include "../world/world.h"
 #include "../primitive/mesh.h"
@@ -123,11 +124,13 @@ namespace RadeonRays
         PlainBvhTranslator translator;
     };
 
-    IntersectorTwoLevel::IntersectorTwoLevel(Calc::Device* device)
+    IntersectorTwoLevel::IntersectorTwoLevel(Calc::Device* device, std::string const& kernel_cache_path)
         : Intersector(device)
         , m_gpudata(new GpuData(device))
         , m_cpudata(new CpuData)
     {
+        KernelCache kernels(device, kernel_cache_path);
+
         std::string buildopts =
 #ifdef RR_RAY_MASK
             "-D RR_RAY_MASK ";
@@ -146,26 +149,26 @@ namespace RadeonRays
 
             int numheaders = sizeof(headers) / sizeof(char const*);
 
-            m_gpudata->executable = m_device->CompileExecutable("../RadeonRays/src/kernels/CL/intersect_bvh2level_skiplinks.cl", headers, numheaders, buildopts.c_str());
+            m_gpudata->executable = kernels.CompileExecutable("../RadeonRays/src/kernels/CL/intersect_bvh2level_skiplinks.cl", headers, numheaders, buildopts.c_str());
         }
         else
         {
             assert( device->GetPlatform() == Calc::Platform::kVulkan );
-            m_gpudata->executable = m_device->CompileExecutable( "../RadeonRays/src/kernels/GLSL/bvh2l.comp", nullptr, 0, buildopts.c_str());
+            m_gpudata->executable = kernels.CompileExecutable( "../RadeonRays/src/kernels/GLSL/bvh2l.comp", nullptr, 0, buildopts.c_str());
         }
 
 #else
 #if USE_OPENCL
         if (device->GetPlatform() == Calc::Platform::kOpenCL)
         {
-            m_gpudata->executable = m_device->CompileExecutable(g_intersect_bvh2level_skiplinks_opencl, std::strlen(g_intersect_bvh2level_skiplinks_opencl), buildopts.c_str());
+            m_gpudata->executable = kernels.CompileExecutable(g_intersect_bvh2level_skiplinks_opencl, std::strlen(g_intersect_bvh2level_skiplinks_opencl), buildopts.c_str());
         }
 #endif
 
 #if USE_VULKAN
         if (m_gpudata->executable == nullptr && device->GetPlatform() == Calc::Platform::kVulkan)
         {
-            m_gpudata->executable = m_device->CompileExecutable(g_bvh2l_vulkan, std::strlen(g_bvh2l_vulkan), buildopts.c_str());
+            m_gpudata->executable = kernels.CompileExecutable(g_bvh2l_vulkan, std::strlen(g_bvh2l_vulkan), buildopts.c_str());
         }
 #endif
 #endif
@@ -221,7 +224,7 @@ namespace RadeonRays
                     auto instance = static_cast<Instance const*>(shapeimpl);
                     auto base_shape = instance->GetBaseShape();
 
-                    if (std::find(world.shapes_.cbegin(), world.shapes_.cend(), base_shape) == world.shapes_.cend())
+                    if (!world.IsAttached(base_shape))
                     {
                         // Need to add the shape to the list
                         shapes.push_back(base_shape);
@@ -369,13 +372,11 @@ namespace RadeonRays
                 {
                     // Get the mesh
                     Mesh const* mesh = static_cast<Mesh const*>(shapes[i]);
-                    // Get vertex buffer of the current mesh
-                    float3 const* myvertexdata = mesh->GetVertexData();
 
                     // Iterate thru vertices multiply and append them to GPU buffer
                     for (int j = 0; j < mesh->num_vertices(); ++j)
                     {
-                        vertexdata[m_cpudata->mesh_vertices_start_idx[i] + j] = myvertexdata[j];
+                        vertexdata[m_cpudata->mesh_vertices_start_idx[i] + j] = mesh->GetVertex(j);
                     }
                 }
 
@@ -413,8 +414,6 @@ namespace RadeonRays
                     // Get the mesh
                     Mesh const* mesh = static_cast<Mesh const*>(shapes[i]);
 
-                    Mesh::Face const* myfaces = mesh->GetFaceData();
-
                     int startidx = m_cpudata->mesh_vertices_start_idx[i];
 
                     for (int j = 0; j < mesh->num_faces(); ++j)
@@ -423,9 +422,10 @@ namespace RadeonRays
                         int myidx = m_cpudata->mesh_faces_start_idx[i] + j;
                         int faceidx = reordering[j];
 
-                        facedata[myidx].idx[0] = myfaces[faceidx].idx[0] + startidx;
-                        facedata[myidx].idx[1] = myfaces[faceidx].idx[1] + startidx;
-                        facedata[myidx].idx[2] = myfaces[faceidx].idx[2] + startidx;
+                        Mesh::Face const face = mesh->GetFace(faceidx);
+                        facedata[myidx].idx[0] = face.idx[0] + startidx;
+                        facedata[myidx].idx[1] = face.idx[1] + startidx;
+                        facedata[myidx].idx[2] = face.idx[2] + startidx;
 
                         facedata[myidx].shape_id = mesh->GetId();
                         facedata[myidx].prim_id = faceidx;
@@ -511,7 +511,7 @@ namespace RadeonRays
                     auto instance = static_cast<Instance const*>(shapeimpl);
                     auto base_shape = instance->GetBaseShape();
 
-                    if (std::find(world.shapes_.cbegin(), world.shapes_.cend(), base_shape) == world.shapes_.cend())
+                    if (!world.IsAttached(base_shape))
                     {
                         // Need to add the shape to the list
                         shapes.push_back(base_shape);
@@ -52,6 +52,7 @@ THE SOFTWARE.
 #include "calc.h"
 #include "device.h"
 #include "intersector.h"
+#include <string>
 #include <memory>
 #include <vector>
 
@@ -67,7 +68,7 @@ namespace RadeonRays
     {
     public:
         // Constructor
-        IntersectorTwoLevel(Calc::Device* device);
+        IntersectorTwoLevel(Calc::Device* device, std::string const& kernel_cache_path);
 
     private:
         // World processing implementation
@@ -22,6 +22,8 @@ THE SOFTWARE.
 #include "intersector_hlbvh.h"
 
 #include "../accelerator/hlbvh.h"
+#include "../accelerator/bvh_statistics.h"
+#include "../device/kernel_cache.h"
 #include "../primitive/mesh.h"
 #include "../world/world.h"
 #include "../translator/plain_bvh_translator.h"
@@ -72,11 +74,14 @@ namespace RadeonRays
         }
     };
 
-    IntersectorHlbvh::IntersectorHlbvh(Calc::Device* device)
+    IntersectorHlbvh::IntersectorHlbvh(Calc::Device* device, std::string const& kernel_cache_path)
         : Intersector(device)
         , m_gpudata(new GpuData(device))
         , m_bvh(nullptr)
+        , m_kernel_cache_path(kernel_cache_path)
     {
+        KernelCache kernels(device, kernel_cache_path);
+
         std::string buildopts =
 #ifdef RR_RAY_MASK
             "-D RR_RAY_MASK ";
@@ -95,25 +100,25 @@ namespace RadeonRays
 
             int numheaders = sizeof( headers ) / sizeof( char const* );
 
-            m_gpudata->executable = m_device->CompileExecutable( "../RadeonRays/src/kernels/CL/intersect_hlbvh_stack.cl", headers, numheaders, buildopts.c_str());
+            m_gpudata->executable = kernels.CompileExecutable( "../RadeonRays/src/kernels/CL/intersect_hlbvh_stack.cl", headers, numheaders, buildopts.c_str());
         }
         else
         {
             assert( device->GetPlatform() == Calc::Platform::kVulkan );
-            m_gpudata->executable = m_device->CompileExecutable( "../RadeonRays/src/kernels/GLSL/hlbvh.comp", nullptr, 0, buildopts.c_str());
+            m_gpudata->executable = kernels.CompileExecutable( "../RadeonRays/src/kernels/GLSL/hlbvh.comp", nullptr, 0, buildopts.c_str());
         }
 #else
 #if USE_OPENCL
         if (device->GetPlatform() == Calc::Platform::kOpenCL)
         {
-            m_gpudata->executable = m_device->CompileExecutable(g_intersect_hlbvh_stack_opencl, std::strlen(g_intersect_hlbvh_stack_opencl), buildopts.c_str());
+            m_gpudata->executable = kernels.CompileExecutable(g_intersect_hlbvh_stack_opencl, std::strlen(g_intersect_hlbvh_stack_opencl), buildopts.c_str());
         }
 #endif
 
 #if USE_VULKAN
         if (m_gpudata->executable == nullptr && device->GetPlatform() == Calc::Platform::kVulkan)
         {
-            m_gpudata->executable = m_device->CompileExecutable(g_hlbvh_build_vulkan, std::strlen(g_hlbvh_vulkan), buildopts.c_str());
+            m_gpudata->executable = kernels.CompileExecutable(g_hlbvh_build_vulkan, std::strlen(g_hlbvh_vulkan), buildopts.c_str());
         }
 #endif
 
@@ -144,7 +149,7 @@ namespace RadeonRays
             std::vector<int> mesh_faces_start_idx(numshapes);
 
             //
-            m_bvh.reset(new Hlbvh(m_device));
+            m_bvh.reset(new Hlbvh(m_device, m_kernel_cache_path));
 
             // Here we now that only Meshes are present, otherwise 2level strategy would have been used
             for (int i = 0; i < numshapes; ++i)
@@ -172,7 +177,9 @@ namespace RadeonRays
                 }
             }
 
+            auto start = BvhStatisticsCollector::Clock::now();
             m_bvh->Build(&bounds[0], numfaces);
+            float build_ms = BvhStatisticsCollector::GetElapsedMs(start);
 
             // Create vertex buffer
             {
@@ -197,8 +204,6 @@ namespace RadeonRays
                 {
                     // Get the mesh
                     Mesh const* mesh = static_cast<Mesh const*>(world.shapes_[i]);
-                    // Get vertex buffer of the current mesh
-                    float3 const* myvertexdata = mesh->GetVertexData();
                     // Get mesh transform
                     mesh->GetTransform(m, minv);
 
@@ -206,7 +211,7 @@ namespace RadeonRays
                     // Iterate thru vertices multiply and append them to GPU buffer
                     for (int j = 0; j < mesh->num_vertices(); ++j)
                     {
-                        vertexdata[mesh_vertices_start_idx[i] + j] = transform_point(myvertexdata[j], m);
+                        vertexdata[mesh_vertices_start_idx[i] + j] = transform_point(mesh->GetVertex(j), m);
                     }
                 }
                 m_device->UnmapBuffer(m_gpudata->vertices, 0, vertexdata, &e); 
@@ -259,17 +264,16 @@ namespace RadeonRays
                     // Get the mesh directly or out of instance
                     Mesh const* mesh = static_cast<Mesh const*>(world.shapes_[shapeidx]);
 
-                    // Get vertex buffer of the current mesh
-                    Mesh::Face const* myfacedata = mesh->GetFaceData();
                     // Find face idx
                     int faceidx = indextolook4 - mesh_faces_start_idx[shapeidx];
                     // Find mesh start idx
                     int mystartidx = mesh_vertices_start_idx[shapeidx];
 
                     // Copy face data to GPU buffer
-                    facedata[i].idx[0] = myfacedata[faceidx].idx[0] + mystartidx;
-                    facedata[i].idx[1] = myfacedata[faceidx].idx[1] + mystartidx;
-                    facedata[i].idx[2] = myfacedata[faceidx].idx[2] + mystartidx;
+                    Mesh::Face const face = mesh->GetFace(faceidx);
+                    facedata[i].idx[0] = face.idx[0] + mystartidx;
+                    facedata[i].idx[1] = face.idx[1] + mystartidx;
+                    facedata[i].idx[2] = face.idx[2] + mystartidx;
 
                     // Optimization: we are putting faceid here
                     facedata[i].shape_id = mesh->GetId();
@@ -286,6 +290,8 @@ namespace RadeonRays
             m_gpudata->stack = m_device->CreateBuffer(kMaxBatchSize*kMaxStackSize, Calc::BufferType::kWrite);
             // Make sure everything is commited
             m_device->Finish(0);
+
+            CollectStatistics(world, build_ms);
         }
         else if (world.GetStateChange() != ShapeImpl::kStateChangeNone)
         {
@@ -326,7 +332,9 @@ namespace RadeonRays
                 }
             }
 
+            auto start = BvhStatisticsCollector::Clock::now();
             m_bvh->Build(&bounds[0], numfaces);
+            float build_ms = BvhStatisticsCollector::GetElapsedMs(start);
 
             // Create vertex buffer
             {
@@ -351,8 +359,6 @@ namespace RadeonRays
                 {
                     // Get the mesh
                     Mesh const* mesh = static_cast<Mesh const*>(world.shapes_[i]);
-                    // Get vertex buffer of the current mesh
-                    float3 const* myvertexdata = mesh->GetVertexData();
                     // Get mesh transform
                     mesh->GetTransform(m, minv);
 
@@ -360,7 +366,7 @@ namespace RadeonRays
                     // Iterate thru vertices multiply and append them to GPU buffer
                     for (int j = 0; j < mesh->num_vertices(); ++j)
                     {
-                        vertexdata[mesh_vertices_start_idx[i] + j] = transform_point(myvertexdata[j], m);
+                        vertexdata[mesh_vertices_start_idx[i] + j] = transform_point(mesh->GetVertex(j), m);
                     }
                 }
                 m_device->UnmapBuffer(m_gpudata->vertices, 0, vertexdata, &e);
@@ -368,9 +374,33 @@ namespace RadeonRays
                 e->Wait();
                 m_device->DeleteEvent(e);
             }
+
+            CollectStatistics(world, build_ms);
         }
     }
 
+    void IntersectorHlbvh::CollectStatistics(World const& world, float build_ms)
+    {
+        auto statsepo = world.options_.GetOption("bvh.statistics.epo");
+        bool collect_epo = statsepo && statsepo->AsFloat() > 0.f;
+
+        // Faces follow world shapes, like the bounds the tree has been built for
+        std::vector<float3> triangles;
+        if (collect_epo)
+        {
+            BvhStatisticsCollector::GetTriangles(world.shapes_.data(), world.shapes_.size(), triangles);
+        }
+
+        m_statistics.reset(new BvhStatistics());
+        m_bvh->GetStatistics(*m_statistics, collect_epo ? triangles.data() : nullptr);
+
+        // Nodes and their bounds are traversed in place, triangles come from faces and vertices
+        m_statistics->layout = "hlbvh";
+        m_statistics->width = 2;
+        m_statistics->layout_bytes = m_statistics->bvh_bytes + m_gpudata->vertices->GetSize() + m_gpudata->faces->GetSize();
+        m_statistics->build_ms = build_ms;
+    }
+
 
     void IntersectorHlbvh::Intersect(std::uint32_t queue_idx, Calc::Buffer const* rays, Calc::Buffer const* num_rays, std::uint32_t max_rays, Calc::Buffer* hits, Calc::Event const* wait_event, Calc::Event** event) const
     {
@@ -24,6 +24,7 @@ THE SOFTWARE.
 #include "calc.h"
 #include "device.h"
 #include "intersector.h"
+#include <string>
 #include <memory>
 /**
     \file intersector_hlbvh.h
@@ -57,7 +58,7 @@ namespace RadeonRays
     {
     public:
         // Constructor
-        IntersectorHlbvh(Calc::Device* device);
+        IntersectorHlbvh(Calc::Device* device, std::string const& kernel_cache_path);
 
     private:
         // World processing implementation
@@ -73,6 +74,9 @@ namespace RadeonRays
             std::uint32_t max_rays, Calc::Buffer *hits, 
             Calc::Event const *wait_event, Calc::Event **event) const override;
 
+        // Fill m_statistics once the scene is uploaded
+        void CollectStatistics(World const& world, float build_ms);
+
     private:
         struct GpuData;
         struct ShapeData;
@@ -81,5 +85,7 @@ namespace RadeonRays
         std::unique_ptr<GpuData> m_gpudata;
         // Bvh data structure
         std::unique_ptr<Hlbvh> m_bvh;
+        // Kernel cache directory for Hlbvh build kernels
+        std::string m_kernel_cache_path;
     };
 }
@@ -24,6 +24,9 @@ THE SOFTWARE.
 #include "calc.h"
 #include "executable.h"
 #include "../accelerator/bvh2.h"
+#include "../accelerator/bvh_cache.h"
+#include "../accelerator/bvh_statistics.h"
+#include "../device/kernel_cache.h"
 #include "../primitive/mesh.h"
 #include "../primitive/instance.h"
 #include "../translator/q_bvh_translator.h"
@@ -92,10 +95,12 @@ namespace RadeonRays
         }
     };
 
-    IntersectorLDS::IntersectorLDS(Calc::Device *device)
+    IntersectorLDS::IntersectorLDS(Calc::Device *device, std::string const& kernel_cache_path)
         : Intersector(device)
         , m_gpudata(new GpuData(device))
     {
+        KernelCache kernels(device, kernel_cache_path);
+
         std::string buildopts;
 #ifdef RR_RAY_MASK
         buildopts.append("-D RR_RAY_MASK ");
@@ -114,33 +119,33 @@ namespace RadeonRays
 
             int numheaders = sizeof(headers) / sizeof(const char *);
 
-            m_gpudata->bvh_prog.executable = m_device->CompileExecutable("../RadeonRays/src/kernels/CL/intersect_bvh2_lds.cl", headers, numheaders, buildopts.c_str());
+            m_gpudata->bvh_prog.executable = kernels.CompileExecutable("../RadeonRays/src/kernels/CL/intersect_bvh2_lds.cl", headers, numheaders, buildopts.c_str());
             if (spec.has_fp16)
-                m_gpudata->qbvh_prog.executable = m_device->CompileExecutable("../RadeonRays/src/kernels/CL/intersect_bvh2_lds_fp16.cl", headers, numheaders, buildopts.c_str());
+                m_gpudata->qbvh_prog.executable = kernels.CompileExecutable("../RadeonRays/src/kernels/CL/intersect_bvh2_lds_fp16.cl", headers, numheaders, buildopts.c_str());
         }
         else
         {
             assert(device->GetPlatform() == Calc::Platform::kVulkan);
-            m_gpudata->bvh_prog.executable = m_device->CompileExecutable("../RadeonRays/src/kernels/GLSL/bvh2.comp", nullptr, 0, buildopts.c_str());
+            m_gpudata->bvh_prog.executable = kernels.CompileExecutable("../RadeonRays/src/kernels/GLSL/bvh2.comp", nullptr, 0, buildopts.c_str());
             if (spec.has_fp16)
-                m_gpudata->qbvh_prog.executable = m_device->CompileExecutable("../RadeonRays/src/kernels/GLSL/bvh2_fp16.comp", nullptr, 0, buildopts.c_str());
+                m_gpudata->qbvh_prog.executable = kernels.CompileExecutable("../RadeonRays/src/kernels/GLSL/bvh2_fp16.comp", nullptr, 0, buildopts.c_str());
         }
 #else
 #if USE_OPENCL
         if (device->GetPlatform() == Calc::Platform::kOpenCL)
         {
-            m_gpudata->bvh_prog.executable = m_device->CompileExecutable(g_intersect_bvh2_lds_opencl, std::strlen(g_intersect_bvh2_lds_opencl), buildopts.c_str());
+            m_gpudata->bvh_prog.executable = kernels.CompileExecutable(g_intersect_bvh2_lds_opencl, std::strlen(g_intersect_bvh2_lds_opencl), buildopts.c_str());
             if (spec.has_fp16)
-                m_gpudata->qbvh_prog.executable = m_device->CompileExecutable(g_intersect_bvh2_lds_fp16_opencl, std::strlen(g_intersect_bvh2_lds_fp16_opencl), buildopts.c_str());
+                m_gpudata->qbvh_prog.executable = kernels.CompileExecutable(g_intersect_bvh2_lds_fp16_opencl, std::strlen(g_intersect_bvh2_lds_fp16_opencl), buildopts.c_str());
         }
 #endif
 #if USE_VULKAN
         if (device->GetPlatform() == Calc::Platform::kVulkan)
         {
             if (m_gpudata->bvh_prog.executable == nullptr)
-                m_gpudata->bvh_prog.executable = m_device->CompileExecutable(g_bvh2_vulkan, std::strlen(g_bvh2_vulkan), buildopts.c_str());
+                m_gpudata->bvh_prog.executable = kernels.CompileExecutable(g_bvh2_vulkan, std::strlen(g_bvh2_vulkan), buildopts.c_str());
             if (m_gpudata->qbvh_prog.executable == nullptr && spec.has_fp16)
-                m_gpudata->qbvh_prog.executable = m_device->CompileExecutable(g_bvh2_fp16_vulkan, std::strlen(g_bvh2_fp16_vulkan), buildopts.c_str());
+                m_gpudata->qbvh_prog.executable = kernels.CompileExecutable(g_bvh2_fp16_vulkan, std::strlen(g_bvh2_fp16_vulkan), buildopts.c_str());
         }
 #endif
 #endif
@@ -171,10 +176,17 @@ namespace RadeonRays
             auto builder = world.options_.GetOption("bvh.builder");
             auto nbins = world.options_.GetOption("bvh.sah.num_bins");
             auto tcost = world.options_.GetOption("bvh.sah.traversal_cost");
+            auto leafsize = world.options_.GetOption("bvh.max_leaf_size");
+            auto optimize = world.options_.GetOption("bvh.optimize");
+            auto cachepath = world.options_.GetOption("bvh.cache_path");
+            auto statsepo = world.options_.GetOption("bvh.statistics.epo");
 
             bool use_qbvh = false, use_sah = false;
             int num_bins = (nbins ? static_cast<int>(nbins->AsFloat()) : 64);
             float traversal_cost = (tcost ? tcost->AsFloat() : 10.0f);
+            int max_leaf_size = (leafsize ? static_cast<int>(leafsize->AsFloat()) : 1);
+            int optimize_passes = (optimize ? static_cast<int>(optimize->AsFloat()) : 0);
+            bool collect_epo = (statsepo && statsepo->AsFloat() > 0.f);
 
 #if 0
             if (type && type->AsString() == "qbvh")
@@ -188,73 +200,118 @@ namespace RadeonRays
                 use_sah = true;
             }
 
-            // Create the bvh
-            Bvh2 bvh(traversal_cost, num_bins, use_sah);
-            bvh.Build(world.shapes_.begin(), world.shapes_.end());
-
-            // Upload BVH data to GPU memory
-            if (!use_qbvh)
-            {
-                auto bvh_size_in_bytes = bvh.GetSizeInBytes();
-                m_gpudata->bvh = m_device->CreateBuffer(bvh_size_in_bytes, Calc::BufferType::kRead);
+            std::size_t const node_size = use_qbvh ? sizeof(QBvhTranslator::Node) : sizeof(Bvh2::Node);
 
-                // Get the pointer to mapped data
-                Calc::Event *e = nullptr;
-                Bvh2::Node *bvhdata = nullptr;
+            // Nodes to upload, either mapped from the cache or built here
+            void* nodes = nullptr;
+            std::size_t num_nodes = 0;
 
-                m_device->MapBuffer(m_gpudata->bvh, 0, 0, bvh_size_in_bytes, Calc::MapType::kMapWrite, (void **)&bvhdata, &e);
+            std::unique_ptr<BvhCache> cache;
+            std::shared_ptr<BvhCache::Entry> entry;
+            std::uint64_t key = 0;
 
-                e->Wait();
-                m_device->DeleteEvent(e);
+            // Build phase timings
+            auto start = BvhStatisticsCollector::Clock::now();
+            float build_ms = 0.f, optimize_ms = 0.f, translate_ms = 0.f;
 
-                // Copy BVH data
-                for (std::size_t i = 0; i < bvh.m_nodecount; ++i)
-                    bvhdata[i] = bvh.m_nodes[i];
+            if (cachepath && !cachepath->AsString().empty())
+            {
+                cache.reset(new BvhCache(cachepath->AsString()));
+
+                BvhCache::Hasher hasher;
+                hasher.Add(use_qbvh);
+                hasher.Add(use_sah);
+                hasher.Add(num_bins);
+                hasher.Add(traversal_cost);
+                hasher.Add(max_leaf_size);
+                hasher.Add(optimize_passes);
+                hasher.AddShapes(world.shapes_.data(), world.shapes_.size());
+                key = hasher.GetValue();
+
+                entry = cache->Load("lds", key);
+                if (entry)
+                {
+                    nodes = use_qbvh ?
+                        static_cast<void*>(entry->GetArray<QBvhTranslator::Node>(0, num_nodes)) :
+                        static_cast<void*>(entry->GetArray<Bvh2::Node>(0, num_nodes));
+                }
+            }
 
-                // Unmap gpu data
-                m_device->UnmapBuffer(m_gpudata->bvh, 0, bvhdata, &e);
+            // Create the bvh (QBVH translator expects single triangle leaves)
+            Bvh2 bvh(traversal_cost, num_bins, use_sah, use_qbvh ? 1 : max_leaf_size);
+            QBvhTranslator translator;
 
-                e->Wait();
-                m_device->DeleteEvent(e);
+            bool cached = (nodes != nullptr);
+            build_ms = BvhStatisticsCollector::GetElapsedMs(start);
 
-                // Select intersection program
-                m_gpudata->prog = &m_gpudata->bvh_prog;
+            if (cached && !use_qbvh)
+            {
+                // Cached Bvh2 nodes are the tree itself, it is only used for statistics
+                bvh.Assign(static_cast<Bvh2::Node*>(nodes), num_nodes, entry);
             }
-            else
+
+            if (!nodes)
             {
-                QBvhTranslator translator;
-                translator.Process(bvh);
+                start = BvhStatisticsCollector::Clock::now();
+                bvh.Build(world.shapes_.begin(), world.shapes_.end());
+                build_ms = BvhStatisticsCollector::GetElapsedMs(start);
 
-                // Update GPU data
-                auto bvh_size_in_bytes = translator.GetSizeInBytes();
-                m_gpudata->bvh = m_device->CreateBuffer(bvh_size_in_bytes, Calc::BufferType::kRead);
+                start = BvhStatisticsCollector::Clock::now();
+                bvh.Optimize(optimize_passes);
+                optimize_ms = BvhStatisticsCollector::GetElapsedMs(start);
+
+                if (!use_qbvh)
+                {
+                    nodes = bvh.m_nodes;
+                    num_nodes = bvh.m_nodecount;
+                }
+                else
+                {
+                    start = BvhStatisticsCollector::Clock::now();
+                    translator.Process(bvh);
+                    translate_ms = BvhStatisticsCollector::GetElapsedMs(start);
 
-                // Get the pointer to mapped data
-                Calc::Event *e = nullptr;
-                QBvhTranslator::Node *bvhdata = nullptr;
+                    nodes = translator.nodes_.data();
+                    num_nodes = translator.nodes_.size();
+                }
 
-                m_device->MapBuffer(m_gpudata->bvh, 0, 0, bvh_size_in_bytes, Calc::MapType::kMapWrite, (void **)&bvhdata, &e);
+                if (cache)
+                {
+                    BvhCache::Array array = { nodes, node_size, num_nodes };
+                    cache->Store("lds", key, &array, 1);
+                }
+            }
 
-                e->Wait();
-                m_device->DeleteEvent(e);
+            // Upload BVH data to GPU memory
+            m_gpudata->bvh = m_device->CreateBuffer(num_nodes * node_size, Calc::BufferType::kRead, nodes);
 
-                // Copy BVH data
-                std::size_t i = 0;
-                for (auto it = translator.nodes_.begin(); it != translator.nodes_.end(); ++it)
-                    bvhdata[i++] = *it;
+            // Select intersection program
+            m_gpudata->prog = use_qbvh ? &m_gpudata->qbvh_prog : &m_gpudata->bvh_prog;
 
-                // Unmap gpu data
-                m_device->UnmapBuffer(m_gpudata->bvh, 0, bvhdata, &e);
+            // Make sure everything is committed
+            m_device->Finish(0);
 
-                e->Wait();
-                m_device->DeleteEvent(e);
+            m_statistics.reset(new BvhStatistics());
 
-                // Select intersection program
-                m_gpudata->prog = &m_gpudata->qbvh_prog;
+            if (bvh.m_nodes)
+            {
+                bvh.GetStatistics(*m_statistics, collect_epo);
+            }
+            else
+            {
+                // Only translated nodes are cached
+                m_statistics->sah_cost = -1.f;
+                m_statistics->epo = -1.f;
             }
 
-            // Make sure everything is committed
-            m_device->Finish(0);
+            // Leaf nodes hold the triangles, so the nodes are all the kernel reads
+            m_statistics->layout = use_qbvh ? "qbvh" : "fatbvh";
+            m_statistics->width = use_qbvh ? 4 : 2;
+            m_statistics->layout_bytes = num_nodes * node_size;
+            m_statistics->build_ms = build_ms;
+            m_statistics->optimize_ms = optimize_ms;
+            m_statistics->translate_ms = translate_ms;
+            m_statistics->cached = cached;
         }
     }
 
@@ -24,6 +24,7 @@ THE SOFTWARE.
 #include "calc.h"
 #include "device.h"
 #include "intersector.h"
+#include <string>
 
 namespace RadeonRays
 {
@@ -31,7 +32,7 @@ namespace RadeonRays
     {
     public:
         // Constructor
-        IntersectorLDS(Calc::Device *device);
+        IntersectorLDS(Calc::Device *device, std::string const& kernel_cache_path);
 
     private:
         // World preprocessing implementation
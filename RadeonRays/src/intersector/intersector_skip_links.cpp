@@ -22,7 +22,10 @@ THE SOFTWARE.
 #include "intersector_skip_links.h"
 
 #include "../accelerator/bvh.h"
+#include "../accelerator/bvh_cache.h"
+#include "../accelerator/bvh_statistics.h"
 #include "../accelerator/split_bvh.h"
+#include "../device/kernel_cache.h"
 #include "../primitive/mesh.h"
 #include "../primitive/instance.h"
 #include "../world/world.h"
@@ -76,11 +79,60 @@ namespace RadeonRays
         }
     };
 
-    IntersectorSkipLinks::IntersectorSkipLinks(Calc::Device* device)
+    // Check a cached tree against the scene before using it: a damaged entry or
+    // one of another scene hashed to the same key must not index out of bounds
+    static bool IsValidCacheEntry(PlainBvhTranslator::Node const* nodes, std::size_t num_nodes,
+        int const* reordering, int numindices, int numfaces)
+    {
+        if (num_nodes == 0 || numindices <= 0)
+        {
+            return false;
+        }
+
+        for (int i = 0; i < numindices; ++i)
+        {
+            if (reordering[i] < 0 || reordering[i] >= numfaces)
+            {
+                return false;
+            }
+        }
+
+        // Links and leaf ranges are stored as floats, see PlainBvhTranslator
+        for (std::size_t i = 0; i < num_nodes; ++i)
+        {
+            float next = nodes[i].bounds.pmax.w;
+            if (!(next == -1.f || (next > static_cast<float>(i) && next < static_cast<float>(num_nodes))))
+            {
+                return false;
+            }
+
+            float leaf = nodes[i].bounds.pmin.w;
+            if (leaf != -1.f)
+            {
+                if (!(leaf >= 0.f && leaf < static_cast<float>(numindices) * 16.f))
+                {
+                    return false;
+                }
+
+                int start = static_cast<int>(leaf) >> 4;
+                int count = static_cast<int>(leaf) & 0xF;
+                if (start + count > numindices)
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    IntersectorSkipLinks::IntersectorSkipLinks(Calc::Device* device, std::string const& kernel_cache_path)
         : Intersector(device)
         , m_gpudata(new GpuData(device))
         , m_bvh(nullptr)
     {
+        KernelCache kernels(device, kernel_cache_path);
+
         std::string buildopts =
 #ifdef RR_RAY_MASK
             "-D RR_RAY_MASK ";
@@ -99,25 +151,25 @@ namespace RadeonRays
 
             int numheaders = sizeof( headers ) / sizeof( char const* );
 
-            m_gpudata->executable = m_device->CompileExecutable( "../RadeonRays/src/kernels/CL/intersect_bvh2_skiplinks.cl", headers, numheaders, buildopts.c_str());
+            m_gpudata->executable = kernels.CompileExecutable( "../RadeonRays/src/kernels/CL/intersect_bvh2_skiplinks.cl", headers, numheaders, buildopts.c_str());
         }
         else
         {
             assert( device->GetPlatform() == Calc::Platform::kVulkan );
-            m_gpudata->executable = m_device->CompileExecutable( "../RadeonRays/src/kernels/GLSL/bvh.comp", nullptr, 0, buildopts.c_str());
+            m_gpudata->executable = kernels.CompileExecutable( "../RadeonRays/src/kernels/GLSL/bvh.comp", nullptr, 0, buildopts.c_str());
         }
 #else
 #if USE_OPENCL
         if (device->GetPlatform() == Calc::Platform::kOpenCL)
         {
-            m_gpudata->executable = m_device->CompileExecutable(g_intersect_bvh2_skiplinks_opencl, std::strlen(g_intersect_bvh2_skiplinks_opencl), buildopts.c_str());
+            m_gpudata->executable = kernels.CompileExecutable(g_intersect_bvh2_skiplinks_opencl, std::strlen(g_intersect_bvh2_skiplinks_opencl), buildopts.c_str());
         }
 #endif
 
 #if USE_VULKAN
         if (m_gpudata->executable == nullptr && device->GetPlatform() == Calc::Platform::kVulkan)
         {
-            m_gpudata->executable = m_device->CompileExecutable(g_bvh_vulkan, std::strlen(g_bvh_vulkan), buildopts.c_str());
+            m_gpudata->executable = kernels.CompileExecutable(g_bvh_vulkan, std::strlen(g_bvh_vulkan), buildopts.c_str());
         }
 #endif
 #endif
@@ -156,6 +208,11 @@ namespace RadeonRays
             auto tcost = world.options_.GetOption("bvh.sah.traversal_cost");
             auto node_budget = world.options_.GetOption("bvh.sah.extra_node_budget");
             auto nbins = world.options_.GetOption("bvh.sah.num_bins");
+            auto leafsize = world.options_.GetOption("bvh.max_leaf_size");
+            auto optimize = world.options_.GetOption("bvh.optimize");
+            auto reinsertion = world.options_.GetOption("bvh.reinsertion.time_budget");
+            auto cachepath = world.options_.GetOption("bvh.cache_path");
+            auto statsepo = world.options_.GetOption("bvh.statistics.epo");
 
             bool use_sah = false;
             bool use_splits = false;
@@ -164,6 +221,10 @@ namespace RadeonRays
             float min_overlap = overlap ? overlap->AsFloat() : 0.05f;
             float traversal_cost = tcost ? tcost->AsFloat() : 10.f;
             float extra_node_budget = node_budget ? node_budget->AsFloat() : 0.5f;
+            int max_leaf_size = leafsize ? (int)leafsize->AsFloat() : 1;
+            int optimize_passes = optimize ? (int)optimize->AsFloat() : 0;
+            float reinsertion_budget = reinsertion ? reinsertion->AsFloat() : 0.f;
+            bool collect_epo = statsepo && statsepo->AsFloat() > 0.f;
 
             if (builder && builder->AsString() == "sah")
             {
@@ -176,8 +237,8 @@ namespace RadeonRays
             }
 
             m_bvh.reset( use_splits ?
-                new SplitBvh(traversal_cost, num_bins, max_split_depth, min_overlap, extra_node_budget) :
-                new Bvh(traversal_cost, num_bins, use_sah)
+                new SplitBvh(traversal_cost, num_bins, max_split_depth, min_overlap, extra_node_budget, max_leaf_size) :
+                new Bvh(traversal_cost, num_bins, use_sah, max_leaf_size)
             );
 
             // Partition the array into meshes and instances
@@ -217,53 +278,136 @@ namespace RadeonRays
                 numvertices += mesh->num_vertices();
             }
 
-            // We can't avoild allocating it here, since bounds aren't stored anywhere
-            std::vector<bbox> bounds(numfaces);
+            // Translated nodes and primitive order, either mapped from the cache or built below
+            PlainBvhTranslator translator;
+            PlainBvhTranslator::Node* nodes = nullptr;
+            std::size_t num_nodes = 0;
+            int const* reordering = nullptr;
+            // This number is different from the number of faces for some BVHs
+            int numindices = 0;
 
-            // We handle meshes first collecting their world space bounds
-#pragma omp parallel for
-            for (int i = 0; i < nummeshes; ++i)
-            {
-                Mesh const* mesh = static_cast<Mesh const*>(shapes[i]);
+            std::unique_ptr<BvhCache> cache;
+            std::shared_ptr<BvhCache::Entry> entry;
+            std::uint64_t key = 0;
 
-                for (int j = 0; j < mesh->num_faces(); ++j)
+            // Build phase timings
+            auto start = BvhStatisticsCollector::Clock::now();
+            float build_ms = 0.f, optimize_ms = 0.f, translate_ms = 0.f;
+
+            if (cachepath && !cachepath->AsString().empty())
+            {
+                cache.reset(new BvhCache(cachepath->AsString()));
+
+                BvhCache::Hasher hasher;
+                hasher.Add(use_sah);
+                hasher.Add(use_splits);
+                hasher.Add(max_split_depth);
+                hasher.Add(num_bins);
+                hasher.Add(min_overlap);
+                hasher.Add(traversal_cost);
+                hasher.Add(extra_node_budget);
+                hasher.Add(max_leaf_size);
+                hasher.Add(optimize_passes);
+                hasher.Add(reinsertion_budget);
+                hasher.AddShapes(shapes.data(), shapes.size());
+                key = hasher.GetValue();
+
+                entry = cache->Load("skiplinks", key);
+                if (entry)
                 {
-                    // Here we directly get world space bounds
-                    mesh->GetFaceBounds(j, false, bounds[mesh_faces_start_idx[i] + j]);
+                    std::size_t count = 0;
+                    nodes = entry->GetArray<PlainBvhTranslator::Node>(0, num_nodes);
+                    reordering = entry->GetArray<int>(1, count);
+                    numindices = static_cast<int>(count);
+
+                    // Anything wrong with the entry means a rebuild
+                    if (!reordering || !nodes || !IsValidCacheEntry(nodes, num_nodes, reordering, numindices, numfaces))
+                    {
+                        nodes = nullptr;
+                        reordering = nullptr;
+                        numindices = 0;
+                        entry.reset();
+                    }
                 }
             }
 
-            // Then we handle instances. Need to flatten them into actual geometry.
-#pragma omp parallel for
-            for (int i = nummeshes; i < nummeshes + numinstances; ++i)
+            bool cached = (nodes != nullptr);
+            build_ms = BvhStatisticsCollector::GetElapsedMs(start);
+
+            if (!nodes)
             {
-                Instance const* instance = static_cast<Instance const*>(shapes[i]);
-                Mesh const* mesh = static_cast<Mesh const*>(instance->GetBaseShape());
+                start = BvhStatisticsCollector::Clock::now();
 
-                // Instance is using its own transform for base shape geometry
-                // so we need to get object space bounds and transform them manually
-                matrix m, minv;
-                instance->GetTransform(m, minv);
+                // We can't avoild allocating it here, since bounds aren't stored anywhere
+                std::vector<bbox> bounds(numfaces);
 
-                for (int j = 0; j < mesh->num_faces(); ++j)
+                // We handle meshes first collecting their world space bounds
+#pragma omp parallel for
+                for (int i = 0; i < nummeshes; ++i)
                 {
-                    bbox tmp;
-                    mesh->GetFaceBounds(j, true, tmp);
-                    bounds[mesh_faces_start_idx[i] + j] = transform_bbox(tmp, m);
+                    Mesh const* mesh = static_cast<Mesh const*>(shapes[i]);
+
+                    for (int j = 0; j < mesh->num_faces(); ++j)
+                    {
+                        // Here we directly get world space bounds
+                        mesh->GetFaceBounds(j, false, bounds[mesh_faces_start_idx[i] + j]);
+                    }
                 }
-            }
 
-            m_bvh->Build(&bounds[0], numfaces);
+                // Then we handle instances. Need to flatten them into actual geometry.
+#pragma omp parallel for
+                for (int i = nummeshes; i < nummeshes + numinstances; ++i)
+                {
+                    Instance const* instance = static_cast<Instance const*>(shapes[i]);
+                    Mesh const* mesh = static_cast<Mesh const*>(instance->GetBaseShape());
+
+                    // Instance is using its own transform for base shape geometry
+                    // so we need to get object space bounds and transform them manually
+                    matrix m, minv;
+                    instance->GetTransform(m, minv);
+
+                    for (int j = 0; j < mesh->num_faces(); ++j)
+                    {
+                        bbox tmp;
+                        mesh->GetFaceBounds(j, true, tmp);
+                        bounds[mesh_faces_start_idx[i] + j] = transform_bbox(tmp, m);
+                    }
+                }
+
+                m_bvh->Build(&bounds[0], numfaces);
+                build_ms = BvhStatisticsCollector::GetElapsedMs(start);
+
+                start = BvhStatisticsCollector::Clock::now();
+                m_bvh->Optimize(optimize_passes);
+                m_bvh->OptimizeReinsertion(reinsertion_budget);
+                optimize_ms = BvhStatisticsCollector::GetElapsedMs(start);
 
 #ifdef RR_PROFILE
-            m_bvh->PrintStatistics(std::cout);
+                m_bvh->PrintStatistics(std::cout);
 #endif
-            PlainBvhTranslator translator;
-            translator.Process(*m_bvh);
+                start = BvhStatisticsCollector::Clock::now();
+                translator.Process(*m_bvh);
+                translate_ms = BvhStatisticsCollector::GetElapsedMs(start);
+
+                nodes = translator.nodes_.data();
+                num_nodes = translator.nodes_.size();
+                reordering = m_bvh->GetIndices();
+                numindices = m_bvh->GetNumIndices();
+
+                if (cache)
+                {
+                    BvhCache::Array arrays[2] =
+                    {
+                        { nodes, sizeof(PlainBvhTranslator::Node), num_nodes },
+                        { reordering, sizeof(int), (std::size_t)numindices }
+                    };
+                    cache->Store("skiplinks", key, arrays, 2);
+                }
+            }
 
             // Update GPU data
             // Copy translated nodes first
-            m_gpudata->bvh = m_device->CreateBuffer(translator.nodes_.size() * sizeof(PlainBvhTranslator::Node), Calc::BufferType::kRead, &translator.nodes_[0]);
+            m_gpudata->bvh = m_device->CreateBuffer(num_nodes * sizeof(PlainBvhTranslator::Node), Calc::BufferType::kRead, nodes);
 
             // Create vertex buffer
             {
@@ -287,8 +431,6 @@ namespace RadeonRays
                 {
                     // Get the mesh
                     Mesh const* mesh = static_cast<Mesh const*>(shapes[i]);
-                    // Get vertex buffer of the current mesh
-                    float3 const* myvertexdata = mesh->GetVertexData();
                     // Get mesh transform
                     mesh->GetTransform(m, minv);
 
@@ -296,7 +438,7 @@ namespace RadeonRays
                     // Iterate thru vertices multiply and append them to GPU buffer
                     for (int j = 0; j < mesh->num_vertices(); ++j)
                     {
-                        vertexdata[mesh_vertices_start_idx[i] + j] = transform_point(myvertexdata[j], m);
+                        vertexdata[mesh_vertices_start_idx[i] + j] = transform_point(mesh->GetVertex(j), m);
                     }
                 }
 
@@ -306,8 +448,6 @@ namespace RadeonRays
                     Instance const* instance = static_cast<Instance const*>(shapes[i]);
                     // Get the mesh
                     Mesh const* mesh = static_cast<Mesh const*>(instance->GetBaseShape());
-                    // Get vertex buffer of the current mesh
-                    float3 const* myvertexdata = mesh->GetVertexData();
                     // Get mesh transform
                     instance->GetTransform(m, minv);
 
@@ -315,7 +455,7 @@ namespace RadeonRays
                     // Iterate thru vertices multiply and append them to GPU buffer
                     for (int j = 0; j < mesh->num_vertices(); ++j)
                     {
-                        vertexdata[mesh_vertices_start_idx[i] + j] = transform_point(myvertexdata[j], m);
+                        vertexdata[mesh_vertices_start_idx[i] + j] = transform_point(mesh->GetVertex(j), m);
                     }
                 }
 
@@ -339,8 +479,6 @@ namespace RadeonRays
                     int prim_id;
                 };
 
-                // This number is different from the number of faces for some BVHs
-                auto numindices = m_bvh->GetNumIndices();
                 // Create face buffer
                 m_gpudata->faces = m_device->CreateBuffer(numindices * sizeof(Face), Calc::BufferType::kRead);
 
@@ -357,7 +495,6 @@ namespace RadeonRays
                 // getting absolute index in the buffer.
                 // Besides that we need to permute the faces accorningly to BVH reordering, whihc
                 // is contained within bvh.primids_
-                int const* reordering = m_bvh->GetIndices();
                 for (int i = 0; i < numindices; ++i)
                 {
                     int indextolook4 = reordering[i];
@@ -379,17 +516,16 @@ namespace RadeonRays
                         mesh = static_cast<Mesh const*>(static_cast<Instance const*>(shapes[shapeidx])->GetBaseShape());
                     }
 
-                    // Get vertex buffer of the current mesh
-                    Mesh::Face const* myfacedata = mesh->GetFaceData();
                     // Find face idx
                     int faceidx = indextolook4 - mesh_faces_start_idx[shapeidx];
                     // Find mesh start idx
                     int mystartidx = mesh_vertices_start_idx[shapeidx];
 
                     // Copy face data to GPU buffer
-                    facedata[i].idx[0] = myfacedata[faceidx].idx[0] + mystartidx;
-                    facedata[i].idx[1] = myfacedata[faceidx].idx[1] + mystartidx;
-                    facedata[i].idx[2] = myfacedata[faceidx].idx[2] + mystartidx;
+                    Mesh::Face const face = mesh->GetFace(faceidx);
+                    facedata[i].idx[0] = face.idx[0] + mystartidx;
+                    facedata[i].idx[1] = face.idx[1] + mystartidx;
+                    facedata[i].idx[2] = face.idx[2] + mystartidx;
 
                     // Optimization: we are putting faceid here
                     facedata[i].shape_id = shapes[shapeidx]->GetId();
@@ -405,6 +541,34 @@ namespace RadeonRays
 
             // Make sure everything is commited
             m_device->Finish(0);
+
+            m_statistics.reset(new BvhStatistics());
+
+            if (!cached)
+            {
+                // Triangles follow the order of the bounds the tree has been built for
+                std::vector<float3> triangles;
+                if (collect_epo)
+                {
+                    BvhStatisticsCollector::GetTriangles(shapes.data(), shapes.size(), triangles);
+                }
+
+                m_bvh->GetStatistics(*m_statistics, collect_epo ? triangles.data() : nullptr);
+            }
+            else
+            {
+                // Only translated nodes are cached
+                m_statistics->sah_cost = -1.f;
+                m_statistics->epo = -1.f;
+            }
+
+            m_statistics->layout = "bvh";
+            m_statistics->width = 2;
+            m_statistics->layout_bytes = m_gpudata->bvh->GetSize() + m_gpudata->vertices->GetSize() + m_gpudata->faces->GetSize();
+            m_statistics->build_ms = build_ms;
+            m_statistics->optimize_ms = optimize_ms;
+            m_statistics->translate_ms = translate_ms;
+            m_statistics->cached = cached;
         }
     }
 
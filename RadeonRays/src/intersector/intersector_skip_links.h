@@ -62,6 +62,7 @@ THE SOFTWARE.
 #include "calc.h"
 #include "device.h"
 #include "intersector.h"
+#include <string>
 #include <memory>
 
 namespace RadeonRays
@@ -75,7 +76,7 @@ namespace RadeonRays
     {
     public:
         // Constructor
-        IntersectorSkipLinks(Calc::Device* device);
+        IntersectorSkipLinks(Calc::Device* device, std::string const& kernel_cache_path);
 
     private:
         // Preprocess implementation
@@ -160,17 +160,26 @@ KERNEL void intersect_main(
                 }
                 else
                 {
-                    float t = fast_intersect_triangle(
-                        my_ray,
-                        node.aabb_left_min_or_v0_and_addr_left.xyz,
-                        node.aabb_left_max_or_v1_and_mesh_id.xyz,
-                        node.aabb_right_min_or_v2_and_addr_right.xyz,
-                        closest_t);
+                    // Leaf triangles occupy consecutive nodes,
+                    // the first one holds their count in addr_right
+                    const uint num_prims = GetAddrRight(node);
 
-                    if (t < closest_t)
+                    for (uint i = 0; i < num_prims; ++i)
                     {
-                        closest_t = t;
-                        closest_addr = addr;
+                        const bvh_node leaf = nodes[addr + i];
+
+                        float t = fast_intersect_triangle(
+                            my_ray,
+                            leaf.aabb_left_min_or_v0_and_addr_left.xyz,
+                            leaf.aabb_left_max_or_v1_and_mesh_id.xyz,
+                            leaf.aabb_right_min_or_v2_and_addr_right.xyz,
+                            closest_t);
+
+                        if (t < closest_t)
+                        {
+                            closest_t = t;
+                            closest_addr = addr + i;
+                        }
                     }
                 }
 
@@ -313,17 +322,26 @@ KERNEL void occluded_main(
                 }
                 else
                 {
-                    float t = fast_intersect_triangle(
-                        my_ray,
-                        node.aabb_left_min_or_v0_and_addr_left.xyz,
-                        node.aabb_left_max_or_v1_and_mesh_id.xyz,
-                        node.aabb_right_min_or_v2_and_addr_right.xyz,
-                        closest_t);
+                    // Leaf triangles occupy consecutive nodes,
+                    // the first one holds their count in addr_right
+                    const uint num_prims = GetAddrRight(node);
 
-                    if (t < closest_t)
+                    for (uint i = 0; i < num_prims; ++i)
                     {
-                        hits[index] = HIT_MARKER;
-                        return;
+                        const bvh_node leaf = nodes[addr + i];
+
+                        float t = fast_intersect_triangle(
+                            my_ray,
+                            leaf.aabb_left_min_or_v0_and_addr_left.xyz,
+                            leaf.aabb_left_max_or_v1_and_mesh_id.xyz,
+                            leaf.aabb_right_min_or_v2_and_addr_right.xyz,
+                            closest_t);
+
+                        if (t < closest_t)
+                        {
+                            hits[index] = HIT_MARKER;
+                            return;
+                        }
                     }
                 }
 
@@ -143,19 +143,25 @@ void intersect_main(
                     // Check if the node is a leaf
                     if (LEAFNODE(node))
                     {
-                        int const face_idx = STARTIDX(node);
-                        Face const face = faces[face_idx];
-                        float3 const v1 = vertices[face.idx[0]];
-                        float3 const v2 = vertices[face.idx[1]];
-                        float3 const v3 = vertices[face.idx[2]];
-
-                        // Intersect triangle
-                        float const f = fast_intersect_triangle(r, v1, v2, v3, t_max);
-                        // If hit update closest hit distance and index
-                        if (f < t_max)
+                        int const start = STARTIDX(node);
+                        int const end = start + NUMPRIMS(node);
+
+                        // Leaves reference a range of faces
+                        for (int face_idx = start; face_idx < end; ++face_idx)
                         {
-                            t_max = f;
-                            isect_idx = face_idx;
+                            Face const face = faces[face_idx];
+                            float3 const v1 = vertices[face.idx[0]];
+                            float3 const v2 = vertices[face.idx[1]];
+                            float3 const v3 = vertices[face.idx[2]];
+
+                            // Intersect triangle
+                            float const f = fast_intersect_triangle(r, v1, v2, v3, t_max);
+                            // If hit update closest hit distance and index
+                            if (f < t_max)
+                            {
+                                t_max = f;
+                                isect_idx = face_idx;
+                            }
                         }
                     }
                     else
@@ -245,19 +251,25 @@ void occluded_main(
                     // Check if the node is a leaf
                     if (LEAFNODE(node))
                     {
-                        int const face_idx = STARTIDX(node);
-                        Face const face = faces[face_idx];
-                        float3 const v1 = vertices[face.idx[0]];
-                        float3 const v2 = vertices[face.idx[1]];
-                        float3 const v3 = vertices[face.idx[2]];
-
-                        // Intersect triangle
-                        float const f = fast_intersect_triangle(r, v1, v2, v3, t_max);
-                        // If hit store the result and bail out
-                        if (f < t_max)
+                        int const start = STARTIDX(node);
+                        int const end = start + NUMPRIMS(node);
+
+                        // Leaves reference a range of faces
+                        for (int face_idx = start; face_idx < end; ++face_idx)
                         {
-                            hits[global_id] = HIT_MARKER;
-                            return;
+                            Face const face = faces[face_idx];
+                            float3 const v1 = vertices[face.idx[0]];
+                            float3 const v2 = vertices[face.idx[1]];
+                            float3 const v3 = vertices[face.idx[2]];
+
+                            // Intersect triangle
+                            float const f = fast_intersect_triangle(r, v1, v2, v3, t_max);
+                            // If hit store the result and bail out
+                            if (f < t_max)
+                            {
+                                hits[global_id] = HIT_MARKER;
+                                return;
+                            }
                         }
                     }
                     else
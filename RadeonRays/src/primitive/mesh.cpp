@@ -22,39 +22,111 @@ THE SOFTWARE.
 #include "mesh.h"
 
 #include "../except/except.h"
+#include "../async/thread_pool.h"
 
 #include <algorithm>
 #include <functional>
 
 namespace RadeonRays
 {
+    // Vertices or faces loaded by a single task
+    static int const kLoadGrainSize = 64 * 1024;
+
     Mesh::Mesh(float const* vertices, int vnum, int vstride,
         int const* vidx, int vistride,
         int const* nfaceverts,
         int nfaces)
-        : puretriangle_(true)
+        : storage_(std::make_shared<Storage>())
+        , numvertices_(vnum)
+        , numfaces_(nfaces)
+        , puretriangle_(true)
     {
-        // Handle vertices
         // Allocate space in advance
-        vertices_.resize(vnum);
+        storage_->vertices.resize(vnum);
+        storage_->faces.resize(nfaces);
+
+        Load(vertices, vstride, vidx, vistride, nfaceverts, storage_->vertices.data(), storage_->faces.data());
+    }
+
+    Mesh::Mesh(MeshDesc const& desc, std::shared_ptr<Storage> storage, std::size_t firstvertex, std::size_t firstface)
+        : storage_(std::move(storage))
+        , numvertices_(desc.vnum)
+        , numfaces_(desc.numfaces)
+        , puretriangle_(true)
+    {
+        Load(desc.vertices, desc.vstride, desc.indices, desc.istride, desc.numfacevertices,
+            storage_->vertices.data() + firstvertex, storage_->faces.data() + firstface);
+    }
+
+    std::vector<std::unique_ptr<Mesh>> Mesh::CreateMeshes(MeshDesc const* descs, int nummeshes)
+    {
+        // Small meshes are cheap to load, batch them to keep task overhead low,
+        // large ones are split further by the mesh itself
+        int const kMeshesPerTask = 64;
+
+        // A vertex and a face block for all meshes instead of two per mesh
+        std::vector<std::size_t> firstvertex(nummeshes);
+        std::vector<std::size_t> firstface(nummeshes);
+        std::size_t numvertices = 0;
+        std::size_t numfaces = 0;
+
+        for (int i = 0; i < nummeshes; ++i)
+        {
+            ThrowIf(descs[i].vnum < 0 || descs[i].numfaces < 0, "Invalid mesh size.");
+            firstvertex[i] = numvertices;
+            firstface[i] = numfaces;
+            numvertices += descs[i].vnum;
+            numfaces += descs[i].numfaces;
+        }
+
+        auto storage = std::make_shared<Storage>();
+        storage->vertices.resize(numvertices);
+        storage->faces.resize(numfaces);
+
+        std::vector<std::unique_ptr<Mesh>> meshes(nummeshes);
+        parallel_for(0, nummeshes, kMeshesPerTask, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                meshes[i].reset(new Mesh(descs[i], storage, firstvertex[i], firstface[i]));
+            }
+        });
+
+        return meshes;
+    }
+
+    void Mesh::Load(float const* vertices, int vstride,
+        int const* vidx, int vistride,
+        int const* nfaceverts,
+        float3* outvertices, Face* outfaces)
+    {
+        int const vnum = numvertices_;
+        int const nfaces = numfaces_;
+
         // Calculate vertex stride, assume dense packing if non passed
         vstride = (vstride == 0) ? (3 * sizeof(float)) : vstride;
-        // Allocate space for faces
-        faces_.resize(nfaces);
 
-        // Load vertices
-#pragma omp parallel for
-        for (int i = 0; i < vnum; ++i)
+        facedata_ = outfaces;
+        vertexdata_ = vnum > 0 ? &outvertices[0].x : nullptr;
+        vertexstride_ = sizeof(float3);
+        indexdata_ = nfaces > 0 ? outfaces[0].idx : nullptr;
+        indexstride_ = sizeof(Face);
+
+        // Load vertices, small meshes are loaded inline
+        parallel_for(0, vnum, kLoadGrainSize, [&](int begin, int end)
         {
-            float const* current = (float const*)((char*)vertices + i*vstride);
+            for (int i = begin; i < end; ++i)
+            {
+                float const* current = (float const*)((char*)vertices + i*vstride);
 
-            float3 temp;
-            temp.x = current[0];
-            temp.y = current[1];
-            temp.z = current[2];
+                float3 temp;
+                temp.x = current[0];
+                temp.y = current[1];
+                temp.z = current[2];
 
-            vertices_[i] = temp;
-        }
+                outvertices[i] = temp;
+            }
+        });
 
         // If mesh consists of triangles only apply parallel loading
         if (nfaceverts == nullptr)
@@ -63,65 +135,90 @@ namespace RadeonRays
 
             int istride = (vistride == 0) ? (3 * sizeof(int)) : vistride;
 
-#pragma omp parallel for
-            for (int i = 0; i < nfaces; ++i)
+            parallel_for(0, nfaces, kLoadGrainSize, [&](int begin, int end)
             {
-                faces_[i].i0 = *((int const*)((char const*)vidx + i * istride));
-                faces_[i].i1 = *((int const*)((char const*)vidx + i * istride + sizeof(int)));
-                faces_[i].i2 = *((int const*)((char const*)vidx + i * istride + 2 * sizeof(int)));
-                faces_[i].type_ = FaceType::TRIANGLE;
-            }
+                for (int i = begin; i < end; ++i)
+                {
+                    outfaces[i].i0 = *((int const*)((char const*)vidx + i * istride));
+                    outfaces[i].i1 = *((int const*)((char const*)vidx + i * istride + sizeof(int)));
+                    outfaces[i].i2 = *((int const*)((char const*)vidx + i * istride + 2 * sizeof(int)));
+                    outfaces[i].type_ = FaceType::TRIANGLE;
+                }
+            });
         }
-        // Otherwise execute serially
+        // Otherwise find where each face starts first, then load in parallel
         else
         {
-            char const* vidxptr = (char const*)vidx;
+            std::vector<std::size_t> offsets(nfaces);
+            std::size_t offset = 0;
 
             for (int i = 0; i < nfaces; ++i)
             {
-                // Triangle case
-                if (nfaceverts[i] == 3)
+                if (nfaceverts[i] != 3 && nfaceverts[i] != 4)
                 {
-                    faces_[i].i0 = *((int const*)(vidxptr));
-                    faces_[i].i1 = *((int const*)(vidxptr + sizeof(int)));
-                    faces_[i].i2 = *((int const*)(vidxptr + 2 * sizeof(int)));
-                    faces_[i].type_ = FaceType::TRIANGLE;
-
-                    // Goto next primitive
-                    vidxptr += (vistride == 0) ? (3 * sizeof(int)) : vistride;
+                    throw ExceptionImpl("Wrong number of vertices per face");
                 }
-                // Quad case
-                else if (nfaceverts[i] == 4)
-                {
-                    faces_[i].i0 = *((int const*)(vidxptr));
-                    faces_[i].i1 = *((int const*)(vidxptr + sizeof(int)));
-                    faces_[i].i2 = *((int const*)(vidxptr + 2 * sizeof(int)));
-                    faces_[i].i3 = *((int const*)(vidxptr + 3 * sizeof(int)));
-                    faces_[i].type_ = FaceType::QUAD;
 
-                    puretriangle_ = false;
+                puretriangle_ = puretriangle_ && nfaceverts[i] == 3;
 
-                    // Goto next primitive
-                    vidxptr += (vistride == 0) ? (4 * sizeof(int)) : vistride;
-                }
-                else
+                offsets[i] = offset;
+                offset += (vistride == 0) ? (nfaceverts[i] * sizeof(int)) : vistride;
+            }
+
+            parallel_for(0, nfaces, kLoadGrainSize, [&](int begin, int end)
+            {
+                for (int i = begin; i < end; ++i)
                 {
-                    throw ExceptionImpl("Wrong number of vertices per face");
+                    int const* idx = (int const*)((char const*)vidx + offsets[i]);
+
+                    outfaces[i].i0 = idx[0];
+                    outfaces[i].i1 = idx[1];
+                    outfaces[i].i2 = idx[2];
+
+                    // Quad case
+                    if (nfaceverts[i] == 4)
+                    {
+                        outfaces[i].i3 = idx[3];
+                        outfaces[i].type_ = FaceType::QUAD;
+                    }
+                    // Triangle case
+                    else
+                    {
+                        outfaces[i].type_ = FaceType::TRIANGLE;
+                    }
                 }
-            }
+            });
         }
     }
 
+    Mesh::Mesh(float const* vertices, int vnum, int vstride,
+        int const* vidx, int vistride,
+        int nfaces)
+        : facedata_(nullptr)
+        , vertexdata_(vertices)
+        , vertexstride_((vstride == 0) ? (3 * sizeof(float)) : vstride)
+        , indexdata_(vidx)
+        , indexstride_((vistride == 0) ? (3 * sizeof(int)) : vistride)
+        , numvertices_(vnum)
+        , numfaces_(nfaces)
+        , puretriangle_(true)
+    {
+        ThrowIf(vnum < 0 || nfaces < 0, "Invalid mesh size.");
+        ThrowIf((vnum > 0 && !vertices) || (nfaces > 0 && !vidx), "Invalid mesh data.");
+        ThrowIf(vertexstride_ < (int)(3 * sizeof(float)) || indexstride_ < (int)(3 * sizeof(int)), "Invalid mesh stride.");
+    }
+
     int Mesh::GetTransformedFace(int const faceidx, matrix const & transform, float3* outverts) const
     {
         // origin code special cased identity matrix. TODO check speed regressions
-        outverts[0] = transform_point(vertices_[faces_[faceidx].i0], transform);
-        outverts[1] = transform_point(vertices_[faces_[faceidx].i1], transform);
-        outverts[2] = transform_point(vertices_[faces_[faceidx].i2], transform);
+        Face const face = GetFace(faceidx);
+        outverts[0] = transform_point(GetVertex(face.i0), transform);
+        outverts[1] = transform_point(GetVertex(face.i1), transform);
+        outverts[2] = transform_point(GetVertex(face.i2), transform);
 
-        if (faces_[faceidx].type_ == FaceType::QUAD)
+        if (face.type_ == FaceType::QUAD)
         {
-            outverts[3] = transform_point(vertices_[faces_[faceidx].i3], transform);
+            outverts[3] = transform_point(GetVertex(face.i3), transform);
             return 4;
         } else
         {
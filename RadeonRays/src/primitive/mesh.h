@@ -63,11 +63,29 @@ namespace RadeonRays
             FaceType type_;
         };
 
+        ///< Vertex and face blocks owned by meshes, meshes created
+        ///< together share one, it goes away with the last of them
+        struct Storage
+        {
+            std::vector<float3> vertices;
+            std::vector<Face> faces;
+        };
+
         //
         Mesh(float const* vertices, int vnum, int vstride,
             int const* vidx, int vistride,
             int const* nfaceverts,
             int nfaces);
+
+        // Load meshes into a single Storage sized for all of them, in order of descs
+        static std::vector<std::unique_ptr<Mesh>> CreateMeshes(MeshDesc const* descs, int nummeshes);
+
+        // Triangle mesh referencing caller owned vertex and index data in place.
+        // The data is neither copied nor converted, so it has to stay valid
+        // and unchanged until the mesh is deleted.
+        Mesh(float const* vertices, int vnum, int vstride,
+            int const* vidx, int vistride,
+            int nfaces);
         
         //
         ~Mesh();
@@ -77,25 +95,50 @@ namespace RadeonRays
         int num_vertices() const;
         // 
         void GetFaceBounds(int faceidx, bool objectspace, bbox& bounds) const;
-        //
-        float3 const* GetVertexData() const { return &vertices_[0]; }
-        //
-        Face const* GetFaceData() const { return &faces_[0]; }
+        // Object space vertex position
+        float3 GetVertex(int i) const;
+        // Face indices and type
+        Face GetFace(int i) const;
         // True if the mesh consists of triangles only
         bool puretriangle() const { return puretriangle_;  }
+        // True if the mesh references caller memory, see constructor
+        bool external() const { return !facedata_ && numfaces_ > 0; }
+        // Raw vertex positions and triangle indices, strided by
+        // vertex_stride()/index_stride() bytes, only valid for external meshes
+        float const* GetRawVertexData() const { return vertexdata_; }
+        int vertex_stride() const { return vertexstride_; }
+        int const* GetRawIndexData() const { return indexdata_; }
+        int index_stride() const { return indexstride_; }
 
     private:
         /// Disallow to copy meshes, too heavy
         Mesh(Mesh const& o);
         Mesh& operator = (Mesh const& o);
 
+        // Mesh loaded into storage starting at the given vertex and face
+        Mesh(MeshDesc const& desc, std::shared_ptr<Storage> storage, std::size_t firstvertex, std::size_t firstface);
+
+        // Copy and convert vertices and faces into storage_ slices starting at vertices and faces
+        void Load(float const* vertices, int vstride,
+            int const* vidx, int vistride,
+            int const* nfaceverts,
+            float3* outvertices, Face* outfaces);
+
         // transforms face vertices, outverts but be at least 4 float3 in size, no of vertices in face returned
         int GetTransformedFace(int const faceidx, matrix const & transform, float3* outverts) const;
 
-        /// Vertices
-        std::vector<float3> vertices_;
-        /// Primitives
-        std::vector<Face> faces_;
+        /// Vertices and primitives, nullptr for external meshes
+        std::shared_ptr<Storage> storage_;
+        /// Faces of the mesh in storage_, nullptr for external meshes
+        Face const* facedata_;
+        /// Vertex and index data used for access, either
+        /// pointing to storage_ or caller memory
+        float const* vertexdata_;
+        int vertexstride_;
+        int const* indexdata_;
+        int indexstride_;
+        int numvertices_;
+        int numfaces_;
         /// Pure triangle flag
         bool puretriangle_;
     };
@@ -103,13 +146,36 @@ namespace RadeonRays
     //
     inline int Mesh::num_faces() const
     {
-        return (int)faces_.size();
+        return numfaces_;
     }
 
     //
     inline int Mesh::num_vertices() const
     {
-        return (int)vertices_.size();
+        return numvertices_;
+    }
+
+    inline float3 Mesh::GetVertex(int i) const
+    {
+        float const* v = (float const*)((char const*)vertexdata_ + (std::size_t)i * vertexstride_);
+        return float3(v[0], v[1], v[2]);
+    }
+
+    inline Mesh::Face Mesh::GetFace(int i) const
+    {
+        if (facedata_)
+        {
+            return facedata_[i];
+        }
+
+        int const* idx = (int const*)((char const*)indexdata_ + (std::size_t)i * indexstride_);
+        Face face;
+        face.i0 = idx[0];
+        face.i1 = idx[1];
+        face.i2 = idx[2];
+        face.i3 = 0;
+        face.type_ = FaceType::TRIANGLE;
+        return face;
     }
 }
 
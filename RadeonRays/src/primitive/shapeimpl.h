@@ -22,6 +22,8 @@ THE SOFTWARE.
 #ifndef SHAPEIMPL_H
 #define SHAPEIMPL_H
 
+#include <vector>
+
 #include "radeon_rays.h"
 #include "math/float3.h"
 #include "math/matrix.h"
@@ -41,7 +43,7 @@ namespace RadeonRays
             kStateChangeTransform = 0x1,
             kStateChangeMotion = 0x2,
             kStateChangeId = 0x4,
-            kStateChangeMask = 0x5
+            kStateChangeMask = 0x8
         };
         
         // Constructor
@@ -88,8 +90,22 @@ namespace RadeonRays
 
         // Clear state change
         void OnCommit() const;
+
+        // Called by the World the shape is attached to. While attached the shape
+        // adds itself to dirtylist when its state changes for the first time
+        // since the last commit.
+        void OnAttach(std::vector<Shape const*>* dirtylist) const;
+
+        // Called by the World the shape is detached from,
+        // removes the shape from dirtylist in O(1)
+        void OnDetach() const;
         
     protected:
+        // Record state changes, see OnAttach
+        void AddStateChange(int flags);
+        // Append to the dirty list remembering the slot
+        void AddToDirtyList() const;
+
         // World transform
         matrix worldmat_;
         matrix worldmatinv_;
@@ -100,9 +116,16 @@ namespace RadeonRays
         Id id_;
         // State change
         mutable int statechange_;
+        // Dirty list of the world the shape is attached to
+        mutable std::vector<Shape const*>* dirtylist_;
+        // Position in dirtylist_ while the shape is in it
+        mutable std::size_t dirtyindex_;
     };
 
     inline ShapeImpl::ShapeImpl()
+        : statechange_(kStateChangeNone)
+        , dirtylist_(nullptr)
+        , dirtyindex_(0)
     {
         SetMask(0xFFFFFFFF);
     }
@@ -115,7 +138,7 @@ namespace RadeonRays
     {
         worldmat_ = m;
         worldmatinv_ = minv;
-        statechange_ |= kStateChangeTransform;
+        AddStateChange(kStateChangeTransform);
     }
     
     inline void ShapeImpl::GetTransform(matrix& m, matrix& minv) const
@@ -127,7 +150,7 @@ namespace RadeonRays
     inline void ShapeImpl::SetLinearVelocity(float3 const& v)
     {
         linearmotion_ = v;
-        statechange_ |= kStateChangeMotion;
+        AddStateChange(kStateChangeMotion);
     }
     
     inline float3 ShapeImpl::GetLinearVelocity() const
@@ -138,7 +161,7 @@ namespace RadeonRays
     inline void ShapeImpl::SetAngularVelocity(quaternion const& q)
     {
         angulrmotion_ = q;
-        statechange_ |= kStateChangeMotion;
+        AddStateChange(kStateChangeMotion);
     }
     
     inline quaternion ShapeImpl::GetAngularVelocity() const
@@ -149,7 +172,7 @@ namespace RadeonRays
     inline void ShapeImpl::SetId(Id id)
     {
         id_ = id;
-        statechange_ |= kStateChangeId;
+        AddStateChange(kStateChangeId);
     }
     
     inline Id ShapeImpl::GetId() const
@@ -167,6 +190,46 @@ namespace RadeonRays
         statechange_ = kStateChangeNone;
     }
 
+    inline void ShapeImpl::OnAttach(std::vector<Shape const*>* dirtylist) const
+    {
+        dirtylist_ = dirtylist;
+
+        if (statechange_ != kStateChangeNone)
+        {
+            AddToDirtyList();
+        }
+    }
+
+    inline void ShapeImpl::OnDetach() const
+    {
+        // Changed shapes are in the list, move the last one into the freed slot
+        if (statechange_ != kStateChangeNone && dirtylist_)
+        {
+            auto last = static_cast<ShapeImpl const*>(dirtylist_->back());
+            (*dirtylist_)[dirtyindex_] = last;
+            last->dirtyindex_ = dirtyindex_;
+            dirtylist_->pop_back();
+        }
+
+        dirtylist_ = nullptr;
+    }
+
+    inline void ShapeImpl::AddStateChange(int flags)
+    {
+        if (statechange_ == kStateChangeNone && dirtylist_)
+        {
+            AddToDirtyList();
+        }
+
+        statechange_ |= flags;
+    }
+
+    inline void ShapeImpl::AddToDirtyList() const
+    {
+        dirtyindex_ = dirtylist_->size();
+        dirtylist_->push_back(this);
+    }
+
     inline bool ShapeImpl::is_instance() const
     {
         return false;
@@ -175,7 +238,7 @@ namespace RadeonRays
     inline void ShapeImpl::SetMask(int mask)
     {
         mask_ = mask;
-        statechange_ |= kStateChangeMask;
+        AddStateChange(kStateChangeMask);
     }
 
     inline int  ShapeImpl::GetMask() const
@@ -0,0 +1,185 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "wide_bvh_translator.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace RadeonRays
+{
+    template <int W>
+    void WideBvhTranslator<W>::Process(Bvh const& bvh)
+    {
+        nodes_.clear();
+
+        if (!bvh.m_root)
+        {
+            return;
+        }
+
+        std::vector<Bvh::Node*> nodes;
+        std::vector<TreeletOptimizer::Node> flat;
+        bvh.Flatten(nodes, flat);
+
+        std::vector<std::uint32_t> leaves(flat.size(), kInvalidId);
+        for (std::size_t i = 0; i < flat.size(); ++i)
+        {
+            if (flat[i].left == -1)
+            {
+                leaves[i] = static_cast<std::uint32_t>(nodes[i]->startidx);
+            }
+        }
+
+        Collapse(flat, leaves);
+    }
+
+    template <int W>
+    void WideBvhTranslator<W>::Process(Bvh2 const& bvh)
+    {
+        nodes_.clear();
+
+        if (!bvh.m_nodes)
+        {
+            return;
+        }
+
+        std::vector<std::uint32_t> addrs;
+        std::vector<TreeletOptimizer::Node> flat;
+        bvh.Flatten(addrs, flat);
+
+        std::vector<std::uint32_t> leaves(flat.size(), kInvalidId);
+        for (std::size_t i = 0; i < flat.size(); ++i)
+        {
+            if (flat[i].left == -1)
+            {
+                leaves[i] = addrs[i];
+            }
+        }
+
+        Collapse(flat, leaves);
+    }
+
+    template <int W>
+    void WideBvhTranslator<W>::Collapse(std::vector<TreeletOptimizer::Node> const& flat, std::vector<std::uint32_t> const& leaves)
+    {
+        auto constexpr inf = std::numeric_limits<float>::infinity();
+
+        // Wide node count is about (number of binary internal nodes) / (W - 1)
+        nodes_.reserve(flat.size() / (2 * (W - 1)) + 1);
+        nodes_.emplace_back();
+
+        // Pairs of binary node and wide node it is collapsed into
+        std::vector<std::pair<int, std::uint32_t>> stack;
+        stack.push_back(std::make_pair(0, 0u));
+
+        while (!stack.empty())
+        {
+            auto idx = stack.back().first;
+            auto wide_idx = stack.back().second;
+            stack.pop_back();
+
+            // Single leaf tree still gets an internal root
+            int children[W] = { idx };
+            int num_children = 1;
+
+            if (flat[idx].left != -1)
+            {
+                children[0] = flat[idx].left;
+                children[1] = flat[idx].right;
+                num_children = 2;
+            }
+
+            // Open the child with the largest area until the node is full,
+            // its children take its slot and the next one to keep the order
+            while (num_children < W)
+            {
+                int best = -1;
+                float best_area = -1.f;
+
+                for (int i = 0; i < num_children; ++i)
+                {
+                    auto const& child = flat[children[i]];
+                    if (child.left != -1 && child.bounds.surface_area() > best_area)
+                    {
+                        best_area = child.bounds.surface_area();
+                        best = i;
+                    }
+                }
+
+                if (best == -1)
+                {
+                    break;
+                }
+
+                int opened = children[best];
+                std::copy_backward(children + best + 1, children + num_children, children + num_children + 1);
+                children[best] = flat[opened].left;
+                children[best + 1] = flat[opened].right;
+                ++num_children;
+            }
+
+            Node node;
+            for (int i = 0; i < W; ++i)
+            {
+                if (i < num_children)
+                {
+                    auto const& child = flat[children[i]];
+
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        node.bounds[axis][0][i] = child.bounds.pmin[axis];
+                        node.bounds[axis][1][i] = child.bounds.pmax[axis];
+                    }
+
+                    if (child.left == -1)
+                    {
+                        node.child[i] = leaves[children[i]];
+                        node.num_prims[i] = static_cast<std::uint32_t>(child.numprims);
+                    }
+                    else
+                    {
+                        node.child[i] = static_cast<std::uint32_t>(nodes_.size());
+                        node.num_prims[i] = 0;
+                        nodes_.emplace_back();
+                        stack.push_back(std::make_pair(children[i], node.child[i]));
+                    }
+                }
+                else
+                {
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        node.bounds[axis][0][i] = inf;
+                        node.bounds[axis][1][i] = -inf;
+                    }
+
+                    node.child[i] = kInvalidId;
+                    node.num_prims[i] = 0;
+                }
+            }
+
+            nodes_[wide_idx] = node;
+        }
+    }
+
+    template class WideBvhTranslator<4>;
+    template class WideBvhTranslator<8>;
+}
@@ -0,0 +1,85 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "../accelerator/bvh.h"
+#include "../accelerator/bvh2.h"
+#include "../util/alignedalloc.h"
+
+namespace RadeonRays
+{
+    ///< Collapses a binary BVH into W-wide nodes for CPU traversal.
+    ///< Child bounds are stored SoA so SSE (W = 4) or AVX (W = 8) code
+    ///< tests all children of a node at once. Each node opens the child with
+    ///< the largest surface area (largest SAH contribution) until W children
+    ///< are collected, so the tree depth is roughly halved (W = 4) or thirded (W = 8).
+    ///<
+    template <int W>
+    class WideBvhTranslator
+    {
+    public:
+        static_assert(W == 4 || W == 8, "Only 4 and 8 wide nodes are supported");
+
+        static constexpr std::uint32_t kInvalidId = 0xffffffffu;
+        static constexpr int kWidth = W;
+
+        struct Node
+        {
+            // Child bounds: [axis][0 - min, 1 - max][child],
+            // empty slots have inverted infinite bounds and never hit
+            alignas(32) float bounds[3][2][W];
+            // Child node index for internal children,
+            // leaf data (see Process) for leaf children,
+            // kInvalidId for empty slots
+            std::uint32_t child[W];
+            // Number of primitives for leaf children, 0 otherwise
+            std::uint32_t num_prims[W];
+        };
+
+        WideBvhTranslator()
+        {
+        }
+
+        // Leaf data is the first index into bvh.GetIndices()
+        void Process(Bvh const& bvh);
+        // Leaf data is the address of the first leaf node in bvh.m_nodes
+        void Process(Bvh2 const& bvh);
+
+        inline std::size_t GetSizeInBytes() const
+        {
+            return nodes_.size() * sizeof(Node);
+        }
+
+        // Nodes, root goes first
+        std::vector<Node, aligned_allocator<Node, 32>> nodes_;
+
+    private:
+        // Collapse flat binary tree rooted at flat[0], leaves[i] is leaf data of flat node i
+        void Collapse(std::vector<TreeletOptimizer::Node> const& flat, std::vector<std::uint32_t> const& leaves);
+    };
+
+    using Bvh4Translator = WideBvhTranslator<4>;
+    using Bvh8Translator = WideBvhTranslator<8>;
+}
@@ -23,30 +23,49 @@ THE SOFTWARE.
 
 #include "../primitive/shapeimpl.h"
 
+
 namespace RadeonRays
 {
     void World::AttachShape(Shape const* shape)
     {
-        if (std::find(shapes_.cbegin(), shapes_.cend(), shape) == shapes_.cend())
+        if (shape_index_.emplace(shape, shapes_.size()).second)
         {
             shapes_.push_back(shape);
             has_changed_ = true;
+
+            auto shapeimpl = static_cast<ShapeImpl const*>(shape);
+            shapeimpl->OnAttach(&shapes_dirty_);
         }
     }
 
     void World::DetachShape(Shape const* shape)
     {
-        auto iter = std::find(shapes_.begin(), shapes_.end(), shape);
-        if (iter != shapes_.end())
+        auto iter = shape_index_.find(shape);
+        if (iter != shape_index_.end())
         {
-            shapes_.erase(iter);
+            // Move the last shape into the freed slot
+            std::size_t idx = iter->second;
+            shapes_[idx] = shapes_.back();
+            shape_index_[shapes_[idx]] = idx;
+            shapes_.pop_back();
+            shape_index_.erase(shape);
             has_changed_ = true;
+
+            // Leaves shapes_dirty_ as well
+            static_cast<ShapeImpl const*>(shape)->OnDetach();
         }
     }
     
     void World::DetachAll()
     {
+        for (auto shape : shapes_)
+        {
+            static_cast<ShapeImpl const*>(shape)->OnDetach();
+        }
+
         shapes_.clear();
+        shapes_dirty_.clear();
+        shape_index_.clear();
         has_changed_ = true;
     }
 
@@ -54,7 +73,7 @@ namespace RadeonRays
     {
         int statechange_ = ShapeImpl::kStateChangeNone;
 
-        for (auto iter = shapes_.cbegin(); iter != shapes_.cend(); ++iter)
+        for (auto iter = shapes_dirty_.cbegin(); iter != shapes_dirty_.cend(); ++iter)
         {
             ShapeImpl const* shapeimpl = static_cast<ShapeImpl const*>(*iter);
 
@@ -66,13 +85,15 @@ namespace RadeonRays
 
     void World::OnCommit()
     {
-        for (auto iter = shapes_.cbegin(); iter != shapes_.cend(); ++iter)
+        // Only shapes in the dirty list have state to clear
+        for (auto iter = shapes_dirty_.cbegin(); iter != shapes_dirty_.cend(); ++iter)
         {
             auto shapeimpl = static_cast<ShapeImpl const*>(*iter);
 
             shapeimpl->OnCommit();
         }
 
+        shapes_dirty_.clear();
         has_changed_ = false;
     }
-}
\ No newline at end of file
+}
@@ -24,6 +24,7 @@ THE SOFTWARE.
 
 #include <memory>
 #include <vector>
+#include <unordered_map>
 
 #include "radeon_rays.h"
 #include "../util/options.h"
@@ -42,27 +43,31 @@ namespace RadeonRays
         World();
         //
         virtual ~World();
-        // Attach the shape updating all the flags
+        // Attach the shape updating all the flags, O(1)
         void AttachShape(Shape const* shape);
-        // Detach the shape 
+        // Detach the shape, O(1), the order of shapes_ and shapes_dirty_ is not preserved
         void DetachShape(Shape const* shape);
+        // Check if the shape is attached, O(1)
+        bool IsAttached(Shape const* shape) const;
         // Detach all
         void DetachAll();
         // Call this as scene has been commited
         void OnCommit();
-        // 
+        // True if shapes have been attached or detached since the last commit
         bool has_changed() const;
-        //
+        // Combined state changes of the shapes in shapes_dirty_
         int GetStateChange() const;
 
 
     public:
         // Shapes in the scene
         std::vector<Shape const*> shapes_;
-        // Flags to indicate shapes have been changed
-        std::vector<int> shapes_dirty_;
+        // Attached shapes with state changes since the last commit,
+        // shapes add themselves here on their first change
+        std::vector<Shape const*> shapes_dirty_;
+        // Position of every attached shape in shapes_
+        std::unordered_map<Shape const*, std::size_t> shape_index_;
 
-        // TODO: Do more preciese dirty flags tracking
         bool has_changed_;
         // Global flags
         int hint_;
@@ -83,6 +88,11 @@ namespace RadeonRays
     {
         return has_changed_;
     }
+
+    inline bool World::IsAttached(Shape const* shape) const
+    {
+        return shape_index_.find(shape) != shape_index_.end();
+    }
 }
 
 
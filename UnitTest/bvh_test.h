@@ -0,0 +1,86 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+/// This test suite is testing BVH builders directly
+///
+
+#include "gtest/gtest.h"
+#include "radeon_rays.h"
+#include "accelerator/bvh.h"
+
+#include <random>
+#include <vector>
+
+using namespace RadeonRays;
+
+// Random box soup, large enough for forked subtrees and parallel binning
+class BvhBuild : public ::testing::Test
+{
+public:
+    virtual void SetUp()
+    {
+        std::mt19937 rng(17);
+        std::uniform_real_distribution<float> position(-100.f, 100.f);
+        std::uniform_real_distribution<float> size(0.01f, 2.f);
+
+        bounds_.resize(kNumPrims);
+        for (auto& b : bounds_)
+        {
+            float3 p(position(rng), position(rng), position(rng));
+            float3 e(size(rng), size(rng), size(rng));
+            b = bbox(p, p + e);
+        }
+    }
+
+    static int const kNumPrims = 150000;
+
+    std::vector<bbox> bounds_;
+};
+
+TEST_F(BvhBuild, Sah_ParallelMatchesSerial)
+{
+    Bvh serial(10.f, 64, true, 4);
+    serial.SetParallelBuild(false);
+    serial.Build(bounds_.data(), kNumPrims);
+
+    BvhStatistics expected;
+    serial.GetStatistics(expected, nullptr);
+    std::vector<int> indices(serial.GetIndices(), serial.GetIndices() + serial.GetNumIndices());
+
+    // Subtree builds are stolen and run by waiting threads in a different order each time
+    for (int i = 0; i < 2; ++i)
+    {
+        Bvh parallel(10.f, 64, true, 4);
+        parallel.Build(bounds_.data(), kNumPrims);
+
+        BvhStatistics stats;
+        parallel.GetStatistics(stats, nullptr);
+
+        ASSERT_EQ(stats.num_nodes, expected.num_nodes);
+        ASSERT_EQ(stats.max_depth, expected.max_depth);
+        ASSERT_EQ(stats.sah_cost, expected.sah_cost);
+        ASSERT_EQ(parallel.GetHeight(), serial.GetHeight());
+        ASSERT_EQ(parallel.GetNumIndices(), indices.size());
+        ASSERT_TRUE(std::equal(indices.begin(), indices.end(), parallel.GetIndices()));
+    }
+}
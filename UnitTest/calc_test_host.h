@@ -0,0 +1,245 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include <memory>
+#include <functional>
+
+#include "gtest/gtest.h"
+#include "calc.h"
+#include "device.h"
+#include "device_host.h"
+#include "buffer.h"
+#include "except.h"
+#include "event.h"
+#include "executable.h"
+#include "primitives.h"
+
+// Calc fixture for the host device
+class CalcTestkHost : public ::testing::Test
+{
+public:
+    virtual void SetUp()
+    {
+        m_calc = CreateCalc(Calc::Platform::kHost, 0);
+        ASSERT_TRUE(m_calc != nullptr);
+        ASSERT_EQ(m_calc->GetDeviceCount(), 1U);
+        m_device = m_calc->CreateDevice(0);
+    }
+
+    virtual void TearDown()
+    {
+        m_calc->DeleteDevice(m_device);
+        DeleteCalc(m_calc);
+    }
+
+    // c[i] = a[i] + b
+    static void Add(Calc::HostArgs const& args, std::size_t begin, std::size_t end)
+    {
+        auto a = args.GetBuffer<int const>(0);
+        auto b = args.GetValue<int>(1);
+        auto c = args.GetBuffer<int>(2);
+
+        for (auto i = begin; i < end; ++i)
+        {
+            c[i] = a[i] + b;
+        }
+    }
+
+    Calc::Calc* m_calc;
+    Calc::Device* m_device;
+};
+
+TEST_F(CalcTestkHost, CreateBufferZeroSize)
+{
+    ASSERT_THROW(m_device->CreateBuffer(0, Calc::BufferType::kWrite), Calc::Exception);
+}
+
+TEST_F(CalcTestkHost, ReadWriteMapBuffer)
+{
+    const auto kBufferSize = 1000;
+    std::vector<int> numbers(kBufferSize);
+    std::generate(numbers.begin(), numbers.end(), std::rand);
+
+    Calc::Buffer* buffer = nullptr;
+    ASSERT_NO_THROW(buffer = m_device->CreateBuffer(kBufferSize * sizeof(int), Calc::BufferType::kWrite));
+
+    Calc::Event* e = nullptr;
+    ASSERT_NO_THROW(m_device->WriteTypedBuffer(buffer, 0, 0, kBufferSize, &numbers[0], &e));
+    ASSERT_TRUE(e->IsComplete());
+    m_device->DeleteEvent(e);
+
+    int* mapdata = nullptr;
+    ASSERT_NO_THROW(m_device->MapTypedBuffer(buffer, 0, 0, kBufferSize, Calc::kMapWrite, &mapdata, nullptr));
+    for (auto& n : numbers)
+    {
+        n += 1;
+    }
+    std::copy(numbers.begin(), numbers.end(), mapdata);
+    ASSERT_NO_THROW(m_device->UnmapBuffer(buffer, 0, mapdata, nullptr));
+
+    std::vector<int> numbers_calc(kBufferSize);
+    ASSERT_NO_THROW(m_device->ReadTypedBuffer(buffer, 0, 0, kBufferSize, &numbers_calc[0], nullptr));
+    ASSERT_EQ(numbers, numbers_calc);
+
+    // Out of bounds access
+    ASSERT_THROW(m_device->ReadTypedBuffer(buffer, 0, 1, kBufferSize, &numbers_calc[0], nullptr), Calc::Exception);
+
+    ASSERT_NO_THROW(m_device->DeleteBuffer(buffer));
+}
+
+TEST_F(CalcTestkHost, Execute)
+{
+    Calc::HostFunctionEntry const functions[] = { { "add", Add } };
+
+    Calc::Executable* executable = nullptr;
+    ASSERT_THROW(m_device->CompileExecutable("", 0, nullptr), Calc::Exception);
+    ASSERT_NO_THROW(executable = static_cast<Calc::DeviceHost*>(m_device)->CreateExecutable(functions, 1));
+    ASSERT_THROW(executable->CreateFunction("sub"), Calc::Exception);
+
+    Calc::Function* func = nullptr;
+    ASSERT_NO_THROW(func = executable->CreateFunction("add"));
+
+    const auto kBufferSize = 100000;
+    std::vector<int> a(kBufferSize);
+    std::iota(a.begin(), a.end(), 0);
+    int b = 5;
+
+    auto a_buffer = m_device->CreateBuffer(kBufferSize * sizeof(int), Calc::BufferType::kRead, &a[0]);
+    auto c_buffer = m_device->CreateBuffer(kBufferSize * sizeof(int), Calc::BufferType::kWrite);
+
+    func->SetArg(0, a_buffer);
+    func->SetArg(2, c_buffer);
+
+    // Argument 1 has not been set
+    ASSERT_THROW(m_device->Execute(func, 0, kBufferSize, 64, nullptr), Calc::Exception);
+
+    func->SetArg(1, sizeof(b), &b);
+    ASSERT_NO_THROW(m_device->Execute(func, 0, kBufferSize, 64, nullptr));
+
+    std::vector<int> c(kBufferSize);
+    m_device->ReadTypedBuffer(c_buffer, 0, 0, kBufferSize, &c[0], nullptr);
+
+    for (auto i = 0; i < kBufferSize; ++i)
+    {
+        ASSERT_EQ(c[i], a[i] + b);
+    }
+
+    m_device->DeleteBuffer(a_buffer);
+    m_device->DeleteBuffer(c_buffer);
+    executable->DeleteFunction(func);
+    m_device->DeleteExecutable(executable);
+}
+
+TEST_F(CalcTestkHost, Execute_Executor)
+{
+    Calc::HostFunctionEntry const functions[] = { { "add", Add } };
+
+    // Serial executor counting the tasks it runs
+    std::size_t num_tasks = 0;
+    auto host_device = static_cast<Calc::DeviceHost*>(m_device);
+    host_device->SetExecutor([&num_tasks](std::size_t count, std::function<void(std::size_t)> const& task)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            task(i);
+            ++num_tasks;
+        }
+    }, 1);
+
+    Calc::Executable* executable = nullptr;
+    ASSERT_NO_THROW(executable = host_device->CreateExecutable(functions, 1));
+    Calc::Function* func = nullptr;
+    ASSERT_NO_THROW(func = executable->CreateFunction("add"));
+
+    const auto kBufferSize = 100000;
+    std::vector<int> a(kBufferSize);
+    std::iota(a.begin(), a.end(), 0);
+    int b = 5;
+
+    auto a_buffer = m_device->CreateBuffer(kBufferSize * sizeof(int), Calc::BufferType::kRead, &a[0]);
+    auto c_buffer = m_device->CreateBuffer(kBufferSize * sizeof(int), Calc::BufferType::kWrite);
+
+    func->SetArg(0, a_buffer);
+    func->SetArg(1, sizeof(b), &b);
+    func->SetArg(2, c_buffer);
+    ASSERT_NO_THROW(m_device->Execute(func, 0, kBufferSize, 64, nullptr));
+    EXPECT_GT(num_tasks, 0U);
+
+    std::vector<int> c(kBufferSize);
+    m_device->ReadTypedBuffer(c_buffer, 0, 0, kBufferSize, &c[0], nullptr);
+
+    for (auto i = 0; i < kBufferSize; ++i)
+    {
+        ASSERT_EQ(c[i], a[i] + b);
+    }
+
+    m_device->DeleteBuffer(a_buffer);
+    m_device->DeleteBuffer(c_buffer);
+    executable->DeleteFunction(func);
+    m_device->DeleteExecutable(executable);
+}
+
+TEST_F(CalcTestkHost, SortRadixInt32)
+{
+    ASSERT_TRUE(m_device->HasBuiltinPrimitives());
+
+    const auto kBufferSize = 100000;
+    std::vector<int> keys(kBufferSize);
+    std::vector<int> values(kBufferSize);
+    std::generate(keys.begin(), keys.end(), []() { return std::rand() % 1000; });
+    std::iota(values.begin(), values.end(), 0);
+
+    auto from_key = m_device->CreateBuffer(kBufferSize * sizeof(int), Calc::BufferType::kRead, &keys[0]);
+    auto from_value = m_device->CreateBuffer(kBufferSize * sizeof(int), Calc::BufferType::kRead, &values[0]);
+    auto to_key = m_device->CreateBuffer(kBufferSize * sizeof(int), Calc::BufferType::kWrite);
+    auto to_value = m_device->CreateBuffer(kBufferSize * sizeof(int), Calc::BufferType::kWrite);
+
+    auto prims = m_device->CreatePrimitives();
+    ASSERT_NO_THROW(prims->SortRadixInt32(0, from_key, to_key, from_value, to_value, kBufferSize));
+
+    std::vector<int> sorted_keys(kBufferSize);
+    std::vector<int> sorted_values(kBufferSize);
+    m_device->ReadTypedBuffer(to_key, 0, 0, kBufferSize, &sorted_keys[0], nullptr);
+    m_device->ReadTypedBuffer(to_value, 0, 0, kBufferSize, &sorted_values[0], nullptr);
+
+    // Stable sort reference
+    std::vector<int> order(kBufferSize);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&keys](int a, int b) { return keys[a] < keys[b]; });
+
+    for (auto i = 0; i < kBufferSize; ++i)
+    {
+        ASSERT_EQ(sorted_keys[i], keys[order[i]]);
+        ASSERT_EQ(sorted_values[i], order[i]);
+    }
+
+    m_device->DeletePrimitives(prims);
+    m_device->DeleteBuffer(from_key);
+    m_device->DeleteBuffer(from_value);
+    m_device->DeleteBuffer(to_key);
+    m_device->DeleteBuffer(to_value);
+}
@@ -0,0 +1,123 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+/// This test suite is testing host device command queues
+/// and the task scheduler they run on
+///
+
+#include "gtest/gtest.h"
+#include "device/cpu_event.h"
+#include "async/thread_pool.h"
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+
+using namespace RadeonRays;
+
+TEST(CpuCommandQueue, FailedCommand_ExceptionRethrown)
+{
+    CpuCommandQueue queue;
+
+    Event* failed = nullptr;
+    queue.Execute([]() { throw std::runtime_error("failed"); }, nullptr, &failed);
+
+    // Commands waiting for a failed one are skipped and fail as well
+    bool executed = false;
+    Event* dependent = nullptr;
+    queue.Execute([&executed]() { executed = true; }, failed, &dependent);
+
+    ASSERT_THROW(failed->Wait(), std::runtime_error);
+    ASSERT_THROW(dependent->Wait(), std::runtime_error);
+    ASSERT_THROW(dependent->Complete(), std::runtime_error);
+    ASSERT_FALSE(executed);
+    ASSERT_THROW(queue.Execute([]() {}, failed, nullptr), std::runtime_error);
+
+    ASSERT_NO_THROW(queue.DeleteEvent(failed));
+    ASSERT_NO_THROW(queue.DeleteEvent(dependent));
+
+    // Recycled events are clean
+    Event* completed = queue.CreateCompletedEvent();
+    Event* next = nullptr;
+    queue.Execute([&executed]() { executed = true; }, nullptr, &next);
+    ASSERT_TRUE(completed->Complete());
+    ASSERT_NO_THROW(next->Wait());
+    ASSERT_TRUE(executed);
+
+    queue.DeleteEvent(completed);
+    queue.DeleteEvent(next);
+}
+
+TEST(TaskScheduler, GroupWait_RunsOwnTasksOnly)
+{
+    std::atomic<bool> unrelated_done(false);
+    bool own_done = false;
+    bool unrelated_done_in_wait = true;
+    std::promise<void> done;
+    auto done_future = done.get_future();
+
+    // Single worker: everything spawned below is queued on it
+    task_scheduler scheduler(1);
+    scheduler.spawn([&]()
+    {
+        task_group group(scheduler);
+        group.run([&own_done]() { own_done = true; });
+        scheduler.spawn([&unrelated_done]() { unrelated_done = true; });
+
+        // The unrelated task is the newest one in the worker queue,
+        // waiting must not pick it up
+        group.wait();
+        unrelated_done_in_wait = unrelated_done;
+        done.set_value();
+    });
+
+    done_future.wait();
+    ASSERT_TRUE(own_done);
+    ASSERT_FALSE(unrelated_done_in_wait);
+}
+
+TEST(TaskScheduler, NestedGroups_ExceptionRethrown)
+{
+    task_scheduler scheduler(4);
+    std::atomic<int> leaves(0);
+
+    // Non-worker thread blocks, workers help with their own groups
+    task_group group(scheduler);
+    for (int i = 0; i < 16; ++i)
+    {
+        group.run([&scheduler, &leaves]()
+        {
+            task_group nested(scheduler);
+            for (int j = 0; j < 16; ++j)
+            {
+                nested.run([&leaves]() { ++leaves; });
+            }
+            nested.wait();
+        });
+    }
+    group.run([]() { throw std::runtime_error("failed"); });
+
+    ASSERT_THROW(group.wait(), std::runtime_error);
+    ASSERT_EQ(leaves.load(), 256);
+    ASSERT_NO_THROW(group.wait());
+}
@@ -26,6 +26,8 @@ THE SOFTWARE.
 ///
 
 #include "gtest/gtest.h"
+#include <cstdlib>
+#include <string>
 #include "radeon_rays.h"
 #include "math/quaternion.h"
 #include "tiny_obj_loader.h"
@@ -244,6 +246,53 @@ TEST_F(ApiBackendOpenCL, Intersection_1Ray)
 }
 
 
+// The test commits the same scene with a kernel cache twice, second time loading binaries
+TEST_F(ApiBackendOpenCL, Intersection_1Ray_KernelCache)
+{
+    char const* tmp_dir = std::getenv("TMPDIR");
+    if (!tmp_dir) tmp_dir = std::getenv("TEMP");
+    std::string cache_path = tmp_dir ? tmp_dir : "/tmp";
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (i > 0)
+        {
+            IntersectionApi::Delete(api_);
+            SetUp();
+        }
+
+        ASSERT_NO_THROW(api_->SetOption("kernel.cache_path", cache_path.c_str()));
+
+        Shape* mesh = nullptr;
+        ASSERT_NO_THROW(mesh = api_->CreateMesh(vertices(), 3, 3*sizeof(float), indices(), 0, numfaceverts(), 1));
+        ASSERT_NO_THROW(api_->AttachShape(mesh));
+
+        ray r(float3(0.f, 0.f, -10.f), float3(0.f, 0.f, 1.f), 10000.f);
+        Intersection isect;
+
+        auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+        auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+        ASSERT_NO_THROW(api_->Commit());
+        ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+        Intersection* tmp = nullptr;
+        ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+        Wait();
+
+        isect = *tmp;
+        ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+        Wait();
+
+        ASSERT_EQ(isect.shapeid, mesh->GetId());
+
+        ASSERT_NO_THROW(api_->DetachShape(mesh));
+        ASSERT_NO_THROW(api_->DeleteShape(mesh));
+        ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+        ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+    }
+}
+
 #ifdef RR_RAY_MASK
 // The test creates a single triangle mesh and tests attach/detach functionality
 TEST_F(ApiBackendOpenCL, Intersection_1Ray_Masked)
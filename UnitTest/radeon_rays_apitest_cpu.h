@@ -0,0 +1,1479 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+/// This test suite is testing RadeonRays library functionality
+///
+
+#include "gtest/gtest.h"
+#include "radeon_rays.h"
+
+using namespace RadeonRays;
+
+#include "tiny_obj_loader.h"
+#include "utils.h"
+
+// Api creation fixture, prepares api_ for further tests
+class ApiBackendCpu : public ::testing::Test
+{
+public:
+    virtual void SetUp()
+    {
+        api_ = nullptr;
+        int nativeidx = -1;
+
+        // Always use native CPU device
+        IntersectionApi::SetPlatform(DeviceInfo::kNative);
+
+        for (auto idx = 0U; idx < IntersectionApi::GetDeviceCount(); ++idx)
+        {
+            DeviceInfo devinfo;
+            IntersectionApi::GetDeviceInfo(idx, devinfo);
+            //            printf( "DeviceInfo %s %s %i %i\n", devinfo.name, devinfo.vendor, devinfo.type, devinfo.platform );
+
+            if (devinfo.type == DeviceInfo::kCpu && nativeidx == -1)
+            {
+                nativeidx = idx;
+            }
+        }
+
+        ASSERT_NE(nativeidx, -1);
+
+        api_ = IntersectionApi::Create(nativeidx);
+
+        //        printf("[ok] RadeonRays test setup");
+    }
+
+    virtual void TearDown()
+    {
+        if (api_) { IntersectionApi::Delete(api_); }
+    }
+
+    void Wait()
+    {
+        e_->Wait();
+        api_->DeleteEvent(e_);
+    }
+
+    IntersectionApi* api_;
+    Event* e_;
+
+    static float const * vertices() {
+        static float const vertices[] = {
+            -1.f,-1.f,0.f,
+            1.f,-1.f,0.f,
+            0.f,1.f,0.f,
+
+        };
+        return vertices;
+    }
+    static int const * indices() {
+        static int const indices[] = { 0, 1, 2 };
+        return indices;
+    }
+
+    static int const * numfaceverts() {
+        static const int numfaceverts[] = { 3 };
+        return numfaceverts;
+    }
+};
+
+TEST_F(ApiBackendCpu, NativeDeviceIndexTest)
+{
+    IntersectionApi::SetPlatform(DeviceInfo::kNative);
+
+    ASSERT_EQ(IntersectionApi::GetDeviceCount(), 1U);
+
+    DeviceInfo devinfo;
+    IntersectionApi::GetDeviceInfo(0, devinfo);
+    ASSERT_EQ(devinfo.type, DeviceInfo::kCpu);
+    ASSERT_EQ(devinfo.platform, DeviceInfo::kNative);
+
+#if    USE_EMBREE
+    IntersectionApi::SetPlatform((DeviceInfo::Platform)(DeviceInfo::kEmbree | DeviceInfo::kNative));
+    ASSERT_EQ(IntersectionApi::GetDeviceCount(), 2U);
+#endif
+
+#if    USE_OPENCL
+    IntersectionApi::SetPlatform(DeviceInfo::kOpenCL);
+    const auto openclCount = IntersectionApi::GetDeviceCount();
+
+    IntersectionApi::SetPlatform((DeviceInfo::Platform)(DeviceInfo::kNative | DeviceInfo::kOpenCL));
+    ASSERT_EQ(IntersectionApi::GetDeviceCount(), openclCount + 1);
+#endif
+    IntersectionApi::SetPlatform(DeviceInfo::kNative);
+}
+
+// The test checks whether the api has been successfully created
+TEST_F(ApiBackendCpu, DeviceEnum)
+{
+    int numdevices = 0;
+    ASSERT_NO_THROW(numdevices = IntersectionApi::GetDeviceCount());
+    ASSERT_GT(numdevices, 0);
+
+    for (int i = 0; i<numdevices; ++i)
+    {
+        DeviceInfo devinfo;
+        IntersectionApi::GetDeviceInfo(i, devinfo);
+
+        ASSERT_NE(devinfo.name, nullptr);
+        ASSERT_NE(devinfo.vendor, nullptr);
+    }
+}
+
+// The test checks whether the api has been successfully created
+TEST_F(ApiBackendCpu, SingleDevice)
+{
+    ASSERT_TRUE(api_ != nullptr);
+}
+
+// The test creates a single triangle mesh and tests attach/detach functionality
+TEST_F(ApiBackendCpu, Mesh)
+{
+    Shape* shape = nullptr;
+
+    ASSERT_NO_THROW(shape = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+
+    ASSERT_TRUE(shape != nullptr);
+
+    ASSERT_NO_THROW(api_->AttachShape(shape));
+    ASSERT_NO_THROW(api_->DetachShape(shape));
+    ASSERT_NO_THROW(api_->DeleteShape(shape));
+}
+
+// The test creates an empty scene
+TEST_F(ApiBackendCpu, EmptyScene)
+{
+    ASSERT_THROW(api_->Commit(), Exception);
+}
+
+// The test creates a single triangle mesh and tests attach/detach functionality
+TEST_F(ApiBackendCpu, MeshStrided)
+{
+    struct Vertex
+    {
+        float position[3];
+        float normal[3];
+        float uv[2];
+    };
+
+    // Mesh vertices
+    Vertex meshvertices[] = {
+        { 0.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f },
+        { 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f },
+        { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f },
+        { 0.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f },
+        { 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f },
+        { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f }
+    };
+
+    // Indices
+    int mindices[] = { 0, 1, 2, 0, 0, 1, 2, 0 };
+
+    Shape* shape = nullptr;
+
+    ASSERT_NO_THROW(shape = api_->CreateMesh((float const*)meshvertices, 6, sizeof(Vertex), mindices, 4 * sizeof(int), nullptr, 2));
+
+    ASSERT_TRUE(shape != nullptr);
+
+    ASSERT_NO_THROW(api_->AttachShape(shape));
+    ASSERT_NO_THROW(api_->DetachShape(shape));
+    ASSERT_NO_THROW(api_->DeleteShape(shape));
+}
+
+
+
+// The test attaches many instances, detaches some of them and updates others
+TEST_F(ApiBackendCpu, Intersection_ManyInstances_AttachDetach)
+{
+    int const kNumInstances = 4096;
+
+    Shape* mesh = nullptr;
+    ASSERT_NO_THROW(mesh = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+
+    // A row of instances along x, one ray per instance
+    std::vector<Shape*> instances(kNumInstances);
+    std::vector<ray> rays(kNumInstances);
+    for (int i = 0; i < kNumInstances; ++i)
+    {
+        ASSERT_NO_THROW(instances[i] = api_->CreateInstance(mesh));
+        matrix m = translation(float3(3.f * i, 0, 0));
+        instances[i]->SetTransform(m, inverse(m));
+        ASSERT_NO_THROW(api_->AttachShape(instances[i]));
+        // Attaching twice is a no-op
+        ASSERT_NO_THROW(api_->AttachShape(instances[i]));
+
+        rays[i].o = float4(3.f * i, 0.f, -10.f, 1000.f);
+        rays[i].d = float3(0.f, 0.f, 1.f);
+    }
+
+    for (int i = 1; i < kNumInstances; i += 2)
+    {
+        ASSERT_NO_THROW(api_->DetachShape(instances[i]));
+    }
+
+    auto ray_buffer = api_->CreateBuffer(kNumInstances * sizeof(ray), rays.data());
+    auto isect_buffer = api_->CreateBuffer(kNumInstances * sizeof(Intersection), nullptr);
+
+    auto query = [&](std::vector<Intersection>& isect)
+    {
+        ASSERT_NO_THROW(api_->Commit());
+        ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, kNumInstances, isect_buffer, nullptr, nullptr));
+
+        Intersection* tmp = nullptr;
+        ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, kNumInstances * sizeof(Intersection), (void**)&tmp, &e_));
+        Wait();
+        isect.assign(tmp, tmp + kNumInstances);
+        ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+        Wait();
+    };
+
+    std::vector<Intersection> isect;
+    query(isect);
+    for (int i = 0; i < kNumInstances; ++i)
+    {
+        ASSERT_EQ(isect[i].shapeid, (i % 2) ? kNullId : instances[i]->GetId());
+    }
+
+    // Move an attached instance away, commit only sees the changed shape
+    matrix m = translation(float3(0, 10, 0));
+    instances[0]->SetTransform(m, inverse(m));
+    // Changes of detached shapes do not matter
+    instances[1]->SetTransform(matrix(), matrix());
+    query(isect);
+    ASSERT_EQ(isect[0].shapeid, kNullId);
+    ASSERT_EQ(isect[1].shapeid, kNullId);
+    ASSERT_EQ(isect[2].shapeid, instances[2]->GetId());
+
+    // Deleting an attached shape detaches it
+    ASSERT_NO_THROW(api_->DeleteShape(instances[2]));
+    instances[2] = nullptr;
+    query(isect);
+    ASSERT_EQ(isect[2].shapeid, kNullId);
+    ASSERT_EQ(isect[4].shapeid, instances[4]->GetId());
+
+    ASSERT_NO_THROW(api_->DetachAll());
+    for (auto instance : instances)
+    {
+        if (instance) { ASSERT_NO_THROW(api_->DeleteShape(instance)); }
+    }
+    ASSERT_NO_THROW(api_->DeleteShape(mesh));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
+
+// The test creates a mesh over strided caller memory and checks it is hit
+TEST_F(ApiBackendCpu, MeshExternalMemory)
+{
+    struct Vertex
+    {
+        float position[3];
+        float normal[3];
+    };
+
+    Vertex meshvertices[] = {
+        { -1.f, -1.f, 0.f, 0.f, 0.f, 1.f },
+        { 1.f, -1.f, 0.f, 0.f, 0.f, 1.f },
+        { 0.f, 1.f, 0.f, 0.f, 0.f, 1.f }
+    };
+
+    // Indices with a padding int per face
+    int mindices[] = { 0, 1, 2, 0 };
+
+    Shape* shape = nullptr;
+
+    ASSERT_THROW(api_->CreateMeshFromExternalMemory(nullptr, 3, sizeof(Vertex), mindices, 4 * sizeof(int), 1), Exception);
+    ASSERT_NO_THROW(shape = api_->CreateMeshFromExternalMemory((float const*)meshvertices, 3, sizeof(Vertex), mindices, 4 * sizeof(int), 1));
+    ASSERT_TRUE(shape != nullptr);
+    ASSERT_NO_THROW(api_->AttachShape(shape));
+
+    ray r;
+    r.o = float4(0.f, 0.f, -10.f, 1000.f);
+    r.d = float3(0.f, 0.f, 1.f);
+
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+    ASSERT_NO_THROW(api_->Commit());
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    Intersection* isect = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&isect, &e_));
+    Wait();
+    ASSERT_EQ(isect->shapeid, shape->GetId());
+    ASSERT_NEAR(isect->uvwt.w, 10.f, 1e-5f);
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, isect, &e_));
+    Wait();
+
+    ASSERT_NO_THROW(api_->DetachShape(shape));
+    ASSERT_NO_THROW(api_->DeleteShape(shape));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
+
+// The test creates a batch of meshes and checks the closest one is hit
+TEST_F(ApiBackendCpu, CreateMeshes)
+{
+    int const kNumMeshes = 1000;
+
+    // One triangle per mesh, moving away from the ray origin
+    std::vector<float> meshvertices(kNumMeshes * 9);
+    std::vector<MeshDesc> descs(kNumMeshes);
+    for (int i = 0; i < kNumMeshes; ++i)
+    {
+        for (int j = 0; j < 9; ++j)
+        {
+            meshvertices[i * 9 + j] = (j % 3 == 2) ? (float)i : vertices()[j];
+        }
+
+        descs[i] = { &meshvertices[i * 9], 3, 3 * sizeof(float), indices(), 0, (i % 2) ? numfaceverts() : nullptr, 1 };
+    }
+
+    std::vector<Shape*> shapes(kNumMeshes, nullptr);
+    ASSERT_NO_THROW(api_->CreateMeshes(descs.data(), kNumMeshes, shapes.data()));
+
+    for (int i = 0; i < kNumMeshes; ++i)
+    {
+        ASSERT_TRUE(shapes[i] != nullptr);
+        ASSERT_EQ(shapes[i]->GetId(), shapes[0]->GetId() + i);
+        ASSERT_NO_THROW(api_->AttachShape(shapes[i]));
+    }
+
+    ray r;
+    r.o = float4(0.f, 0.f, -10.f, 10000.f);
+    r.d = float3(0.f, 0.f, 1.f);
+
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+    ASSERT_NO_THROW(api_->Commit());
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    Intersection* isect = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&isect, &e_));
+    Wait();
+    ASSERT_EQ(isect->shapeid, shapes[0]->GetId());
+    ASSERT_NEAR(isect->uvwt.w, 10.f, 1e-5f);
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, isect, &e_));
+    Wait();
+
+    // Face sizes are checked in a batch as well
+    int const badfaceverts[] = { 5 };
+    MeshDesc bad = { vertices(), 3, 3 * sizeof(float), indices(), 0, badfaceverts, 1 };
+    Shape* badshape = nullptr;
+    ASSERT_THROW(api_->CreateMeshes(&bad, 1, &badshape), Exception);
+
+    // Meshes of a batch share their memory, the rest stays intact when some are deleted
+    int const kNumDeleted = kNumMeshes / 2;
+    for (int i = 0; i < kNumDeleted; ++i)
+    {
+        ASSERT_NO_THROW(api_->DeleteShape(shapes[i]));
+    }
+
+    ASSERT_NO_THROW(api_->Commit());
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&isect, &e_));
+    Wait();
+    ASSERT_EQ(isect->shapeid, shapes[kNumDeleted]->GetId());
+    ASSERT_NEAR(isect->uvwt.w, 10.f + kNumDeleted, 1e-3f);
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, isect, &e_));
+    Wait();
+
+    ASSERT_NO_THROW(api_->DetachAll());
+    for (int i = kNumDeleted; i < kNumMeshes; ++i)
+    {
+        ASSERT_NO_THROW(api_->DeleteShape(shapes[i]));
+    }
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
+
+//The test creates a single triangle mesh and then tries to create an instance of the mesh
+TEST_F(ApiBackendCpu, Instance)
+{
+
+    Shape* shape = nullptr;
+
+    ASSERT_NO_THROW(shape = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+
+    ASSERT_TRUE(shape != nullptr);
+
+    ASSERT_NO_THROW(api_->AttachShape(shape));
+    ASSERT_NO_THROW(api_->DetachShape(shape));
+
+    Shape* instance = nullptr;
+
+    ASSERT_NO_THROW(instance = api_->CreateInstance(shape));
+
+    ASSERT_TRUE(instance != nullptr);
+
+    ASSERT_NO_THROW(api_->DeleteShape(shape));
+}
+
+// The test creates a single triangle mesh and tests attach/detach functionality
+TEST_F(ApiBackendCpu, Intersection_1Ray)
+{
+    Shape* mesh = nullptr;
+
+    // Create mesh
+    ASSERT_NO_THROW(mesh = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+
+    ASSERT_TRUE(mesh != nullptr);
+
+    // Attach the mesh to the scene
+    ASSERT_NO_THROW(api_->AttachShape(mesh));
+
+    // Prepare the ray
+    ray r(float3(0.f, 0.f, -10.f), float3(0.f, 0.f, 1.f), 10000.f);
+
+    // Intersection and hit data
+    Intersection isect;
+
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    Intersection* tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, mesh->GetId());
+
+    // Bail out
+    ASSERT_NO_THROW(api_->DetachShape(mesh));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
+
+
+// The test creates a single triangle mesh and tests attach/detach functionality
+TEST_F(ApiBackendCpu, Intersection_1Ray_Masked)
+{
+    Shape* mesh = nullptr;
+
+    api_->SetOption("acc.type", "bvh");
+    //api_->SetOption("bvh.force2level", 1.f);
+
+    // Create mesh
+    ASSERT_NO_THROW(mesh = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+
+    // Set mask 
+    ASSERT_NO_THROW(mesh->SetMask(0xFFFFFFFF));
+
+    ASSERT_TRUE(mesh != nullptr);
+
+    // Attach the mesh to the scene
+    ASSERT_NO_THROW(api_->AttachShape(mesh));
+
+    // Prepare the ray
+    ray r(float3(0.f, 0.f, -10.f), float3(0.f, 0.f, 1.f), 10000.f);
+    r.SetMask(0xFFFFFFFF);
+
+    // Intersection and hit data
+    Intersection isect;
+
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+    auto isect_flag_buffer = api_->CreateBuffer(sizeof(int), nullptr);
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    Intersection* tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, mesh->GetId());
+
+    mesh->SetMask(0x0);
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, kNullId);
+
+    mesh->SetMask(0xFF000000);
+
+    int result = kNullId;
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryOcclusion(ray_buffer, 1, isect_flag_buffer, nullptr, nullptr));
+
+    int* isect_flag = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_flag_buffer, kMapRead, 0, sizeof(int), (void**)&isect_flag, &e_));
+    Wait();
+    result = *isect_flag;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_flag_buffer, isect_flag, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_GT(result, 0);
+
+    mesh->SetMask(0xFF000000);
+
+    r.SetMask(0x000000FF);
+
+    ray* rr = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(ray_buffer, kMapWrite, 0, sizeof(ray), (void**)&rr, &e_));
+    Wait();
+    *rr = r;
+    ASSERT_NO_THROW(api_->UnmapBuffer(ray_buffer, rr, &e_));
+    Wait();
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryOcclusion(ray_buffer, 1, isect_flag_buffer, nullptr, nullptr));
+
+    isect_flag = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_flag_buffer, kMapRead, 0, sizeof(int), (void**)&isect_flag, &e_));
+    Wait();
+    result = *isect_flag;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_flag_buffer, isect_flag, &e_));
+    Wait();
+    // Check results
+    ASSERT_EQ(result, kNullId);
+
+
+    // Bail out
+    ASSERT_NO_THROW(api_->DetachShape(mesh));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_flag_buffer));
+
+}
+
+// The test creates a single triangle mesh and tests attach/detach functionality
+TEST_F(ApiBackendCpu, Intersection_1Ray_Active)
+{
+
+    Shape* mesh = nullptr;
+
+    // Create mesh
+    ASSERT_NO_THROW(mesh = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+
+    ASSERT_TRUE(mesh != nullptr);
+
+    // Attach the mesh to the scene
+    ASSERT_NO_THROW(api_->AttachShape(mesh));
+
+    // Prepare the ray
+    ray r(float3(0.f, 0.f, -10.f), float3(0.f, 0.f, 1.f), 10000.f);
+
+    // Intersection and hit data
+    Intersection isect;
+
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    Intersection* tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, mesh->GetId());
+
+    isect.primid = kNullId;
+    isect.shapeid = kNullId;
+
+    r.SetActive(false);
+
+    ray* rr = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(ray_buffer, kMapWrite, 0, sizeof(ray), (void**)&rr, &e_));
+    Wait();
+    *rr = r;
+    ASSERT_NO_THROW(api_->UnmapBuffer(ray_buffer, rr, &e_));
+    Wait();
+
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapWrite, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    *tmp = isect;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, kNullId);
+
+
+    // Bail out
+    ASSERT_NO_THROW(api_->DeleteShape(mesh));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
+
+// The test creates a single triangle mesh and tests attach/detach functionality
+TEST_F(ApiBackendCpu, Intersection_3Rays)
+{
+    Shape* mesh = nullptr;
+
+    // 
+    ASSERT_NO_THROW(api_->SetOption("acc.type", "grid"));
+
+    // Create mesh
+    ASSERT_NO_THROW(mesh = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+
+    ASSERT_TRUE(mesh != nullptr);
+
+    // Attach the mesh to the scene
+    ASSERT_NO_THROW(api_->AttachShape(mesh));
+
+    // Rays
+    ray rays[3];
+
+    // Prepare the ray
+    rays[0].o = float4(0.f, 0.f, -10.f, 1000.f);
+    rays[0].d = float3(0.f, 0.f, 1.f);
+
+    rays[1].o = float4(0.f, 0.5f, -10.f, 1000.f);
+    rays[1].d = float3(0.f, 0.f, 1.f);
+
+    rays[2].o = float4(0.5f, 0.f, -10.f, 1000.f);
+    rays[2].d = float3(0.f, 0.f, 1.f);
+
+    // Intersection and hit data
+    Intersection isect[3];
+
+    auto ray_buffer = api_->CreateBuffer(3 * sizeof(ray), rays);
+    auto isect_buffer = api_->CreateBuffer(3 * sizeof(Intersection), nullptr);
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 3, isect_buffer, nullptr, nullptr));
+
+    Intersection* tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, 3 * sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect[0] = tmp[0];
+    isect[1] = tmp[1];
+    isect[2] = tmp[2];
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    for (int i = 0; i<3; ++i)
+    {
+        ASSERT_EQ(isect[i].shapeid, mesh->GetId());
+    }
+
+    // Bail out
+    ASSERT_NO_THROW(api_->DeleteShape(mesh));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
+
+
+// Test is checking if mesh transform is working as expected
+TEST_F(ApiBackendCpu, Intersection_1Ray_Transformed)
+{
+
+    Shape* mesh = nullptr;
+
+    // Create mesh
+    ASSERT_NO_THROW(mesh = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+
+    ASSERT_TRUE(mesh != nullptr);
+
+    // Attach the mesh to the scene
+    ASSERT_NO_THROW(api_->AttachShape(mesh));
+
+    // Prepare the ray
+    ray r;
+    r.o = float4(0.f, 0.f, -10.f, 1000.f);
+    r.d = float3(0.f, 0.f, 1.f);
+
+    // Intersection and hit data
+    Intersection isect;
+
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    Intersection* tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, mesh->GetId());
+
+    matrix m = translation(float3(0, 2, 0));
+    matrix minv = inverse(m);
+    // Move the mesh
+    ASSERT_NO_THROW(mesh->SetTransform(m, minv));
+    // Reset ray
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, -1);
+
+    // Set transform to identity
+    m = matrix();
+    ASSERT_NO_THROW(mesh->SetTransform(m, m));
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, mesh->GetId());
+
+    // Bail out
+    ASSERT_NO_THROW(api_->DeleteShape(mesh));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
+
+// The test checks intersection after geometry addition
+TEST_F(ApiBackendCpu, Intersection_1Ray_DynamicGeo)
+{
+    // Mesh vertices
+    float const vertices0[] = {
+        -1.f,-1.f,0.f,
+        1.f,-1.f,0.f,
+        0.f,1.f,0.f,
+
+    };
+
+    float const vertices1[] = {
+        -1.f,-1.f,-1.f,
+        1.f,-1.f,-1.f,
+        0.f,1.f,-1.f,
+
+    };
+
+    Shape* closemesh = nullptr;
+    Shape* farmesh = nullptr;
+
+    // Create two meshes
+    ASSERT_NO_THROW(farmesh = api_->CreateMesh(vertices0, 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+    ASSERT_NO_THROW(closemesh = api_->CreateMesh(vertices1, 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+
+    ASSERT_TRUE(farmesh != nullptr);
+    ASSERT_TRUE(closemesh != nullptr);
+
+    // Attach the mesh to the scene
+    ASSERT_NO_THROW(api_->AttachShape(farmesh));
+
+    // Prepare the ray
+    ray r;
+    r.o = float4(0.f, 0.f, -10.f, 1000.f);
+    r.d = float3(0.f, 0.f, 1.f);
+
+
+    // Intersection and hit data
+    Intersection isect;
+
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    Intersection* tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, farmesh->GetId());
+
+    // Attach closer mesh to the scene
+    ASSERT_NO_THROW(api_->AttachShape(closemesh));
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, closemesh->GetId());
+
+    // Attach closer mesh to the scene
+    ASSERT_NO_THROW(api_->DetachShape(closemesh));
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, farmesh->GetId());
+
+    // Bail out
+    ASSERT_NO_THROW(api_->DeleteShape(farmesh));
+    ASSERT_NO_THROW(api_->DeleteShape(closemesh));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
+
+TEST_F(ApiBackendCpu, CornellBoxLoad)
+{
+    using namespace tinyobj;
+    std::vector<shape_t> shapes;
+    std::vector<material_t> materials;
+    std::vector<Shape*> apishapes;
+
+    // Load obj file 
+    std::string res = LoadObj(shapes, materials, "../Resources/CornellBox/orig.objm");
+
+    ASSERT_NO_THROW(api_->SetOption("acc.type", "grid"));
+
+    // Create meshes within IntersectionApi
+    for (int i = 0; i<(int)shapes.size(); ++i)
+    {
+        Shape* shape = nullptr;
+        ASSERT_NO_THROW(shape = api_->CreateMesh(&shapes[i].mesh.positions[0], (int)shapes[i].mesh.positions.size() / 3, 3 * sizeof(float),
+            &shapes[i].mesh.indices[0], 0, nullptr, (int)shapes[i].mesh.indices.size() / 3));
+
+        ASSERT_NO_THROW(api_->AttachShape(shape));
+        apishapes.push_back(shape);
+    }
+
+    // Commit update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Delete meshes
+    for (int i = 0; i<(int)apishapes.size(); ++i)
+    {
+        ASSERT_NO_THROW(api_->DeleteShape(apishapes[i]));
+    }
+}
+
+TEST_F(ApiBackendCpu, CornellBox_1Ray)
+{
+    using namespace tinyobj;
+    std::vector<shape_t> shapes;
+    std::vector<material_t> materials;
+    std::vector<Shape*> apishapes;
+
+    // Load obj file 
+    std::string res = LoadObj(shapes, materials, "../Resources/CornellBox/orig.objm");
+
+    //ASSERT_NO_THROW(api_->SetOption("acc.type", "grid"));
+
+    // Create meshes within IntersectionApi
+    for (int i = 0; i<(int)shapes.size(); ++i)
+    {
+        Shape* shape = nullptr;
+        ASSERT_NO_THROW(shape = api_->CreateMesh(&shapes[i].mesh.positions[0], (int)shapes[i].mesh.positions.size() / 3, 3 * sizeof(float),
+            &shapes[i].mesh.indices[0], 0, nullptr, (int)shapes[i].mesh.indices.size() / 3));
+
+        ASSERT_NO_THROW(api_->AttachShape(shape));
+        apishapes.push_back(shape);
+    }
+
+    // Prepare the ray
+    ray r;
+    r.o = float4(0.f, 0.5f, -10.f, 1000.f);
+    r.d = float3(0.f, 0.f, 1.f);
+
+
+    // Intersection and hit data
+    Intersection isect;
+
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    Intersection* tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+
+    // Delete meshes
+    for (int i = 0; i<(int)apishapes.size(); ++i)
+    {
+        ASSERT_NO_THROW(api_->DeleteShape(apishapes[i]));
+    }
+
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
+
+
+TEST_F(ApiBackendCpu, BvhStatistics)
+{
+    BvhStatistics stats;
+
+    // Nothing has been committed yet
+    ASSERT_ANY_THROW(api_->GetBvhStatistics(stats));
+
+    Shape* mesh = nullptr;
+    ASSERT_NO_THROW(mesh = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+    ASSERT_NO_THROW(api_->AttachShape(mesh));
+    ASSERT_NO_THROW(api_->SetOption("bvh.width", 2.f));
+    ASSERT_NO_THROW(api_->SetOption("bvh.statistics.epo", 1.f));
+    ASSERT_NO_THROW(api_->Commit());
+    ASSERT_NO_THROW(api_->GetBvhStatistics(stats));
+
+    // A single leaf is the root, nothing else can overlap it
+    ASSERT_STREQ(stats.layout, "bvh2");
+    ASSERT_EQ(stats.width, 2);
+    ASSERT_EQ(stats.num_nodes, 1);
+    ASSERT_EQ(stats.num_leaves, 1);
+    ASSERT_EQ(stats.num_references, 1);
+    ASSERT_EQ(stats.max_depth, 0);
+    ASSERT_EQ(stats.leaf_sizes[1], 1);
+    ASSERT_EQ(stats.leaf_depths[0], 1);
+    ASSERT_FLOAT_EQ(stats.sah_cost, 1.f);
+    ASSERT_FLOAT_EQ(stats.epo, 0.f);
+    ASSERT_GT(stats.bvh_bytes, 0u);
+    ASSERT_EQ(stats.layout_bytes, stats.bvh_bytes);
+    ASSERT_FALSE(stats.cached);
+
+    ASSERT_NO_THROW(api_->DeleteShape(mesh));
+}
+
+TEST_F(ApiBackendCpu, CornellBox_BvhStatistics)
+{
+    using namespace tinyobj;
+    std::vector<shape_t> shapes;
+    std::vector<material_t> materials;
+    std::vector<Shape*> apishapes;
+
+    // Load obj file 
+    std::string res = LoadObj(shapes, materials, "../Resources/CornellBox/orig.objm");
+
+    // Create meshes within IntersectionApi
+    int numfaces = 0;
+    for (int i = 0; i<(int)shapes.size(); ++i)
+    {
+        Shape* shape = nullptr;
+        ASSERT_NO_THROW(shape = api_->CreateMesh(&shapes[i].mesh.positions[0], (int)shapes[i].mesh.positions.size() / 3, 3 * sizeof(float),
+            &shapes[i].mesh.indices[0], 0, nullptr, (int)shapes[i].mesh.indices.size() / 3));
+
+        ASSERT_NO_THROW(api_->AttachShape(shape));
+        apishapes.push_back(shape);
+        numfaces += (int)shapes[i].mesh.indices.size() / 3;
+    }
+
+    ASSERT_NO_THROW(api_->SetOption("bvh.builder", "sah"));
+    ASSERT_NO_THROW(api_->SetOption("bvh.max_leaf_size", 4.f));
+    ASSERT_NO_THROW(api_->SetOption("bvh.width", 4.f));
+    ASSERT_NO_THROW(api_->SetOption("bvh.statistics.epo", 1.f));
+    ASSERT_NO_THROW(api_->Commit());
+
+    BvhStatistics stats;
+    ASSERT_NO_THROW(api_->GetBvhStatistics(stats));
+
+    ASSERT_STREQ(stats.layout, "bvh4");
+    ASSERT_EQ(stats.width, 4);
+    ASSERT_EQ(stats.num_references, numfaces);
+    ASSERT_EQ(stats.num_nodes, 2 * stats.num_leaves - 1);
+    ASSERT_GT(stats.max_depth, 0);
+
+    // Histograms account for every leaf, none is empty or larger than allowed
+    int leaf_sizes = 0;
+    int leaf_depths = 0;
+    for (int i = 0; i < BvhStatistics::kLeafSizeBins; ++i)
+    {
+        leaf_sizes += stats.leaf_sizes[i];
+        ASSERT_TRUE((i > 0 && i <= 4) || stats.leaf_sizes[i] == 0);
+    }
+    for (int i = 0; i < BvhStatistics::kDepthBins; ++i)
+    {
+        leaf_depths += stats.leaf_depths[i];
+    }
+    ASSERT_EQ(leaf_sizes, stats.num_leaves);
+    ASSERT_EQ(leaf_depths, stats.num_leaves);
+
+    // The root alone costs 1
+    ASSERT_GT(stats.sah_cost, 1.f);
+    ASSERT_GE(stats.epo, 0.f);
+    ASSERT_GT(stats.layout_bytes, stats.bvh_bytes);
+
+    // Delete meshes
+    for (int i = 0; i<(int)apishapes.size(); ++i)
+    {
+        ASSERT_NO_THROW(api_->DeleteShape(apishapes[i]));
+    }
+}
+
+// Test is checking if mesh transform is working as expected
+// Parallel triangles at exponentially shrinking distances make median splits cut off
+// one triangle at a time, the tree still has to stay within the traversal stack depth
+TEST_F(ApiBackendCpu, Intersection_DeepTree)
+{
+    int const kNumFaces = 100;
+
+    std::vector<float> positions;
+    std::vector<int> faces;
+    std::vector<ray> rays;
+    float x = 1.f;
+    for (int i = 0; i < kNumFaces; ++i, x *= 0.5f)
+    {
+        float const v[9] = { x, -1.f, -1.f, x, 3.f, -1.f, x, -1.f, 3.f };
+        positions.insert(positions.end(), v, v + 9);
+        faces.push_back(3 * i);
+        faces.push_back(3 * i + 1);
+        faces.push_back(3 * i + 2);
+
+        // Starts between triangle i + 1 and triangle i
+        rays.push_back(ray(float3(0.75f * x, 0.1f, 0.1f), float3(1.f, 0.f, 0.f), 10.f));
+    }
+
+    Shape* mesh = nullptr;
+    ASSERT_NO_THROW(mesh = api_->CreateMesh(positions.data(), 3 * kNumFaces, 3 * sizeof(float), faces.data(), 0, nullptr, kNumFaces));
+
+    auto ray_buffer = api_->CreateBuffer(kNumFaces * sizeof(ray), rays.data());
+    auto isect_buffer = api_->CreateBuffer(kNumFaces * sizeof(Intersection), nullptr);
+
+    float const widths[] = { 2.f, 4.f, 8.f };
+    for (auto width : widths)
+    {
+        // Options alone do not trigger a build, attach the mesh again
+        ASSERT_NO_THROW(api_->SetOption("bvh.width", width));
+        ASSERT_NO_THROW(api_->AttachShape(mesh));
+        ASSERT_NO_THROW(api_->Commit());
+
+        BvhStatistics stats;
+        ASSERT_NO_THROW(api_->GetBvhStatistics(stats));
+        ASSERT_EQ(stats.width, static_cast<int>(width));
+        ASSERT_LE(stats.max_depth, 64);
+
+        ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, kNumFaces, isect_buffer, nullptr, nullptr));
+
+        Intersection* isect = nullptr;
+        ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, kNumFaces * sizeof(Intersection), (void**)&isect, &e_));
+        Wait();
+
+        for (int i = 0; i < kNumFaces; ++i)
+        {
+            ASSERT_EQ(isect[i].shapeid, mesh->GetId());
+            ASSERT_EQ(isect[i].primid, i);
+        }
+
+        ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, isect, &e_));
+        Wait();
+
+        ASSERT_NO_THROW(api_->DetachShape(mesh));
+    }
+
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+    ASSERT_NO_THROW(api_->DeleteShape(mesh));
+}
+
+TEST_F(ApiBackendCpu, Intersection_1Ray_TransformedInstance1)
+{
+    // this test uses a single mesh, it added into the world as itself
+    // at <0,-1,1000> AND as an instance at <0,0,2>
+    // ray from <0,0,-10> along the pos z should hit the uninstanced mesh
+
+    std::vector<TestShape> shapes = { TestShape(vertices(), 3, indices(), 3, numfaceverts(), 1),
+        TestShape(vertices(), 3, indices(), 3, numfaceverts(), 1),
+        TestShape(vertices(), 3, indices(), 3, numfaceverts(), 1) };
+    TestShape& mesh0 = shapes[0];
+    TestShape& mesh1 = shapes[1];
+    TestShape& instance = shapes[2];
+
+    // Create meshes
+    // NOTE mesh in world and as a instance upsets the simple TestIntersection API call 
+    ASSERT_NO_THROW(mesh0.shape = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+    ASSERT_TRUE(mesh0.shape != nullptr);
+    ASSERT_NO_THROW(mesh1.shape = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+    ASSERT_TRUE(mesh1.shape != nullptr);
+
+    // Attach the mesh to the scene
+    ASSERT_NO_THROW(api_->AttachShape(mesh0.shape));
+    // Create instance of a triangle
+    ASSERT_NO_THROW(instance.shape = api_->CreateInstance(mesh1.shape));
+
+    matrix m = translation(float3(0, 0, 2));
+    const matrix minv = inverse(m);
+    ASSERT_NO_THROW(instance.shape->SetTransform(m, minv));
+
+    ASSERT_NO_THROW(api_->AttachShape(instance.shape));
+
+    ray r(float3(0.f, 0.f, -10.f), float3(0.f, 0.f, 1.f), 10000.f);
+
+    // Intersection and hit data
+    Intersection isect;
+
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    Intersection* tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results for 1st ray
+    Intersection isect_brute;
+    TestIntersections(shapes.data(), (int)shapes.size(), &r, 1, &isect_brute);
+    // check the test gets the mesh we expect
+    EXPECT_EQ(isect_brute.shapeid, mesh0.shape->GetId());
+    // does the accelerated radeon rays match the test
+    EXPECT_EQ(isect.shapeid, isect_brute.shapeid);
+    EXPECT_LE(std::fabs(isect.uvwt.w - 10.f), 0.01f);
+
+    // Bail out
+    ASSERT_NO_THROW(api_->DetachShape(instance.shape));
+    ASSERT_NO_THROW(api_->DetachShape(mesh0.shape));
+    ASSERT_NO_THROW(api_->DetachShape(mesh1.shape));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+
+}
+TEST_F(ApiBackendCpu, Intersection_1Ray_TransformedInstance2)
+{
+    // this test uses a single mesh, it added into the world as itself
+    // at <0,-1,1000> AND as an instance at <0,0,-2>
+    // ray from <0,0,-10> along the pos z should hit the instanced mesh
+
+    std::vector<TestShape> shapes = { TestShape(vertices(), 3, indices(), 3, numfaceverts(), 1),
+        TestShape(vertices(), 3, indices(), 3, numfaceverts(), 1),
+        TestShape(vertices(), 3, indices(), 3, numfaceverts(), 1) };
+    TestShape& mesh0 = shapes[0];
+    TestShape& mesh1 = shapes[1];
+    TestShape& instance = shapes[2];
+
+    // Create meshes
+    // NOTE mesh in world and as a instance upsets the simple TestIntersection API call 
+    ASSERT_NO_THROW(mesh0.shape = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+    ASSERT_TRUE(mesh0.shape != nullptr);
+    ASSERT_NO_THROW(mesh1.shape = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+    ASSERT_TRUE(mesh1.shape != nullptr);
+
+    // Attach the mesh to the scene
+    ASSERT_NO_THROW(api_->AttachShape(mesh0.shape));
+    // Create instance of a triangle
+    ASSERT_NO_THROW(instance.shape = api_->CreateInstance(mesh1.shape));
+
+    //
+    const matrix m = translation(float3(0, 0, -2));
+    const matrix minv = inverse(m);
+    ASSERT_NO_THROW(instance.shape->SetTransform(m, minv));
+
+    // Prepare the ray
+    ray r(float3(0.f, 0.f, -10.f), float3(0.f, 0.f, 1.f), 10000.f);
+
+
+    // Commit geometry update
+    EXPECT_NO_THROW(api_->Commit());
+
+    ASSERT_NO_THROW(api_->AttachShape(instance.shape));
+
+    // Intersection and hit data
+    Intersection isect;
+
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    Intersection* tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results for 1st ray
+    Intersection isect_brute;
+    TestIntersections(shapes.data(), (int)shapes.size(), &r, 1, &isect_brute);
+    // check the test gets the mesh we expect
+    EXPECT_EQ(isect_brute.shapeid, instance.shape->GetId());
+    // does the accelerated radeon rays match the test
+    EXPECT_EQ(isect.shapeid, isect_brute.shapeid);
+    EXPECT_LE(std::fabs(isect.uvwt.w - 8.f), 0.01f);
+
+    // Bail out
+    ASSERT_NO_THROW(api_->DetachShape(instance.shape));
+    ASSERT_NO_THROW(api_->DetachShape(mesh0.shape));
+    ASSERT_NO_THROW(api_->DetachShape(mesh1.shape));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
+
+TEST_F(ApiBackendCpu, Intersection_1Ray_TransformedInstanceFlat)
+{
+
+    // Set flattening
+    api_->SetOption("bvh.forceflat", 1.f);
+
+    Shape* mesh = nullptr;
+
+    // Create mesh
+    ASSERT_NO_THROW(mesh = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+
+    ASSERT_TRUE(mesh != nullptr);
+
+    // Attach the mesh to the scene
+    ASSERT_NO_THROW(api_->AttachShape(mesh));
+
+    // Prepare the ray
+    ray r;
+    r.o = float3(0.f, 0.f, -10.f, 1000.f);
+    r.d = float3(0.f, 0.f, 1.f);
+
+    // Intersection and hit data
+    Intersection isect;
+
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+    // Create instance of a triangle
+    Shape* instance = nullptr;
+    ASSERT_NO_THROW(instance = api_->CreateInstance(mesh));
+
+    matrix m = translation(float3(0, 0, -2));
+    matrix minv = inverse(m);
+    ASSERT_NO_THROW(instance->SetTransform(m, minv));
+
+    ASSERT_NO_THROW(api_->AttachShape(instance));
+
+    // Prepare the ray
+    r.o = float3(0.f, 0.f, -10.f, 1000.f);
+    r.d = float3(0.f, 0.f, 1.f);
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    Intersection* tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, instance->GetId());
+    ASSERT_LE(std::fabs(isect.uvwt.w - 8.f), 0.01f);
+
+    //
+    m = translation(float3(0, 0, 2));
+    minv = inverse(m);
+    ASSERT_NO_THROW(instance->SetTransform(m, minv));
+
+    // Prepare the ray
+    r.o = float3(0.f, 0.f, -10.f, 1000.f);
+    r.d = float3(0.f, 0.f, 1.f);
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, mesh->GetId());
+    ASSERT_LE(std::fabs(isect.uvwt.w - 10.f), 0.01f);
+
+    // Bail out
+    ASSERT_NO_THROW(api_->DetachShape(instance));
+    ASSERT_NO_THROW(api_->DetachShape(mesh));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
+// Test is checking if mesh transform is working as expected
+// DK: #22 repro case : Commit throws if base shape has not been attached
+TEST_F(ApiBackendCpu, Intersection_1Ray_InstanceNoShape)
+{
+    Shape* mesh = nullptr;
+
+    // Create mesh
+    ASSERT_NO_THROW(mesh = api_->CreateMesh(vertices(), 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+
+    ASSERT_TRUE(mesh != nullptr);
+
+    // Attach the mesh to the scene
+    //ASSERT_NO_THROW(api_->AttachShape(mesh));
+
+    // Prepare the ray
+    ray r;
+    r.o = float3(0.f, 0.f, -10.f, 1000.f);
+    r.d = float3(0.f, 0.f, 1.f);
+
+    // Intersection and hit data
+    Intersection isect;
+
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+    // Create instance of a triangle
+    Shape* instance = nullptr;
+    ASSERT_NO_THROW(instance = api_->CreateInstance(mesh));
+
+    matrix m = translation(float3(0, 0, 2));
+    matrix minv = inverse(m);
+    ASSERT_NO_THROW(instance->SetTransform(m, minv));
+
+    ASSERT_NO_THROW(api_->AttachShape(instance));
+
+    // Prepare the ray
+    r.o = float3(0.f, 0.f, -10.f, 1000.f);
+    r.d = float3(0.f, 0.f, 1.f);
+
+    // Commit geometry update
+    ASSERT_NO_THROW(api_->Commit());
+
+    // Intersect
+    ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+    Intersection* tmp = nullptr;
+    ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+    Wait();
+    isect = *tmp;
+    ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+    Wait();
+
+    // Check results
+    ASSERT_EQ(isect.shapeid, instance->GetId());
+    ASSERT_LE(std::fabs(isect.uvwt.w - 12.f), 0.01f);
+
+    // Bail out
+    ASSERT_NO_THROW(api_->DetachShape(instance));
+    ASSERT_NO_THROW(api_->DetachShape(mesh));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
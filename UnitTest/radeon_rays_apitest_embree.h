@@ -718,6 +718,69 @@ TEST_F(ApiBackendEmbree, Intersection_1Ray_DynamicGeo)
     ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
 }
 
+TEST_F(ApiBackendEmbree, Intersection_1Ray_ReattachMesh)
+{
+    // Mesh vertices
+    float const vertices[] = {
+        -1.f,-1.f,0.f,
+        1.f,-1.f,0.f,
+        0.f,1.f,0.f,
+
+    };
+
+    Shape* mesh = nullptr;
+    Shape* instance = nullptr;
+
+    ASSERT_NO_THROW(mesh = api_->CreateMesh(vertices, 3, 3 * sizeof(float), indices(), 0, numfaceverts(), 1));
+    ASSERT_NO_THROW(instance = api_->CreateInstance(mesh));
+    ASSERT_NO_THROW(api_->AttachShape(mesh));
+
+    ray r;
+    r.o = float4(0.f, 0.f, -10.f, 1000.f);
+    r.d = float3(0.f, 0.f, 1.f);
+
+    Intersection isect;
+    auto ray_buffer = api_->CreateBuffer(sizeof(ray), &r);
+    auto isect_buffer = api_->CreateBuffer(sizeof(Intersection), nullptr);
+
+    auto query = [&]()
+    {
+        ASSERT_NO_THROW(api_->Commit());
+        ASSERT_NO_THROW(api_->QueryIntersection(ray_buffer, 1, isect_buffer, nullptr, nullptr));
+
+        Intersection* tmp = nullptr;
+        ASSERT_NO_THROW(api_->MapBuffer(isect_buffer, kMapRead, 0, sizeof(Intersection), (void**)&tmp, &e_));
+        Wait();
+        isect = *tmp;
+        ASSERT_NO_THROW(api_->UnmapBuffer(isect_buffer, tmp, &e_));
+        Wait();
+    };
+
+    query();
+    ASSERT_EQ(isect.shapeid, mesh->GetId());
+
+    // The mesh scene is kept while nothing references it
+    ASSERT_NO_THROW(api_->DetachShape(mesh));
+    ASSERT_NO_THROW(api_->AttachShape(instance));
+    query();
+    ASSERT_EQ(isect.shapeid, instance->GetId());
+
+    // A mesh used by an attached instance can't be deleted, the refused deletion changes nothing
+    ASSERT_NO_THROW(api_->AttachShape(mesh));
+    query();
+    ASSERT_ANY_THROW(api_->DeleteShape(mesh));
+    ASSERT_NO_THROW(api_->DetachShape(instance));
+    query();
+    ASSERT_EQ(isect.shapeid, mesh->GetId());
+
+    // Deleting a detached mesh releases its scene
+    ASSERT_NO_THROW(api_->DetachShape(mesh));
+    ASSERT_NO_THROW(api_->DeleteShape(instance));
+    ASSERT_NO_THROW(api_->DeleteShape(mesh));
+    ASSERT_NO_THROW(api_->DeleteBuffer(ray_buffer));
+    ASSERT_NO_THROW(api_->DeleteBuffer(isect_buffer));
+}
+
 TEST_F(ApiBackendEmbree, CornellBoxLoad)
 {
     using namespace tinyobj;
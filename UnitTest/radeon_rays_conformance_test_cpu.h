@@ -0,0 +1,964 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+/// This test suite is testing RadeonRays native CPU results to conform to brute force
+///
+
+#include "gtest/gtest.h"
+#include "radeon_rays.h"
+
+using namespace RadeonRays;
+using namespace tinyobj;
+
+#include "tiny_obj_loader.h"
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// Api creation fixture, prepares api_ for further tests
+class ApiConformanceCpu : public ::testing::Test
+{
+public:
+    static const int kMaxRaysTests = 10000;
+
+    void SetUp() override;
+    void TearDown() override;
+
+    void Wait(IntersectionApi* api)
+    {
+        e_->Wait();
+        api->DeleteEvent(e_);
+    }
+
+    void ExpectClosestIntersectionOk(const Intersection& expected, const Intersection& test) const;
+
+    template< int kNumRays> void ExpectClosestRaysOk(RadeonRays::IntersectionApi* api) const;
+
+    template< int kNumRays> void ExpectAnyRaysOk(RadeonRays::IntersectionApi* api) const;
+
+    // GPU api
+    IntersectionApi* apigpu_;
+
+    std::vector<Shape*> apishapes_gpu_;
+    std::vector<TestShape> test_shapes_;
+
+    Event* e_;
+
+    // Tinyobj data
+    std::vector<shape_t> shapes_;
+    std::vector<material_t> materials_;
+
+};
+
+inline void ApiConformanceCpu::SetUp()
+{
+    apigpu_ = nullptr;
+
+    // TODO make conformance tests across multiple backends and devices
+    IntersectionApi::SetPlatform(DeviceInfo::kNative);
+
+    //Search for native CPU
+    int cpuidx = -1;
+    for (auto idx = 0U; idx < IntersectionApi::GetDeviceCount(); ++idx)
+    {
+        DeviceInfo devinfo;
+        IntersectionApi::GetDeviceInfo(idx, devinfo);
+
+        if (devinfo.type == DeviceInfo::kCpu && cpuidx == -1)
+        {
+            cpuidx = idx;
+        }
+    }
+
+    EXPECT_NE(cpuidx, -1);
+
+    apigpu_ = IntersectionApi::Create(cpuidx);
+    EXPECT_NE(apigpu_, nullptr);
+
+    // Load obj file 
+    std::string res = LoadObj(shapes_, materials_, "../Resources/CornellBox/orig.objm");
+
+    // Create meshes within IntersectionApi
+    for (int i = 0; i<(int)shapes_.size(); ++i)
+    {
+        Shape* shape = nullptr;
+
+        EXPECT_NO_THROW(shape = apigpu_->CreateMesh(&shapes_[i].mesh.positions[0], (int)shapes_[i].mesh.positions.size() / 3, 3 * sizeof(float),
+            &shapes_[i].mesh.indices[0], 0, nullptr, (int)shapes_[i].mesh.indices.size() / 3));
+
+        EXPECT_NO_THROW(apigpu_->AttachShape(shape));
+        
+        test_shapes_.push_back({ &shapes_[i].mesh.positions[0], (int)shapes_[i].mesh.positions.size() / 3,
+            &shapes_[i].mesh.indices[0], (int)shapes_[i].mesh.indices.size(), nullptr, (int)shapes_[i].mesh.indices.size() / 3 });
+        test_shapes_.back().shape = shape;
+
+        apishapes_gpu_.push_back(shape);
+    }
+
+    apigpu_->SetOption("acc.type", "bvh");
+    apigpu_->SetOption("bvh.builder", "sah");
+
+    srand(0xABCDEF12);
+
+}
+
+inline void ApiConformanceCpu::TearDown()
+{
+    // TearDown needs to be safe for no OpenCL cpu or GPU hence
+    // all the if( apiXpu_)
+
+    // Commit update
+    if (apigpu_) { EXPECT_NO_THROW(apigpu_->Commit()); }
+
+    // Delete meshes
+    for (int i = 0; i<(int)apishapes_gpu_.size(); ++i)
+    {
+        if (apigpu_) { EXPECT_NO_THROW(apigpu_->DeleteShape(apishapes_gpu_[i])); }
+    }
+
+    if (apigpu_) { IntersectionApi::Delete(apigpu_); }
+}
+
+/*
+BEGIN GPU TESTS
+*/
+TEST_F(ApiConformanceCpu, CornellBox_1RandomRay_ClosestHit_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+
+    ExpectClosestRaysOk<1>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_100RayRandom_ClosestHit_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+
+    ExpectClosestRaysOk<100>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_1000RaysRandom_ClosestHit_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+
+    ExpectClosestRaysOk<1000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_ClosestHit_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+
+    ExpectClosestRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10RaysRandom_ClosestHit_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+
+    ExpectClosestRaysOk<10>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_ClosestHit_Force2level_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 1.f);
+
+    ExpectClosestRaysOk<10000>(api);
+
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_1000RandomRays_ClosestHit_Bruteforce_FatBvh)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "fatbvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+
+    ExpectClosestRaysOk<1000>(api);
+
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_ClosestHit_MaxLeafSize_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+    api->SetOption("bvh.max_leaf_size", 4.f);
+
+    ExpectClosestRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_ClosestHit_MaxLeafSize_Median_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "median");
+    api->SetOption("bvh.force2level", 0.f);
+    api->SetOption("bvh.max_leaf_size", 8.f);
+
+    ExpectClosestRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_AnyHit_MaxLeafSize_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+    api->SetOption("bvh.max_leaf_size", 4.f);
+
+    ExpectAnyRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_ClosestHit_Optimize_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "median");
+    api->SetOption("bvh.force2level", 0.f);
+    api->SetOption("bvh.max_leaf_size", 4.f);
+    api->SetOption("bvh.optimize", 3.f);
+
+    ExpectClosestRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_AnyHit_Optimize_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+    api->SetOption("bvh.optimize", 3.f);
+
+    ExpectAnyRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_ClosestHit_Width2_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+    api->SetOption("bvh.width", 2.f);
+
+    ExpectClosestRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_AnyHit_Width2_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+    api->SetOption("bvh.width", 2.f);
+
+    ExpectAnyRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_ClosestHit_Width8_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+    api->SetOption("bvh.max_leaf_size", 4.f);
+    api->SetOption("bvh.width", 8.f);
+
+    ExpectClosestRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_AnyHit_Width8_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "median");
+    api->SetOption("bvh.force2level", 0.f);
+    api->SetOption("bvh.width", 8.f);
+
+    ExpectAnyRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceCpu, DISABLED_CornellBox_1000Rays_Brutforce_HlBvh)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "hlbvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+
+    ExpectClosestRaysOk<1000>(api);
+
+}
+
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_ClosestHit_ExternalMemory_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+
+    // Replace the scene with meshes referencing the loaded data in place
+    EXPECT_NO_THROW(api->DetachAll());
+    for (int i = 0; i < (int)shapes_.size(); ++i)
+    {
+        Shape* shape = nullptr;
+        EXPECT_NO_THROW(shape = api->CreateMeshFromExternalMemory(&shapes_[i].mesh.positions[0], (int)shapes_[i].mesh.positions.size() / 3, 3 * sizeof(float),
+            &shapes_[i].mesh.indices[0], 0, (int)shapes_[i].mesh.indices.size() / 3));
+        EXPECT_NO_THROW(api->AttachShape(shape));
+
+        test_shapes_[i].shape = shape;
+        apishapes_gpu_.push_back(shape);
+    }
+
+    ExpectClosestRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_ClosestHit_BvhCache_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+    api->SetOption("bvh.max_leaf_size", 4.f);
+
+#ifdef WIN32
+    char const* tmp = std::getenv("TEMP");
+#else
+    char const* tmp = std::getenv("TMPDIR");
+#endif
+    std::string cache_path = tmp ? tmp : ".";
+#ifndef WIN32
+    if (!tmp)
+    {
+        cache_path = "/tmp";
+    }
+#endif
+    api->SetOption("bvh.cache_path", cache_path.c_str());
+
+    float const widths[] = { 2.f, 4.f, 8.f };
+    for (auto width : widths)
+    {
+        api->SetOption("bvh.width", width);
+
+        // Either builds the scene and writes it to the cache or loads an earlier entry
+        for (auto shape : apishapes_gpu_)
+        {
+            shape->SetTransform(matrix(), matrix());
+        }
+        ExpectClosestRaysOk<10000>(api);
+
+        // Same geometry and options, loaded from the cache
+        for (auto shape : apishapes_gpu_)
+        {
+            shape->SetTransform(matrix(), matrix());
+        }
+        ExpectClosestRaysOk<10000>(api);
+
+        // A valid entry is used, not rebuilt
+        BvhStatistics stats;
+        EXPECT_NO_THROW(api->GetBvhStatistics(stats));
+        EXPECT_TRUE(stats.cached);
+    }
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_1RandomRays_AnyHit_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+
+    ExpectAnyRaysOk<1>(api);
+}
+TEST_F(ApiConformanceCpu, CornellBox_100RandomRays_AnyHit_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+
+    ExpectAnyRaysOk<100>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_1000RandomRays_AnyHit_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+
+    ExpectAnyRaysOk<1000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RandomRays_AnyHit_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("acc.type", "bvh");
+    api->SetOption("bvh.builder", "sah");
+    api->SetOption("bvh.force2level", 0.f);
+
+    ExpectAnyRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_ClosestHit_Events_Bruteforce)
+{
+    int const kNumRays = 10000;
+
+    // Make sure the ray is not on BB boundary
+    // in this case results may differ due to 
+    // different NaNs propagation in BB test
+    // TODO: fix this
+    Intersection isect_brute[kNumRays];
+    ray r_brute[kNumRays];
+
+    // generate some random vectors
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        r_brute[i].o = float3(rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, 1000.f);
+        r_brute[i].d = normalize(float3(rand_float(), rand_float(), rand_float()));
+    }
+
+    EXPECT_NO_THROW(apigpu_->Commit());
+
+    TestIntersections(test_shapes_.data(), (int)test_shapes_.size(), r_brute, kNumRays, isect_brute);
+
+    auto ray_buffer_gpu = apigpu_->CreateBuffer(kNumRays * sizeof(ray), nullptr);
+    auto isect_buffer_gpu = apigpu_->CreateBuffer(kNumRays * sizeof(Intersection), nullptr);
+
+    ray* r_gpu = nullptr;
+
+    Event* egpu;
+    EXPECT_NO_THROW(apigpu_->MapBuffer(ray_buffer_gpu, kMapWrite, 0, kNumRays * sizeof(ray), (void**)&r_gpu, &egpu));
+    egpu->Wait(); apigpu_->DeleteEvent(egpu);
+
+    for (int i = 0; i<kNumRays; ++i)
+    {
+        r_gpu[i].o = r_brute[i].o;
+        r_gpu[i].d = r_brute[i].d;
+        r_gpu[i].SetActive(true);
+        r_gpu[i].SetMask(0xFFFFFFFF);
+    }
+
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(ray_buffer_gpu, r_gpu, &egpu));
+    egpu->Wait(); apigpu_->DeleteEvent(egpu);
+
+    // Intersect
+    Event* gpu_event = nullptr;
+    EXPECT_NO_THROW(apigpu_->QueryIntersection(ray_buffer_gpu, kNumRays, isect_buffer_gpu, nullptr, &gpu_event));
+
+    EXPECT_NE(gpu_event, nullptr);
+
+    EXPECT_NO_THROW(gpu_event->Complete());
+    EXPECT_NO_THROW(gpu_event->Wait());
+
+    Intersection* isect_gpu = nullptr;
+
+    EXPECT_NO_THROW(apigpu_->MapBuffer(isect_buffer_gpu, kMapRead, 0, kNumRays * sizeof(Intersection), (void**)&isect_gpu, &egpu));
+    egpu->Wait(); apigpu_->DeleteEvent(egpu);
+
+    for (int i = 0; i<kNumRays; ++i)
+    {
+        ExpectClosestIntersectionOk(isect_brute[i] , isect_gpu[i]);
+    }
+
+
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(isect_buffer_gpu, isect_gpu, &egpu));
+    egpu->Wait(); apigpu_->DeleteEvent(egpu);
+
+    EXPECT_NO_THROW(apigpu_->DeleteEvent(gpu_event));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(ray_buffer_gpu));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(isect_buffer_gpu));
+}
+
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_ChainedEvents_Bruteforce)
+{
+    int const kNumRays = 10000;
+
+    std::vector<Intersection> isect_brute(kNumRays);
+    std::vector<ray> r_brute(kNumRays);
+
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        r_brute[i].o = float3(rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, 1000.f);
+        r_brute[i].d = normalize(float3(rand_float(), rand_float(), rand_float()));
+        r_brute[i].SetActive(true);
+        r_brute[i].SetMask(0xFFFFFFFF);
+    }
+
+    EXPECT_NO_THROW(apigpu_->Commit());
+
+    TestIntersections(test_shapes_.data(), (int)test_shapes_.size(), r_brute.data(), kNumRays, isect_brute.data());
+
+    auto ray_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(ray), r_brute.data());
+    auto isect_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(Intersection), nullptr);
+    auto occl_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(int), nullptr);
+
+    // Both queries are queued without waiting, the second one depends on the first
+    Event* isect_event = nullptr;
+    Event* occl_event = nullptr;
+    EXPECT_NO_THROW(apigpu_->QueryIntersection(ray_buffer, kNumRays, isect_buffer, nullptr, &isect_event));
+    EXPECT_NO_THROW(apigpu_->QueryOcclusion(ray_buffer, kNumRays, occl_buffer, isect_event, &occl_event));
+
+    // Deleting an event with pending dependents is legal
+    EXPECT_NO_THROW(apigpu_->DeleteEvent(isect_event));
+    EXPECT_NO_THROW(occl_event->Wait());
+    EXPECT_TRUE(occl_event->Complete());
+
+    Intersection* isect = nullptr;
+    int* occl = nullptr;
+    EXPECT_NO_THROW(apigpu_->MapBuffer(isect_buffer, kMapRead, 0, kNumRays * sizeof(Intersection), (void**)&isect, nullptr));
+    EXPECT_NO_THROW(apigpu_->MapBuffer(occl_buffer, kMapRead, 0, kNumRays * sizeof(int), (void**)&occl, nullptr));
+
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        ExpectClosestIntersectionOk(isect_brute[i], isect[i]);
+        EXPECT_EQ(occl[i] > 0, isect_brute[i].shapeid != kNullId);
+    }
+
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(isect_buffer, isect, nullptr));
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(occl_buffer, occl, nullptr));
+
+    EXPECT_NO_THROW(apigpu_->DeleteEvent(occl_event));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(ray_buffer));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(isect_buffer));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(occl_buffer));
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_SoA_Bruteforce)
+{
+    int const kNumRays = 10000;
+
+    std::vector<Intersection> isect_brute(kNumRays);
+    std::vector<ray> r_brute(kNumRays);
+    // ox, oy, oz, dx, dy, dz, maxt
+    std::vector<float> soa[7];
+    std::vector<int> mask(kNumRays);
+    for (auto& a : soa)
+        a.resize(kNumRays);
+
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        r_brute[i].o = float3(rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, 1000.f);
+        r_brute[i].d = normalize(float3(rand_float(), rand_float(), rand_float()));
+        r_brute[i].SetActive(true);
+        r_brute[i].SetMask(0xFFFFFFFF);
+
+        for (int j = 0; j < 3; ++j)
+        {
+            soa[j][i] = r_brute[i].o[j];
+            soa[3 + j][i] = r_brute[i].d[j];
+        }
+        soa[6][i] = r_brute[i].o.w;
+        // Every 7th ray is masked out and should miss
+        mask[i] = (i % 7) ? -1 : 0;
+    }
+
+    EXPECT_NO_THROW(apigpu_->Commit());
+
+    TestIntersections(test_shapes_.data(), (int)test_shapes_.size(), r_brute.data(), kNumRays, isect_brute.data());
+
+    Buffer* soa_buffers[7];
+    for (int j = 0; j < 7; ++j)
+        soa_buffers[j] = apigpu_->CreateBuffer(kNumRays * sizeof(float), soa[j].data());
+    auto mask_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(int), mask.data());
+    auto isect_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(Intersection), nullptr);
+    auto occl_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(int), nullptr);
+
+    RayBufferSoA rays = { soa_buffers[0], soa_buffers[1], soa_buffers[2], soa_buffers[3], soa_buffers[4], soa_buffers[5], soa_buffers[6], mask_buffer };
+
+    Event* e = nullptr;
+    EXPECT_NO_THROW(apigpu_->QueryIntersection(rays, kNumRays, isect_buffer, nullptr, nullptr));
+    EXPECT_NO_THROW(apigpu_->QueryOcclusion(rays, kNumRays, occl_buffer, nullptr, &e));
+    EXPECT_NO_THROW(e->Wait());
+    EXPECT_NO_THROW(apigpu_->DeleteEvent(e));
+
+    Intersection* isect = nullptr;
+    int* occl = nullptr;
+    EXPECT_NO_THROW(apigpu_->MapBuffer(isect_buffer, kMapRead, 0, kNumRays * sizeof(Intersection), (void**)&isect, nullptr));
+    EXPECT_NO_THROW(apigpu_->MapBuffer(occl_buffer, kMapRead, 0, kNumRays * sizeof(int), (void**)&occl, nullptr));
+
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        if (mask[i])
+        {
+            ExpectClosestIntersectionOk(isect_brute[i], isect[i]);
+            EXPECT_EQ(occl[i] > 0, isect_brute[i].shapeid != kNullId);
+        }
+        else
+        {
+            EXPECT_EQ(isect[i].shapeid, kNullId);
+            EXPECT_FALSE(occl[i] > 0);
+        }
+    }
+
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(isect_buffer, isect, nullptr));
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(occl_buffer, occl, nullptr));
+
+    for (int j = 0; j < 7; ++j)
+        EXPECT_NO_THROW(apigpu_->DeleteBuffer(soa_buffers[j]));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(mask_buffer));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(isect_buffer));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(occl_buffer));
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_CommitAsync_Bruteforce)
+{
+    int const kNumRays = 10000;
+
+    std::vector<Intersection> isect_brute(kNumRays);
+    std::vector<ray> r_brute(kNumRays);
+
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        r_brute[i].o = float3(rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, 1000.f);
+        r_brute[i].d = normalize(float3(rand_float(), rand_float(), rand_float()));
+        r_brute[i].SetActive(true);
+        r_brute[i].SetMask(0xFFFFFFFF);
+    }
+
+    TestIntersections(test_shapes_.data(), (int)test_shapes_.size(), r_brute.data(), kNumRays, isect_brute.data());
+
+    auto ray_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(ray), r_brute.data());
+    auto isect_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(Intersection), nullptr);
+    auto isect_buffer_async = apigpu_->CreateBuffer(kNumRays * sizeof(Intersection), nullptr);
+
+    // The first commit is waited for by the query
+    Event* commit_event = nullptr;
+    Event* e = nullptr;
+    EXPECT_NO_THROW(apigpu_->CommitAsync(&commit_event));
+    EXPECT_NO_THROW(apigpu_->QueryIntersection(ray_buffer, kNumRays, isect_buffer, commit_event, &e));
+    EXPECT_NO_THROW(e->Wait());
+    EXPECT_NO_THROW(apigpu_->DeleteEvent(e));
+    EXPECT_NO_THROW(apigpu_->DeleteEvent(commit_event));
+
+    Intersection* isect = nullptr;
+    EXPECT_NO_THROW(apigpu_->MapBuffer(isect_buffer, kMapRead, 0, kNumRays * sizeof(Intersection), (void**)&isect, nullptr));
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        ExpectClosestIntersectionOk(isect_brute[i], isect[i]);
+    }
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(isect_buffer, isect, nullptr));
+
+    // Move everything out of the way of the rays and commit again. A query racing
+    // with the build sees either the old or the new scene, never a mix of both.
+    matrix m = translation(float3(0.f, -100.f, 0.f));
+    for (auto shape : apishapes_gpu_)
+    {
+        shape->SetTransform(m, inverse(m));
+    }
+
+    EXPECT_NO_THROW(apigpu_->CommitAsync(&commit_event));
+    EXPECT_NO_THROW(apigpu_->QueryIntersection(ray_buffer, kNumRays, isect_buffer_async, nullptr, &e));
+    EXPECT_NO_THROW(apigpu_->QueryIntersection(ray_buffer, kNumRays, isect_buffer, commit_event, nullptr));
+    EXPECT_NO_THROW(e->Wait());
+    EXPECT_NO_THROW(apigpu_->DeleteEvent(e));
+    EXPECT_NO_THROW(commit_event->Wait());
+    EXPECT_TRUE(commit_event->Complete());
+    EXPECT_NO_THROW(apigpu_->DeleteEvent(commit_event));
+
+    Intersection* isect_async = nullptr;
+    EXPECT_NO_THROW(apigpu_->MapBuffer(isect_buffer, kMapRead, 0, kNumRays * sizeof(Intersection), (void**)&isect, nullptr));
+    EXPECT_NO_THROW(apigpu_->MapBuffer(isect_buffer_async, kMapRead, 0, kNumRays * sizeof(Intersection), (void**)&isect_async, nullptr));
+
+    bool old_scene = false;
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        ASSERT_EQ(isect[i].shapeid, kNullId);
+        old_scene |= isect_async[i].shapeid != kNullId;
+    }
+
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        if (old_scene)
+        {
+            ExpectClosestIntersectionOk(isect_brute[i], isect_async[i]);
+        }
+        else
+        {
+            ASSERT_EQ(isect_async[i].shapeid, kNullId);
+        }
+    }
+
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(isect_buffer, isect, nullptr));
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(isect_buffer_async, isect_async, nullptr));
+
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(ray_buffer));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(isect_buffer));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(isect_buffer_async));
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_CommitAfterCommitAsync)
+{
+    int const kNumRays = 10000;
+
+    std::vector<ray> r(kNumRays);
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        r[i].o = float3(rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, 1000.f);
+        r[i].d = normalize(float3(rand_float(), rand_float(), rand_float()));
+        r[i].SetActive(true);
+        r[i].SetMask(0xFFFFFFFF);
+    }
+
+    EXPECT_NO_THROW(apigpu_->Commit());
+
+    matrix m = translation(float3(0.f, -100.f, 0.f));
+    for (auto shape : apishapes_gpu_)
+    {
+        shape->SetTransform(m, inverse(m));
+    }
+
+    // Commit without changes still waits for the build started by CommitAsync
+    Event* commit_event = nullptr;
+    EXPECT_NO_THROW(apigpu_->CommitAsync(&commit_event));
+    EXPECT_NO_THROW(apigpu_->Commit());
+    EXPECT_TRUE(commit_event->Complete());
+
+    auto ray_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(ray), r.data());
+    auto isect_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(Intersection), nullptr);
+    EXPECT_NO_THROW(apigpu_->QueryIntersection(ray_buffer, kNumRays, isect_buffer, nullptr, nullptr));
+
+    Intersection* isect = nullptr;
+    EXPECT_NO_THROW(apigpu_->MapBuffer(isect_buffer, kMapRead, 0, kNumRays * sizeof(Intersection), (void**)&isect, nullptr));
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        ASSERT_EQ(isect[i].shapeid, kNullId);
+    }
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(isect_buffer, isect, nullptr));
+
+    EXPECT_NO_THROW(apigpu_->DeleteEvent(commit_event));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(ray_buffer));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(isect_buffer));
+}
+
+TEST_F(ApiConformanceCpu, CornellBox_10000RaysRandom_CommitAsync_ChangeWhileBuilding_Bruteforce)
+{
+    int const kNumRays = 10000;
+
+    std::vector<Intersection> isect_brute(kNumRays);
+    std::vector<ray> r_brute(kNumRays);
+
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        r_brute[i].o = float3(rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, 1000.f);
+        r_brute[i].d = normalize(float3(rand_float(), rand_float(), rand_float()));
+        r_brute[i].SetActive(true);
+        r_brute[i].SetMask(0xFFFFFFFF);
+    }
+
+    TestIntersections(test_shapes_.data(), (int)test_shapes_.size(), r_brute.data(), kNumRays, isect_brute.data());
+
+    // Extra copy of a mesh out of the way of the rays, deleted during the build
+    Shape* extra = nullptr;
+    EXPECT_NO_THROW(extra = apigpu_->CreateMesh(&shapes_[0].mesh.positions[0], (int)shapes_[0].mesh.positions.size() / 3, 3 * sizeof(float),
+        &shapes_[0].mesh.indices[0], 0, nullptr, (int)shapes_[0].mesh.indices.size() / 3));
+    matrix away = translation(float3(0.f, -100.f, 0.f));
+    extra->SetTransform(away, inverse(away));
+    EXPECT_NO_THROW(apigpu_->AttachShape(extra));
+
+    // The build uses the state at the time of the call
+    Event* commit_event = nullptr;
+    EXPECT_NO_THROW(apigpu_->CommitAsync(&commit_event));
+    EXPECT_NO_THROW(apigpu_->DeleteShape(extra));
+    for (auto shape : apishapes_gpu_)
+    {
+        shape->SetTransform(away, inverse(away));
+        shape->SetMask(0);
+    }
+    EXPECT_NO_THROW(commit_event->Wait());
+    EXPECT_NO_THROW(apigpu_->DeleteEvent(commit_event));
+
+    auto ray_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(ray), r_brute.data());
+    auto isect_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(Intersection), nullptr);
+    EXPECT_NO_THROW(apigpu_->QueryIntersection(ray_buffer, kNumRays, isect_buffer, nullptr, nullptr));
+
+    Intersection* isect = nullptr;
+    EXPECT_NO_THROW(apigpu_->MapBuffer(isect_buffer, kMapRead, 0, kNumRays * sizeof(Intersection), (void**)&isect, nullptr));
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        ExpectClosestIntersectionOk(isect_brute[i], isect[i]);
+    }
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(isect_buffer, isect, nullptr));
+
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(ray_buffer));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(isect_buffer));
+}
+
+inline void ApiConformanceCpu::ExpectClosestIntersectionOk(const Intersection& expected, const Intersection& test) const
+{
+    ASSERT_EQ(test.shapeid, expected.shapeid);
+
+    if (test.shapeid != kNullId)
+    {
+        // Check if the distance is the same
+        const double dist = (test.uvwt.w - expected.uvwt.w) * (test.uvwt.w - expected.uvwt.w);
+        ASSERT_NEAR(0, dist, 1e-5);
+    }
+}
+
+template<int kNumRays>
+inline void ApiConformanceCpu::ExpectClosestRaysOk(RadeonRays::IntersectionApi* api)const
+{
+    // Make sure the ray is not on BB boundary
+    // in this case results may differ due to 
+    // different NaNs propagation in BB test
+    // TODO: fix this
+    Intersection isect_brute[kNumRays];
+    ray r_brute[kNumRays];
+
+    // generate some random vectors
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        r_brute[i].o = float3(rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, 1000.f);
+        r_brute[i].d = normalize(float3(rand_float(), rand_float(), rand_float()));
+    }
+
+    EXPECT_NO_THROW(api->Commit());
+
+    // generate the golden test results
+    TestIntersections(test_shapes_.data(), (int)test_shapes_.size(), r_brute, kNumRays, isect_brute);
+
+    auto ray_buffer = api->CreateBuffer(kNumRays * sizeof(ray), nullptr);
+    auto isect_buffer = api->CreateBuffer(kNumRays * sizeof(Intersection), nullptr);
+
+    ray* rays = nullptr;
+    Event* ev;
+
+    EXPECT_NO_THROW(api->MapBuffer(ray_buffer, kMapWrite, 0, kNumRays * sizeof(ray), (void**)&rays, &ev));
+    ev->Wait(); api->DeleteEvent(ev);
+
+    for (auto i = 0; i<kNumRays; ++i)
+    {
+        rays[i].o = r_brute[i].o;
+        rays[i].d = r_brute[i].d;
+
+        rays[i].SetActive(true);
+        rays[i].SetMask(0xFFFFFFFF);
+    }
+
+    EXPECT_NO_THROW(api->UnmapBuffer(ray_buffer, rays, &ev));
+    ev->Wait(); api->DeleteEvent(ev);
+
+    // Intersect
+    EXPECT_NO_THROW(api->QueryIntersection(ray_buffer, kNumRays, isect_buffer, nullptr, nullptr));
+
+    Intersection* isect = nullptr;
+    EXPECT_NO_THROW(api->MapBuffer(isect_buffer, kMapRead, 0, kNumRays * sizeof(Intersection), (void**)&isect, &ev));
+    ev->Wait(); api->DeleteEvent(ev);
+
+    for (auto i = 0; i<kNumRays; ++i)
+    {
+        ExpectClosestIntersectionOk(isect_brute[i], isect[i]);
+    }
+
+    EXPECT_NO_THROW(api->UnmapBuffer(isect_buffer, isect, &ev));
+    ev->Wait(); api->DeleteEvent(ev);
+
+
+    EXPECT_NO_THROW(api->DeleteBuffer(ray_buffer));
+    EXPECT_NO_THROW(api->DeleteBuffer(isect_buffer));
+}
+
+template<int kNumRays>
+inline void ApiConformanceCpu::ExpectAnyRaysOk(RadeonRays::IntersectionApi* api) const
+{
+    // Make sure the ray is not on BB boundary
+    // in this case results may differ due to 
+    // different NaNs propagation in BB test
+    // TODO: fix this
+
+    bool any_brute[kNumRays];
+    ray r_brute[kNumRays];
+
+    // generate some random vectors
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        r_brute[i].o = float3(rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, 1000.f);
+        r_brute[i].d = normalize(float3(rand_float(), rand_float(), rand_float()));
+    }
+
+    EXPECT_NO_THROW(api->Commit());
+
+    // generate the golden test results
+    TestOcclusions(test_shapes_.data(), (int)test_shapes_.size(), r_brute, kNumRays, any_brute);
+
+    auto ray_buffer = api->CreateBuffer(kNumRays * sizeof(ray), nullptr);
+    auto result_buffer = api->CreateBuffer(kNumRays * sizeof(int), nullptr);
+
+    ray* rays = nullptr;
+    Event* ev;
+
+    EXPECT_NO_THROW(api->MapBuffer(ray_buffer, kMapWrite, 0, kNumRays * sizeof(ray), (void**)&rays, &ev));
+    ev->Wait(); api->DeleteEvent(ev);
+
+    for (auto i = 0; i<kNumRays; ++i)
+    {
+        rays[i].o = r_brute[i].o;
+        rays[i].d = r_brute[i].d;
+
+        rays[i].SetActive(true);
+        rays[i].SetMask(0xFFFFFFFF);
+    }
+
+    EXPECT_NO_THROW(api->UnmapBuffer(ray_buffer, rays, &ev));
+    ev->Wait(); api->DeleteEvent(ev);
+
+    // Intersect
+    EXPECT_NO_THROW(api->QueryOcclusion(ray_buffer, kNumRays, result_buffer, nullptr, nullptr));
+
+
+    int* results = nullptr;
+    EXPECT_NO_THROW(api->MapBuffer(result_buffer, kMapRead, 0, kNumRays * sizeof(int), (void**)&results, &ev));
+    ev->Wait(); api->DeleteEvent(ev);
+
+    for (auto i = 0; i<kNumRays; ++i)
+    {
+        ASSERT_EQ(any_brute[i], (results[i] > 0) ? true : false);
+    }
+
+    EXPECT_NO_THROW(api->UnmapBuffer(result_buffer, results, &ev));
+    ev->Wait(); api->DeleteEvent(ev);
+
+
+    EXPECT_NO_THROW(api->DeleteBuffer(ray_buffer));
+    EXPECT_NO_THROW(api->DeleteBuffer(result_buffer));
+}
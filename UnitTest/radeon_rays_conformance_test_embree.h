@@ -266,6 +266,39 @@ TEST_F(ApiConformanceEmbree, CornellBox_10000RandomRays_AnyHit_Bruteforce)
     ExpectAnyRaysOk<10000>(api);
 }
 
+TEST_F(ApiConformanceEmbree, CornellBox_10000RaysRandom_ClosestHit_PacketWidth4_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("embree.packet_width", 4.f);
+    api->SetOption("embree.task_size", 100.f);
+
+    ExpectClosestRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceEmbree, CornellBox_10000RandomRays_AnyHit_PacketWidth16_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("embree.packet_width", 16.f);
+
+    ExpectAnyRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceEmbree, CornellBox_10000RaysRandom_ClosestHit_Stream_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("embree.stream", 1.f);
+
+    ExpectClosestRaysOk<10000>(api);
+}
+
+TEST_F(ApiConformanceEmbree, CornellBox_10000RandomRays_AnyHit_Stream_Bruteforce)
+{
+    auto api = apigpu_;
+    api->SetOption("embree.stream", 1.f);
+
+    ExpectAnyRaysOk<10000>(api);
+}
+
 TEST_F(ApiConformanceEmbree, CornellBox_10000RaysRandom_ClosestHit_Events_Bruteforce)
 {
     int const kNumRays = 10000;
@@ -337,6 +370,62 @@ TEST_F(ApiConformanceEmbree, CornellBox_10000RaysRandom_ClosestHit_Events_Brutef
 }
 
 
+TEST_F(ApiConformanceEmbree, CornellBox_10000RaysRandom_ChainedEvents_Bruteforce)
+{
+    int const kNumRays = 10000;
+
+    std::vector<Intersection> isect_brute(kNumRays);
+    std::vector<ray> r_brute(kNumRays);
+
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        r_brute[i].o = float3(rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, rand_float() * 3.f - 1.5f, 1000.f);
+        r_brute[i].d = normalize(float3(rand_float(), rand_float(), rand_float()));
+        r_brute[i].SetActive(true);
+        r_brute[i].SetMask(0xFFFFFFFF);
+    }
+
+    EXPECT_NO_THROW(apigpu_->Commit());
+
+    TestIntersections(test_shapes_.data(), (int)test_shapes_.size(), r_brute.data(), kNumRays, isect_brute.data());
+
+    int numrays = kNumRays;
+    auto ray_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(ray), r_brute.data());
+    auto count_buffer = apigpu_->CreateBuffer(sizeof(int), &numrays);
+    auto isect_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(Intersection), nullptr);
+    auto occl_buffer = apigpu_->CreateBuffer(kNumRays * sizeof(int), nullptr);
+
+    // Both queries are queued without waiting, the second one depends on the first
+    Event* isect_event = nullptr;
+    Event* occl_event = nullptr;
+    EXPECT_NO_THROW(apigpu_->QueryIntersection(ray_buffer, kNumRays, isect_buffer, nullptr, &isect_event));
+    EXPECT_NO_THROW(apigpu_->QueryOcclusion(ray_buffer, count_buffer, kNumRays, occl_buffer, isect_event, &occl_event));
+
+    EXPECT_NO_THROW(apigpu_->DeleteEvent(isect_event));
+    EXPECT_NO_THROW(occl_event->Wait());
+    EXPECT_TRUE(occl_event->Complete());
+
+    Intersection* isect = nullptr;
+    int* occl = nullptr;
+    EXPECT_NO_THROW(apigpu_->MapBuffer(isect_buffer, kMapRead, 0, kNumRays * sizeof(Intersection), (void**)&isect, nullptr));
+    EXPECT_NO_THROW(apigpu_->MapBuffer(occl_buffer, kMapRead, 0, kNumRays * sizeof(int), (void**)&occl, nullptr));
+
+    for (int i = 0; i < kNumRays; ++i)
+    {
+        ExpectClosestIntersectionOk(isect_brute[i], isect[i]);
+        EXPECT_EQ(occl[i] != kNullId, isect_brute[i].shapeid != kNullId);
+    }
+
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(isect_buffer, isect, nullptr));
+    EXPECT_NO_THROW(apigpu_->UnmapBuffer(occl_buffer, occl, nullptr));
+
+    EXPECT_NO_THROW(apigpu_->DeleteEvent(occl_event));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(ray_buffer));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(count_buffer));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(isect_buffer));
+    EXPECT_NO_THROW(apigpu_->DeleteBuffer(occl_buffer));
+}
+
 inline void ApiConformanceEmbree::ExpectClosestIntersectionOk(const Intersection& expected, const Intersection& test) const
 {
     ASSERT_EQ(test.shapeid, expected.shapeid);
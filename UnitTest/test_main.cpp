@@ -42,6 +42,13 @@ THE SOFTWARE.
 
 #endif
 
+#include "bvh_test.h"
+#include "calc_test_host.h"
+#include "cpu_event_test.h"
+#include "radeon_rays_apitest_cpu.h"
+#include "radeon_rays_conformance_test_cpu.h"
+#include "world_test.h"
+
 #include "gtest/gtest.h"
 
 
@@ -0,0 +1,115 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+/// This test suite is testing World shape bookkeeping
+///
+
+#include "gtest/gtest.h"
+#include "world/world.h"
+#include "primitive/shapeimpl.h"
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <vector>
+
+using namespace RadeonRays;
+
+// Shape with the state handling only
+class WorldTestShape : public ShapeImpl
+{
+};
+
+class WorldTest : public ::testing::Test
+{
+public:
+    // Dirty list has every attached shape with state changes exactly once
+    void CheckDirtyList() const
+    {
+        std::set<Shape const*> dirty(world_.shapes_dirty_.begin(), world_.shapes_dirty_.end());
+        ASSERT_EQ(dirty.size(), world_.shapes_dirty_.size());
+
+        for (auto shape : world_.shapes_)
+        {
+            bool changed = static_cast<ShapeImpl const*>(shape)->GetStateChange() != ShapeImpl::kStateChangeNone;
+            ASSERT_EQ(dirty.count(shape), changed ? 1U : 0U);
+        }
+
+        for (auto shape : world_.shapes_dirty_)
+        {
+            ASSERT_TRUE(world_.IsAttached(shape));
+        }
+    }
+
+    World world_;
+};
+
+TEST_F(WorldTest, DetachShape_DirtyList)
+{
+    int const kNumShapes = 1000;
+
+    // New shapes are dirty, they get their ids
+    std::vector<std::unique_ptr<WorldTestShape>> shapes(kNumShapes);
+    for (int i = 0; i < kNumShapes; ++i)
+    {
+        shapes[i].reset(new WorldTestShape());
+        shapes[i]->SetId(i + 1);
+        world_.AttachShape(shapes[i].get());
+    }
+    ASSERT_EQ(world_.shapes_dirty_.size(), (std::size_t)kNumShapes);
+
+    // Detach dirty shapes from everywhere in the list, the rest keeps its slots
+    for (int i = kNumShapes - 1; i >= 0; i -= 3)
+    {
+        world_.DetachShape(shapes[i].get());
+    }
+    for (int i = 0; i < kNumShapes; i += 7)
+    {
+        world_.DetachShape(shapes[i].get());
+    }
+    CheckDirtyList();
+
+    // After a commit only changed shapes are in the list
+    world_.OnCommit();
+    ASSERT_TRUE(world_.shapes_dirty_.empty());
+
+    for (int i = 0; i < kNumShapes; i += 2)
+    {
+        shapes[i]->SetMask(i);
+    }
+    for (int i = 0; i < kNumShapes; i += 5)
+    {
+        world_.DetachShape(shapes[i].get());
+    }
+    CheckDirtyList();
+
+    // Reattached shapes come back with their changes
+    for (int i = 0; i < kNumShapes; i += 5)
+    {
+        world_.AttachShape(shapes[i].get());
+    }
+    CheckDirtyList();
+
+    world_.DetachAll();
+    ASSERT_TRUE(world_.shapes_dirty_.empty());
+}